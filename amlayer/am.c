@@ -5,8 +5,8 @@
 
 /* splits a leaf node */
 
-AM_SplitLeaf(fileDesc,pageBuf,pageNum,attrLength,recId,value,status,index,key)
-int fileDesc; /* file descriptor */
+AM_SplitLeaf(handle,pageBuf,pageNum,attrLength,recId,value,status,index,key)
+AM_INDEXHANDLE *handle; /* the insert */
 char *pageBuf; /* pointer to buffer */
 int *pageNum; /* pagenumber of new leaf created */
 int attrLength; 
@@ -20,16 +20,23 @@ char *key; /* returns the key to be filled in the parent */
 
 	AM_LEAFHEADER head,temphead; /* local header */
 	AM_LEAFHEADER *header,*tempheader;
-	char tempPage[PF_PAGE_SIZE]; /* temporary page for manipulation on the 
+	char tempPage[AM_MAXPAGESIZE]; /* temporary page for manipulation on the 
 								         page */
 	char *tempPageBuf,*tempPageBuf1;/* buffers for new pages to be
 								    allocated */
 	int errVal; 
 	int tempPageNum,tempPageNum1;/* pagenumbers for pages to be allocated */
+	int fileDesc; /* file descriptor */
+
+	/* compressed leaves are split their own way */
+	if (*pageBuf == 'L')
+		return(AM_CSplitLeaf(handle,pageBuf,pageNum,attrLength,recId,
+				     value,status,index,key));
 
 	/* initialise pointers to headers */
 	header = &head;
 	tempheader = &temphead;
+	fileDesc = handle->fileDesc;
 
 	/* copy header from buffer */
 	bcopy(pageBuf,header,AM_sl);
@@ -64,7 +71,7 @@ char *key; /* returns the key to be filled in the parent */
 	bcopy(tempPage,tempheader,AM_sl);
 	tempheader->nextLeafPage = tempPageNum;
 	bcopy(tempheader,tempPage,AM_sl);
-	bcopy(tempPage,pageBuf,PF_PAGE_SIZE);
+	bcopy(tempPage,pageBuf,AM_PageSize);
 
 	/* copy the value of key to be written onto the parent */
 
@@ -72,7 +79,7 @@ char *key; /* returns the key to be filled in the parent */
 
 
 	/*check if the split page is root */
-	if ((*pageNum) == AM_RootPageNum)
+	if ((*pageNum) == handle->rootPageNum)
 	{
 		/* the page being split is the root*/
 		/* Allocate a new page for another leaf as a new root has 
@@ -80,11 +87,11 @@ char *key; /* returns the key to be filled in the parent */
 		errVal = PF_AllocPage(fileDesc,&tempPageNum1,&tempPageBuf1);
 		AM_Check;
 
-		AM_LeftPageNum = tempPageNum1; /* this will remain the 
-							   leftmost page hence*/
+		/* tempPageNum1 is now the leftmost leaf */
+		AM_CacheDrop(fileDesc,*pageNum);
 
 		/* copy the old first half(actually the root) into a new page */ 
-		bcopy(pageBuf,tempPageBuf1,PF_PAGE_SIZE);
+		bcopy(pageBuf,tempPageBuf1,AM_PageSize);
 		/* Initialise the new root page */ 
 
 		AM_FillRootPage(pageBuf,tempPageNum1,tempPageNum,key,
@@ -99,7 +106,7 @@ char *key; /* returns the key to be filled in the parent */
 	errVal = PF_UnfixPage(fileDesc,tempPageNum,TRUE);
 	AM_Check;
 
-	if ((*pageNum) == AM_RootPageNum)
+	if ((*pageNum) == handle->rootPageNum)
 		return(FALSE);
 	else
 	{
@@ -109,15 +116,15 @@ char *key; /* returns the key to be filled in the parent */
 }
 
 /* Adds to the parent(on top of the path stack) attribute value and page Number*/
-AM_AddtoParent(fileDesc,pageNum,value,attrLength)
-int fileDesc;
+AM_AddtoParent(handle,pageNum,value,attrLength)
+AM_INDEXHANDLE *handle; /* the insert, whose path leads to the parent */
 int pageNum; /* page Number to be added to parent */
 char *value; /*  pointer to attribute value to be added - 
                  gives back the attribute value to be added to it's parent*/
 int attrLength;
 
 {
-	char tempPage[PF_PAGE_SIZE];/* temporary page for manipulating page */
+	char tempPage[AM_MAXPAGESIZE];/* temporary page for manipulating page */
 	int pageNumber; /* pageNumber of parent to which key is to be added- 
 			                                        got from stack*/
 	int offset; /* Place in parent where key is to be added - 
@@ -127,14 +134,21 @@ int attrLength;
 
 	char *pageBuf,*pageBuf1,*pageBuf2;
 	AM_INTHEADER head,*header;
+	int compressed; /* whether the parent is a compressed node */
+	int added; /* whether the key fitted in the parent */
+	int fileDesc; /* file descriptor */
 
 
 	/* initialise header */
 	header = &head;
+	fileDesc = handle->fileDesc;
 	/* Get the top of stack values for the page number of the parent 
 						 and offset of the key */
-	AM_topofStack(&pageNumber,&offset);
-	AM_PopStack();
+	AM_topofStack(handle,&pageNumber,&offset);
+	AM_PopStack(handle);
+
+	/* the copy of the parent in the descent cache is to be changed */
+	AM_CacheDrop(fileDesc,pageNumber);
 
 	/* Get the parent node */
 	errVal = PF_GetThisPage(fileDesc,pageNumber,&pageBuf);
@@ -142,16 +156,26 @@ int attrLength;
 
 	/* copy the header from buffer */
 	bcopy(pageBuf,header,AM_sint);
+	compressed = (*pageBuf == 'I');
 
 	/* check if there is room in this node for another key */
-	if ((header->numKeys) < (header->maxKeys))
+	if (compressed)
+		/* room on a compressed node depends on the keys */
+		added = AM_CAddtoIntPage(pageBuf,value,pageNum,offset);
+	else if ((header->numKeys) < (header->maxKeys))
 	{
 		/* add the attribute value to the node */ 
 		AM_AddtoIntPage(pageBuf,value,pageNum,header,offset);
 
 		/* copy the updated header into buffer*/
 		bcopy(header,pageBuf,AM_sint) ;
+		added = TRUE;
+	}
+	else
+		added = FALSE;
 
+	if (added)
+	{
 		errVal = PF_UnfixPage(fileDesc,pageNumber,TRUE);
 		AM_Check;
 		return(AME_OK);
@@ -163,23 +187,36 @@ int attrLength;
 		AM_Check;
 
 		/* split the internal node */
-		AM_SplitIntNode(pageBuf,tempPage,pageBuf1,header,
+		PF_StatsCount(PF_CNT_AMSPLIT,1L);
+		if (compressed)
+		{
+			errVal = AM_CSplitIntNode(pageBuf,tempPage,pageBuf1,
+						  value,pageNum,offset);
+			if (errVal != AME_OK)
+				return(errVal);
+		}
+		else
+			AM_SplitIntNode(pageBuf,tempPage,pageBuf1,header,
 					 value,pageNum,offset);
 
 		/* check if page being split is root */
-		if (pageNumber == AM_RootPageNum)
+		if (pageNumber == handle->rootPageNum)
 		{
 			/* allocate a new page for a new root */
 			errVal = PF_AllocPage(fileDesc,&pageNum2,&pageBuf2);
 			AM_Check;
 
 			/* copy the first half into another buffer */
-			bcopy(tempPage,pageBuf2,PF_PAGE_SIZE);
+			bcopy(tempPage,pageBuf2,AM_PageSize);
 
 			/* fill the header of new root page and the 
 			attribute value */
-			AM_FillRootPage(pageBuf,pageNum2,pageNum1,value,
-			header->attrLength, header->maxKeys);
+			if (compressed)
+				AM_CFillRootPage(pageBuf,pageNum2,pageNum1,value,
+				header->attrLength, header->maxKeys);
+			else
+				AM_FillRootPage(pageBuf,pageNum2,pageNum1,value,
+				header->attrLength, header->maxKeys);
 
 			errVal = PF_UnfixPage(fileDesc,pageNumber,TRUE);
 			AM_Check;
@@ -194,7 +231,7 @@ int attrLength;
 		}
 		else
 		{
-			bcopy(tempPage,pageBuf,PF_PAGE_SIZE);
+			bcopy(tempPage,pageBuf,AM_PageSize);
 
 			errVal = PF_UnfixPage(fileDesc,pageNumber,TRUE);
 			AM_Check;
@@ -204,7 +241,7 @@ int attrLength;
 
 			/* recursive call to add to the parent of this 
 			internal node*/
-			errVal =  AM_AddtoParent(fileDesc,pageNum1,value,
+			errVal =  AM_AddtoParent(handle,pageNum1,value,
 						 attrLength);
 			AM_Check;
 		}
@@ -283,7 +320,7 @@ int pageNum,offset;
 {
 	AM_INTHEADER temphead,*tempheader;
 	int recSize;
-	char tempPage[PF_PAGE_SIZE + AM_MAXATTRLENGTH];/* temp page for 
+	char tempPage[AM_MAXPAGESIZE + AM_MAXATTRLENGTH];/* temp page for 
 	                                               manipulating pageBuf */
 	int length1,length2;
 
@@ -9,6 +9,7 @@ typedef struct am_leafheader
 		short attrLength;
 		short numKeys;
 		short maxKeys;
+		short prefixLength; /* compressed leaves: length of the page prefix */
 	}  AM_LEAFHEADER; /* Header for a leaf page */
 
 typedef struct am_intheader 
@@ -19,17 +20,35 @@ typedef struct am_intheader
 		short attrLength;
 	}	AM_INTHEADER ; /* Header for an internal node */
 
-extern int AM_RootPageNum; /* The page number of the root */
-extern int AM_LeftPageNum; /* The page Number of the leftmost leaf */
-extern int AM_Errno; /* last error in AM layer */
+typedef struct am_cintheader 
+	{
+		char pageType;
+		short numKeys;
+		short maxKeys;
+		short attrLength;
+		short heapPtr; /* lowest offset of the key cells */
+		short prefixLength; /* length of the page prefix */
+	}	AM_CINTHEADER ; /* Header for a compressed internal node; the
+			fields it shares with AM_INTHEADER come first */
+
+extern __thread int AM_Errno; /* last error in AM layer, one per thread */
+extern __thread int AM_PageSize; /* node size of the index in use, one per
+				    thread; set by AM_UseIndex() */
 extern char *calloc();
 extern char *malloc();
+extern char *realloc();
+extern void AM_PrintError(); /* writes a message and the last AM error */
 
 # define AM_Check if (errVal != PFE_OK) {AM_Errno = AME_PF; return(AME_PF) ;}
+/* node size of an index whose file has pages of pageSize bytes: files of
+the default size keep the nodes of PF_PAGE_SIZE bytes they always had */
+# define AM_NodeSize(pageSize) (((pageSize) == PF_FILE_PAGE_SIZE) ? \
+				PF_PAGE_SIZE : (pageSize))
 # define AM_si sizeof(int)
 # define AM_ss sizeof(short)
 # define AM_sl sizeof(AM_LEAFHEADER)
 # define AM_sint sizeof(AM_INTHEADER)
+# define AM_scint sizeof(AM_CINTHEADER)
 # define AM_sc sizeof(char)
 # define AM_sf sizeof(float)
 # define AM_NOT_FOUND 0 /* Key is not in tree */
@@ -50,8 +69,54 @@ extern char *malloc();
 # define LESS_THAN_EQUAL 4
 # define GREATER_THAN_EQUAL 5
 # define NOT_EQUAL 6
-# define MAXSCANS 20
+# define AM_SCANTABSIZE 20 /* scans the scan table first has room for; it
+			   doubles whenever it is full */
+# define AM_MAXSTACK 50 /* levels of a descent path */
+# define AM_BATCHWALK 1 /* leaves a batch lookup goes along the leaf chain
+			  before it searches from the root again */
+# define AM_MAXCACHED 20 /* file descriptors the descent cache is kept for */
+# define AM_CACHELEVELS 2 /* levels of internal nodes kept, from the root */
+# define AM_CACHEPAGES 32 /* internal nodes kept for one index */
 # define AM_MAXATTRLENGTH 256
+# define AM_MAXPAGESIZE 16384 /* largest node: offsets on a node are shorts */
+# define AM_FETCHBATCH 256 /* RIDs AM_FetchRecords fetches at a time */
+
+/* char keys of at least AM_CMINLENGTH bytes are kept on compressed pages,
+'L' leaves and 'I' internal nodes, where their slots hold AM_CKEY bytes:
+the first AM_CPREFIX bytes of the key and the offset of the rest */
+# define AM_CMINLENGTH 8
+# define AM_CPREFIX 4
+# define AM_CKEY (AM_CPREFIX + AM_ss)
+# define AM_Compressed(attrType,attrLength) (((attrType) == 'c') && \
+			((attrLength) >= AM_CMINLENGTH))
+# define AM_IsLeaf(pageBuf) ((*(pageBuf) == 'l') || (*(pageBuf) == 'L'))
+/* bytes of a leaf slot before the head of its recId list */
+# define AM_KeySize(pageType,attrLength) (((pageType) == 'L') ? AM_CKEY : \
+			(attrLength))
+
+/* first key and page number of each node of a level being bulk loaded */
+typedef struct am_bulkentry
+	{
+		int pageNum;
+		char key[AM_MAXATTRLENGTH];
+	} AM_BULKENTRY;
+
+/* State of one operation on an index: the path from the root down to the
+leaf it works on, for the splits of an insert to go back up. Each call
+into the AM layer has its own, so calls on different indexes, and lookups
+and scans of the same index, may run at the same time in different
+threads. Calls that change an index must have it to themselves. */
+typedef struct am_indexhandle
+	{
+		int fileDesc; /* file descriptor of the index */
+		int rootPageNum; /* page number of the root, once searched */
+		int topofStack; /* last entry of path in use, or -1 */
+		struct
+		    {
+		     int pageNumber; /* internal node on the path */
+		     int offset; /* place in it of the key followed */
+		    } path[AM_MAXSTACK];
+	} AM_INDEXHANDLE;
 
 
 # define AME_OK 0
@@ -66,3 +131,11 @@ extern char *malloc();
 # define AME_INVALIDATTRTYPE -9
 # define AME_FD -10
 # define AME_INVALIDVALUE -11
+# define AME_NOTEMPTY -12
+# define AME_UNSORTED -13
+# define AME_KEYLISTFULL -14
+# define AME_INVALIDFILLFACTOR -15
+# define AME_SORT -16
+# define AME_RHF -17
+# define AME_PAGESIZE -18
+# define AME_NOTHASH -19
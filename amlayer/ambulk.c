@@ -0,0 +1,873 @@
+# include <stdio.h>
+# include "am.h"
+# include "pf.h"
+
+/* The bulk loader builds a whole tree from a stream of (key,recId) pairs
+in key order. Leaves are packed left to right on consecutive pages, then
+each internal level is built from the first keys and page numbers of the
+level below until a single node, the root, is left. */
+
+/* leaf being filled */
+typedef struct am_bulkleaf
+	{
+		int pageNum; /* page number of the leaf */
+		char *pageBuf; /* buffer the leaf is fixed in */
+		AM_LEAFHEADER header; /* its header, copied back on unfix */
+		int listLength; /* number of recIds of the last key */
+	} AM_BULKLEAF;
+
+
+/* Adds an entry to the array of first keys, growing it as needed */
+static AM_BulkAddEntry(entries,numEntries,maxEntries,key,pageNum,attrLength)
+AM_BULKENTRY **entries;
+int *numEntries;
+int *maxEntries;
+char *key; /* first key of the node */
+int pageNum; /* page number of the node */
+int attrLength;
+
+{
+	AM_BULKENTRY *temp;
+
+	if (*numEntries == *maxEntries)
+	{
+		temp = (AM_BULKENTRY *)realloc((char *)*entries,
+			2 * (*maxEntries) * sizeof(AM_BULKENTRY));
+		if (temp == NULL)
+		{
+			PFerrno = PFE_NOMEM;
+			AM_Errno = AME_PF;
+			return(AME_PF);
+		}
+		*entries = temp;
+		*maxEntries = 2 * (*maxEntries);
+	}
+	(*entries)[*numEntries].pageNum = pageNum;
+	bcopy(key,(*entries)[*numEntries].key,attrLength);
+	(*numEntries)++;
+	return(AME_OK);
+}
+
+
+/* Allocates a new empty leaf; its header is taken from the model */
+static AM_BulkNewLeaf(fileDesc,leaf,model)
+int fileDesc;
+AM_BULKLEAF *leaf;
+AM_LEAFHEADER *model; /* header of the empty root leaf */
+
+{
+	int errVal;
+
+	errVal = PF_AllocPage(fileDesc,&leaf->pageNum,&leaf->pageBuf);
+	AM_Check;
+	bcopy(model,&leaf->header,AM_sl);
+	leaf->header.nextLeafPage = AM_NULL_PAGE;
+	leaf->header.recIdPtr = AM_PageSize;
+	leaf->header.keyPtr = AM_sl;
+	leaf->header.freeListPtr = AM_NULL;
+	leaf->header.numinfreeList = 0;
+	leaf->header.numKeys = 0;
+	leaf->header.prefixLength = 0;
+	leaf->listLength = 0;
+	/* compressed leaves are changed on the page itself */
+	bcopy(&leaf->header,leaf->pageBuf,AM_sl);
+	return(AME_OK);
+}
+
+
+/* Adds a recId to the leaf, as the last of the list of the last key if
+newKey is FALSE, or under a new last key. The caller has checked that there
+is room. */
+static AM_BulkAppend(leaf,value,recId,newKey)
+AM_BULKLEAF *leaf;
+char *value;
+int recId;
+int newKey; /* TRUE if value is not the last key of the leaf */
+
+{
+	AM_LEAFHEADER *header;
+	int recSize;
+	short recPtr; /* offset of the new recId */
+	short null = AM_NULL;
+	char *listPtr; /* where the offset of the new recId goes */
+
+	header = &leaf->header;
+	recSize = header->attrLength + AM_ss;
+	header->recIdPtr = header->recIdPtr - AM_si - AM_ss;
+	recPtr = header->recIdPtr;
+
+	if (newKey)
+	{
+		bcopy(value,leaf->pageBuf + header->keyPtr,header->attrLength);
+		listPtr = leaf->pageBuf + header->keyPtr + header->attrLength;
+		header->keyPtr = header->keyPtr + recSize;
+		header->numKeys++;
+		leaf->listLength = 0;
+	}
+	else
+		/* recIds of the last key sit just above the new one, the
+		last appended at the lowest offset */
+		listPtr = leaf->pageBuf + recPtr + AM_si + AM_ss + AM_si;
+
+	bcopy((char *)&recPtr,listPtr,AM_ss);
+	bcopy((char *)&recId,leaf->pageBuf + recPtr,AM_si);
+	bcopy((char *)&null,leaf->pageBuf + recPtr + AM_si,AM_ss);
+	leaf->listLength++;
+}
+
+
+/* Moves the last key of a full leaf and its recIds onto an empty one, so
+that all the recIds of a key stay on one leaf */
+static AM_BulkMoveLastKey(from,to)
+AM_BULKLEAF *from;
+AM_BULKLEAF *to;
+
+{
+	AM_LEAFHEADER *header;
+	int recSize;
+	int count; /* number of recIds of the key */
+	int recId;
+	char *key;
+	int i;
+
+	header = &from->header;
+	recSize = header->attrLength + AM_ss;
+	count = from->listLength;
+	key = from->pageBuf + header->keyPtr - recSize;
+
+	/* the first recId of the list has the highest offset */
+	for (i = count - 1; i >= 0; i--)
+	{
+		bcopy(from->pageBuf + header->recIdPtr + i*(AM_si + AM_ss),
+		      (char *)&recId,AM_si);
+		AM_BulkAppend(to,key,recId,i == count - 1);
+	}
+
+	header->recIdPtr = header->recIdPtr + count*(AM_si + AM_ss);
+	header->keyPtr = header->keyPtr - recSize;
+	header->numKeys--;
+}
+
+
+/* Builds one internal level over the numEntries nodes in entries, and
+replaces them by the entries of the new level. The nodes get the same
+number of children, give or take one, and at most fillFactor percent of
+maxKeys keys; a single node is the root and goes on the first page. */
+static AM_BulkBuildLevel(fileDesc,entries,numEntries,attrLength,maxKeys,
+			 fillFactor)
+int fileDesc;
+AM_BULKENTRY *entries;
+int *numEntries;
+int attrLength;
+int maxKeys; /* maximum keys in an internal node */
+int fillFactor; /* percentage of maxKeys to fill */
+
+{
+	AM_INTHEADER head,*header;
+	int maxChildren; /* children of a node at the fill factor */
+	int numNodes; /* nodes on this level */
+	int numChildren; /* children of the node being built */
+	int recSize;
+	int pageNum;
+	char *pageBuf;
+	int first; /* first child of the node being built */
+	int node,i;
+	int errVal;
+
+	header = &head;
+	recSize = attrLength + AM_si;
+	maxChildren = (maxKeys * fillFactor) / 100 + 1;
+	if (maxChildren < 2)
+		maxChildren = 2;
+
+	/* every node needs at least one key, that is two children */
+	numNodes = (*numEntries + maxChildren - 1) / maxChildren;
+	if (*numEntries < 2 * numNodes)
+		numNodes = *numEntries / 2;
+
+	first = 0;
+	for (node = 0; node < numNodes; node++)
+	{
+		numChildren = *numEntries / numNodes;
+		if (node < *numEntries % numNodes)
+			numChildren++;
+
+		if (numNodes == 1)
+		{
+			errVal = PF_GetFirstPage(fileDesc,&pageNum,&pageBuf);
+			AM_Check;
+		}
+		else
+		{
+			errVal = PF_AllocPage(fileDesc,&pageNum,&pageBuf);
+			AM_Check;
+		}
+
+		header->pageType = 'i';
+		header->numKeys = numChildren - 1;
+		header->maxKeys = maxKeys;
+		header->attrLength = attrLength;
+		bcopy(header,pageBuf,AM_sint);
+		bcopy((char *)&entries[first].pageNum,pageBuf + AM_sint,AM_si);
+		for (i = 1; i < numChildren; i++)
+		{
+			bcopy(entries[first + i].key,pageBuf + AM_sint + AM_si +
+			      (i - 1)*recSize,attrLength);
+			bcopy((char *)&entries[first + i].pageNum,pageBuf +
+			      AM_sint + i*recSize,AM_si);
+		}
+
+		errVal = PF_UnfixPage(fileDesc,pageNum,TRUE);
+		AM_Check;
+
+		/* the node stands for its first key on the next level */
+		if (node != first)
+			bcopy(entries[first].key,entries[node].key,attrLength);
+		entries[node].pageNum = pageNum;
+		first = first + numChildren;
+	}
+	*numEntries = numNodes;
+	return(AME_OK);
+}
+
+
+/* Builds one compressed internal level over the numEntries nodes in
+entries, as AM_BulkBuildLevel does. Keys take up different room, so each
+node takes children until fillFactor percent of the page is used, and
+never leaves a single one for the last node. */
+static AM_BulkBuildCLevel(fileDesc,entries,numEntries,attrLength,maxKeys,
+			  fillFactor)
+int fileDesc;
+AM_BULKENTRY *entries;
+int *numEntries;
+int attrLength;
+int maxKeys;
+int fillFactor;
+
+{
+	int target; /* bytes of a node to fill */
+	int numNodes; /* nodes built so far */
+	int numChildren; /* children of the node being built */
+	int pageNum;
+	char *pageBuf;
+	int first; /* first child of the node being built */
+	int errVal;
+
+	target = (AM_PageSize * fillFactor) / 100;
+	numNodes = 0;
+	for (first = 0; first < *numEntries; first = first + numChildren)
+	{
+		/* every node needs at least one key, that is two children */
+		numChildren = 2;
+		while ((first + numChildren < *numEntries) &&
+		       (AM_CBulkIntSize(entries + first,numChildren + 1,
+					attrLength) <= target))
+			numChildren++;
+		if (first + numChildren == *numEntries - 1)
+		{
+			if (AM_CBulkIntSize(entries + first,numChildren + 1,
+					    attrLength) <= AM_PageSize)
+				numChildren++;
+			else
+				numChildren--;
+		}
+
+		if ((first == 0) && (numChildren == *numEntries))
+		{
+			errVal = PF_GetFirstPage(fileDesc,&pageNum,&pageBuf);
+			AM_Check;
+		}
+		else
+		{
+			errVal = PF_AllocPage(fileDesc,&pageNum,&pageBuf);
+			AM_Check;
+		}
+		AM_CBulkIntNode(pageBuf,entries + first,numChildren,attrLength,
+				maxKeys);
+		errVal = PF_UnfixPage(fileDesc,pageNum,TRUE);
+		AM_Check;
+
+		/* the node stands for its first key on the next level */
+		if (numNodes != first)
+			bcopy(entries[first].key,entries[numNodes].key,attrLength);
+		entries[numNodes].pageNum = pageNum;
+		numNodes++;
+	}
+	*numEntries = numNodes;
+	return(AME_OK);
+}
+
+
+/* Copies the only leaf onto the first page, the root, and disposes of
+its own page */
+static AM_BulkMoveToRoot(fileDesc,pageNum)
+int fileDesc;
+int pageNum; /* page number of the leaf */
+
+{
+	char *pageBuf,*rootBuf;
+	int rootNum;
+	int errVal;
+
+	errVal = PF_GetFirstPage(fileDesc,&rootNum,&rootBuf);
+	AM_Check;
+	errVal = PF_GetThisPage(fileDesc,pageNum,&pageBuf);
+	AM_Check;
+	bcopy(pageBuf,rootBuf,AM_PageSize);
+	errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+	AM_Check;
+	errVal = PF_UnfixPage(fileDesc,rootNum,TRUE);
+	AM_Check;
+	errVal = PF_DisposePage(fileDesc,pageNum);
+	AM_Check;
+	return(AME_OK);
+}
+
+
+/* Builds the tree in fileDesc from the pairs returned by nextEntry, as
+AM_BulkLoad. The root goes on the first page once the leaves are built;
+model is the header of an empty leaf of the index. */
+static AM_BulkBuild(fileDesc,attrType,attrLength,model,nextEntry,arg,
+		    fillFactor)
+int fileDesc;
+char attrType;
+int attrLength;
+AM_LEAFHEADER *model;
+int (*nextEntry)();
+char *arg;
+int fillFactor;
+
+{
+	AM_BULKLEAF leaf,next; /* leaf being filled, and the one after */
+	AM_BULKENTRY *entries; /* first key and page of every leaf */
+	int numEntries,maxEntries;
+	char value[AM_MAXATTRLENGTH]; /* key returned by nextEntry */
+	char lastValue[AM_MAXATTRLENGTH]; /* key before it */
+	int recId;
+	char sep[AM_MAXATTRLENGTH]; /* separator before a compressed leaf */
+	int recSize;
+	int compressed; /* whether the leaves are compressed */
+	int newKey; /* whether value differs from lastValue */
+	int needed; /* room needed on the leaf for the pair */
+	int full; /* whether the pair did not go on the leaf */
+	int status;
+	int errVal;
+
+	maxEntries = 64;
+	numEntries = 0;
+	entries = (AM_BULKENTRY *)malloc(maxEntries * sizeof(AM_BULKENTRY));
+	if (entries == NULL)
+		{
+		 PFerrno = PFE_NOMEM;
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+                }
+
+	/* fill the leaves */
+	recSize = attrLength + AM_ss;
+	compressed = (model->pageType == 'L');
+	leaf.pageBuf = NULL;
+	while ((status = (*nextEntry)(arg,value,&recId)) == AME_OK)
+	{
+		if (leaf.pageBuf == NULL)
+			newKey = TRUE;
+		else
+		{
+			status = AM_Compare(lastValue,attrType,attrLength,value);
+			if (status < 0)
+			{
+				status = AME_UNSORTED;
+				break;
+			}
+			newKey = (status != 0);
+		}
+
+		needed = AM_si + AM_ss;
+		if (newKey)
+			needed = needed + recSize;
+
+		if (leaf.pageBuf == NULL)
+			full = TRUE;
+		else if (compressed)
+			full = !AM_CAppend(leaf.pageBuf,value,recId,newKey);
+		else
+			full = (leaf.header.recIdPtr - leaf.header.keyPtr < needed);
+
+		if (full)
+		{
+			/* start the next leaf */
+			if ((leaf.pageBuf != NULL) && !newKey &&
+			    (leaf.header.numKeys == 1))
+			{
+				/* the recIds of this key fill a whole page */
+				status = AME_KEYLISTFULL;
+				break;
+			}
+			status = AM_BulkNewLeaf(fileDesc,&next,model);
+			if (status != AME_OK)
+				break;
+			if ((leaf.pageBuf != NULL) && compressed)
+			{
+				if (!newKey)
+					AM_CMoveLastKey(leaf.pageBuf,next.pageBuf);
+				AM_CLeafSeparator(leaf.pageBuf,
+					newKey ? value : lastValue,sep);
+				bcopy(leaf.pageBuf,(char *)&leaf.header,AM_sl);
+			}
+			else if (leaf.pageBuf != NULL)
+			{
+				if (!newKey)
+					AM_BulkMoveLastKey(&leaf,&next);
+			}
+			if (leaf.pageBuf != NULL)
+			{
+				leaf.header.nextLeafPage = next.pageNum;
+				bcopy((char *)&leaf.header,leaf.pageBuf,AM_sl);
+				errVal = PF_UnfixPage(fileDesc,leaf.pageNum,TRUE);
+				leaf.pageBuf = NULL;
+				if (errVal != PFE_OK)
+				{
+					status = AME_PF;
+					break;
+				}
+			}
+			bcopy((char *)&next,(char *)&leaf,sizeof(AM_BULKLEAF));
+			status = AM_BulkAddEntry(&entries,&numEntries,&maxEntries,
+			      (compressed && (numEntries > 0)) ? sep :
+			      (newKey ? value : lastValue),leaf.pageNum,attrLength);
+			if (status != AME_OK)
+				break;
+		}
+
+		if (compressed)
+		{
+			if (full && !AM_CAppend(leaf.pageBuf,value,recId,newKey))
+			{
+				/* the recIds of this key fill a whole page */
+				status = AME_KEYLISTFULL;
+				break;
+			}
+			bcopy(leaf.pageBuf,(char *)&leaf.header,AM_sl);
+		}
+		else
+			AM_BulkAppend(&leaf,value,recId,newKey);
+		bcopy(value,lastValue,attrLength);
+	}
+
+	if (leaf.pageBuf != NULL)
+	{
+		bcopy((char *)&leaf.header,leaf.pageBuf,AM_sl);
+		errVal = PF_UnfixPage(fileDesc,leaf.pageNum,TRUE);
+		if ((errVal != PFE_OK) && (status == AME_EOF))
+			status = AME_PF;
+	}
+	if (status != AME_EOF)
+	{
+		free((char *)entries);
+		AM_Errno = status;
+		return(status);
+	}
+
+	status = AME_OK;
+	if (numEntries == 1)
+		/* a single leaf is the root, and goes on the first page */
+		status = AM_BulkMoveToRoot(fileDesc,entries[0].pageNum);
+
+	/* build the internal levels up to the root */
+	while ((numEntries > 1) && (status == AME_OK))
+		if (compressed)
+			status = AM_BulkBuildCLevel(fileDesc,entries,&numEntries,
+					attrLength,model->maxKeys,fillFactor);
+		else
+			status = AM_BulkBuildLevel(fileDesc,entries,&numEntries,
+					attrLength,model->maxKeys,fillFactor);
+	free((char *)entries);
+	AM_CacheClear(fileDesc);
+	if (status != AME_OK)
+	{
+		AM_Errno = status;
+		return(status);
+	}
+	return(AME_OK);
+}
+
+
+/* Builds the index in fileDesc, which must be as left by AM_CreateIndex,
+from the pairs returned by nextEntry. The pairs must come in ascending key
+order; the recIds of a key are kept in the order they come in. */
+AM_BulkLoad(fileDesc,attrType,attrLength,nextEntry,arg,fillFactor)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'c' , 'i' or 'f' */
+int attrLength; /* 4 for 'i' or 'f' , 1-255 for 'c' */
+int (*nextEntry)(); /* nextEntry(arg,value,&recId) copies the next pair
+		    into value and recId and returns AME_OK, or returns
+		    AME_EOF at the end of the input or an AM error code */
+char *arg; /* passed to nextEntry */
+int fillFactor; /* percentage of an internal node to fill, 1 to 100;
+		   leaves are always packed */
+
+{
+	char *pageBuf; /* buffer for the root page */
+	int pageNum; /* page number of the root */
+	AM_LEAFHEADER model; /* header of the empty root */
+	int errVal;
+
+	/* check the parameters */
+	if ((attrType != 'c') && (attrType != 'f') && (attrType != 'i'))
+		{
+		 AM_Errno = AME_INVALIDATTRTYPE;
+		 return(AME_INVALIDATTRTYPE);
+                }
+
+	if (fileDesc < 0)
+		{
+		 AM_Errno = AME_FD;
+		 return(AME_FD);
+                }
+
+	/* work with the node size of this index */
+	errVal = AM_UseIndex(fileDesc);
+	AM_Check;
+
+	if ((fillFactor < 1) || (fillFactor > 100))
+		{
+		 AM_Errno = AME_INVALIDFILLFACTOR;
+		 return(AME_INVALIDFILLFACTOR);
+                }
+
+	/* the tree cannot be changed through a read-only mapping */
+	if (PF_FileMode(fileDesc) == PF_MODE_MMAP)
+		{
+		 PFerrno = PFE_READONLY;
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+                }
+
+	/* changes to compressed nodes decode them off the stack */
+	if (AM_Compressed(attrType,attrLength))
+		{
+		 errVal = AM_CReserve();
+		 AM_Check;
+		}
+
+	/* the root must be an empty leaf, and the only page */
+	errVal = PF_GetFirstPage(fileDesc,&pageNum,&pageBuf);
+	AM_Check;
+	bcopy(pageBuf,(char *)&model,AM_sl);
+	errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+	AM_Check;
+	if (!AM_IsLeaf(&model.pageType) || (model.numKeys != 0))
+		{
+		 AM_Errno = AME_NOTEMPTY;
+		 return(AME_NOTEMPTY);
+                }
+	if (model.attrLength != attrLength)
+		{
+		 AM_Errno = AME_INVALIDATTRLENGTH;
+		 return(AME_INVALIDATTRLENGTH);
+                }
+	errVal = PF_GetNextPage(fileDesc,&pageNum,&pageBuf);
+	if (errVal == PFE_OK)
+		{
+		 PF_UnfixPage(fileDesc,pageNum,FALSE);
+		 AM_Errno = AME_NOTEMPTY;
+		 return(AME_NOTEMPTY);
+                }
+	if (errVal != PFE_EOF)
+		{
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+                }
+
+	return(AM_BulkBuild(fileDesc,attrType,attrLength,&model,nextEntry,arg,
+			     fillFactor));
+}
+
+
+/* Old leaves read by AM_Reorganize. Each is copied as soon as it is
+reached; their pages are kept until the new tree is built. */
+typedef struct am_reorg
+	{
+		int fileDesc;
+		int numPairs; /* pairs returned so far */
+		int nextLeaf; /* next old leaf to read, or AM_NULL_PAGE */
+		int index; /* key of the leaf the pairs come from, from 1 */
+		short nextRec; /* next recId on the list of that key */
+		char key[AM_MAXATTRLENGTH]; /* that key */
+		char page[AM_MAXPAGESIZE]; /* copy of the leaf being read */
+	} AM_REORG;
+
+
+/* Returns the next pair of the old leaves, for AM_BulkBuild */
+static AM_ReorgEntry(arg,value,recId)
+char *arg; /* the AM_REORG */
+char *value;
+int *recId;
+
+{
+	AM_REORG *reorg = (AM_REORG *)arg;
+	AM_LEAFHEADER head,*header;
+	int keySize;
+	char *pageBuf;
+	int pageNum;
+	int errVal;
+
+	header = &head;
+	bcopy(reorg->page,header,AM_sl);
+	while (reorg->nextRec == AM_NULL)
+	{
+		if (reorg->index < header->numKeys)
+		{
+			/* the next key of the leaf */
+			reorg->index++;
+			keySize = AM_KeySize(header->pageType,header->attrLength);
+			AM_GetLeafKey(reorg->page,reorg->index,reorg->key);
+			bcopy(reorg->page + AM_sl + (reorg->index - 1)*
+			      (keySize + AM_ss) + keySize,
+			      (char *)&reorg->nextRec,AM_ss);
+			continue;
+		}
+		if (reorg->nextLeaf == AM_NULL_PAGE)
+			return(AME_EOF);
+
+		/* the next leaf */
+		pageNum = reorg->nextLeaf;
+		errVal = PF_GetThisPage(reorg->fileDesc,pageNum,&pageBuf);
+		AM_Check;
+		bcopy(pageBuf,reorg->page,AM_PageSize);
+		errVal = PF_UnfixPage(reorg->fileDesc,pageNum,FALSE);
+		AM_Check;
+		bcopy(reorg->page,header,AM_sl);
+		reorg->nextLeaf = header->nextLeafPage;
+		reorg->index = 0;
+	}
+
+	bcopy(reorg->key,value,header->attrLength);
+	bcopy(reorg->page + reorg->nextRec,(char *)recId,AM_si);
+	bcopy(reorg->page + reorg->nextRec + AM_si,(char *)&reorg->nextRec,
+	      AM_ss);
+	reorg->numPairs++;
+	return(AME_OK);
+}
+
+
+/* Gives back to PF the pages after the first that are old ones, if the
+new tree was built, or are not, if it was not; old[pageNum] tells whether
+pageNum was a page of the old tree, for the numOld pages it had */
+static AM_ReorgDispose(fileDesc,old,numOld,built)
+int fileDesc;
+char *old;
+int numOld;
+int built; /* whether the new tree was built */
+
+{
+	char *pageBuf;
+	int pageNum;
+	int isOld;
+	int errVal;
+
+	errVal = PF_GetFirstPage(fileDesc,&pageNum,&pageBuf);
+	if (errVal == PFE_OK)
+		errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+	while (errVal == PFE_OK)
+	{
+		errVal = PF_GetNextPage(fileDesc,&pageNum,&pageBuf);
+		if (errVal != PFE_OK)
+			break;
+		isOld = (pageNum < numOld) && old[pageNum];
+		errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+		if ((errVal == PFE_OK) && (isOld == built))
+			errVal = PF_DisposePage(fileDesc,pageNum);
+	}
+	if (errVal != PFE_EOF)
+		{
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+                }
+	return(AME_OK);
+}
+
+
+/* Rebuilds the index in fileDesc in place, as AM_BulkLoad would build it
+from the pairs it holds, so that its height and number of pages follow
+the keys left after deletes. The new tree is built on pages of its own,
+and its root goes on the first page last; only then are the pages of the
+old tree given back to PF, so an error leaves the old tree as it was, but
+the file holds both trees meanwhile. The recIds of a key keep their
+order. The index must not be used by any other call meanwhile. */
+AM_Reorganize(fileDesc,attrType,attrLength,fillFactor)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'c' , 'i' or 'f' */
+int attrLength; /* 4 for 'i' or 'f' , 1-255 for 'c' */
+int fillFactor; /* percentage of an internal node to fill, 1 to 100 */
+
+{
+	AM_REORG *reorg;
+	AM_LEAFHEADER model; /* header of an empty leaf of the index */
+	char *pageBuf;
+	int pageNum;
+	int rootNum; /* page number of the root, the first page */
+	int leftPage; /* leftmost old leaf */
+	char *old; /* whether each page is one of the old tree */
+	int numOld; /* pages of the file before the new tree */
+	int status;
+	int errVal;
+
+	/* check the parameters */
+	if ((attrType != 'c') && (attrType != 'f') && (attrType != 'i'))
+		{
+		 AM_Errno = AME_INVALIDATTRTYPE;
+		 return(AME_INVALIDATTRTYPE);
+                }
+
+	if (fileDesc < 0)
+		{
+		 AM_Errno = AME_FD;
+		 return(AME_FD);
+                }
+
+	/* work with the node size of this index */
+	errVal = AM_UseIndex(fileDesc);
+	AM_Check;
+
+	if ((fillFactor < 1) || (fillFactor > 100))
+		{
+		 AM_Errno = AME_INVALIDFILLFACTOR;
+		 return(AME_INVALIDFILLFACTOR);
+                }
+
+	/* the tree cannot be changed through a read-only mapping */
+	if (PF_FileMode(fileDesc) == PF_MODE_MMAP)
+		{
+		 PFerrno = PFE_READONLY;
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+                }
+
+	/* changes to compressed nodes decode them off the stack */
+	if (AM_Compressed(attrType,attrLength))
+		{
+		 errVal = AM_CReserve();
+		 AM_Check;
+		}
+
+	leftPage = GetLeftPageNum(fileDesc);
+	if (leftPage < 0)
+		return(leftPage);
+	AM_CacheClear(fileDesc);
+
+	reorg = (AM_REORG *)malloc(sizeof(AM_REORG));
+	if (reorg == NULL)
+		{
+		 PFerrno = PFE_NOMEM;
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+                }
+	reorg->fileDesc = fileDesc;
+	reorg->numPairs = 0;
+	reorg->nextRec = AM_NULL;
+	reorg->index = 0;
+
+	/* the model comes from the leftmost leaf */
+	errVal = PF_GetThisPage(fileDesc,leftPage,&pageBuf);
+	if (errVal == PFE_OK)
+	{
+		bcopy(pageBuf,(char *)&model,AM_sl);
+		errVal = PF_UnfixPage(fileDesc,leftPage,FALSE);
+	}
+	if (errVal == PFE_OK)
+		errVal = PF_GetFirstPage(fileDesc,&rootNum,&pageBuf);
+	if (errVal != PFE_OK)
+	{
+		free((char *)reorg);
+		AM_Errno = AME_PF;
+		return(AME_PF);
+	}
+	if (model.attrLength != attrLength)
+	{
+		PF_UnfixPage(fileDesc,rootNum,FALSE);
+		free((char *)reorg);
+		AM_Errno = AME_INVALIDATTRLENGTH;
+		return(AME_INVALIDATTRLENGTH);
+	}
+
+	/* a root leaf is the only leaf, and is read from a copy */
+	if (AM_IsLeaf(pageBuf))
+	{
+		bcopy(pageBuf,reorg->page,AM_PageSize);
+		reorg->nextLeaf = AM_NULL_PAGE;
+	}
+	else
+	{
+		bzero(reorg->page,AM_sl);
+		reorg->nextLeaf = leftPage;
+	}
+
+	errVal = PF_UnfixPage(fileDesc,rootNum,FALSE);
+
+	/* the pages of the old tree, kept until the new one is built */
+	numOld = PF_NumPages(fileDesc);
+	old = NULL;
+	if (errVal == PFE_OK)
+	{
+		old = calloc((unsigned)numOld,1);
+		if (old == NULL)
+			errVal = PFE_NOMEM;
+	}
+	pageNum = rootNum;
+	while (errVal == PFE_OK)
+	{
+		errVal = PF_GetNextPage(fileDesc,&pageNum,&pageBuf);
+		if (errVal != PFE_OK)
+			break;
+		old[pageNum] = TRUE;
+		errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+	}
+	if (errVal != PFE_EOF)
+	{
+		if (old != NULL)
+			free(old);
+		free((char *)reorg);
+		if (errVal == PFE_NOMEM)
+			PFerrno = PFE_NOMEM;
+		AM_Errno = AME_PF;
+		return(AME_PF);
+	}
+
+	/* the new tree, on leaves with the header of an empty one */
+	model.nextLeafPage = AM_NULL_PAGE;
+	model.recIdPtr = AM_PageSize;
+	model.keyPtr = AM_sl;
+	model.freeListPtr = AM_NULL;
+	model.numinfreeList = 0;
+	model.numKeys = 0;
+	model.prefixLength = 0;
+	status = AM_BulkBuild(fileDesc,attrType,attrLength,&model,
+			      AM_ReorgEntry,(char *)reorg,fillFactor);
+
+	/* with no pairs left, nothing was built: the root becomes empty */
+	if ((status == AME_OK) && (reorg->numPairs == 0))
+	{
+		errVal = PF_GetFirstPage(fileDesc,&rootNum,&pageBuf);
+		if (errVal == PFE_OK)
+		{
+			bcopy((char *)&model,pageBuf,AM_sl);
+			errVal = PF_UnfixPage(fileDesc,rootNum,TRUE);
+		}
+		if (errVal != PFE_OK)
+			status = AME_PF;
+	}
+	free((char *)reorg);
+
+	errVal = AM_ReorgDispose(fileDesc,old,numOld,status == AME_OK);
+	free(old);
+	AM_CacheClear(fileDesc);
+	if (status != AME_OK)
+	{
+		AM_Errno = status;
+		return(status);
+	}
+	if (errVal != AME_OK)
+		return(errVal);
+	return(AME_OK);
+}
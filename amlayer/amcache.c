@@ -0,0 +1,298 @@
+# include <stdio.h>
+# include <pthread.h>
+# include "am.h"
+# include "pf.h"
+
+/* The descent cache keeps copies of the internal nodes of the top
+AM_CACHELEVELS levels of each open index, and its leftmost leaf, so that
+a search only fixes the pages below them. Only the functions that write
+internal nodes must drop them from the cache; an index opened again, even
+on the same file descriptor, starts with an empty cache. Searches in
+several threads share the copies: AM_cachelock is held for reading while
+one is in use, and for writing while the cache is changed. */
+
+typedef struct am_cache
+	{
+		int stamp; /* PF_FileStamp of the file the cache is for */
+		int rootNum; /* page number of the root, or AM_NULL_PAGE */
+		int leftPage; /* leftmost leaf, or AM_NULL_PAGE if not known */
+		int numPages; /* copies in use; the root is the first */
+		int victim; /* next copy to give up when all are in use */
+		int pageNum[AM_CACHEPAGES]; /* page number of each copy */
+		int pageSize; /* node size of the file, the size of a copy */
+		char *pages; /* the copies, AM_CACHEPAGES of pageSize bytes */
+	} AM_CACHE;
+
+/* copy slot of cache */
+# define AM_CachePage(cache,slot) ((cache)->pages + (slot)*(cache)->pageSize)
+
+static AM_CACHE *AM_Cache[AM_MAXCACHED]; /* cache of each file descriptor */
+static pthread_rwlock_t AM_cachelock = PTHREAD_RWLOCK_INITIALIZER;
+
+
+/* Returns the cache of fileDesc, or NULL if it has none for this opening
+of the file descriptor. AM_cachelock must be held. */
+static AM_CACHE *AM_FindCache(fileDesc)
+int fileDesc;
+
+{
+	AM_CACHE *cache;
+
+	if ((fileDesc < 0) || (fileDesc >= AM_MAXCACHED))
+		return(NULL);
+	cache = AM_Cache[fileDesc];
+	if ((cache == NULL) || (cache->stamp != PF_FileStamp(fileDesc)))
+		return(NULL);
+	return(cache);
+}
+
+
+/* Empties cache */
+static AM_CacheEmpty(cache)
+AM_CACHE *cache;
+
+{
+	cache->numPages = 0;
+	cache->victim = 1;
+	cache->rootNum = AM_NULL_PAGE;
+	cache->leftPage = AM_NULL_PAGE;
+}
+
+
+/* Returns the cache of fileDesc, emptied if it was for another opening of
+the file descriptor, or NULL if there can be none. AM_cachelock must be
+held for writing. */
+static AM_CACHE *AM_GetCache(fileDesc)
+int fileDesc;
+
+{
+	AM_CACHE *cache;
+	int stamp;
+	int pageSize;
+	char *pages;
+
+	if ((fileDesc < 0) || (fileDesc >= AM_MAXCACHED))
+		return(NULL);
+	stamp = PF_FileStamp(fileDesc);
+	if (stamp < 0)
+		return(NULL);
+
+	cache = AM_Cache[fileDesc];
+	if (cache == NULL)
+	{
+		cache = (AM_CACHE *)malloc(sizeof(AM_CACHE));
+		if (cache == NULL)
+			return(NULL);
+		cache->stamp = 0;
+		cache->pageSize = 0;
+		cache->pages = NULL;
+		AM_Cache[fileDesc] = cache;
+	}
+	if (cache->stamp != stamp)
+	{
+		/* the file now open may have nodes of another size */
+		pageSize = AM_NodeSize(PF_PageSize(fileDesc));
+		if (pageSize != cache->pageSize)
+		{
+			pages = realloc(cache->pages,AM_CACHEPAGES * pageSize);
+			if (pages == NULL)
+				return(NULL);
+			cache->pages = pages;
+			cache->pageSize = pageSize;
+		}
+		cache->stamp = stamp;
+		AM_CacheEmpty(cache);
+	}
+	return(cache);
+}
+
+
+/* Gets the page *pageNum, depth levels below the root, for a search down
+the tree; the root if *pageNum is AM_NULL_PAGE, and then sets *pageNum.
+Internal nodes of the top levels come from the cache, and are copied into
+it the first time they are fixed; other pages are fixed, and *fixed tells
+which. A cached copy must be given back with AM_CacheRelease. Returns a PF
+error code. */
+AM_CacheGetPage(fileDesc,pageNum,depth,pageBuf,fixed)
+int fileDesc;
+int *pageNum;
+int depth;
+char **pageBuf;
+int *fixed; /* set to whether the page is fixed in the buffer */
+
+{
+	AM_CACHE *cache;
+	int slot;
+	int errVal;
+
+	if (depth < AM_CACHELEVELS)
+	{
+		pthread_rwlock_rdlock(&AM_cachelock);
+		cache = AM_FindCache(fileDesc);
+		if (cache != NULL)
+		{
+			if (*pageNum == AM_NULL_PAGE)
+			{
+				if (cache->numPages > 0)
+				{
+					*pageNum = cache->rootNum;
+					*pageBuf = AM_CachePage(cache,0);
+					*fixed = FALSE;
+					return(PFE_OK);
+				}
+			}
+			else
+				for (slot = 1; slot < cache->numPages; slot++)
+					if (cache->pageNum[slot] == *pageNum)
+					{
+						*pageBuf = AM_CachePage(cache,slot);
+						*fixed = FALSE;
+						return(PFE_OK);
+					}
+		}
+		pthread_rwlock_unlock(&AM_cachelock);
+	}
+
+	if (*pageNum == AM_NULL_PAGE)
+		errVal = PF_GetFirstPage(fileDesc,pageNum,pageBuf);
+	else
+		errVal = PF_GetThisPage(fileDesc,*pageNum,pageBuf);
+	if (errVal != PFE_OK)
+		return(errVal);
+	*fixed = TRUE;
+	if ((depth >= AM_CACHELEVELS) || AM_IsLeaf(*pageBuf))
+		return(PFE_OK);
+
+	/* keep a copy of the internal node; the root goes first */
+	pthread_rwlock_wrlock(&AM_cachelock);
+	cache = AM_GetCache(fileDesc);
+	if (cache == NULL)
+		slot = -1;
+	else if (depth == 0)
+	{
+		cache->rootNum = *pageNum;
+		slot = 0;
+		if (cache->numPages == 0)
+			cache->numPages = 1;
+	}
+	else if (cache->numPages == 0)
+		/* other nodes are only kept with the root */
+		slot = -1;
+	else
+	{
+		/* another search may have kept it meanwhile */
+		for (slot = 1; slot < cache->numPages; slot++)
+			if (cache->pageNum[slot] == *pageNum)
+				break;
+		if (slot < cache->numPages)
+			;
+		else if (cache->numPages < AM_CACHEPAGES)
+			slot = cache->numPages++;
+		else
+		{
+			slot = cache->victim;
+			cache->victim = (slot + 1 < AM_CACHEPAGES) ? slot + 1 : 1;
+		}
+	}
+	if (slot >= 0)
+	{
+		cache->pageNum[slot] = *pageNum;
+		bcopy(*pageBuf,AM_CachePage(cache,slot),cache->pageSize);
+	}
+	pthread_rwlock_unlock(&AM_cachelock);
+	return(PFE_OK);
+}
+
+
+/* Gives back a copy got from AM_CacheGetPage */
+AM_CacheRelease()
+
+{
+	pthread_rwlock_unlock(&AM_cachelock);
+}
+
+
+/* Returns the cached leftmost leaf of fileDesc, or AM_NULL_PAGE */
+AM_CacheLeftPage(fileDesc)
+int fileDesc;
+
+{
+	AM_CACHE *cache;
+	int pageNum;
+
+	pthread_rwlock_rdlock(&AM_cachelock);
+	cache = AM_FindCache(fileDesc);
+	pageNum = (cache == NULL) ? AM_NULL_PAGE : cache->leftPage;
+	pthread_rwlock_unlock(&AM_cachelock);
+	return(pageNum);
+}
+
+
+/* Remembers pageNum as the leftmost leaf of fileDesc */
+AM_CacheSetLeftPage(fileDesc,pageNum)
+int fileDesc;
+int pageNum;
+
+{
+	AM_CACHE *cache;
+
+	pthread_rwlock_wrlock(&AM_cachelock);
+	cache = AM_GetCache(fileDesc);
+	if (cache != NULL)
+		cache->leftPage = pageNum;
+	pthread_rwlock_unlock(&AM_cachelock);
+}
+
+
+/* Drops the copy of page pageNum of fileDesc, about to be changed. A
+change to the root may also change the leftmost leaf, and empties the
+whole cache. */
+AM_CacheDrop(fileDesc,pageNum)
+int fileDesc;
+int pageNum;
+
+{
+	AM_CACHE *cache;
+	int slot;
+
+	pthread_rwlock_wrlock(&AM_cachelock);
+	cache = AM_GetCache(fileDesc);
+	if (cache == NULL)
+		;
+	else if ((pageNum == cache->rootNum) || (cache->rootNum == AM_NULL_PAGE))
+		AM_CacheEmpty(cache);
+	else
+		for (slot = 1; slot < cache->numPages; slot++)
+			if (cache->pageNum[slot] == pageNum)
+			{
+				cache->numPages--;
+				if (slot != cache->numPages)
+				{
+					cache->pageNum[slot] =
+						cache->pageNum[cache->numPages];
+					bcopy(AM_CachePage(cache,
+							   cache->numPages),
+					      AM_CachePage(cache,slot),
+					      cache->pageSize);
+				}
+				if (cache->victim >= cache->numPages)
+					cache->victim = 1;
+				break;
+			}
+	pthread_rwlock_unlock(&AM_cachelock);
+}
+
+
+/* Empties the cache of fileDesc, whose tree has been rebuilt */
+AM_CacheClear(fileDesc)
+int fileDesc;
+
+{
+	AM_CACHE *cache;
+
+	pthread_rwlock_wrlock(&AM_cachelock);
+	cache = AM_GetCache(fileDesc);
+	if (cache != NULL)
+		AM_CacheEmpty(cache);
+	pthread_rwlock_unlock(&AM_cachelock);
+}
@@ -0,0 +1,1211 @@
+# include <stdio.h>
+# include <pthread.h>
+# include "am.h"
+# include "pf.h"
+
+/* Compressed pages for char indexes.
+
+Char keys of AM_CMINLENGTH bytes or more are not kept at their full
+attrLength. A key is cut at its first null, since strncmp never looks past
+it, and the bytes that every key on a page starts with, the page prefix,
+are kept once at the very end of the page. The rest of each key goes into
+a cell, its length in a byte and then its bytes, on a heap that grows down
+from the page prefix.
+
+A compressed leaf ('L') has the usual leaf header. Its slots hold the
+first AM_CPREFIX bytes of the rest of the key, padded with nulls, the
+offset of its cell, and the head of its recId list; recIds are kept as on
+other leaves, on the same heap as the cells. A compressed internal node
+('I') has an AM_CINTHEADER, the first child, and slots of the first bytes
+of a key, the offset of its cell and the child after it. Its keys are the
+shortest prefixes that still separate the two leaves of a split.
+
+A search compares the fixed size slot prefixes, and reads a cell only when
+they tie. A change that fits on the page and keeps its prefix is made in
+place; otherwise the page is decoded into an AM_CPAGE, changed, and
+encoded again, which also gets back the cells of deleted keys. */
+
+/* a decoded page holds a node of AM_PageSize bytes and one more key */
+# define AM_CMAXENTRIES (AM_PageSize/(AM_CKEY + AM_ss + 1) + 2)
+# define AM_CMAXRECIDS (AM_PageSize/(AM_si + AM_ss) + 2)
+# define AM_CLEAFSLOT (AM_CKEY + AM_ss) /* leaf slot: key, list head */
+# define AM_CINTSLOT (AM_CKEY + AM_si) /* internal slot: key, child */
+
+typedef struct am_centry
+	{
+		char key[AM_MAXATTRLENGTH]; /* the whole key, cut at its null */
+		int keyLength;
+		int child; /* internal nodes: the child after the key */
+		int firstRecId; /* leaves: its recIds, in list order, are */
+		int numRecIds;	/* recId[firstRecId] on */
+	} AM_CENTRY;
+
+typedef struct am_cpage
+	{
+		int numEntries;
+		int firstChild; /* internal nodes: the child before all keys */
+		int numRecIds;
+		AM_CENTRY *entry; /* AM_CMAXENTRIES of them */
+		int *recId; /* AM_CMAXRECIDS of them */
+	} AM_CPAGE;
+
+/* The decoded pages of a thread, which are too big for its stack. A change
+decodes at most two pages at once: a node, and a new root above it. They
+are sized by AM_CReserve for the nodes of the index in use, and freed when
+the thread exits. */
+typedef struct am_cpages
+	{
+		int pageSize; /* node size they are sized for */
+		AM_CPAGE page[2];
+	} AM_CPAGES;
+
+static __thread AM_CPAGES *AM_CPages;
+static pthread_key_t AM_CPagesKey; /* to free them at thread exit */
+static pthread_once_t AM_CPagesOnce = PTHREAD_ONCE_INIT;
+
+/* decoded page n of this thread */
+# define AM_CDecoded(n) (&AM_CPages->page[n])
+
+
+/* Frees the decoded pages of an exiting thread */
+static void AM_CFreePages(arg)
+void *arg;
+
+{
+	AM_CPAGES *pages = (AM_CPAGES *)arg;
+	int i;
+
+	for (i = 0; i < 2; i++)
+	{
+		free((char *)pages->page[i].entry);
+		free((char *)pages->page[i].recId);
+	}
+	free((char *)pages);
+}
+
+
+static void AM_CMakeKey()
+
+{
+	pthread_key_create(&AM_CPagesKey,AM_CFreePages);
+}
+
+
+/* Makes the decoded pages of this thread big enough for nodes of
+AM_PageSize bytes; the changes of a compressed index need them. Returns
+PFE_OK, or PFE_NOMEM with PFerrno set. */
+AM_CReserve()
+
+{
+	AM_CPAGES *pages;
+	char *entry,*recId;
+	int i;
+
+	pages = AM_CPages;
+	if ((pages != NULL) && (pages->pageSize >= AM_PageSize))
+		return(PFE_OK);
+	if (pages == NULL)
+	{
+		pthread_once(&AM_CPagesOnce,AM_CMakeKey);
+		pages = (AM_CPAGES *)calloc(1,sizeof(AM_CPAGES));
+		if (pages == NULL)
+		{
+			PFerrno = PFE_NOMEM;
+			return(PFE_NOMEM);
+		}
+		AM_CPages = pages;
+		pthread_setspecific(AM_CPagesKey,(char *)pages);
+	}
+
+	/* pages stay usable at their old size if one cannot grow */
+	for (i = 0; i < 2; i++)
+	{
+		entry = realloc((char *)pages->page[i].entry,
+				AM_CMAXENTRIES*sizeof(AM_CENTRY));
+		if (entry != NULL)
+			pages->page[i].entry = (AM_CENTRY *)entry;
+		recId = realloc((char *)pages->page[i].recId,AM_CMAXRECIDS*AM_si);
+		if (recId != NULL)
+			pages->page[i].recId = (int *)recId;
+		if ((entry == NULL) || (recId == NULL))
+		{
+			PFerrno = PFE_NOMEM;
+			return(PFE_NOMEM);
+		}
+	}
+	pages->pageSize = AM_PageSize;
+	return(PFE_OK);
+}
+
+
+/* length of a char key up to its first null */
+static AM_CKeyLength(value,attrLength)
+char *value;
+int attrLength;
+
+{
+	int i;
+
+	for (i = 0; (i < attrLength) && (value[i] != '\0'); i++);
+	return(i);
+}
+
+
+/* length of the common prefix of two keys */
+static AM_CCommon(a,alen,b,blen)
+char *a,*b;
+int alen,blen;
+
+{
+	int i;
+
+	for (i = 0; (i < alen) && (i < blen) && (a[i] == b[i]); i++);
+	return(i);
+}
+
+
+/* compares two keys cut at their nulls like strncmp compares them whole:
+returns < 0, 0 or > 0 as a sorts before, with or after b */
+static AM_CCompare(a,alen,b,blen)
+char *a,*b;
+int alen,blen;
+
+{
+	int compareVal;
+
+	compareVal = memcmp(a,b,(alen < blen) ? alen : blen);
+	if (compareVal != 0)
+		return(compareVal);
+	return(alen - blen);
+}
+
+
+/* the first AM_CPREFIX bytes of a key, padded with nulls, as an unsigned
+number that orders like the bytes */
+static unsigned AM_CPrefixOf(ptr,length)
+char *ptr;
+int length;
+
+{
+	unsigned prefix = 0;
+	int i;
+
+	for (i = 0; i < AM_CPREFIX; i++)
+		prefix = (prefix << 8) | ((i < length) ? (unsigned char)ptr[i] : 0);
+	return(prefix);
+}
+
+
+/* Returns the number of keys of a compressed page, in numKeys slots of
+slotSize bytes from slots, that sort before value, or before or with it if
+orEqual */
+static AM_CCount(pageBuf,slots,slotSize,numKeys,prefixLength,value,valLength,
+		 orEqual)
+char *pageBuf;
+char *slots; /* first slot */
+int slotSize;
+int numKeys;
+int prefixLength; /* length of the page prefix */
+char *value; /* key to look for, cut at its null */
+int valLength;
+int orEqual;
+
+{
+	int low,high,mid; /* keys before low sort before value, from high on
+			     not */
+	unsigned valPrefix,keyPrefix;
+	int compareVal; /* of the key with value */
+	short cellPtr; /* offset of the cell of a key */
+	int restLength;
+	int n;
+
+	/* every key starts with the page prefix */
+	n = (valLength < prefixLength) ? valLength : prefixLength;
+	compareVal = memcmp(value,pageBuf + AM_PageSize - prefixLength,n);
+	if ((compareVal < 0) || ((compareVal == 0) && (valLength < prefixLength)))
+		return(0);
+	if (compareVal > 0)
+		return(numKeys);
+	value = value + prefixLength;
+	valLength = valLength - prefixLength;
+
+	valPrefix = AM_CPrefixOf(value,valLength);
+	low = 0;
+	high = numKeys;
+	while (low < high)
+	{
+		mid = (low + high) / 2;
+		keyPrefix = AM_CPrefixOf(slots + mid*slotSize,AM_CPREFIX);
+		if (keyPrefix != valPrefix)
+			compareVal = (keyPrefix < valPrefix) ? -1 : 1;
+		else if (valLength < AM_CPREFIX)
+			/* both end within the slot prefix */
+			compareVal = 0;
+		else
+		{
+			bcopy(slots + mid*slotSize + AM_CPREFIX,(char *)&cellPtr,
+			      AM_ss);
+			restLength = (unsigned char)pageBuf[cellPtr];
+			compareVal = AM_CCompare(pageBuf + cellPtr + 1 + AM_CPREFIX,
+				restLength - AM_CPREFIX,value + AM_CPREFIX,
+				valLength - AM_CPREFIX);
+		}
+		if ((compareVal < 0) || (orEqual && (compareVal == 0)))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return(low);
+}
+
+
+/* Copies the whole key of a slot of a compressed page into key, and
+returns its length */
+static AM_CSlotKey(pageBuf,slot,prefixLength,key)
+char *pageBuf;
+char *slot;
+int prefixLength;
+char *key;
+
+{
+	short cellPtr;
+	int restLength;
+
+	bcopy(pageBuf + AM_PageSize - prefixLength,key,prefixLength);
+	bcopy(slot + AM_CPREFIX,(char *)&cellPtr,AM_ss);
+	restLength = (unsigned char)pageBuf[cellPtr];
+	bcopy(pageBuf + cellPtr + 1,key + prefixLength,restLength);
+	return(prefixLength + restLength);
+}
+
+
+/* Puts the rest of a key into a new cell below heapPtr, and fills the key
+part of its slot. Returns the new heapPtr. */
+static AM_CPutKey(pageBuf,slot,heapPtr,key,keyLength,prefixLength)
+char *pageBuf;
+char *slot;
+int heapPtr;
+char *key;
+int keyLength;
+int prefixLength;
+
+{
+	short cellPtr;
+	int i;
+
+	key = key + prefixLength;
+	keyLength = keyLength - prefixLength;
+	cellPtr = heapPtr - 1 - keyLength;
+	pageBuf[cellPtr] = keyLength;
+	bcopy(key,pageBuf + cellPtr + 1,keyLength);
+	for (i = 0; i < AM_CPREFIX; i++)
+		slot[i] = (i < keyLength) ? key[i] : '\0';
+	bcopy((char *)&cellPtr,slot + AM_CPREFIX,AM_ss);
+	return(cellPtr);
+}
+
+
+/* length of the page prefix of entries low to high-1 */
+static AM_CPagePrefix(page,low,high)
+AM_CPAGE *page;
+int low,high;
+
+{
+	if (high <= low)
+		return(0);
+	return(AM_CCommon(page->entry[low].key,page->entry[low].keyLength,
+		page->entry[high-1].key,page->entry[high-1].keyLength));
+}
+
+
+/* Adds an entry for key at the end of a decoded page */
+static AM_CAddEntry(page,key,keyLength)
+AM_CPAGE *page;
+char *key;
+int keyLength;
+
+{
+	AM_CENTRY *entry;
+
+	entry = &page->entry[page->numEntries++];
+	bcopy(key,entry->key,keyLength);
+	entry->keyLength = keyLength;
+	entry->firstRecId = page->numRecIds;
+	entry->numRecIds = 0;
+}
+
+
+/* Decodes a compressed leaf into page. If value is not NULL the pair
+value,recId is put in at index as AM_InsertintoLeaf would: as a new key if
+status is AM_NOT_FOUND, else at the head of the list of the key. */
+static AM_CDecodeLeaf(pageBuf,page,value,recId,index,status)
+char *pageBuf;
+AM_CPAGE *page;
+char *value;
+int recId;
+int index;
+int status;
+
+{
+	AM_LEAFHEADER head,*header;
+	char *slot;
+	short nextRec;
+	int i;
+
+	header = &head;
+	bcopy(pageBuf,header,AM_sl);
+	page->numEntries = 0;
+	page->numRecIds = 0;
+	for (i = 1; i <= header->numKeys + 1; i++)
+	{
+		if ((value != NULL) && (i == index) && (status != AM_FOUND))
+		{
+			AM_CAddEntry(page,value,AM_CKeyLength(value,
+				     header->attrLength));
+			page->recId[page->numRecIds++] = recId;
+			page->entry[page->numEntries - 1].numRecIds = 1;
+		}
+		if (i > header->numKeys)
+			break;
+
+		slot = pageBuf + AM_sl + (i - 1)*AM_CLEAFSLOT;
+		page->entry[page->numEntries].keyLength = AM_CSlotKey(pageBuf,
+			slot,header->prefixLength,page->entry[page->numEntries].key);
+		page->entry[page->numEntries].firstRecId = page->numRecIds;
+		if ((value != NULL) && (i == index) && (status == AM_FOUND))
+			page->recId[page->numRecIds++] = recId;
+		bcopy(slot + AM_CKEY,(char *)&nextRec,AM_ss);
+		while (nextRec != AM_NULL)
+		{
+			bcopy(pageBuf + nextRec,(char *)&page->recId[page->numRecIds++],
+			      AM_si);
+			bcopy(pageBuf + nextRec + AM_si,(char *)&nextRec,AM_ss);
+		}
+		page->entry[page->numEntries].numRecIds = page->numRecIds -
+			page->entry[page->numEntries].firstRecId;
+		page->numEntries++;
+	}
+}
+
+
+/* bytes entries low to high-1 of a decoded leaf need on a page */
+static AM_CLeafSize(page,low,high)
+AM_CPAGE *page;
+int low,high;
+
+{
+	int prefixLength;
+	int size;
+	int i;
+
+	prefixLength = AM_CPagePrefix(page,low,high);
+	size = AM_sl + prefixLength;
+	for (i = low; i < high; i++)
+		size = size + AM_CLEAFSLOT + 1 + page->entry[i].keyLength -
+		       prefixLength + page->entry[i].numRecIds*(AM_si + AM_ss);
+	return(size);
+}
+
+
+/* Encodes entries low to high-1 of a decoded leaf onto pageBuf, with the
+rest of the header taken from model. Returns FALSE, and leaves pageBuf
+alone, if they do not fit. */
+static AM_CEncodeLeaf(page,low,high,pageBuf,model)
+AM_CPAGE *page;
+int low,high;
+char *pageBuf;
+AM_LEAFHEADER *model;
+
+{
+	AM_LEAFHEADER head,*header;
+	AM_CENTRY *entry;
+	char *slot;
+	int heapPtr;
+	short nextRec;
+	int i,j;
+
+	if (AM_CLeafSize(page,low,high) > AM_PageSize)
+		return(FALSE);
+
+	header = &head;
+	bcopy(model,header,AM_sl);
+	header->pageType = 'L';
+	header->prefixLength = AM_CPagePrefix(page,low,high);
+	header->numKeys = high - low;
+	header->keyPtr = AM_sl + (high - low)*AM_CLEAFSLOT;
+	header->freeListPtr = AM_NULL;
+	header->numinfreeList = 0;
+
+	heapPtr = AM_PageSize - header->prefixLength;
+	if (high > low)
+		bcopy(page->entry[low].key,pageBuf + heapPtr,header->prefixLength);
+	for (i = low; i < high; i++)
+	{
+		entry = &page->entry[i];
+		slot = pageBuf + AM_sl + (i - low)*AM_CLEAFSLOT;
+		heapPtr = AM_CPutKey(pageBuf,slot,heapPtr,entry->key,
+				     entry->keyLength,header->prefixLength);
+
+		/* the list is laid out from its tail */
+		nextRec = AM_NULL;
+		for (j = entry->numRecIds - 1; j >= 0; j--)
+		{
+			heapPtr = heapPtr - AM_si - AM_ss;
+			bcopy((char *)&page->recId[entry->firstRecId + j],
+			      pageBuf + heapPtr,AM_si);
+			bcopy((char *)&nextRec,pageBuf + heapPtr + AM_si,AM_ss);
+			nextRec = heapPtr;
+		}
+		bcopy((char *)&nextRec,slot + AM_CKEY,AM_ss);
+	}
+	header->recIdPtr = heapPtr;
+	bcopy(header,pageBuf,AM_sl);
+	return(TRUE);
+}
+
+
+/* Decodes a compressed internal node into page. If value is not NULL,
+value is put in as the key at offset, with child after it, as
+AM_AddtoIntPage would. */
+static AM_CDecodeInt(pageBuf,page,value,child,offset)
+char *pageBuf;
+AM_CPAGE *page;
+char *value;
+int child;
+int offset;
+
+{
+	AM_CINTHEADER head,*header;
+	char *slot;
+	int i;
+
+	header = &head;
+	bcopy(pageBuf,header,AM_scint);
+	page->numEntries = 0;
+	page->numRecIds = 0;
+	bcopy(pageBuf + AM_scint,(char *)&page->firstChild,AM_si);
+	for (i = 0; i <= header->numKeys; i++)
+	{
+		if ((value != NULL) && (i == offset))
+		{
+			AM_CAddEntry(page,value,AM_CKeyLength(value,
+				     header->attrLength));
+			page->entry[page->numEntries - 1].child = child;
+		}
+		if (i == header->numKeys)
+			break;
+
+		slot = pageBuf + AM_scint + AM_si + i*AM_CINTSLOT;
+		page->entry[page->numEntries].keyLength = AM_CSlotKey(pageBuf,
+			slot,header->prefixLength,page->entry[page->numEntries].key);
+		bcopy(slot + AM_CKEY,(char *)&page->entry[page->numEntries].child,
+		      AM_si);
+		page->numEntries++;
+	}
+}
+
+
+/* bytes keys low to high-1 of a decoded internal node need on a page */
+static AM_CIntSize(page,low,high)
+AM_CPAGE *page;
+int low,high;
+
+{
+	int prefixLength;
+	int size;
+	int i;
+
+	prefixLength = AM_CPagePrefix(page,low,high);
+	size = AM_scint + AM_si + prefixLength;
+	for (i = low; i < high; i++)
+		size = size + AM_CINTSLOT + 1 + page->entry[i].keyLength -
+		       prefixLength;
+	return(size);
+}
+
+
+/* Encodes keys low to high-1 of a decoded internal node, and their
+children after firstChild, onto pageBuf. Returns FALSE, and leaves pageBuf
+alone, if they do not fit. */
+static AM_CEncodeInt(page,low,high,firstChild,pageBuf,attrLength,maxKeys)
+AM_CPAGE *page;
+int low,high;
+int firstChild;
+char *pageBuf;
+int attrLength;
+int maxKeys;
+
+{
+	AM_CINTHEADER head,*header;
+	char *slot;
+	int heapPtr;
+	int i;
+
+	if (AM_CIntSize(page,low,high) > AM_PageSize)
+		return(FALSE);
+
+	header = &head;
+	header->pageType = 'I';
+	header->numKeys = high - low;
+	header->maxKeys = maxKeys;
+	header->attrLength = attrLength;
+	header->prefixLength = AM_CPagePrefix(page,low,high);
+
+	heapPtr = AM_PageSize - header->prefixLength;
+	if (high > low)
+		bcopy(page->entry[low].key,pageBuf + heapPtr,header->prefixLength);
+	bcopy((char *)&firstChild,pageBuf + AM_scint,AM_si);
+	for (i = low; i < high; i++)
+	{
+		slot = pageBuf + AM_scint + AM_si + (i - low)*AM_CINTSLOT;
+		heapPtr = AM_CPutKey(pageBuf,slot,heapPtr,page->entry[i].key,
+			page->entry[i].keyLength,header->prefixLength);
+		bcopy((char *)&page->entry[i].child,slot + AM_CKEY,AM_si);
+	}
+	header->heapPtr = heapPtr;
+	bcopy(header,pageBuf,AM_scint);
+	return(TRUE);
+}
+
+
+/* Makes sep, padded with nulls to attrLength, the shortest prefix of the
+key right that sorts after the key left. Keys from right on sort with or
+after it, so it can separate them from keys up to left. */
+static AM_CSeparator(left,leftLength,right,rightLength,attrLength,sep)
+char *left,*right;
+int leftLength,rightLength;
+int attrLength;
+char *sep;
+
+{
+	int sepLength;
+	int i;
+
+	sepLength = AM_CCommon(left,leftLength,right,rightLength) + 1;
+	if (sepLength > rightLength)
+		sepLength = rightLength;
+	bcopy(right,sep,sepLength);
+	for (i = sepLength; i < attrLength; i++)
+		sep[i] = '\0';
+}
+
+
+/* search a compressed leaf for the key - returns whether it is found, and
+the place where it is found or can be inserted, as AM_SearchLeaf */
+AM_CSearchLeaf(pageBuf,attrLength,value,indexPtr)
+char *pageBuf;
+int attrLength;
+char *value;
+int *indexPtr;
+
+{
+	AM_LEAFHEADER head,*header;
+	int valLength;
+	char *slot;
+
+	header = &head;
+	bcopy(pageBuf,header,AM_sl);
+	valLength = AM_CKeyLength(value,attrLength);
+
+	*indexPtr = 1 + AM_CCount(pageBuf,pageBuf + AM_sl,AM_CLEAFSLOT,
+		header->numKeys,header->prefixLength,value,valLength,FALSE);
+	if (*indexPtr > header->numKeys)
+		return(AM_NOT_FOUND);
+
+	/* that key is value if it also does not sort after value */
+	slot = pageBuf + AM_sl + (*indexPtr - 1)*AM_CLEAFSLOT;
+	if (AM_CCount(pageBuf,slot,AM_CLEAFSLOT,1,header->prefixLength,value,
+		      valLength,TRUE) == 1)
+		return(AM_FOUND);
+	return(AM_NOT_FOUND);
+}
+
+
+/* Finds the child of a compressed internal node to follow for value, as
+AM_BinSearch */
+AM_CBinSearch(pageBuf,attrLength,value,indexPtr)
+char *pageBuf;
+int attrLength;
+char *value;
+int *indexPtr;
+
+{
+	AM_CINTHEADER head,*header;
+	int pageNum;
+
+	header = &head;
+	bcopy(pageBuf,header,AM_scint);
+	*indexPtr = AM_CCount(pageBuf,pageBuf + AM_scint + AM_si,AM_CINTSLOT,
+		header->numKeys,header->prefixLength,value,
+		AM_CKeyLength(value,attrLength),TRUE);
+	bcopy(pageBuf + AM_scint + (*indexPtr)*AM_CINTSLOT,(char *)&pageNum,
+	      AM_si);
+	return(pageNum);
+}
+
+
+/* Copies the key at index of a leaf, of either kind, into key, padded
+with nulls to attrLength */
+AM_GetLeafKey(pageBuf,index,key)
+char *pageBuf;
+int index;
+char *key;
+
+{
+	AM_LEAFHEADER head,*header;
+	int keyLength;
+	int i;
+
+	header = &head;
+	bcopy(pageBuf,header,AM_sl);
+	if (header->pageType != 'L')
+	{
+		bcopy(pageBuf + AM_sl + (index - 1)*(header->attrLength + AM_ss),
+		      key,header->attrLength);
+		return;
+	}
+	keyLength = AM_CSlotKey(pageBuf,pageBuf + AM_sl + (index - 1)*
+		AM_CLEAFSLOT,header->prefixLength,key);
+	for (i = keyLength; i < header->attrLength; i++)
+		key[i] = '\0';
+}
+
+
+/* Copies key index (from 1) of an internal node, of either kind, into
+key, padded with nulls to attrLength, and returns the child after it */
+AM_GetIntKey(pageBuf,index,key)
+char *pageBuf;
+int index;
+char *key;
+
+{
+	AM_CINTHEADER head,*header;
+	char *slot;
+	int keyLength;
+	int child;
+	int i;
+
+	header = &head;
+	bcopy(pageBuf,header,AM_sint);
+	if (header->pageType != 'I')
+	{
+		slot = pageBuf + AM_sint + AM_si + (index - 1)*
+		       (header->attrLength + AM_si);
+		bcopy(slot,key,header->attrLength);
+		bcopy(slot + header->attrLength,(char *)&child,AM_si);
+		return(child);
+	}
+	bcopy(pageBuf,header,AM_scint);
+	slot = pageBuf + AM_scint + AM_si + (index - 1)*AM_CINTSLOT;
+	keyLength = AM_CSlotKey(pageBuf,slot,header->prefixLength,key);
+	for (i = keyLength; i < header->attrLength; i++)
+		key[i] = '\0';
+	bcopy(slot + AM_CKEY,(char *)&child,AM_si);
+	return(child);
+}
+
+
+/* Inserts a key into a compressed leaf, as AM_InsertintoLeaf */
+AM_CInsertintoLeaf(pageBuf,attrLength,value,recId,index,status)
+char *pageBuf;
+int attrLength;
+char *value;
+int recId;
+int index;
+int status;
+
+{
+	AM_LEAFHEADER head,*header;
+	AM_CPAGE *page;
+	char tempPage[AM_MAXPAGESIZE];
+	int valLength;
+	int cellSize; /* size of the cell for value */
+	int needed; /* room needed in the middle */
+	int i;
+
+	page = AM_CDecoded(0);
+	header = &head;
+	bcopy(pageBuf,header,AM_sl);
+	needed = (header->freeListPtr == AM_NULL) ? AM_si + AM_ss : 0;
+
+	if (status == AM_FOUND)
+	{
+		if (header->recIdPtr - header->keyPtr >= needed)
+		{
+			AM_InsertToLeafFound(pageBuf,recId,index,header);
+			bcopy(header,pageBuf,AM_sl);
+			return(TRUE);
+		}
+	}
+	else
+	{
+		valLength = AM_CKeyLength(value,attrLength);
+		cellSize = 1 + valLength - header->prefixLength;
+		if ((valLength >= header->prefixLength) &&
+		    (memcmp(value,pageBuf + AM_PageSize - header->prefixLength,
+			    header->prefixLength) == 0) &&
+		    (header->recIdPtr - header->keyPtr >= needed +
+		     AM_CLEAFSLOT + cellSize))
+		{
+			/* room for the key, and it starts with the page prefix */
+			for (i = header->numKeys; i >= index; i--)
+				bcopy(pageBuf + AM_sl + (i - 1)*AM_CLEAFSLOT,pageBuf +
+				      AM_sl + i*AM_CLEAFSLOT,AM_CLEAFSLOT);
+			header->recIdPtr = AM_CPutKey(pageBuf,pageBuf + AM_sl +
+				(index - 1)*AM_CLEAFSLOT,header->recIdPtr,value,
+				valLength,header->prefixLength);
+			bzero(pageBuf + AM_sl + (index - 1)*AM_CLEAFSLOT + AM_CKEY,
+			      AM_ss);
+			header->keyPtr = header->keyPtr + AM_CLEAFSLOT;
+			header->numKeys++;
+			AM_InsertToLeafFound(pageBuf,recId,index,header);
+			bcopy(header,pageBuf,AM_sl);
+			return(TRUE);
+		}
+	}
+
+	/* rebuild the page, with a new prefix and without dead cells */
+	AM_CDecodeLeaf(pageBuf,page,value,recId,index,status);
+	if (!AM_CEncodeLeaf(page,0,page->numEntries,tempPage,header))
+		return(FALSE);
+	bcopy(tempPage,pageBuf,AM_PageSize);
+	return(TRUE);
+}
+
+
+/* Splits a compressed leaf, as AM_SplitLeaf. The leaf is split where the
+two halves are closest in size, or near there where the separator is
+shortest. */
+AM_CSplitLeaf(handle,pageBuf,pageNum,attrLength,recId,value,status,index,
+	      key)
+AM_INDEXHANDLE *handle; /* the insert */
+char *pageBuf;
+int *pageNum; /* page number of the leaf; returns that of the new leaf */
+int attrLength;
+int recId;
+char *value;
+int status;
+int index;
+char *key; /* returns the key to be filled in the parent */
+
+{
+	AM_LEAFHEADER head,*header;
+	AM_CPAGE *page;
+	char tempPage[AM_MAXPAGESIZE];
+	char *tempPageBuf,*tempPageBuf1;
+	int tempPageNum,tempPageNum1;
+	int total,left; /* sizes of the entries, and of those before i */
+	int best,bestSize; /* most even split */
+	int split,splitLength; /* split chosen, and its separator length */
+	int size,sepLength;
+	int errVal;
+	int fileDesc;
+	int i;
+
+	page = AM_CDecoded(0);
+	fileDesc = handle->fileDesc;
+	header = &head;
+	bcopy(pageBuf,header,AM_sl);
+	AM_CDecodeLeaf(pageBuf,page,value,recId,index,status);
+
+	total = 0;
+	for (i = 0; i < page->numEntries; i++)
+		total = total + AM_CLEAFSLOT + 1 + page->entry[i].keyLength +
+			page->entry[i].numRecIds*(AM_si + AM_ss);
+
+	/* halves no more than an eighth of a page past the most even split
+	are as good, and the shortest separator among them is taken */
+	best = 0;
+	bestSize = total + 1;
+	left = 0;
+	for (i = 1; i < page->numEntries; i++)
+	{
+		left = left + AM_CLEAFSLOT + 1 + page->entry[i-1].keyLength +
+			page->entry[i-1].numRecIds*(AM_si + AM_ss);
+		size = (left > total - left) ? left : total - left;
+		if (size < bestSize)
+		{
+			best = i;
+			bestSize = size;
+		}
+	}
+	split = best;
+	splitLength = AM_MAXATTRLENGTH;
+	left = 0;
+	for (i = 1; (best > 0) && (i < page->numEntries); i++)
+	{
+		left = left + AM_CLEAFSLOT + 1 + page->entry[i-1].keyLength +
+			page->entry[i-1].numRecIds*(AM_si + AM_ss);
+		size = (left > total - left) ? left : total - left;
+		if (size > bestSize + AM_PageSize/8)
+			continue;
+		sepLength = AM_CCommon(page->entry[i-1].key,
+			page->entry[i-1].keyLength,page->entry[i].key,
+			page->entry[i].keyLength);
+		if (sepLength < splitLength)
+		{
+			split = i;
+			splitLength = sepLength;
+		}
+	}
+
+	if ((split != best) && ((AM_CLeafSize(page,0,split) > AM_PageSize) ||
+	    (AM_CLeafSize(page,split,page->numEntries) > AM_PageSize)))
+		split = best;
+
+	/* the recIds of a single key fill the page */
+	if ((split == 0) || (AM_CLeafSize(page,0,split) > AM_PageSize) ||
+	    (AM_CLeafSize(page,split,page->numEntries) > AM_PageSize))
+	{
+		PF_UnfixPage(fileDesc,*pageNum,FALSE);
+		AM_Errno = AME_KEYLISTFULL;
+		return(AME_KEYLISTFULL);
+	}
+
+	/* Allocate a new page for the second half of the leaf */
+	errVal = PF_AllocPage(fileDesc,&tempPageNum,&tempPageBuf);
+	AM_Check;
+	AM_CEncodeLeaf(page,split,page->numEntries,tempPageBuf,header);
+	header->nextLeafPage = tempPageNum;
+	AM_CEncodeLeaf(page,0,split,tempPage,header);
+	bcopy(tempPage,pageBuf,AM_PageSize);
+
+	/* the key to be written onto the parent */
+	AM_CSeparator(page->entry[split-1].key,page->entry[split-1].keyLength,
+		page->entry[split].key,page->entry[split].keyLength,attrLength,key);
+
+	/*check if the split page is root */
+	if ((*pageNum) == handle->rootPageNum)
+	{
+		/* move the first half off the root, which becomes an
+		internal node */
+		errVal = PF_AllocPage(fileDesc,&tempPageNum1,&tempPageBuf1);
+		AM_Check;
+		AM_CacheDrop(fileDesc,*pageNum);
+		bcopy(pageBuf,tempPageBuf1,AM_PageSize);
+		AM_CFillRootPage(pageBuf,tempPageNum1,tempPageNum,key,
+		header->attrLength,header->maxKeys);
+		errVal = PF_UnfixPage(fileDesc,tempPageNum1,TRUE);
+		AM_Check;
+	}
+
+	errVal = PF_UnfixPage(fileDesc,*pageNum,TRUE);
+	AM_Check;
+
+	errVal = PF_UnfixPage(fileDesc,tempPageNum,TRUE);
+	AM_Check;
+
+	if ((*pageNum) == handle->rootPageNum)
+		return(FALSE);
+	*pageNum = tempPageNum;
+	return(TRUE);
+}
+
+
+/* Adds a key and the child after it to a compressed internal node, as
+AM_AddtoIntPage. Returns FALSE if the node has no room for them. */
+AM_CAddtoIntPage(pageBuf,value,pageNum,offset)
+char *pageBuf;
+char *value; /* key to be added */
+int pageNum; /* page number of the child after it */
+int offset; /* place where the key is to be inserted */
+
+{
+	AM_CINTHEADER head,*header;
+	AM_CPAGE *page;
+	char tempPage[AM_MAXPAGESIZE];
+	int valLength;
+	int cellSize; /* size of the cell for value */
+	char *slot;
+	int i;
+
+	page = AM_CDecoded(0);
+	header = &head;
+	bcopy(pageBuf,header,AM_scint);
+	valLength = AM_CKeyLength(value,header->attrLength);
+	cellSize = 1 + valLength - header->prefixLength;
+
+	if ((valLength >= header->prefixLength) &&
+	    (memcmp(value,pageBuf + AM_PageSize - header->prefixLength,
+		    header->prefixLength) == 0) &&
+	    (header->heapPtr - (AM_scint + AM_si + header->numKeys*AM_CINTSLOT)
+	     >= AM_CINTSLOT + cellSize))
+	{
+		/* room for the key, and it starts with the page prefix */
+		for (i = header->numKeys - 1; i >= offset; i--)
+			bcopy(pageBuf + AM_scint + AM_si + i*AM_CINTSLOT,pageBuf +
+			      AM_scint + AM_si + (i + 1)*AM_CINTSLOT,AM_CINTSLOT);
+		slot = pageBuf + AM_scint + AM_si + offset*AM_CINTSLOT;
+		header->heapPtr = AM_CPutKey(pageBuf,slot,header->heapPtr,value,
+			valLength,header->prefixLength);
+		bcopy((char *)&pageNum,slot + AM_CKEY,AM_si);
+		header->numKeys++;
+		bcopy(header,pageBuf,AM_scint);
+		return(TRUE);
+	}
+
+	/* rebuild the node with a new prefix */
+	AM_CDecodeInt(pageBuf,page,value,pageNum,offset);
+	if (!AM_CEncodeInt(page,0,page->numEntries,page->firstChild,tempPage,
+			   header->attrLength,header->maxKeys))
+		return(FALSE);
+	bcopy(tempPage,pageBuf,AM_PageSize);
+	return(TRUE);
+}
+
+
+/* Splits a full compressed internal node, as AM_SplitIntNode: the halves
+go to pbuf1 and pbuf2, and the key between them is returned in value */
+AM_CSplitIntNode(pageBuf,pbuf1,pbuf2,value,pageNum,offset)
+char *pageBuf; /* internal node to be split */
+char *pbuf1,*pbuf2; /* the buffers for the two halves */
+char *value; /* key to be added, and returns the key for the parent */
+int pageNum,offset; /* child after the key, and where the key goes */
+
+{
+	AM_CINTHEADER head,*header;
+	AM_CPAGE *page;
+	int total,left,right; /* sizes of the keys, before and after i */
+	int middle,bestSize; /* key going up, and the larger half */
+	int size;
+	int i;
+
+	page = AM_CDecoded(0);
+	header = &head;
+	bcopy(pageBuf,header,AM_scint);
+	AM_CDecodeInt(pageBuf,page,value,pageNum,offset);
+
+	total = 0;
+	for (i = 0; i < page->numEntries; i++)
+		total = total + AM_CINTSLOT + 1 + page->entry[i].keyLength;
+
+	/* each half keeps at least one key */
+	middle = 0;
+	bestSize = total + 1;
+	left = 0;
+	for (i = 1; i < page->numEntries - 1; i++)
+	{
+		left = left + AM_CINTSLOT + 1 + page->entry[i-1].keyLength;
+		right = total - left - (AM_CINTSLOT + 1 + page->entry[i].keyLength);
+		size = (left > right) ? left : right;
+		if (size < bestSize)
+		{
+			middle = i;
+			bestSize = size;
+		}
+	}
+	if (middle == 0)
+	{
+		AM_Errno = AME_INTERROR;
+		return(AME_INTERROR);
+	}
+
+	AM_CEncodeInt(page,0,middle,page->firstChild,pbuf1,header->attrLength,
+		header->maxKeys);
+	AM_CEncodeInt(page,middle + 1,page->numEntries,page->entry[middle].child,
+		pbuf2,header->attrLength,header->maxKeys);
+	bcopy(page->entry[middle].key,value,page->entry[middle].keyLength);
+	for (i = page->entry[middle].keyLength; i < header->attrLength; i++)
+		value[i] = '\0';
+	return(AME_OK);
+}
+
+
+/* Fills a new compressed root with one key and its two children */
+AM_CFillRootPage(pageBuf,pageNum1,pageNum2,value,attrLength,maxKeys)
+char *pageBuf;
+int pageNum1,pageNum2;
+char *value;
+short attrLength,maxKeys;
+
+{
+	AM_CPAGE *page;
+
+	page = AM_CDecoded(1);
+	page->numEntries = 0;
+	page->numRecIds = 0;
+	AM_CAddEntry(page,value,AM_CKeyLength(value,attrLength));
+	page->entry[0].child = pageNum2;
+	AM_CEncodeInt(page,0,1,pageNum1,pageBuf,attrLength,maxKeys);
+}
+
+
+/* Appends value,recId to a compressed leaf being bulk loaded: under a new
+last key if newKey, else at the tail of the list of the last key. Returns
+FALSE if the leaf has no room for it. */
+AM_CAppend(pageBuf,value,recId,newKey)
+char *pageBuf;
+char *value;
+int recId;
+int newKey;
+
+{
+	AM_LEAFHEADER head,*header;
+	AM_CPAGE *page;
+	char tempPage[AM_MAXPAGESIZE];
+	char *slot;
+	int valLength;
+	short recPtr; /* offset of the new recId */
+	short nextRec;
+	char *listPtr; /* where the offset of the new recId goes */
+	short null = AM_NULL;
+
+	page = AM_CDecoded(0);
+	header = &head;
+	bcopy(pageBuf,header,AM_sl);
+	valLength = AM_CKeyLength(value,header->attrLength);
+
+	if (!newKey && (header->recIdPtr - header->keyPtr >= AM_si + AM_ss))
+	{
+		/* the list of the last key ends at the first null pointer */
+		listPtr = pageBuf + header->keyPtr - AM_ss;
+		bcopy(listPtr,(char *)&nextRec,AM_ss);
+		while (nextRec != AM_NULL)
+		{
+			listPtr = pageBuf + nextRec + AM_si;
+			bcopy(listPtr,(char *)&nextRec,AM_ss);
+		}
+		header->recIdPtr = header->recIdPtr - AM_si - AM_ss;
+		recPtr = header->recIdPtr;
+		bcopy((char *)&recId,pageBuf + recPtr,AM_si);
+		bcopy((char *)&null,pageBuf + recPtr + AM_si,AM_ss);
+		bcopy((char *)&recPtr,listPtr,AM_ss);
+		bcopy(header,pageBuf,AM_sl);
+		return(TRUE);
+	}
+
+	if (newKey && (valLength >= header->prefixLength) &&
+	    (memcmp(value,pageBuf + AM_PageSize - header->prefixLength,
+		    header->prefixLength) == 0) &&
+	    (header->recIdPtr - header->keyPtr >= AM_CLEAFSLOT + 1 + valLength -
+	     header->prefixLength + AM_si + AM_ss))
+	{
+		slot = pageBuf + header->keyPtr;
+		header->recIdPtr = AM_CPutKey(pageBuf,slot,header->recIdPtr,value,
+					      valLength,header->prefixLength);
+		header->recIdPtr = header->recIdPtr - AM_si - AM_ss;
+		recPtr = header->recIdPtr;
+		bcopy((char *)&recId,pageBuf + recPtr,AM_si);
+		bcopy((char *)&null,pageBuf + recPtr + AM_si,AM_ss);
+		bcopy((char *)&recPtr,slot + AM_CKEY,AM_ss);
+		header->keyPtr = header->keyPtr + AM_CLEAFSLOT;
+		header->numKeys++;
+		bcopy(header,pageBuf,AM_sl);
+		return(TRUE);
+	}
+
+	/* rebuild the leaf with the pair at its end */
+	AM_CDecodeLeaf(pageBuf,page,NULL,0,0,0);
+	if (newKey)
+		AM_CAddEntry(page,value,valLength);
+	if (page->numEntries == 0)
+		return(FALSE);
+	page->recId[page->numRecIds++] = recId;
+	page->entry[page->numEntries - 1].numRecIds++;
+	if (!AM_CEncodeLeaf(page,0,page->numEntries,tempPage,header))
+		return(FALSE);
+	bcopy(tempPage,pageBuf,AM_PageSize);
+	return(TRUE);
+}
+
+
+/* Moves the last key of a compressed leaf being bulk loaded and its
+recIds onto the empty leaf to, so that all the recIds of a key stay on
+one leaf */
+AM_CMoveLastKey(from,to)
+char *from,*to;
+
+{
+	AM_LEAFHEADER head,*header;
+	AM_CPAGE *page;
+	char tempPage[AM_MAXPAGESIZE];
+	AM_CENTRY *entry;
+
+	page = AM_CDecoded(0);
+	header = &head;
+	bcopy(from,header,AM_sl);
+	AM_CDecodeLeaf(from,page,NULL,0,0,0);
+	AM_CEncodeLeaf(page,0,page->numEntries - 1,tempPage,header);
+	bcopy(tempPage,from,AM_PageSize);
+
+	entry = &page->entry[page->numEntries - 1];
+	bcopy(to,header,AM_sl);
+	bcopy((char *)entry,(char *)&page->entry[0],sizeof(AM_CENTRY));
+	AM_CEncodeLeaf(page,0,1,to,header);
+}
+
+
+/* Makes sep the separator for the internal levels between the last key
+of the leaf pageBuf and the key first, which starts the next leaf */
+AM_CLeafSeparator(pageBuf,first,sep)
+char *pageBuf;
+char *first;
+char *sep;
+
+{
+	AM_LEAFHEADER head,*header;
+	char last[AM_MAXATTRLENGTH];
+
+	header = &head;
+	bcopy(pageBuf,header,AM_sl);
+	AM_GetLeafKey(pageBuf,header->numKeys,last);
+	AM_CSeparator(last,AM_CKeyLength(last,header->attrLength),first,
+		AM_CKeyLength(first,header->attrLength),header->attrLength,sep);
+}
+
+
+/* Fills a decoded page with the first key and page number of numChildren
+nodes, for a compressed internal node over them */
+static AM_CBulkPage(page,entries,numChildren,attrLength)
+AM_CPAGE *page;
+AM_BULKENTRY *entries;
+int numChildren;
+int attrLength;
+
+{
+	int i;
+
+	page->numEntries = 0;
+	page->numRecIds = 0;
+	page->firstChild = entries[0].pageNum;
+	for (i = 1; i < numChildren; i++)
+	{
+		AM_CAddEntry(page,entries[i].key,AM_CKeyLength(entries[i].key,
+			     attrLength));
+		page->entry[i - 1].child = entries[i].pageNum;
+	}
+}
+
+
+/* bytes a compressed internal node over numChildren bulk entries needs */
+AM_CBulkIntSize(entries,numChildren,attrLength)
+AM_BULKENTRY *entries;
+int numChildren;
+int attrLength;
+
+{
+	AM_CPAGE *page;
+
+	page = AM_CDecoded(0);
+	AM_CBulkPage(page,entries,numChildren,attrLength);
+	return(AM_CIntSize(page,0,page->numEntries));
+}
+
+
+/* Builds a compressed internal node over numChildren bulk entries on
+pageBuf. Returns FALSE if they do not fit. */
+AM_CBulkIntNode(pageBuf,entries,numChildren,attrLength,maxKeys)
+char *pageBuf;
+AM_BULKENTRY *entries;
+int numChildren;
+int attrLength;
+int maxKeys;
+
+{
+	AM_CPAGE *page;
+
+	page = AM_CDecoded(0);
+	AM_CBulkPage(page,entries,numChildren,attrLength);
+	return(AM_CEncodeInt(page,0,page->numEntries,page->firstChild,pageBuf,
+			     attrLength,maxKeys));
+}
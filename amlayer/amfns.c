@@ -11,6 +11,23 @@ int indexNo;/*number of this index for file */
 char attrType;/* 'c' for char ,'i' for int ,'f' for float */
 int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
 
+{
+	return(AM_CreateIndexSize(fileName,indexNo,attrType,attrLength,
+				  PF_FILE_PAGE_SIZE));
+}
+
+
+/* Creates a secondary index file called fileName.indexNo whose pages are
+pageSize bytes, a power of two from PF_FILE_PAGE_SIZE to AM_MAXPAGESIZE.
+Bigger nodes make the tree shallower, at the cost of more bytes to read
+for each node */
+AM_CreateIndexSize(fileName,indexNo,attrType,attrLength,pageSize)
+char *fileName;/* Name of indexed file */
+int indexNo;/*number of this index for file */
+char attrType;/* 'c' for char ,'i' for int ,'f' for float */
+int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+int pageSize; /* page size of the index file */
+
 
 {
 	char *pageBuf; /* buffer for holding a page */
@@ -41,12 +58,21 @@ int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
 			 AM_Errno = AME_INVALIDATTRLENGTH;
 			 return(AME_INVALIDATTRLENGTH);
                         }
+
+	/* PF takes smaller powers of two, but the offsets on a node stop
+	at AM_MAXPAGESIZE */
+	if ((pageSize < PF_FILE_PAGE_SIZE) || (pageSize > AM_MAXPAGESIZE) ||
+	    ((pageSize & (pageSize - 1)) != 0))
+		{
+		 AM_Errno = AME_PAGESIZE;
+		 return(AME_PAGESIZE);
+		}
 	
 	header = &head;
 	
 	/* Get the filename with extension and create a paged file by that name*/
 	sprintf(indexfName,"%s.%d",fileName,indexNo);
-	errVal = PF_CreateFile(indexfName);
+	errVal = PF_CreateFileSize(indexfName,pageSize);
 	AM_Check;
 
 	/* open the new file */
@@ -61,17 +87,19 @@ int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
 	errVal = PF_AllocPage(fileDesc,&pageNum,&pageBuf);
 	AM_Check;
 	
-	/* initialise the header */
-	header->pageType = 'l';
+	/* initialise the header; long char keys go on compressed pages */
+	header->pageType = AM_Compressed(attrType,attrLength) ? 'L' : 'l';
 	header->nextLeafPage = AM_NULL_PAGE;
-	header->recIdPtr = PF_PAGE_SIZE;
+	header->recIdPtr = AM_NodeSize(pageSize);
 	header->keyPtr = AM_sl;
 	header->freeListPtr = AM_NULL;
 	header->numinfreeList = 0;
 	header->attrLength = attrLength;
 	header->numKeys = 0;
+	header->prefixLength = 0;
 	/* the maximum keys in an internal node- has to be even always*/
-	maxKeys = (PF_PAGE_SIZE - AM_sint - AM_si)/(AM_si + attrLength);
+	maxKeys = (AM_NodeSize(pageSize) - AM_sint - AM_si)/
+						(AM_si + attrLength);
 	if (( maxKeys % 2) != 0) 
 		header->maxKeys = maxKeys - 1;
 	else 
@@ -85,9 +113,6 @@ int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
 	/* Close the file */
 	errVal = PF_CloseFile(fileDesc);
 	AM_Check;
-	
-	/* initialise the root page and the leftmost page numbers */
-	AM_RootPageNum = pageNum;
 	return(AME_OK);
 }
 
@@ -117,21 +142,42 @@ int attrLength; /* 4 for 'i' or 'f' , 1-255 for 'c' */
 char *value;/* Value of key whose corr recId is to be deleted */
 int recId; /* id of the record to delete */
 
+{
+	return(AM_DeleteRecIds(fileDesc,attrType,attrLength,value,&recId,1));
+}
+
+
+/* Deletes numRecIds recIds, one after the other on the list for value
+from a place on it that is a multiple of numRecIds, and deletes value if
+the list becomes empty */
+AM_DeleteRecIds(fileDesc,attrType,attrLength,value,recIds,numRecIds)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'c' , 'i' or 'f' */
+int attrLength; /* 4 for 'i' or 'f' , 1-255 for 'c' */
+char *value;/* Value of key whose corr recIds are to be deleted */
+int *recIds; /* ids to delete, in list order */
+int numRecIds; /* # of them */
+
 {
 	char *pageBuf;/* buffer to hold the page */
 	int pageNum; /* page Number of the page in buffer */
 	int index;/* index where key is present */
 	int status; /* whether key is in tree or not */
 	short nextRec;/* contains the next record on the list */
+	short groupRec; /* record after the group of nextRec */
+	short lastRec; /* last record of the group of nextRec */
 	short oldhead; /* contains the old head of the list */
 	short temp; 
 	char *currRecPtr;/* pointer to the current record in the list */
 	AM_LEAFHEADER head,*header;/* header of the page */
 	int recSize; /* length of key,ptr pair for a leaf */
+	int keySize; /* bytes of the pair before the ptr */
 	int tempRec; /* holds the recId of the current record */
+	int matched; /* recIds of the group that are to be deleted */
 	int errVal; /* holds the return value of functions called within 
 				                            this function */
 	int i; /* loop index */
+	AM_INDEXHANDLE handle; /* this delete */
 
 
 	/* check the parameters */
@@ -153,12 +199,25 @@ int recId; /* id of the record to delete */
 		 return(AME_FD);
                 }
 
+	/* work with the node size of this index */
+	errVal = AM_UseIndex(fileDesc);
+	AM_Check;
+
+	/* the tree cannot be changed through a read-only mapping */
+	if (PF_FileMode(fileDesc) == PF_MODE_MMAP)
+		{
+		 PFerrno = PFE_READONLY;
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+                }
+
 	/* initialise the header */
 	header = &head;
 	
 	/* find the pagenumber and the index of the key to be deleted if it is
 	there */
-	status = AM_Search(fileDesc,attrType,attrLength,value,&pageNum,
+	AM_InitHandle(&handle,fileDesc);
+	status = AM_Search(&handle,attrType,attrLength,value,&pageNum,
 			   &pageBuf,&index);
 	
 	/* check if return value is an error */
@@ -176,31 +235,41 @@ int recId; /* id of the record to delete */
                 }
 	
 	bcopy(pageBuf,header,AM_sl);
-	recSize = attrLength + AM_ss;
-	currRecPtr = pageBuf + AM_sl + (index - 1)*recSize + attrLength;
+	keySize = AM_KeySize(header->pageType,attrLength);
+	recSize = keySize + AM_ss;
+	currRecPtr = pageBuf + AM_sl + (index - 1)*recSize + keySize;
 	bcopy(currRecPtr,&nextRec,AM_ss);
 	
-	/* search the list for recId */
+	/* search the list for recIds, a group of numRecIds at a time */
 	while(nextRec != 0)
 	{
-		bcopy(pageBuf + nextRec,&tempRec,AM_si);
+		matched = 0;
+		groupRec = nextRec;
+		for (i = 0; (i < numRecIds) && (groupRec != 0); i++)
+		{
+			bcopy(pageBuf + groupRec,&tempRec,AM_si);
+			if (tempRec == recIds[i])
+				matched++;
+			lastRec = groupRec;
+			bcopy(pageBuf + groupRec + AM_si,&groupRec,AM_ss);
+		}
 		
-		/* found the recId to be deleted */
-		if (recId == tempRec)
+		/* found the recIds to be deleted */
+		if (matched == numRecIds)
 		{
-			/* Delete recId */
-			bcopy(pageBuf + nextRec + AM_si,currRecPtr,AM_ss);
-			header->numinfreeList++;
+			/* Delete the group, onto the free list */
+			bcopy(&groupRec,currRecPtr,AM_ss);
+			header->numinfreeList += numRecIds;
 			oldhead = header->freeListPtr;
 			header->freeListPtr = nextRec;
-			bcopy(&oldhead,pageBuf + nextRec + AM_si,AM_ss);
+			bcopy(&oldhead,pageBuf + lastRec + AM_si,AM_ss);
 			break;
 		}
 		else 
 	        {
-			/* go over to the next item on the list */
-			currRecPtr = pageBuf + nextRec + AM_si;
-			bcopy(currRecPtr,&nextRec,AM_ss);
+			/* go over to the next group on the list */
+			currRecPtr = pageBuf + lastRec + AM_si;
+			nextRec = groupRec;
 		}
 	}
 	
@@ -212,7 +281,7 @@ int recId; /* id of the record to delete */
                 }
 	
 	/* check if list is empty */
-	bcopy(pageBuf + AM_sl + (index - 1)*recSize + attrLength,&temp,AM_ss);
+	bcopy(pageBuf + AM_sl + (index - 1)*recSize + keySize,&temp,AM_ss);
 	if (temp == 0)
 	{
 		/* list is empty , so delete key from the list */
@@ -227,9 +296,6 @@ int recId; /* id of the record to delete */
 	bcopy(header,pageBuf,AM_sl);
 	
 	errVal = PF_UnfixPage(fileDesc,pageNum,TRUE);
-	
-	/* empty the stack so that it is set for next amlayer call */
-	AM_EmptyStack();
 	  {
 	   AM_Errno = AME_OK;
 	   return(AME_OK);
@@ -262,6 +328,7 @@ int recId; /* recId to be inserted */
 	int errVal; /* return value of functions within this function */
 	char key[AM_MAXATTRLENGTH]; /* holds the attribute to be passed 
 						  back to the parent */
+	AM_INDEXHANDLE handle; /* this insert */
 
 	
 	/* check the parameters */
@@ -282,10 +349,30 @@ int recId; /* recId to be inserted */
 		 AM_Errno = AME_FD;
 		 return(AME_FD);
                 }
+
+	/* work with the node size of this index */
+	errVal = AM_UseIndex(fileDesc);
+	AM_Check;
+
+	/* the tree cannot be changed through a read-only mapping */
+	if (PF_FileMode(fileDesc) == PF_MODE_MMAP)
+		{
+		 PFerrno = PFE_READONLY;
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+                }
+
+	/* changes to compressed nodes decode them off the stack */
+	if (AM_Compressed(attrType,attrLength))
+		{
+		 errVal = AM_CReserve();
+		 AM_Check;
+		}
 	
 	
 	/* Search the leaf for the key */
-	status = AM_Search(fileDesc,attrType,attrLength,value,&pageNum,
+	AM_InitHandle(&handle,fileDesc);
+	status = AM_Search(&handle,attrType,attrLength,value,&pageNum,
 			   &pageBuf,&index);
 
 
@@ -293,7 +380,6 @@ int recId; /* recId to be inserted */
 	/* check if there is an error */
 	if (status < 0) 
 	{ 
-		AM_EmptyStack();
 		AM_Errno = status;
 		return(status);
 	}
@@ -307,14 +393,12 @@ int recId; /* recId to be inserted */
 	{
 		errVal = PF_UnfixPage(fileDesc,pageNum,TRUE);
 		AM_Check;
-		AM_EmptyStack();
 		return(AME_OK);
 	}
 	
 	/* check if there is any error */
 	if (inserted < 0) 
 	{
-		AM_EmptyStack();
 		AM_Errno = inserted;
 		return(inserted);
 	}
@@ -323,32 +407,28 @@ int recId; /* recId to be inserted */
 	if (inserted == FALSE)
 	{
 		/* Split the leaf page */
-		addtoparent = AM_SplitLeaf(fileDesc,pageBuf,&pageNum,
+		PF_StatsCount(PF_CNT_AMSPLIT,1L);
+		addtoparent = AM_SplitLeaf(&handle,pageBuf,&pageNum,
 			     attrLength,recId,value, status,index,key);
 		
 		/* check for errors */
 		if (addtoparent < 0) 
 		{
-			AM_EmptyStack();
-			{
-			 AM_Errno = addtoparent;
-			 return(addtoparent);
-                        }
+			AM_Errno = addtoparent;
+			return(addtoparent);
 		}
 		
 		/* if key has to be added to the parent */
 		if (addtoparent == TRUE)
 		{
-			errVal = AM_AddtoParent(fileDesc,pageNum,key,attrLength);
+			errVal = AM_AddtoParent(&handle,pageNum,key,attrLength);
 			if (errVal < 0)
 			{
-				AM_EmptyStack();
 				AM_Errno = errVal;
 				return(errVal);
 			}
 		}
 	}
-	AM_EmptyStack();
 	return(AME_OK);
 }
 
@@ -366,11 +446,19 @@ static char *AMerrormsg[] = {
 "Scan Table is full",
 "Invalid Attribute Type",
 "Invalid file Descriptor",
-"Invalid value to Delete or Insert Entry"
+"Invalid value to Delete or Insert Entry",
+"Index to bulk load is not empty",
+"Bulk load input is not in key order",
+"Too many recIds for one key to fit on a leaf",
+"Invalid fill factor to bulk load",
+"Sort error while reading the bulk load input",
+"Heap file error while fetching records",
+"Invalid page size for an index",
+"Not a hash index"
 };
 
 
-AM_PrintError(s)
+void AM_PrintError(s)
 char *s;
 
 {
@@ -1,6 +1,22 @@
+
 # include "am.h"
+# include "pf.h"
+
+__thread int AM_Errno;
+__thread int AM_PageSize = PF_PAGE_SIZE;
+
+
+/* Makes the index open as fileDesc the one this thread works on: sets
+AM_PageSize to the size of its nodes. Returns PFE_OK, or the PF error if
+fileDesc is not an open file */
+AM_UseIndex(fileDesc)
+int fileDesc;
 
-int AM_RootPageNum = 0;
-int AM_LeftPageNum = 0;
-int AM_Errno;
+{
+	int pageSize;
 
+	if ((pageSize = PF_PageSize(fileDesc)) < 0)
+		return(pageSize);
+	AM_PageSize = AM_NodeSize(pageSize);
+	return(PFE_OK);
+}
@@ -0,0 +1,892 @@
+# include <stdio.h>
+# include <pthread.h>
+# include "am.h"
+# include "pf.h"
+
+/* A hash index keeps the (key,recId) entries of each key in the bucket the
+hash of the key picks, by linear hashing. Page 0 of the file has an
+AM_HASHHEADER, followed by the first page number of each segment of
+buckets. A bucket is a page of entries, with a chain of overflow pages
+once it is full; the buckets of a segment are on consecutive pages, so
+that page 0 alone tells where each one is. The first AM_HSEGGROUP
+segments have AM_HSEGMENT buckets each, the next AM_HSEGGROUP twice as
+many, and so on.
+
+There are (AM_HSEGMENT << level) + next buckets. A key goes to bucket
+hash mod (AM_HSEGMENT << level), or mod twice that if this is below next:
+the buckets below next have been split already. Whenever the entries
+would fill more than AM_HFILL percent of the buckets, bucket next is
+split: its entries are shared with the new bucket next + (AM_HSEGMENT <<
+level), and next moves on. So the index grows one bucket at a time, never
+rehashing all of it, and an equality lookup fixes the page of its bucket,
+and the overflow pages of the bucket only if it has some: page 0 is taken
+from a copy kept for each open index, made by the first call on it and
+brought up to date by every call that changes it.
+
+As for the B+-tree, lookups of an index may run at the same time in
+different threads, but calls that change an index must have it to
+themselves. */
+
+# define AM_HSEGMENT 8 /* buckets of the first segments, and of a new index */
+# define AM_HSEGGROUP 8 /* segments of each size */
+# define AM_HFILL 60 /* % of the room of the buckets the entries may fill */
+# define AM_HashSegSize(segment) (AM_HSEGMENT << ((segment)/AM_HSEGGROUP))
+
+typedef struct am_hashheader
+	{
+		char pageType; /* 'h' */
+		char attrType;
+		short attrLength;
+		int level; /* times the number of buckets has doubled */
+		int next; /* next bucket to split */
+		int numEntries; /* entries in the index */
+		int numSegments; /* segments of buckets allocated */
+		int freePage; /* first overflow page given back, or
+				 AM_NULL_PAGE */
+	} AM_HASHHEADER; /* Header of page 0 of a hash index */
+
+typedef struct am_bucketheader
+	{
+		char pageType; /* 'b' */
+		short numEntries;
+		int nextPage; /* next page of the bucket, or AM_NULL_PAGE */
+	} AM_BUCKETHEADER; /* Header of a page of a bucket */
+
+# define AM_shash sizeof(AM_HASHHEADER)
+# define AM_sbucket sizeof(AM_BUCKETHEADER)
+
+/* State of one call on a hash index, with page 0 fixed or its copy in
+use */
+typedef struct am_hashhandle
+	{
+		int fileDesc;
+		int fixed; /* whether metaBuf is page 0, or else its copy */
+		char *metaBuf; /* page 0 */
+		AM_HASHHEADER header; /* copy of its header */
+		int entrySize; /* bytes of an entry: the key, then the recId */
+		int perPage; /* entries a page of a bucket holds */
+		int maxSegments; /* segments page 0 has room for */
+	} AM_HASHHANDLE;
+
+/* Copy of page 0 of an open hash index, for lookups. As for the descent
+cache, an index opened again starts without one, and lookups in several
+threads share it: AM_hashlock is held for reading while it is in use,
+and for writing while it is changed. */
+typedef struct am_hashcopy
+	{
+		int stamp; /* PF_FileStamp of the file it is of, or 0 */
+		int pageSize; /* room in page */
+		char *page; /* the copy */
+	} AM_HASHCOPY;
+
+static AM_HASHCOPY AM_HashCopies[AM_MAXCACHED]; /* of each file descriptor */
+static pthread_rwlock_t AM_hashlock = PTHREAD_RWLOCK_INITIALIZER;
+
+
+/* Returns the hash of value */
+static unsigned int AM_HashKey(value,attrType,attrLength)
+char *value;
+char attrType;
+int attrLength;
+
+{
+	unsigned int hash;
+	float floatVal;
+	int i;
+
+	if (attrType == 'f')
+	{
+		/* 0 and -0 are the same key */
+		bcopy(value,(char *)&floatVal,AM_sf);
+		if (floatVal == 0)
+		{
+			floatVal = 0;
+			value = (char *)&floatVal;
+		}
+	}
+
+	/* FNV-1a, on char keys up to their first null as AM_Compare */
+	hash = 2166136261u;
+	for (i = 0; i < attrLength; i++)
+	{
+		if ((attrType == 'c') && (value[i] == '\0'))
+			break;
+		hash = (hash ^ (unsigned char)value[i])*16777619u;
+	}
+
+	/* mix the high bits into the low ones the buckets are taken from */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+	return(hash);
+}
+
+
+/* Returns the bucket of a key of hash hash */
+static AM_HashBucket(header,hash)
+AM_HASHHEADER *header;
+unsigned int hash;
+
+{
+	unsigned int bucket;
+
+	bucket = hash & ((AM_HSEGMENT << header->level) - 1);
+	if (bucket < header->next)
+		bucket = hash & ((AM_HSEGMENT << (header->level + 1)) - 1);
+	return(bucket);
+}
+
+
+/* Returns the page number of bucket */
+static AM_HashPage(handle,bucket)
+AM_HASHHANDLE *handle;
+int bucket;
+
+{
+	int group; /* group of AM_HSEGGROUP segments of the same size */
+	int first; /* first page of the segment */
+
+	for (group = 0; bucket >= (AM_HSEGGROUP*AM_HSEGMENT) << group; group++)
+		bucket -= (AM_HSEGGROUP*AM_HSEGMENT) << group;
+	bcopy(handle->metaBuf + AM_shash +
+	      (group*AM_HSEGGROUP + bucket/(AM_HSEGMENT << group))*AM_si,
+	      (char *)&first,AM_si);
+	return(first + bucket % (AM_HSEGMENT << group));
+}
+
+
+/* Makes handle->metaBuf the copy of page 0 of fileDesc, and returns TRUE
+with AM_hashlock held for reading; returns FALSE if there is no copy for
+this opening of the file descriptor. */
+static AM_HashGetCopy(handle,fileDesc)
+AM_HASHHANDLE *handle;
+int fileDesc;
+
+{
+	AM_HASHCOPY *copy;
+
+	if (fileDesc >= AM_MAXCACHED)
+		return(FALSE);
+	pthread_rwlock_rdlock(&AM_hashlock);
+	copy = &AM_HashCopies[fileDesc];
+	if ((copy->page != NULL) && (copy->stamp == PF_FileStamp(fileDesc)))
+	{
+		handle->metaBuf = copy->page;
+		return(TRUE);
+	}
+	pthread_rwlock_unlock(&AM_hashlock);
+	return(FALSE);
+}
+
+
+/* Copies page 0, fixed for handle, for the lookups to come. Without
+memory for it, there is no copy. */
+static void AM_HashKeepCopy(handle)
+AM_HASHHANDLE *handle;
+
+{
+	AM_HASHCOPY *copy;
+	int stamp;
+	int pageSize;
+	char *page;
+
+	if (handle->fileDesc >= AM_MAXCACHED)
+		return;
+	stamp = PF_FileStamp(handle->fileDesc);
+	pageSize = PF_PageSize(handle->fileDesc);
+	if ((stamp < 0) || (pageSize < 0))
+		return;
+
+	pthread_rwlock_wrlock(&AM_hashlock);
+	copy = &AM_HashCopies[handle->fileDesc];
+	copy->stamp = 0;
+	if (pageSize > copy->pageSize)
+	{
+		page = realloc(copy->page,pageSize);
+		if (page != NULL)
+		{
+			copy->page = page;
+			copy->pageSize = pageSize;
+		}
+	}
+	if (pageSize <= copy->pageSize)
+	{
+		bcopy(handle->metaBuf,copy->page,pageSize);
+		copy->stamp = stamp;
+	}
+	pthread_rwlock_unlock(&AM_hashlock);
+}
+
+
+/* Checks the parameters of a call on the hash index fileDesc, fixes its
+page 0, or for a lookup takes its copy if there is one, and sets up
+handle. Returns AME_OK, or an AM error code with neither in use. */
+static AM_HashOpen(handle,fileDesc,attrType,attrLength,value,change)
+AM_HASHHANDLE *handle;
+int fileDesc;
+char attrType;
+int attrLength;
+char *value;
+int change; /* whether the call changes the index */
+
+{
+	int errVal;
+	int pageSize;
+
+	if ((attrType != 'c') && (attrType != 'f') && (attrType != 'i'))
+		{
+		 AM_Errno = AME_INVALIDATTRTYPE;
+		 return(AME_INVALIDATTRTYPE);
+		}
+
+	if (value == NULL)
+		{
+		 AM_Errno = AME_INVALIDVALUE;
+		 return(AME_INVALIDVALUE);
+		}
+
+	if (fileDesc < 0)
+		{
+		 AM_Errno = AME_FD;
+		 return(AME_FD);
+		}
+
+	/* the index cannot be changed through a read-only mapping */
+	if (change && (PF_FileMode(fileDesc) == PF_MODE_MMAP))
+		{
+		 PFerrno = PFE_READONLY;
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+		}
+
+	pageSize = PF_PageSize(fileDesc);
+	handle->fileDesc = fileDesc;
+	handle->fixed = change || !AM_HashGetCopy(handle,fileDesc);
+	if (handle->fixed)
+		{
+		 errVal = (pageSize < 0) ? pageSize :
+			PF_GetThisPage(fileDesc,0,&handle->metaBuf);
+		 AM_Check;
+		}
+	bcopy(handle->metaBuf,(char *)&handle->header,AM_shash);
+	if (handle->header.pageType != 'h')
+		errVal = AME_NOTHASH;
+	else if (handle->header.attrType != attrType)
+		errVal = AME_INVALIDATTRTYPE;
+	else if (handle->header.attrLength != attrLength)
+		errVal = AME_INVALIDATTRLENGTH;
+	else
+		errVal = AME_OK;
+	if (errVal != AME_OK)
+		{
+		 if (handle->fixed)
+			PF_UnfixPage(fileDesc,0,FALSE);
+		 else
+			pthread_rwlock_unlock(&AM_hashlock);
+		 AM_Errno = errVal;
+		 return(errVal);
+		}
+
+	handle->entrySize = attrLength + AM_si;
+	handle->perPage = (pageSize - AM_sbucket)/handle->entrySize;
+	handle->maxSegments = (pageSize - AM_shash)/AM_si;
+	return(AME_OK);
+}
+
+
+/* Writes the header back, brings the copy of page 0 up to date and
+unfixes the page, or is done with the copy; returns errVal, or the PF
+error if that fails */
+static AM_HashClose(handle,errVal,dirty)
+AM_HASHHANDLE *handle;
+int errVal;
+int dirty; /* whether the header has changed */
+
+{
+	if (!handle->fixed)
+		{
+		 pthread_rwlock_unlock(&AM_hashlock);
+		 return(errVal);
+		}
+	if (dirty)
+		bcopy((char *)&handle->header,handle->metaBuf,AM_shash);
+	AM_HashKeepCopy(handle);
+	if ((PF_UnfixPage(handle->fileDesc,0,dirty) != PFE_OK) &&
+	    (errVal == AME_OK))
+		{
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+		}
+	return(errVal);
+}
+
+
+/* Gets an empty page for the end of a bucket, one given back if there
+is one, and leaves it fixed in *pageBuf */
+static AM_HashNewPage(handle,pageNum,pageBuf)
+AM_HASHHANDLE *handle;
+int *pageNum;
+char **pageBuf;
+
+{
+	AM_BUCKETHEADER bucket;
+	int errVal;
+
+	if (handle->header.freePage != AM_NULL_PAGE)
+	{
+		*pageNum = handle->header.freePage;
+		errVal = PF_GetThisPage(handle->fileDesc,*pageNum,pageBuf);
+		AM_Check;
+		bcopy(*pageBuf,(char *)&bucket,AM_sbucket);
+		handle->header.freePage = bucket.nextPage;
+	}
+	else
+	{
+		errVal = PF_AllocPage(handle->fileDesc,pageNum,pageBuf);
+		AM_Check;
+	}
+	bucket.pageType = 'b';
+	bucket.numEntries = 0;
+	bucket.nextPage = AM_NULL_PAGE;
+	bcopy((char *)&bucket,*pageBuf,AM_sbucket);
+	return(AME_OK);
+}
+
+
+/* Allocates the next segment of empty buckets. Returns AME_OK, and
+AME_KEYLISTFULL if page 0 has no room left for it. */
+static AM_HashAddSegment(handle)
+AM_HASHHANDLE *handle;
+
+{
+	AM_BUCKETHEADER bucket;
+	char *pageBuf;
+	int first; /* first page of the segment */
+	int pageNum;
+	int errVal;
+	int i;
+
+	if (handle->header.numSegments >= handle->maxSegments)
+		{
+		 AM_Errno = AME_KEYLISTFULL;
+		 return(AME_KEYLISTFULL);
+		}
+
+	/* pages are never given back to PF, so that they are allocated one
+	after the other at the end of the file */
+	bucket.pageType = 'b';
+	bucket.numEntries = 0;
+	bucket.nextPage = AM_NULL_PAGE;
+	for (i = 0; i < AM_HashSegSize(handle->header.numSegments); i++)
+	{
+		errVal = PF_AllocPage(handle->fileDesc,&pageNum,&pageBuf);
+		AM_Check;
+		bcopy((char *)&bucket,pageBuf,AM_sbucket);
+		errVal = PF_UnfixPage(handle->fileDesc,pageNum,TRUE);
+		AM_Check;
+		if (i == 0)
+			first = pageNum;
+		else if (pageNum != first + i)
+			{
+			 AM_Errno = AME_INTERROR;
+			 return(AME_INTERROR);
+			}
+	}
+	bcopy((char *)&first,handle->metaBuf + AM_shash +
+	      handle->header.numSegments*AM_si,AM_si);
+	handle->header.numSegments++;
+	return(AME_OK);
+}
+
+
+/* Adds entry to the bucket that starts on page pageNum */
+static AM_HashPut(handle,pageNum,entry)
+AM_HASHHANDLE *handle;
+int pageNum;
+char *entry;
+
+{
+	AM_BUCKETHEADER bucket;
+	char *pageBuf;
+	char *newBuf;
+	int newPage;
+	int errVal;
+
+	/* find a page of the bucket with room, or add one to it */
+	for (;;)
+	{
+		errVal = PF_GetThisPage(handle->fileDesc,pageNum,&pageBuf);
+		AM_Check;
+		bcopy(pageBuf,(char *)&bucket,AM_sbucket);
+		if (bucket.numEntries < handle->perPage)
+			break;
+		if (bucket.nextPage == AM_NULL_PAGE)
+		{
+			errVal = AM_HashNewPage(handle,&newPage,&newBuf);
+			if (errVal != AME_OK)
+			{
+				PF_UnfixPage(handle->fileDesc,pageNum,FALSE);
+				return(errVal);
+			}
+			bucket.nextPage = newPage;
+			bcopy((char *)&bucket,pageBuf,AM_sbucket);
+			errVal = PF_UnfixPage(handle->fileDesc,pageNum,TRUE);
+			AM_Check;
+			pageNum = newPage;
+			pageBuf = newBuf;
+			bcopy(pageBuf,(char *)&bucket,AM_sbucket);
+			break;
+		}
+		errVal = PF_UnfixPage(handle->fileDesc,pageNum,FALSE);
+		AM_Check;
+		pageNum = bucket.nextPage;
+	}
+
+	bcopy(entry,pageBuf + AM_sbucket + bucket.numEntries*handle->entrySize,
+	      handle->entrySize);
+	bucket.numEntries++;
+	bcopy((char *)&bucket,pageBuf,AM_sbucket);
+	errVal = PF_UnfixPage(handle->fileDesc,pageNum,TRUE);
+	AM_Check;
+	return(AME_OK);
+}
+
+
+/* Puts the numEntries entries in entries on the bucket that starts on
+page first, in place of the ones it has, and gives back the overflow
+pages it no longer needs. The bucket must have room for them. */
+static AM_HashRewrite(handle,first,entries,numEntries)
+AM_HASHHANDLE *handle;
+int first; /* first page of the bucket */
+char *entries;
+int numEntries;
+
+{
+	AM_BUCKETHEADER bucket;
+	char *pageBuf;
+	int pageNum;
+	int nextPage;
+	int errVal;
+
+	for (pageNum = first; pageNum != AM_NULL_PAGE; pageNum = nextPage)
+	{
+		errVal = PF_GetThisPage(handle->fileDesc,pageNum,&pageBuf);
+		AM_Check;
+		bcopy(pageBuf,(char *)&bucket,AM_sbucket);
+		nextPage = bucket.nextPage;
+		if ((pageNum == first) || (numEntries > 0))
+		{
+			bucket.numEntries = (numEntries < handle->perPage) ?
+				numEntries : handle->perPage;
+			bcopy(entries,pageBuf + AM_sbucket,
+			      bucket.numEntries*handle->entrySize);
+			entries += bucket.numEntries*handle->entrySize;
+			numEntries -= bucket.numEntries;
+			if (numEntries == 0)
+				bucket.nextPage = AM_NULL_PAGE;
+		}
+		else
+		{
+			/* a page the bucket no longer needs */
+			bucket.numEntries = 0;
+			bucket.nextPage = handle->header.freePage;
+			handle->header.freePage = pageNum;
+		}
+		bcopy((char *)&bucket,pageBuf,AM_sbucket);
+		errVal = PF_UnfixPage(handle->fileDesc,pageNum,TRUE);
+		AM_Check;
+	}
+	if (numEntries > 0)
+		{
+		 AM_Errno = AME_INTERROR;
+		 return(AME_INTERROR);
+		}
+	return(AME_OK);
+}
+
+
+/* Splits bucket next, moving the entries that now hash to the new bucket
+to it. They are written there before the split bucket is cut down to the
+entries it keeps, which then fill as many of its pages as they need; the
+overflow pages left over are given back. */
+static AM_HashSplit(handle)
+AM_HASHHANDLE *handle;
+
+{
+	AM_HASHHEADER *header;
+	AM_BUCKETHEADER bucket;
+	char *pageBuf;
+	char *entries; /* the entries of the bucket */
+	char *newEntries;
+	char *entry;
+	int numEntries;
+	int numKept; /* entries that stay, at the front of entries */
+	int room; /* entries there is room for in entries */
+	int first; /* first page of the bucket */
+	int newFirst; /* first page of the new bucket */
+	int newBucket;
+	int pageNum;
+	int numBuckets; /* buckets there are pages for */
+	int errVal;
+	int i;
+
+	header = &handle->header;
+	numBuckets = 0;
+	for (i = 0; i < header->numSegments; i++)
+		numBuckets += AM_HashSegSize(i);
+	newBucket = header->next + (AM_HSEGMENT << header->level);
+	if (newBucket >= numBuckets)
+	{
+		if (header->numSegments >= handle->maxSegments)
+			/* no more buckets: the chains just get longer */
+			return(AME_OK);
+		errVal = AM_HashAddSegment(handle);
+		if (errVal != AME_OK)
+			return(errVal);
+	}
+
+	/* read the entries of the bucket */
+	first = pageNum = AM_HashPage(handle,header->next);
+	newFirst = AM_HashPage(handle,newBucket);
+	entries = NULL;
+	numEntries = room = 0;
+	while (pageNum != AM_NULL_PAGE)
+	{
+		errVal = PF_GetThisPage(handle->fileDesc,pageNum,&pageBuf);
+		if (errVal != PFE_OK)
+			break;
+		bcopy(pageBuf,(char *)&bucket,AM_sbucket);
+		if (numEntries + bucket.numEntries > room)
+		{
+			room = numEntries + handle->perPage;
+			newEntries = realloc(entries,room*handle->entrySize);
+			if (newEntries == NULL)
+			{
+				PF_UnfixPage(handle->fileDesc,pageNum,FALSE);
+				PFerrno = PFE_NOMEM;
+				errVal = PFE_NOMEM;
+				break;
+			}
+			entries = newEntries;
+		}
+		bcopy(pageBuf + AM_sbucket,entries + numEntries*handle->entrySize,
+		      bucket.numEntries*handle->entrySize);
+		numEntries += bucket.numEntries;
+		errVal = PF_UnfixPage(handle->fileDesc,pageNum,FALSE);
+		if (errVal != PFE_OK)
+			break;
+		pageNum = bucket.nextPage;
+	}
+	if (errVal != PFE_OK)
+	{
+		free(entries);
+		AM_Errno = AME_PF;
+		return(AME_PF);
+	}
+
+	/* the split bucket and the new one now hash by one more bit */
+	if (++header->next == (AM_HSEGMENT << header->level))
+	{
+		header->level++;
+		header->next = 0;
+	}
+
+	/* the entries that move go to the new bucket first */
+	errVal = AME_OK;
+	numKept = 0;
+	for (i = 0; (i < numEntries) && (errVal == AME_OK); i++)
+	{
+		entry = entries + i*handle->entrySize;
+		if (AM_HashBucket(header,AM_HashKey(entry,header->attrType,
+		    header->attrLength)) == newBucket)
+			errVal = AM_HashPut(handle,newFirst,entry);
+		else
+		{
+			if (numKept != i)
+				bcopy(entry,entries + numKept*handle->entrySize,
+				      handle->entrySize);
+			numKept++;
+		}
+	}
+	if (errVal != AME_OK)
+	{
+		/* the split bucket is as it was: split it later */
+		if (header->next-- == 0)
+		{
+			header->level--;
+			header->next = (AM_HSEGMENT << header->level) - 1;
+		}
+		AM_HashRewrite(handle,newFirst,entries,0);
+		free(entries);
+		return(errVal);
+	}
+
+	/* only then is the split bucket cut down to the entries it keeps */
+	errVal = AM_HashRewrite(handle,first,entries,numKept);
+	free(entries);
+	return(errVal);
+}
+
+
+/* Creates a hash index file called fileName.indexNo, for exact match
+lookups of its keys */
+AM_CreateHashIndex(fileName,indexNo,attrType,attrLength)
+char *fileName; /* Name of indexed file */
+int indexNo; /* number of this index for file */
+char attrType; /* 'c' for char ,'i' for int ,'f' for float */
+int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+
+{
+	char indexfName[AM_MAX_FNAME_LENGTH];
+	AM_HASHHANDLE handle;
+	int pageNum;
+	int errVal;
+
+	/* Check the parameters */
+	if ((attrType != 'c') && (attrType != 'f') && (attrType != 'i'))
+		{
+		 AM_Errno = AME_INVALIDATTRTYPE;
+		 return(AME_INVALIDATTRTYPE);
+		}
+
+	if ((attrLength < 1) || (attrLength > 255) ||
+	    ((attrType != 'c') && (attrLength != 4)))
+		{
+		 AM_Errno = AME_INVALIDATTRLENGTH;
+		 return(AME_INVALIDATTRLENGTH);
+		}
+
+	sprintf(indexfName,"%s.%d",fileName,indexNo);
+	errVal = PF_CreateFile(indexfName);
+	AM_Check;
+	handle.fileDesc = PF_OpenFile(indexfName);
+	if (handle.fileDesc < 0)
+		{
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+		}
+
+	/* page 0 has the header, and the first segment comes after it */
+	errVal = PF_AllocPage(handle.fileDesc,&pageNum,&handle.metaBuf);
+	if (errVal != PFE_OK)
+		{
+		 PF_CloseFile(handle.fileDesc);
+		 PF_DestroyFile(indexfName);
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+		}
+	handle.fixed = TRUE;
+	handle.header.pageType = 'h';
+	handle.header.attrType = attrType;
+	handle.header.attrLength = attrLength;
+	handle.header.level = 0;
+	handle.header.next = 0;
+	handle.header.numEntries = 0;
+	handle.header.numSegments = 0;
+	handle.header.freePage = AM_NULL_PAGE;
+	handle.maxSegments = (PF_PageSize(handle.fileDesc) - AM_shash)/AM_si;
+	errVal = (pageNum != 0) ? AME_INTERROR : AM_HashAddSegment(&handle);
+	errVal = AM_HashClose(&handle,errVal,TRUE);
+	if (errVal != AME_OK)
+		{
+		 PF_CloseFile(handle.fileDesc);
+		 PF_DestroyFile(indexfName);
+		 AM_Errno = errVal;
+		 return(errVal);
+		}
+
+	errVal = PF_CloseFile(handle.fileDesc);
+	AM_Check;
+	return(AME_OK);
+}
+
+
+/* Adds the entry (value,recId) to the hash index fileDesc */
+AM_InsertHashEntry(fileDesc,attrType,attrLength,value,recId)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'i' or 'c' or 'f' */
+int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+char *value; /* value to be inserted */
+int recId; /* recId to be inserted */
+
+{
+	AM_HASHHANDLE handle;
+	char entry[AM_MAXATTRLENGTH + sizeof(int)];
+	int numBuckets;
+	int errVal;
+
+	errVal = AM_HashOpen(&handle,fileDesc,attrType,attrLength,value,TRUE);
+	if (errVal != AME_OK)
+		return(errVal);
+
+	bcopy(value,entry,attrLength);
+	bcopy((char *)&recId,entry + attrLength,AM_si);
+	errVal = AM_HashPut(&handle,AM_HashPage(&handle,
+		AM_HashBucket(&handle.header,
+		AM_HashKey(value,attrType,attrLength))),entry);
+	if (errVal == AME_OK)
+	{
+		handle.header.numEntries++;
+		numBuckets = (AM_HSEGMENT << handle.header.level) +
+			handle.header.next;
+		if ((long)handle.header.numEntries*100 >
+		    (long)numBuckets*handle.perPage*AM_HFILL)
+			errVal = AM_HashSplit(&handle);
+	}
+	return(AM_HashClose(&handle,errVal,TRUE));
+}
+
+
+/* Deletes the entry (value,recId) from the hash index fileDesc */
+AM_DeleteHashEntry(fileDesc,attrType,attrLength,value,recId)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'c' , 'i' or 'f' */
+int attrLength; /* 4 for 'i' or 'f' , 1-255 for 'c' */
+char *value; /* Value of key whose corr recId is to be deleted */
+int recId; /* id of the record to delete */
+
+{
+	AM_HASHHANDLE handle;
+	AM_BUCKETHEADER bucket;
+	char *pageBuf;
+	char *entry;
+	int pageNum;
+	int prevPage; /* page of the bucket before pageNum, or AM_NULL_PAGE */
+	int nextPage;
+	int entryRecId;
+	int errVal;
+	int i;
+
+	errVal = AM_HashOpen(&handle,fileDesc,attrType,attrLength,value,TRUE);
+	if (errVal != AME_OK)
+		return(errVal);
+
+	pageNum = AM_HashPage(&handle,AM_HashBucket(&handle.header,
+		AM_HashKey(value,attrType,attrLength)));
+	prevPage = AM_NULL_PAGE;
+	while (pageNum != AM_NULL_PAGE)
+	{
+		errVal = PF_GetThisPage(fileDesc,pageNum,&pageBuf);
+		if (errVal != PFE_OK)
+			return(AM_HashClose(&handle,AME_PF,FALSE));
+		bcopy(pageBuf,(char *)&bucket,AM_sbucket);
+		for (i = 0; i < bucket.numEntries; i++)
+		{
+			entry = pageBuf + AM_sbucket + i*handle.entrySize;
+			bcopy(entry + attrLength,(char *)&entryRecId,AM_si);
+			if ((entryRecId == recId) &&
+			    (AM_Compare(entry,attrType,attrLength,value) == 0))
+				break;
+		}
+		if (i < bucket.numEntries)
+			break;
+		errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+		if (errVal != PFE_OK)
+			return(AM_HashClose(&handle,AME_PF,FALSE));
+		prevPage = pageNum;
+		pageNum = bucket.nextPage;
+	}
+	if (pageNum == AM_NULL_PAGE)
+	{
+		AM_Errno = AME_NOTFOUND;
+		return(AM_HashClose(&handle,AME_NOTFOUND,FALSE));
+	}
+
+	/* the last entry of the page takes the place of the one deleted */
+	bucket.numEntries--;
+	bcopy(pageBuf + AM_sbucket + bucket.numEntries*handle.entrySize,entry,
+	      handle.entrySize);
+	nextPage = bucket.nextPage;
+	if ((bucket.numEntries == 0) && (prevPage != AM_NULL_PAGE))
+	{
+		/* give back the empty overflow page */
+		bucket.nextPage = handle.header.freePage;
+		handle.header.freePage = pageNum;
+	}
+	else
+		prevPage = AM_NULL_PAGE;
+	bcopy((char *)&bucket,pageBuf,AM_sbucket);
+	errVal = PF_UnfixPage(fileDesc,pageNum,TRUE);
+	if ((errVal == PFE_OK) && (prevPage != AM_NULL_PAGE))
+	{
+		errVal = PF_GetThisPage(fileDesc,prevPage,&pageBuf);
+		if (errVal == PFE_OK)
+		{
+			bcopy(pageBuf,(char *)&bucket,AM_sbucket);
+			bucket.nextPage = nextPage;
+			bcopy((char *)&bucket,pageBuf,AM_sbucket);
+			errVal = PF_UnfixPage(fileDesc,prevPage,TRUE);
+		}
+	}
+	handle.header.numEntries--;
+	if (errVal != PFE_OK)
+		AM_Errno = errVal = AME_PF;
+	return(AM_HashClose(&handle,errVal,TRUE));
+}
+
+
+/* Calls found as (*found)(arg,recId) for every recId of value in the hash
+index fileDesc, and returns how many there were. found must not change
+the index; if it returns other than AME_OK the lookup stops, and returns
+what it returned. */
+AM_LookupHashEntry(fileDesc,attrType,attrLength,value,found,arg)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'i' or 'c' or 'f' */
+int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+char *value; /* value to be looked up */
+int (*found)(); /* called for each recId found */
+char *arg; /* passed on to found */
+
+{
+	AM_HASHHANDLE handle;
+	AM_BUCKETHEADER bucket;
+	char *pageBuf;
+	char *entry;
+	int pageNum;
+	int recId;
+	int numFound;
+	int errVal;
+	int i;
+
+	if (found == NULL)
+		{
+		 AM_Errno = AME_INVALIDVALUE;
+		 return(AME_INVALIDVALUE);
+		}
+	errVal = AM_HashOpen(&handle,fileDesc,attrType,attrLength,value,FALSE);
+	if (errVal != AME_OK)
+		return(errVal);
+	pageNum = AM_HashPage(&handle,AM_HashBucket(&handle.header,
+		AM_HashKey(value,attrType,attrLength)));
+	errVal = AM_HashClose(&handle,AME_OK,FALSE);
+	if (errVal != AME_OK)
+		return(errVal);
+
+	numFound = 0;
+	while (pageNum != AM_NULL_PAGE)
+	{
+		errVal = PF_GetThisPage(fileDesc,pageNum,&pageBuf);
+		AM_Check;
+		bcopy(pageBuf,(char *)&bucket,AM_sbucket);
+		for (i = 0; (i < bucket.numEntries) && (errVal == AME_OK); i++)
+		{
+			entry = pageBuf + AM_sbucket + i*handle.entrySize;
+			if (AM_Compare(entry,attrType,attrLength,value) != 0)
+				continue;
+			bcopy(entry + attrLength,(char *)&recId,AM_si);
+			errVal = (*found)(arg,recId);
+			numFound++;
+		}
+		if (PF_UnfixPage(fileDesc,pageNum,FALSE) != PFE_OK)
+			{
+			 AM_Errno = AME_PF;
+			 return(AME_PF);
+			}
+		if (errVal != AME_OK)
+			return(errVal);
+		pageNum = bucket.nextPage;
+	}
+	return(numFound);
+}
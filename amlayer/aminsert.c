@@ -13,11 +13,16 @@ int status;/* Whether key is a new key or an old key */
 
 {
 	int recSize;
-	char tempPage[PF_PAGE_SIZE];
+	char tempPage[AM_MAXPAGESIZE];
 	AM_LEAFHEADER head,*header;
 	int errVal;
 
 
+	/* compressed leaves keep keys their own way */
+	if (*pageBuf == 'L')
+		return(AM_CInsertintoLeaf(pageBuf,attrLength,value,recId,index,
+					  status));
+
 	/* initialise the header */
 	header = &head;
 	bcopy(pageBuf,header,AM_sl);
@@ -68,7 +73,7 @@ int status;/* Whether key is a new key or an old key */
 		/* Compact the freelist so that we get enough space in the middle                   so that the new key can be inserted */
 		AM_Compact(1,header->numKeys,pageBuf,tempPage,header);
 		
-		bcopy(tempPage,pageBuf,PF_PAGE_SIZE);
+		bcopy(tempPage,pageBuf,AM_PageSize);
 		bcopy(pageBuf,header,AM_sl);
 		/* Insert into leaf a new key - no need to split */
 		AM_InsertToLeafNotFound(pageBuf,value,recId,index,header);
@@ -92,8 +97,10 @@ AM_LEAFHEADER *header;
 	int recSize;
 	short tempPtr;
 	short oldhead;
+	int keySize; /* bytes of a slot before the head of its list */
 
-	recSize = header->attrLength + AM_ss;
+	keySize = AM_KeySize(header->pageType,header->attrLength);
+	recSize = keySize + AM_ss;
 	if ((header->freeListPtr) == 0)
 	{
 		header->recIdPtr = header->recIdPtr - AM_si - AM_ss;
@@ -108,12 +115,12 @@ AM_LEAFHEADER *header;
 	}
 	
 	/* save  the old head of recId list */
-	bcopy(pageBuf+AM_sl+(index-1)*recSize + header->attrLength,
+	bcopy(pageBuf+AM_sl+(index-1)*recSize + keySize,
 	      (char *)&oldhead, AM_ss);
 
         /* Update the head of recId list to the new recid to be added */
 	bcopy((char *)  &tempPtr,pageBuf+AM_sl + (index-1)*recSize + 
-	       header->attrLength,AM_ss);
+	       keySize,AM_ss);
 
         /* Copy the recId*/
 	bcopy((char *)&recId,pageBuf + tempPtr,AM_si);
@@ -181,7 +188,7 @@ AM_LEAFHEADER *header;
 	bcopy(header,tempheader,AM_sl);
 	
 	recSize = header->attrLength + AM_ss;
-	recIdPtr = PF_PAGE_SIZE - AM_si - AM_ss ;
+	recIdPtr = AM_PageSize - AM_si - AM_ss ;
 
 	for (i = low, j = 1; i <= high; i++,j++)
 	{
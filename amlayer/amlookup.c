@@ -0,0 +1,221 @@
+# include <stdio.h>
+# include "am.h"
+# include "pf.h"
+
+/* A batch lookup finds many keys of an index in key order. A key is
+first looked for on the leaf where the key before it was, then on the
+next AM_BATCHWALK leaves, and only then from the root; keys close
+together in the index so share the fix of their leaf, and the descent. */
+
+int (*AM_SearchKernel())();
+
+
+/* Sorts the n key numbers in order by the keys they stand for, keeping
+equal keys in the order they were given */
+static AM_BatchSort(order,temp,n,keys,attrType,attrLength)
+int *order; /* key numbers to be sorted */
+int *temp; /* room for n key numbers */
+int n;
+char *keys;
+char attrType;
+int attrLength;
+
+{
+	int width; /* length of the runs being merged */
+	int low,mid,high;
+	int i,j,k;
+
+	for (width = 1; width < n; width = 2*width)
+	{
+		for (low = 0; low < n; low = high)
+		{
+			mid = (low + width < n) ? low + width : n;
+			high = (low + 2*width < n) ? low + 2*width : n;
+			i = low;
+			j = mid;
+			for (k = low; k < high; k++)
+				if ((j >= high) || ((i < mid) &&
+				    (AM_Compare(keys + order[i]*attrLength,attrType,
+				     attrLength,keys + order[j]*attrLength) >= 0)))
+					temp[k] = order[i++];
+				else
+					temp[k] = order[j++];
+		}
+		bcopy((char *)temp,(char *)order,n*AM_si);
+	}
+}
+
+
+/* Finds the place of value on a leaf, as AM_Search. *pageNum is the leaf
+fixed in *pageBuf, or AM_NULL_PAGE if there is none; value is not less
+than the key that leaf was found for. */
+static AM_BatchSearch(handle,attrType,attrLength,value,pageNum,pageBuf,
+		      indexPtr)
+AM_INDEXHANDLE *handle;
+char attrType;
+int attrLength;
+char *value;
+int *pageNum;
+char **pageBuf;
+int *indexPtr;
+
+{
+	AM_LEAFHEADER head,*header;
+	char key[AM_MAXATTRLENGTH]; /* last key of the leaf */
+	int walked; /* leaves gone along the leaf chain */
+	int errVal;
+
+	header = &head;
+	for (walked = 0; *pageNum != AM_NULL_PAGE; walked++)
+	{
+		/* every key before this leaf is less than value, so value is
+		here if it is not greater than the last key */
+		bcopy(*pageBuf,header,AM_sl);
+		if (header->numKeys > 0)
+		{
+			AM_GetLeafKey(*pageBuf,header->numKeys,key);
+			if (AM_Compare(key,attrType,attrLength,value) <= 0)
+			{
+				if (header->pageType == 'L')
+					return(AM_CSearchLeaf(*pageBuf,attrLength,
+							      value,indexPtr));
+				return(AM_SearchLeaf(*pageBuf,
+					AM_SearchKernel(attrType),attrLength,
+					value,indexPtr,header));
+			}
+		}
+
+		/* past the last key of the last leaf */
+		if (header->nextLeafPage == AM_NULL_PAGE)
+		{
+			*indexPtr = header->numKeys + 1;
+			return(AM_NOT_FOUND);
+		}
+
+		errVal = PF_UnfixPage(handle->fileDesc,*pageNum,FALSE);
+		*pageNum = AM_NULL_PAGE;
+		AM_Check;
+		if (walked < AM_BATCHWALK)
+		{
+			errVal = PF_GetThisPage(handle->fileDesc,
+						header->nextLeafPage,pageBuf);
+			AM_Check;
+			*pageNum = header->nextLeafPage;
+		}
+	}
+
+	/* too far along: search from the root */
+	AM_InitHandle(handle,handle->fileDesc);
+	errVal = AM_Search(handle,attrType,attrLength,value,pageNum,pageBuf,
+			   indexPtr);
+	if (errVal < 0)
+		*pageNum = AM_NULL_PAGE;
+	return(errVal);
+}
+
+
+/* Looks up the n keys in keys, attrLength bytes apart, and calls found
+for every recId of each key that is in the index, as
+(*found)(arg,i,recId) for the recId of key number i (from 0). Keys are
+looked up in key order, and a key given more than once is looked up that
+many times. found must not change the index; if it returns other than
+AME_OK the lookup stops, and returns what it returned. */
+AM_LookupBatch(fileDesc,attrType,attrLength,keys,n,found,arg)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'i' or 'c' or 'f' */
+int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+char *keys; /* keys to be looked up */
+int n; /* # of keys */
+int (*found)(); /* called for each recId found */
+char *arg; /* passed on to found */
+
+{
+	AM_INDEXHANDLE handle; /* descents of the lookup */
+	int *order; /* key numbers in key order, then room to sort them */
+	char *pageBuf; /* buffer of the leaf fixed */
+	int pageNum; /* leaf fixed, or AM_NULL_PAGE */
+	int index; /* place of the key on the leaf */
+	int status; /* whether the key is in the index */
+	AM_LEAFHEADER head,*header;
+	int keySize; /* bytes of a leaf slot before its recId list */
+	short nextRec; /* next recId on the list of the key */
+	int recId;
+	int errVal;
+	int i,j;
+
+	/* check the parameters */
+	if ((attrType != 'c') && (attrType != 'f') && (attrType != 'i'))
+		{
+		 AM_Errno = AME_INVALIDATTRTYPE;
+		 return(AME_INVALIDATTRTYPE);
+                }
+
+	if ((n < 0) || ((n > 0) && (keys == NULL)) || (found == NULL))
+		{
+		 AM_Errno = AME_INVALIDVALUE;
+		 return(AME_INVALIDVALUE);
+                }
+
+	if (fileDesc < 0)
+		{
+		 AM_Errno = AME_FD;
+		 return(AME_FD);
+                }
+
+	/* work with the node size of this index */
+	errVal = AM_UseIndex(fileDesc);
+	AM_Check;
+
+	if (n == 0)
+		return(AME_OK);
+
+	order = (int *)malloc((unsigned)(2*n*AM_si));
+	if (order == NULL)
+		{
+		 PFerrno = PFE_NOMEM;
+		 AM_Errno = AME_PF;
+		 return(AME_PF);
+		}
+	for (i = 0; i < n; i++)
+		order[i] = i;
+	AM_BatchSort(order,order + n,n,keys,attrType,attrLength);
+
+	header = &head;
+	AM_InitHandle(&handle,fileDesc);
+	pageNum = AM_NULL_PAGE;
+	errVal = AME_OK;
+	for (j = 0; (j < n) && (errVal == AME_OK); j++)
+	{
+		i = order[j];
+		status = AM_BatchSearch(&handle,attrType,attrLength,
+			keys + i*attrLength,&pageNum,&pageBuf,&index);
+		if (status < 0)
+		{
+			errVal = status;
+			break;
+		}
+		if (status != AM_FOUND)
+			continue;
+
+		/* hand over the recIds of the key */
+		bcopy(pageBuf,header,AM_sl);
+		keySize = AM_KeySize(header->pageType,attrLength);
+		bcopy(pageBuf + AM_sl + (index - 1)*(keySize + AM_ss) + keySize,
+		      (char *)&nextRec,AM_ss);
+		while ((nextRec != AM_NULL) && (errVal == AME_OK))
+		{
+			bcopy(pageBuf + nextRec,(char *)&recId,AM_si);
+			bcopy(pageBuf + nextRec + AM_si,(char *)&nextRec,AM_ss);
+			errVal = (*found)(arg,i,recId);
+		}
+	}
+
+	free((char *)order);
+	if ((pageNum != AM_NULL_PAGE) &&
+	    (PF_UnfixPage(fileDesc,pageNum,FALSE) != PFE_OK) &&
+	    (errVal == AME_OK))
+		errVal = AME_PF;
+	if (errVal < 0)
+		AM_Errno = errVal;
+	return(errVal);
+}
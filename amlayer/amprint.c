@@ -8,24 +8,22 @@ char attrType;
 {
 int tempPageint;
 int i;
-int recSize;
+char key[AM_MAXATTRLENGTH];
 AM_INTHEADER *header;
 
 
 header = (AM_INTHEADER *) calloc(1,AM_sint);
 bcopy(pageBuf,header,AM_sint);
-recSize = header->attrLength + AM_si;
 printf("PAGETYPE %c\n",header->pageType);
 printf("NUMKEYS %d\n",header->numKeys);
 printf("MAXKEYS %d\n",header->maxKeys);
 printf("ATTRLENGTH %d\n",header->attrLength);
-bcopy(pageBuf + AM_sint,&tempPageint,AM_si);
+bcopy(pageBuf + ((*pageBuf == 'I') ? AM_scint : AM_sint),&tempPageint,AM_si);
 printf("FIRSTPAGE is %d\n",tempPageint);
 for(i = 1 ; i <= (header->numKeys);i++)
   {
-   AM_PrintAttr(pageBuf + (i-1)*recSize + AM_sint + AM_si,attrType,
-                 header->attrLength);
-   bcopy(pageBuf + i*recSize + AM_sint,&tempPageint,AM_si);
+   tempPageint = AM_GetIntKey(pageBuf,i,key);
+   AM_PrintAttr(key,attrType,header->attrLength);
    printf("NEXTPAGE is %d\n",tempPageint);
   }
 }
@@ -41,11 +39,12 @@ int i;
 int recSize;
 int recId;
 int offset1;
+char key[AM_MAXATTRLENGTH];
 AM_LEAFHEADER *header;
 
 header = (AM_LEAFHEADER *) calloc(1,AM_sl);
 bcopy(pageBuf,header,AM_sl);
-recSize = header->attrLength + AM_ss;
+recSize = AM_KeySize(header->pageType,header->attrLength) + AM_ss;
 printf("PAGETYPE %c\n",header->pageType);
 printf("NEXTLEAFPAGE %d\n",header->nextLeafPage);
 /*printf("RECIDPTR %d\n",header->recIdPtr);
@@ -58,8 +57,9 @@ printf("NUMKEYS %d\n",header->numKeys);
 for (i = 1; i <= header->numKeys; i++)
   {
   offset1 = (i - 1) * recSize + AM_sl;
-  AM_PrintAttr(pageBuf + AM_sl + (i-1)*recSize,attrType,header->attrLength);
-  bcopy(pageBuf + offset1 + header->attrLength,(char *)&nextRec,AM_ss);
+  AM_GetLeafKey(pageBuf,i,key);
+  AM_PrintAttr(key,attrType,header->attrLength);
+  bcopy(pageBuf + offset1 + recSize - AM_ss,(char *)&nextRec,AM_ss);
   while (nextRec != 0)
     {
     bcopy(pageBuf + nextRec,(char *)&recId,AM_si);
@@ -87,10 +87,13 @@ int errVal;
 AM_LEAFHEADER *header;
 
 
+errVal = AM_UseIndex(fileDesc);
+AM_Check;
 value = malloc(AM_si);
 bcopy(&min,value,AM_si);
-printf("%d PAGE \n",AM_LeftPageNum);
-PF_GetThisPage(fileDesc,AM_LeftPageNum,&pageBuf);
+pageNum = GetLeftPageNum(fileDesc);
+printf("%d PAGE \n",pageNum);
+PF_GetThisPage(fileDesc,pageNum,&pageBuf);
 header = (AM_LEAFHEADER *) calloc(1,AM_sl);
 bcopy(pageBuf,header,AM_sl);
 while(header->nextLeafPage != -1)
@@ -122,16 +125,18 @@ int i;
 int recSize;
 int recId;
 int offset1;
+char key[AM_MAXATTRLENGTH];
 AM_LEAFHEADER *header;
 
 header = (AM_LEAFHEADER *) calloc(1,AM_sl);
 bcopy(pageBuf,header,AM_sl);
-recSize = header->attrLength + AM_ss;
+recSize = AM_KeySize(header->pageType,header->attrLength) + AM_ss;
 for (i = 1; i <= header->numKeys; i++)
   {
   offset1 = (i - 1) * recSize + AM_sl;
-  AM_PrintAttr(pageBuf + AM_sl + (i-1)*recSize,attrType,header->attrLength);
-  bcopy(pageBuf + offset1 + header->attrLength,(char *)&nextRec,AM_ss);
+  AM_GetLeafKey(pageBuf,i,key);
+  AM_PrintAttr(key,attrType,header->attrLength);
+  bcopy(pageBuf + offset1 + recSize - AM_ss,(char *)&nextRec,AM_ss);
   while (nextRec != 0)
     {
     bcopy(pageBuf + nextRec,(char *)&recId,AM_si);
@@ -187,15 +192,17 @@ int errVal;
 AM_INTHEADER *header;
 char *tempPage;
 char *pageBuf;
-int recSize;
+char *key;
 int i;
 
+errVal = AM_UseIndex(fileDesc);
+AM_Check;
 printf("GETTING PAGE = %d\n",pageNum);
 errVal = PF_GetThisPage(fileDesc,pageNum,&pageBuf);
-tempPage = malloc(PF_PAGE_SIZE);
-bcopy(pageBuf,tempPage,PF_PAGE_SIZE);
+tempPage = malloc(AM_PageSize);
+bcopy(pageBuf,tempPage,AM_PageSize);
 errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
-if (*tempPage == 'l')
+if (AM_IsLeaf(tempPage))
   {
    printf("PAGENUM = %d\n",pageNum);
    AM_PrintLeafKeys(tempPage,attrType);
@@ -203,12 +210,17 @@ if (*tempPage == 'l')
   }
 header = (AM_INTHEADER *)calloc(1,AM_sint);
 bcopy(tempPage,header,AM_sint);
-recSize = header->attrLength + AM_si;
+key = malloc(AM_MAXATTRLENGTH);
 for(i = 1; i <= (header->numKeys + 1); i++)
   {
-   bcopy(tempPage + AM_sint + (i-1)*recSize,&nextPage,AM_si);
+   if (i == 1)
+     bcopy(tempPage + ((*tempPage == 'I') ? AM_scint : AM_sint),&nextPage,
+	   AM_si);
+   else
+     nextPage = AM_GetIntKey(tempPage,i - 1,key);
    AM_PrintTree(fileDesc,nextPage,attrType);
   }
+free(key);
 printf("PAGENUM = %d",pageNum);
 AM_PrintIntNode(tempPage,attrType);
 }
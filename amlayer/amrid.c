@@ -0,0 +1,197 @@
+# include <stdio.h>
+# include "../pflayer/rhf.h"
+# include "am.h"
+
+/* An index over a heap file keeps the whole RID of each record, the
+sizeof(RID) bytes of its page and slot numbers, as two recIds one after
+the other on the list of its key: the page number, then the slot number.
+The calls below put them there, take them off and hand them over
+together, and the rest of the AM layer keeps the recIds of a key in their
+order, so the two of a RID are never parted. AM_FindNextEntry() on such
+an index gives the page and the slot numbers in turn. */
+# define AM_RIDRECIDS (sizeof(RID)/AM_si) /* recIds a RID is kept as */
+
+
+/* Puts rid into recIds, as it is kept in the index; returns
+AME_INVALIDVALUE if it is not a RID of a heap record */
+static int AM_RIDRecIds(rid,recIds)
+RID *rid;
+int *recIds;
+
+{
+	if ((rid->pageNum < 0) || (rid->slotNum < 0))
+		{
+		 AM_Errno = AME_INVALIDVALUE;
+		 return(AME_INVALIDVALUE);
+                }
+	recIds[0] = rid->pageNum;
+	recIds[1] = rid->slotNum;
+	return(AME_OK);
+}
+
+
+/* Inserts value into the index, for the heap record rid */
+AM_InsertRID(fileDesc,attrType,attrLength,value,rid)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'i' or 'c' or 'f' */
+int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+char *value; /* Value to be inserted */
+RID *rid; /* heap record of value */
+
+{
+	int recIds[AM_RIDRECIDS];
+	int errVal;
+
+	errVal = AM_RIDRecIds(rid,recIds);
+	if (errVal != AME_OK)
+		return(errVal);
+
+	/* each goes to the head of the list, so the slot number goes first */
+	errVal = AM_InsertEntry(fileDesc,attrType,attrLength,value,recIds[1]);
+	if (errVal != AME_OK)
+		return(errVal);
+	errVal = AM_InsertEntry(fileDesc,attrType,attrLength,value,recIds[0]);
+	if (errVal != AME_OK)
+		{
+		 /* take the slot number, still the head, off again */
+		 AM_DeleteEntry(fileDesc,attrType,attrLength,value,recIds[1]);
+		 AM_Errno = errVal;
+		 return(errVal);
+                }
+	return(AME_OK);
+}
+
+
+/* Deletes the entry of value for the heap record rid */
+AM_DeleteRID(fileDesc,attrType,attrLength,value,rid)
+int fileDesc; /* file Descriptor */
+char attrType; /* 'i' or 'c' or 'f' */
+int attrLength; /* 4 for 'i' or 'f', 1-255 for 'c' */
+char *value; /* Value of the entry */
+RID *rid; /* heap record of value */
+
+{
+	int recIds[AM_RIDRECIDS];
+	int errVal;
+
+	errVal = AM_RIDRecIds(rid,recIds);
+	if (errVal != AME_OK)
+		return(errVal);
+	return(AM_DeleteRecIds(fileDesc,attrType,attrLength,value,recIds,
+			       AM_RIDRECIDS));
+}
+
+
+/* Puts the RID of the next record of the scan into *rid; returns AME_OK,
+or AME_EOF once the scan is over. */
+AM_FindNextRID(scanDesc,rid)
+int scanDesc; /* index scan descriptor */
+RID *rid;
+
+{
+	int pageNum,slotNum;
+
+	pageNum = AM_FindNextEntry(scanDesc);
+	if (pageNum < 0)
+		return(pageNum);
+	slotNum = AM_FindNextEntry(scanDesc);
+	if (slotNum == AME_EOF)
+		{
+		 /* the page number of a RID without its slot number */
+		 AM_Errno = AME_INTERROR;
+		 return(AME_INTERROR);
+                }
+	if (slotNum < 0)
+		return(slotNum);
+	rid->pageNum = pageNum;
+	rid->slotNum = slotNum;
+	return(AME_OK);
+}
+
+
+/* what AM_FetchRecords passes on to RHF_GetRecords for each batch */
+typedef struct am_fetch
+	{
+		int (*found)(); /* the caller's */
+		char *arg; /* passed on to found */
+		RID *rids; /* the RIDs of the batch */
+		int errVal; /* what found returned */
+	} AM_FETCH;
+
+
+/* Calls the caller's found for record i of a batch */
+static int AM_FetchFound(arg,i,record,length)
+void *arg;
+int i;
+char *record;
+int length;
+
+{
+	AM_FETCH *fetch = (AM_FETCH *)arg;
+
+	fetch->errVal = (*fetch->found)(fetch->arg,&fetch->rids[i],record,
+					length);
+	return(fetch->errVal);
+}
+
+
+/* Runs the scan to its end and calls found for the heap record of each
+RID it finds in the heap file heapFd, as (*found)(arg,rid,record,length);
+record is only valid until found returns. The RIDs are taken from the
+scan AM_FETCHBATCH at a time, and the records of each batch are fetched
+in heap page order, so each heap page is fixed once for all the records
+of a batch on it. If found returns other than AME_OK, the fetch stops and
+returns what it returned; a RID with no record in the heap file stops it
+with AME_RHF. The scan must still be closed. */
+AM_FetchRecords(scanDesc,heapFd,found,arg)
+int scanDesc; /* index scan descriptor */
+int heapFd; /* heap file the index is over */
+int (*found)(); /* called for each record */
+char *arg; /* passed on to found */
+
+{
+	int recIds[AM_FETCHBATCH*AM_RIDRECIDS]; /* recIds of a batch */
+	RID rids[AM_FETCHBATCH]; /* the RIDs of them */
+	AM_FETCH fetch;
+	int numRecIds; /* # of recIds in the batch */
+	int errVal;
+	int i;
+
+	if (found == NULL)
+		{
+		 AM_Errno = AME_INVALIDVALUE;
+		 return(AME_INVALIDVALUE);
+                }
+
+	fetch.found = found;
+	fetch.arg = arg;
+	fetch.rids = rids;
+	while ((numRecIds = AM_FindNextEntries(scanDesc,recIds,
+				AM_FETCHBATCH*AM_RIDRECIDS)) > 0)
+	{
+		/* the page number of a RID without its slot number */
+		if ((numRecIds % AM_RIDRECIDS) != 0)
+			{
+			 AM_Errno = AME_INTERROR;
+			 return(AME_INTERROR);
+                }
+		for (i = 0; i < numRecIds/AM_RIDRECIDS; i++)
+			{
+			 rids[i].pageNum = recIds[i*AM_RIDRECIDS];
+			 rids[i].slotNum = recIds[i*AM_RIDRECIDS + 1];
+			}
+		fetch.errVal = AME_OK;
+		errVal = RHF_GetRecords(heapFd,rids,numRecIds/AM_RIDRECIDS,
+					AM_FetchFound,(void *)&fetch);
+		if (fetch.errVal != AME_OK)
+			return(fetch.errVal);
+		if (errVal != RHF_OK)
+			{
+			 AM_Errno = AME_RHF;
+			 return(AME_RHF);
+                }
+	}
+	if (numRecIds == AME_EOF)
+		return(AME_OK);
+	return(numRecIds);
+}
@@ -1,10 +1,11 @@
 
 # include <stdio.h>
+# include <pthread.h>
 # include "am.h"
 # include "pf.h"
 
-/* The structure of the scan Table */
-struct {
+/* The structure of a scan Table entry */
+typedef struct am_scan {
          int fileDesc;
          int op;
          int attrType;
@@ -18,7 +19,90 @@ struct {
          int lastpageNum;
          short lastIndex;
          int status;
-       } AM_scanTable[MAXSCANS];
+         int inUse; /* whether a scan has the entry; under AM_scanlock */
+       } AM_SCAN;
+
+/* The scan table: a scan descriptor is the place of its entry, which
+stays where it was allocated when the table grows, so that scans in other
+threads can go on with theirs. AM_scanlock protects the table itself. */
+static AM_SCAN **AM_scanTable;
+static int AM_scanTableSize; /* entries in the table */
+static pthread_mutex_t AM_scanlock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* Returns the entry of scanDesc, or NULL if there is none */
+static AM_SCAN *AM_GetScan(scanDesc)
+int scanDesc;
+
+{
+AM_SCAN *scan;
+
+pthread_mutex_lock(&AM_scanlock);
+if ((scanDesc < 0) || (scanDesc >= AM_scanTableSize))
+  scan = NULL;
+else
+  scan = AM_scanTable[scanDesc];
+pthread_mutex_unlock(&AM_scanlock);
+return(scan);
+}
+
+
+/* Takes a free entry of the scan table, making the table larger if there
+is none; returns its scan descriptor, or AME_SCAN_TAB_FULL */
+static AM_NewScan()
+
+{
+AM_SCAN **table;
+int size;
+int scanDesc;
+
+pthread_mutex_lock(&AM_scanlock);
+for (scanDesc = 0; scanDesc < AM_scanTableSize; scanDesc++)
+  if (!AM_scanTable[scanDesc]->inUse) break;
+
+if (scanDesc == AM_scanTableSize)
+ {
+  /* the table is full: double it */
+  size = (AM_scanTableSize == 0) ? AM_SCANTABSIZE : 2*AM_scanTableSize;
+  if (AM_scanTable == NULL)
+    table = (AM_SCAN **)malloc((unsigned)(size*sizeof(AM_SCAN *)));
+  else
+    table = (AM_SCAN **)realloc((char *)AM_scanTable,
+				(unsigned)(size*sizeof(AM_SCAN *)));
+  if (table == NULL)
+   {
+    pthread_mutex_unlock(&AM_scanlock);
+    return(AME_SCAN_TAB_FULL);
+   }
+  AM_scanTable = table;
+  for (; AM_scanTableSize < size; AM_scanTableSize++)
+   {
+    table[AM_scanTableSize] = (AM_SCAN *)calloc(1,sizeof(AM_SCAN));
+    if (table[AM_scanTableSize] == NULL) break;
+   }
+  if (scanDesc == AM_scanTableSize)
+   {
+    pthread_mutex_unlock(&AM_scanlock);
+    return(AME_SCAN_TAB_FULL);
+   }
+ }
+AM_scanTable[scanDesc]->inUse = TRUE;
+AM_scanTable[scanDesc]->status = FIRST;
+pthread_mutex_unlock(&AM_scanlock);
+return(scanDesc);
+}
+
+
+/* Gives back the entry scan */
+static AM_FreeScan(scan)
+AM_SCAN *scan;
+
+{
+pthread_mutex_lock(&AM_scanlock);
+scan->status = FREE;
+scan->inUse = FALSE;
+pthread_mutex_unlock(&AM_scanlock);
+}
 
 
 /* Opens an index scan */
@@ -36,10 +120,14 @@ int status; /* whether value is found or not in the tree */
 int index; /* index of value in leaf */
 int pageNum;/* page number of leaf page where value is found */
 int recSize; /* size of key,ptr pair in leaf */
+int keySize; /* size of the key part of the pair */
 char *pageBuf; /* buffer for page */
 int errVal; /* return value of functions */
 AM_LEAFHEADER head,*header; /* local header */
 int searchpageNum;
+int leftPageNum; /* page number of the leftmost leaf */
+AM_SCAN *scan; /* entry of the scan in the scan table */
+AM_INDEXHANDLE handle; /* the search for value */
 
 
 
@@ -50,6 +138,10 @@ if (fileDesc < 0)
    return(AME_FD);
   }
 
+/* work with the node size of this index */
+errVal = AM_UseIndex(fileDesc);
+AM_Check;
+
 if ((attrType != 'i') && (attrType != 'c') && (attrType != 'f'))
   {
   AM_Errno = AME_INVALIDATTRTYPE;
@@ -60,72 +152,72 @@ if ((attrType != 'i') && (attrType != 'c') && (attrType != 'f'))
 header = &head;
 
 /* find a vacant place in the scan table */
-for (scanDesc = 0; scanDesc <  MAXSCANS;scanDesc++)
-  if (AM_scanTable[scanDesc].status == FREE) break;
-
-/* scan table is full */
-if (scanDesc > MAXSCANS - 1) 
+scanDesc = AM_NewScan();
+if (scanDesc < 0)
  {
- AM_Errno = AME_SCAN_TAB_FULL;
- return(AME_SCAN_TAB_FULL);
+ AM_Errno = scanDesc;
+ return(scanDesc);
  }
 
 /* there is room */
-AM_scanTable[scanDesc].status = FIRST;
-AM_scanTable[scanDesc].attrType = attrType;
+scan = AM_GetScan(scanDesc);
+scan->attrType = attrType;
 
-/* initialise AM_LeftPageNum */
-AM_LeftPageNum = GetLeftPageNum(fileDesc);
+/* initialise leftPageNum */
+leftPageNum = GetLeftPageNum(fileDesc);
 
 /* scan of all keys */
 if (value == NULL)
   {
-   AM_scanTable[scanDesc].fileDesc = fileDesc;
-   AM_scanTable[scanDesc].op = ALL;
-   AM_scanTable[scanDesc].nextpageNum = AM_LeftPageNum;
-   AM_scanTable[scanDesc].nextIndex = 1;
-   AM_scanTable[scanDesc].actindex = 1;
-   errVal = PF_GetThisPage(fileDesc,AM_LeftPageNum,&pageBuf);
+   scan->fileDesc = fileDesc;
+   scan->op = ALL;
+   scan->nextpageNum = leftPageNum;
+   scan->nextIndex = 1;
+   scan->actindex = 1;
+   errVal = PF_GetThisPage(fileDesc,leftPageNum,&pageBuf);
    AM_Check;
-   bcopy(pageBuf + AM_sl + attrLength,&AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
-   errVal = PF_UnfixPage(fileDesc,AM_LeftPageNum,FALSE);
+   keySize = AM_KeySize(*pageBuf,attrLength);
+   bcopy(pageBuf + AM_sl + keySize,&scan->nextRecIdPtr,AM_ss);
+   errVal = PF_UnfixPage(fileDesc,leftPageNum,FALSE);
    AM_Check;
    return(scanDesc);
   }
   
 /* search for the pagenumber and index of value */
-status = AM_Search(fileDesc,attrType,attrLength,value,&pageNum,&pageBuf,&index);
+AM_InitHandle(&handle,fileDesc);
+status = AM_Search(&handle,attrType,attrLength,value,&pageNum,&pageBuf,&index);
 searchpageNum = pageNum;
 /* check for errors */
 if (status < 0) 
-  { AM_scanTable[scanDesc].status = FREE;
+  { AM_FreeScan(scan);
     AM_Errno = status;
     return(status);
   }
 
 bcopy(pageBuf,header,AM_sl);
-recSize = attrLength + AM_ss;
-AM_scanTable[scanDesc].fileDesc = fileDesc;
-AM_scanTable[scanDesc].op = op;
+keySize = AM_KeySize(header->pageType,attrLength);
+recSize = keySize + AM_ss;
+scan->fileDesc = fileDesc;
+scan->op = op;
 
 /* value is not in leaf but if inserted will have to be inserted after the last
 key */
 if (index > header->numKeys) 
   if (header->nextLeafPage != AM_NULL_PAGE)
   {
-  errVal = PF_GetThisPage(fileDesc,header->nextLeafPage,&pageBuf);
+  pageNum = header->nextLeafPage;
+  errVal = PF_GetThisPage(fileDesc,pageNum,&pageBuf);
   AM_Check;
   bcopy(pageBuf,header,AM_sl);
-  errVal = PF_UnfixPage(fileDesc,header->nextLeafPage,FALSE);
+  errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
   AM_Check;
-  pageNum = header->nextLeafPage;
   index = 1;
   }
   else 
    pageNum = AM_NULL_PAGE;
 
-AM_scanTable[scanDesc].pageNum = pageNum;
-AM_scanTable[scanDesc].index = index;
+scan->pageNum = pageNum;
+scan->index = index;
 
 
 
@@ -136,37 +228,37 @@ switch(op)
                {
                 /* value not in leaf - no match */
 		if (status != AM_FOUND)
-                   AM_scanTable[scanDesc].status = OVER;
+                   scan->status = OVER;
                 else
                  {
-                  AM_scanTable[scanDesc].nextpageNum = pageNum;
-                  AM_scanTable[scanDesc].nextIndex = index;
-                  AM_scanTable[scanDesc].actindex = index;
-                  bcopy(pageBuf + AM_sl + (index - 1)*recSize + attrLength,
-                          &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
-                  AM_scanTable[scanDesc].lastpageNum  = pageNum;
-                  AM_scanTable[scanDesc].lastIndex  = index;
+                  scan->nextpageNum = pageNum;
+                  scan->nextIndex = index;
+                  scan->actindex = index;
+                  bcopy(pageBuf + AM_sl + (index - 1)*recSize + keySize,
+                          &scan->nextRecIdPtr,AM_ss);
+                  scan->lastpageNum  = pageNum;
+                  scan->lastIndex  = index;
                  }
                 break;
                }
   case LESS_THAN : 
                {
-                AM_scanTable[scanDesc].nextpageNum = AM_LeftPageNum;
-                AM_scanTable[scanDesc].nextIndex = 1;
-                AM_scanTable[scanDesc].actindex = 1;
-                if (searchpageNum != AM_LeftPageNum)
-		 { errVal = PF_GetThisPage(fileDesc,AM_LeftPageNum,&pageBuf);
+                scan->nextpageNum = leftPageNum;
+                scan->nextIndex = 1;
+                scan->actindex = 1;
+                if (searchpageNum != leftPageNum)
+		 { errVal = PF_GetThisPage(fileDesc,leftPageNum,&pageBuf);
                   AM_Check;
                  }
-                bcopy(pageBuf + AM_sl + attrLength,
-                        &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
-                if (searchpageNum != AM_LeftPageNum)
+                bcopy(pageBuf + AM_sl + keySize,
+                        &scan->nextRecIdPtr,AM_ss);
+                if (searchpageNum != leftPageNum)
 		 {
-		  errVal = PF_UnfixPage(fileDesc,AM_LeftPageNum,FALSE);
+		  errVal = PF_UnfixPage(fileDesc,leftPageNum,FALSE);
                   AM_Check;
                  }
-                AM_scanTable[scanDesc].lastpageNum  = pageNum;
-                AM_scanTable[scanDesc].lastIndex  = index - 1 ;
+                scan->lastpageNum  = pageNum;
+                scan->lastIndex  = index - 1 ;
                 break;
                }
   case GREATER_THAN :
@@ -174,96 +266,95 @@ switch(op)
                 if (status == AM_FOUND)
                  if ((index + 1) <= (header->numKeys))
                   {
-                   AM_scanTable[scanDesc].nextpageNum = pageNum;
-                   AM_scanTable[scanDesc].nextIndex = index + 1;
-                   AM_scanTable[scanDesc].actindex = index + 1;
-                   bcopy(pageBuf + AM_sl + (index)*recSize + attrLength,
-                             &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
+                   scan->nextpageNum = pageNum;
+                   scan->nextIndex = index + 1;
+                   scan->actindex = index + 1;
+                   bcopy(pageBuf + AM_sl + (index)*recSize + keySize,
+                             &scan->nextRecIdPtr,AM_ss);
                   }
                  else
                    /* got to start from next leaf page */
 		   if (header->nextLeafPage != AM_NULL_PAGE)
                    {
-                   AM_scanTable[scanDesc].nextpageNum = header->nextLeafPage;
-                   AM_scanTable[scanDesc].nextIndex =  1;
-                   AM_scanTable[scanDesc].actindex = 1;
+                   scan->nextpageNum = header->nextLeafPage;
+                   scan->nextIndex =  1;
+                   scan->actindex = 1;
                    errVal =PF_GetThisPage(fileDesc,header->nextLeafPage,&pageBuf);
                    AM_Check;
-                   bcopy(pageBuf + AM_sl + attrLength,
-                           &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
+                   bcopy(pageBuf + AM_sl + keySize,
+                           &scan->nextRecIdPtr,AM_ss);
                    errVal = PF_UnfixPage(fileDesc,header->nextLeafPage,FALSE);
                    AM_Check;
                    }
                    else /* Nextleafpage is not last NULL page */
-                     AM_scanTable[scanDesc].status = OVER;
+                     scan->status = OVER;
                 else /* status == AM_NOT_FOUND */ 
                  {
-                   AM_scanTable[scanDesc].nextpageNum = pageNum;
-                   AM_scanTable[scanDesc].nextIndex = index ;
-                   AM_scanTable[scanDesc].actindex = index;
-                   bcopy(pageBuf + AM_sl + (index - 1)*recSize + attrLength,
-                              &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
+                   scan->nextpageNum = pageNum;
+                   scan->nextIndex = index ;
+                   scan->actindex = index;
+                   bcopy(pageBuf + AM_sl + (index - 1)*recSize + keySize,
+                              &scan->nextRecIdPtr,AM_ss);
                  }
                 break;
                }
   case LESS_THAN_EQUAL :
                {
-               AM_scanTable[scanDesc].nextpageNum = AM_LeftPageNum;
-               AM_scanTable[scanDesc].nextIndex = 1;
-               AM_scanTable[scanDesc].actindex = 1;
-                if (searchpageNum != AM_LeftPageNum)
-		 { errVal = PF_GetThisPage(fileDesc,AM_LeftPageNum,&pageBuf);
+               scan->nextpageNum = leftPageNum;
+               scan->nextIndex = 1;
+               scan->actindex = 1;
+                if (searchpageNum != leftPageNum)
+		 { errVal = PF_GetThisPage(fileDesc,leftPageNum,&pageBuf);
                   AM_Check;
                  }
-               bcopy(pageBuf + AM_sl + attrLength,
-                                 &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
-               if (searchpageNum != AM_LeftPageNum)
+               bcopy(pageBuf + AM_sl + keySize,
+                                 &scan->nextRecIdPtr,AM_ss);
+               if (searchpageNum != leftPageNum)
 		 {
-		  errVal = PF_UnfixPage(fileDesc,AM_LeftPageNum,FALSE);
+		  errVal = PF_UnfixPage(fileDesc,leftPageNum,FALSE);
                   AM_Check;
                  }		   
-               AM_scanTable[scanDesc].lastpageNum  = pageNum;
+               scan->lastpageNum  = pageNum;
                if (status == AM_FOUND)
-                AM_scanTable[scanDesc].lastIndex  = index ;
+                scan->lastIndex  = index ;
                else
-                AM_scanTable[scanDesc].lastIndex  = index - 1;
+                scan->lastIndex  = index - 1;
                break;
                }
   case GREATER_THAN_EQUAL :
                 
                {
-                AM_scanTable[scanDesc].nextpageNum = pageNum;
-                AM_scanTable[scanDesc].nextIndex = index;
-                AM_scanTable[scanDesc].actindex = index;
-                bcopy(pageBuf + AM_sl + (index - 1)*recSize + attrLength,
-                        &AM_scanTable[scanDesc].nextRecIdPtr,   AM_ss);
+                scan->nextpageNum = pageNum;
+                scan->nextIndex = index;
+                scan->actindex = index;
+                bcopy(pageBuf + AM_sl + (index - 1)*recSize + keySize,
+                        &scan->nextRecIdPtr,   AM_ss);
                 break;
                }
   case NOT_EQUAL :
                {
-               if(status == AM_FOUND)
-                {
-                AM_scanTable[scanDesc].nextpageNum = AM_LeftPageNum;
-                AM_scanTable[scanDesc].nextIndex = 1;
-                AM_scanTable[scanDesc].actindex = 1;
-                if (searchpageNum != AM_LeftPageNum)
-		  {
-		  errVal = PF_GetThisPage(fileDesc,AM_LeftPageNum,&pageBuf);
-                  AM_Check;
-		  }
-                bcopy(pageBuf + AM_sl + attrLength,
-                              &AM_scanTable[scanDesc].nextRecIdPtr,   AM_ss);
-                if (searchpageNum != AM_LeftPageNum)
-		 { errVal = PF_UnfixPage(fileDesc,AM_LeftPageNum,FALSE);
-                  AM_Check;
-                 }
+               /* every key is scanned; if value is not there, none is
+               skipped */
+               if(status != AM_FOUND)
+                scan->pageNum = AM_NULL_PAGE;
+               scan->nextpageNum = leftPageNum;
+               scan->nextIndex = 1;
+               scan->actindex = 1;
+               if (searchpageNum != leftPageNum)
+		 {
+		 errVal = PF_GetThisPage(fileDesc,leftPageNum,&pageBuf);
+                 AM_Check;
+		 }
+               bcopy(pageBuf + AM_sl + keySize,
+                             &scan->nextRecIdPtr,   AM_ss);
+               if (searchpageNum != leftPageNum)
+		{ errVal = PF_UnfixPage(fileDesc,leftPageNum,FALSE);
+                 AM_Check;
                 }
-               else 
-                AM_scanTable[scanDesc].pageNum = AM_NULL_PAGE;
                break;
                }
   default : {
-             AM_scanTable[scanDesc].status = FREE;
+             AM_FreeScan(scan);
 	     AM_Errno = AME_INVALID_OP_TO_SCAN;
 	     return(AME_INVALID_OP_TO_SCAN);
              break;
@@ -275,196 +366,308 @@ AM_Check;
 return(scanDesc);
 }
 
-/* returns the record id of the next record that satisfies the conditions
-specified for index scan associated with scanDesc */
-AM_FindNextEntry(scanDesc)
-int scanDesc;/* index scan descriptor */
+/* Makes newPage the leaf of a scan fixed in *pageBuf, in place of
+*pageNum, which is AM_NULL_PAGE if there is none, and counts it in the
+PF statistics if it is past the leaf the scan was on. Returns a PF error
+code. */
+static AM_ScanFix(scan,pageNum,pageBuf,newPage)
+AM_SCAN *scan;
+int *pageNum;
+char **pageBuf;
+int newPage;
+
+{
+int errVal;
+
+if (*pageNum == newPage)
+  return(PFE_OK);
+if (*pageNum != AM_NULL_PAGE)
+ {
+  errVal = PF_UnfixPage(scan->fileDesc,*pageNum,FALSE);
+  *pageNum = AM_NULL_PAGE;
+  if (errVal != PFE_OK)
+    return(errVal);
+ }
+errVal = PF_GetThisPage(scan->fileDesc,newPage,pageBuf);
+if (errVal != PFE_OK)
+  return(errVal);
+*pageNum = newPage;
+if (newPage != scan->nextpageNum)
+  /* on to the next leaf */
+  PF_StatsCount(PF_CNT_AMSCANPAGES,1L);
+return(PFE_OK);
+}
+
+
+/* Returns the record id of the next record of a scan, as
+AM_FindNextEntry. The leaf the scan is on is kept fixed in *pageBuf, and
+*pageNum is its page number, or AM_NULL_PAGE if none is; the caller
+unfixes it once done. fresh tells whether the index may have changed
+since the leaf was fixed. */
+static AM_ScanNext(scan,pageNum,pageBuf,fresh)
+AM_SCAN *scan; /* entry of the scan in the scan table */
+int *pageNum; /* leaf fixed in pageBuf; scans in other threads may fix
+		other pages meanwhile, so it stays fixed while it is read */
+char **pageBuf;/* buffer for page */
+int fresh;
 
 {
 int recId; /* recordId to be returned */
-char *pageBuf;/* buffer for page */
 int errVal;/* return value for functions */
 AM_LEAFHEADER head,*header; /* local header */
 int recSize;/* size of key,ptr pair for leaf */
+int keySize;/* size of the key part of the pair */
+char key[AM_MAXATTRLENGTH]; /* key at nextIndex */
 int compareVal; /* value returned by compare routine */
 
 
-/* check if scanDesc is valid */
-if ((scanDesc < 0) || (scanDesc > MAXSCANS - 1))
-  {
-   AM_Errno = AME_INVALID_SCANDESC;
-   return(AME_INVALID_SCANDESC);
-  }
-
 /* check if scan is over */
-if (AM_scanTable[scanDesc].status == OVER)
+if (scan->status == OVER)
       return(AME_EOF);
 
-if (AM_scanTable[scanDesc].nextpageNum == AM_NULL_PAGE)
+if (scan->nextpageNum == AM_NULL_PAGE)
  {
-  AM_scanTable[scanDesc].status = OVER;
+  scan->status = OVER;
   return(AME_EOF);
  }
 
 header = &head;
-errVal = PF_GetThisPage(AM_scanTable[scanDesc].fileDesc
-                        ,AM_scanTable[scanDesc].nextpageNum,&pageBuf);
+errVal = AM_ScanFix(scan,pageNum,pageBuf,scan->nextpageNum);
 AM_Check;
 
-bcopy(pageBuf,header,AM_sl);
-recSize = header->attrLength + AM_ss;
-
-errVal = PF_UnfixPage(AM_scanTable[scanDesc].fileDesc
-           ,AM_scanTable[scanDesc].nextpageNum,FALSE);
-AM_Check;
+bcopy(*pageBuf,header,AM_sl);
+keySize = AM_KeySize(header->pageType,header->attrLength);
+recSize = keySize + AM_ss;
 
 /* Get next non empty leaf page */
 while(header->numKeys == 0)
   if(header->nextLeafPage == AM_NULL_PAGE)
    {
-    AM_scanTable[scanDesc].status = OVER; 
+    scan->status = OVER; 
     return(AME_EOF);
    }
   else
    {
-    errVal = PF_GetThisPage(AM_scanTable[scanDesc].fileDesc,header->nextLeafPage,&pageBuf);
-    AM_Check;
-    errVal = PF_UnfixPage(AM_scanTable[scanDesc].fileDesc,header->nextLeafPage,FALSE);
+    errVal = AM_ScanFix(scan,pageNum,pageBuf,header->nextLeafPage);
     AM_Check;
-    AM_scanTable[scanDesc].nextpageNum = header->nextLeafPage;
-    AM_scanTable[scanDesc].nextIndex = 1;
-    AM_scanTable[scanDesc].actindex = 1;
-    bcopy(pageBuf,header,AM_sl);
-    bcopy(pageBuf + AM_sl +  (AM_scanTable[scanDesc].nextIndex-1)*recSize
-    + header->attrLength, &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
-    AM_scanTable[scanDesc].status = FIRST;
+    scan->nextpageNum = header->nextLeafPage;
+    scan->nextIndex = 1;
+    scan->actindex = 1;
+    bcopy(*pageBuf,header,AM_sl);
+    bcopy(*pageBuf + AM_sl +  (scan->nextIndex-1)*recSize
+    + keySize, &scan->nextRecIdPtr,AM_ss);
+    scan->status = FIRST;
    }
 
-/* if op is < or <= check if you are done - might have overshot while scanning
-empty pages*/
-if ((AM_scanTable[scanDesc].op == LESS_THAN) || 
-  (AM_scanTable[scanDesc].op == LESS_THAN_EQUAL))
- if ((AM_scanTable[scanDesc].lastpageNum <= AM_scanTable[scanDesc].nextpageNum)
- && (AM_scanTable[scanDesc].lastIndex == 0))
+/* if op is < or <= check if you are done - the last key is the one before
+the first of lastpageNum. Leaves are not in page number order, so only
+getting to that page tells. */
+if ((scan->op == LESS_THAN) || 
+  (scan->op == LESS_THAN_EQUAL))
+ if ((scan->lastpageNum == scan->nextpageNum)
+ && (scan->lastIndex == 0))
  {
-  AM_scanTable[scanDesc].status = OVER;
+  scan->status = OVER;
   return(AME_EOF);
  }
 
 /* if op is not equal then check if we have to skip this value */
-if (AM_scanTable[scanDesc].op == NOT_EQUAL)
-  if ((AM_scanTable[scanDesc].pageNum == AM_scanTable[scanDesc].nextpageNum)
-    && (AM_scanTable[scanDesc].index == AM_scanTable[scanDesc].actindex))
+if (scan->op == NOT_EQUAL)
+  if ((scan->pageNum == scan->nextpageNum)
+    && (scan->index == scan->actindex))
        
        /*skip this value */
-       if ((AM_scanTable[scanDesc].nextIndex + 1) <= (header->numKeys))
+       if ((scan->nextIndex + 1) <= (header->numKeys))
          {
-          AM_scanTable[scanDesc].nextIndex++;
-          AM_scanTable[scanDesc].actindex++;
-          bcopy(pageBuf + AM_sl +  (AM_scanTable[scanDesc].nextIndex-1)*recSize
-          + header->attrLength, &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
+          scan->nextIndex++;
+          scan->actindex++;
+          bcopy(*pageBuf + AM_sl +  (scan->nextIndex-1)*recSize
+          + keySize, &scan->nextRecIdPtr,AM_ss);
          }
        else
           if (header->nextLeafPage == AM_NULL_PAGE)
             return(AME_EOF); 
           else
            {
-            AM_scanTable[scanDesc].nextpageNum = header->nextLeafPage;
-            AM_scanTable[scanDesc].nextIndex =  1;
-            AM_scanTable[scanDesc].actindex = 1;
-            errVal =PF_GetThisPage(AM_scanTable[scanDesc].fileDesc,
-                  header->nextLeafPage,&pageBuf);
-            AM_Check;
-            bcopy(pageBuf + AM_sl + header->attrLength,
-               &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
-            bcopy(pageBuf,header,AM_sl);
-            errVal = PF_UnfixPage(AM_scanTable[scanDesc].fileDesc
-                ,header->nextLeafPage,FALSE);
+            errVal = AM_ScanFix(scan,pageNum,pageBuf,header->nextLeafPage);
             AM_Check;
+            scan->nextpageNum = *pageNum;
+            scan->nextIndex =  1;
+            scan->actindex = 1;
+            bcopy(*pageBuf + AM_sl + keySize,
+               &scan->nextRecIdPtr,AM_ss);
+            bcopy(*pageBuf,header,AM_sl);
            }
 /* if not the first call to findnextentry , check if previous record has 
-been deleted */
-if (AM_scanTable[scanDesc].status != FIRST)
+been deleted; the index cannot have changed since the last entry if the
+leaf stayed fixed */
+if ((scan->status != FIRST) && fresh)
  {
-  compareVal = AM_Compare(pageBuf + (AM_scanTable[scanDesc].nextIndex - 1)
-                *recSize + AM_sl,AM_scanTable[scanDesc].attrType,
-		header->attrLength,AM_scanTable[scanDesc].nextvalue);
+  AM_GetLeafKey(*pageBuf,scan->nextIndex,key);
+  compareVal = AM_Compare(key,scan->attrType,
+		header->attrLength,scan->nextvalue);
   if (compareVal != 0)
    {
     /* prev record deleted */
-    AM_scanTable[scanDesc].nextIndex--;
-    bcopy(pageBuf + AM_sl + (AM_scanTable[scanDesc].nextIndex -1)*recSize + 
-    header->attrLength, &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
+    scan->nextIndex--;
+    bcopy(*pageBuf + AM_sl + (scan->nextIndex -1)*recSize + 
+    keySize, &scan->nextRecIdPtr,AM_ss);
    }
  }
-else 
+else if (scan->status == FIRST)
   /* make the status busy - no more the first call */
-  { AM_scanTable[scanDesc].status = BUSY;
-    bcopy(pageBuf + AM_sl + (AM_scanTable[scanDesc].nextIndex - 1)*recSize,
-    AM_scanTable[scanDesc].nextvalue, header->attrLength);
+  { scan->status = BUSY;
+    AM_GetLeafKey(*pageBuf,scan->nextIndex,
+    scan->nextvalue);
   }
 
 /* copy the recId to be returned */
-bcopy(pageBuf + AM_scanTable[scanDesc].nextRecIdPtr,&recId,AM_si);
+bcopy(*pageBuf + scan->nextRecIdPtr,&recId,AM_si);
 
 /* copy the place for next recId */
-bcopy(pageBuf + AM_scanTable[scanDesc].nextRecIdPtr + AM_si,
-          &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
+bcopy(*pageBuf + scan->nextRecIdPtr + AM_si,
+          &scan->nextRecIdPtr,AM_ss);
 
 
 /* check if this keys list is over */
-if (AM_scanTable[scanDesc].nextRecIdPtr == (short)0)
-   if ((AM_scanTable[scanDesc].nextIndex + 1) <= (header->numKeys))
+if (scan->nextRecIdPtr == (short)0)
+   if ((scan->nextIndex + 1) <= (header->numKeys))
     {
-     AM_scanTable[scanDesc].nextIndex++;
-     AM_scanTable[scanDesc].actindex++;
-     bcopy(pageBuf + AM_sl + (AM_scanTable[scanDesc].nextIndex - 1)*recSize + 
-     header->attrLength , &AM_scanTable[scanDesc].nextRecIdPtr, AM_ss);
-     bcopy(pageBuf + AM_sl + (AM_scanTable[scanDesc].nextIndex -1 )*recSize,
-     AM_scanTable[scanDesc].nextvalue,header->attrLength); 
+     scan->nextIndex++;
+     scan->actindex++;
+     bcopy(*pageBuf + AM_sl + (scan->nextIndex - 1)*recSize + 
+     keySize, &scan->nextRecIdPtr, AM_ss);
+     AM_GetLeafKey(*pageBuf,scan->nextIndex,
+     scan->nextvalue);
     }
    else
     /* got to go to next page */
     if (header->nextLeafPage == AM_NULL_PAGE)
-      AM_scanTable[scanDesc].status = OVER;
+      scan->status = OVER;
     else
      {
-      AM_scanTable[scanDesc].nextpageNum = header->nextLeafPage;
-      AM_scanTable[scanDesc].nextIndex =  1;
-      AM_scanTable[scanDesc].actindex = 1;
-      errVal =PF_GetThisPage(AM_scanTable[scanDesc].fileDesc,
-        header->nextLeafPage,&pageBuf);
-      AM_Check;
-      bcopy(pageBuf + AM_sl + header->attrLength,
-         &AM_scanTable[scanDesc].nextRecIdPtr,AM_ss);
-      errVal = PF_UnfixPage(AM_scanTable[scanDesc].fileDesc
-                ,header->nextLeafPage,FALSE);
+      errVal = AM_ScanFix(scan,pageNum,pageBuf,header->nextLeafPage);
       AM_Check;
-      bcopy(pageBuf + AM_sl + (AM_scanTable[scanDesc].nextIndex -1 )*recSize,
-      AM_scanTable[scanDesc].nextvalue,header->attrLength); 
-      bcopy(pageBuf,header,AM_sl);
+      scan->nextpageNum = *pageNum;
+      scan->nextIndex =  1;
+      scan->actindex = 1;
+      bcopy(*pageBuf + AM_sl + keySize,
+         &scan->nextRecIdPtr,AM_ss);
+      AM_GetLeafKey(*pageBuf,scan->nextIndex,
+      scan->nextvalue);
+      bcopy(*pageBuf,header,AM_sl);
      }
 
 /* If op is equal then see if you are done */
-if (AM_scanTable[scanDesc].op == EQUAL)
-  if ((AM_scanTable[scanDesc].pageNum != AM_scanTable[scanDesc].nextpageNum)
-    || (AM_scanTable[scanDesc].index != AM_scanTable[scanDesc].actindex))
-     AM_scanTable[scanDesc].status = OVER;
+if (scan->op == EQUAL)
+  if ((scan->pageNum != scan->nextpageNum)
+    || (scan->index != scan->actindex))
+     scan->status = OVER;
 
 /* see if you are at the last record if op is < or <= */
-if ((AM_scanTable[scanDesc].op == LESS_THAN) || 
-  (AM_scanTable[scanDesc].op == LESS_THAN_EQUAL))
-   if ((AM_scanTable[scanDesc].lastpageNum == AM_scanTable[scanDesc].nextpageNum)
-    && (AM_scanTable[scanDesc].lastIndex == AM_scanTable[scanDesc].actindex))
-       AM_scanTable[scanDesc].status = LAST;
-  else  if ((AM_scanTable[scanDesc].lastpageNum == AM_scanTable[scanDesc].nextpageNum)
-    && (AM_scanTable[scanDesc].lastIndex  <  AM_scanTable[scanDesc].actindex))
-        AM_scanTable[scanDesc].status = OVER;
+if ((scan->op == LESS_THAN) || 
+  (scan->op == LESS_THAN_EQUAL))
+   if ((scan->lastpageNum == scan->nextpageNum)
+    && (scan->lastIndex == scan->actindex))
+       scan->status = LAST;
+  else  if ((scan->lastpageNum == scan->nextpageNum)
+    && (scan->lastIndex  <  scan->actindex))
+        scan->status = OVER;
     else
-      if (AM_scanTable[scanDesc].status == LAST)
-        AM_scanTable[scanDesc].status = OVER;
+      if (scan->status == LAST)
+        scan->status = OVER;
         
+return(recId);
+}
+
+/* returns the record id of the next record that satisfies the conditions
+specified for index scan associated with scanDesc */
+AM_FindNextEntry(scanDesc)
+int scanDesc;/* index scan descriptor */
+
+{
+int recId; /* recordId to be returned */
+int pageNum; /* leaf fixed by the scan */
+char *pageBuf;/* buffer for page */
+AM_SCAN *scan; /* entry of the scan in the scan table */
+
+/* check if scanDesc is valid */
+scan = AM_GetScan(scanDesc);
+if (scan == NULL)
+  {
+   AM_Errno = AME_INVALID_SCANDESC;
+   return(AME_INVALID_SCANDESC);
+  }
+if (AM_UseIndex(scan->fileDesc) != PFE_OK)
+  {
+   AM_Errno = AME_PF;
+   return(AME_PF);
+  }
+
+pageNum = AM_NULL_PAGE;
+recId = AM_ScanNext(scan,&pageNum,&pageBuf,TRUE);
+if ((pageNum != AM_NULL_PAGE) &&
+    (PF_UnfixPage(scan->fileDesc,pageNum,FALSE) != PFE_OK) && (recId >= 0))
+  {
+   AM_Errno = AME_PF;
+   return(AME_PF);
+  }
+return(recId);
+}
+
+
+/* Puts the record ids of up to maxRecIds next records of the index scan
+scanDesc into recIds, and returns how many it put; AME_EOF once the scan
+is over. The leaf of each record is fixed once for all the records that
+come from it. */
+AM_FindNextEntries(scanDesc,recIds,maxRecIds)
+int scanDesc;/* index scan descriptor */
+int *recIds; /* room for maxRecIds record ids */
+int maxRecIds;
 
+{
+int numRecIds; /* record ids put into recIds */
+int recId;
+int pageNum; /* leaf fixed by the scan */
+char *pageBuf;/* buffer for page */
+AM_SCAN *scan; /* entry of the scan in the scan table */
+
+/* check if scanDesc is valid */
+scan = AM_GetScan(scanDesc);
+if (scan == NULL)
+  {
+   AM_Errno = AME_INVALID_SCANDESC;
+   return(AME_INVALID_SCANDESC);
+  }
+if (AM_UseIndex(scan->fileDesc) != PFE_OK)
+  {
+   AM_Errno = AME_PF;
+   return(AME_PF);
+  }
+if ((maxRecIds <= 0) || (recIds == NULL))
+  {
+   AM_Errno = AME_INVALIDVALUE;
+   return(AME_INVALIDVALUE);
+  }
+
+pageNum = AM_NULL_PAGE;
+recId = AME_OK;
+for (numRecIds = 0; numRecIds < maxRecIds; numRecIds++)
+ {
+  recId = AM_ScanNext(scan,&pageNum,&pageBuf,numRecIds == 0);
+  if (recId < 0)
+    break;
+  recIds[numRecIds] = recId;
+ }
+if ((pageNum != AM_NULL_PAGE) &&
+    (PF_UnfixPage(scan->fileDesc,pageNum,FALSE) != PFE_OK) && (recId >= 0))
+  recId = AME_PF;
+
+/* an error is told by the next call */
+if (numRecIds > 0)
+  return(numRecIds);
+if (recId != AME_EOF)
+  AM_Errno = recId;
 return(recId);
 }
 
@@ -474,12 +677,15 @@ AM_CloseIndexScan(scanDesc)
 int scanDesc;/* scan Descriptor*/
 
 {
-if ((scanDesc < 0) || (scanDesc > MAXSCANS - 1))
+AM_SCAN *scan; /* entry of the scan in the scan table */
+
+scan = AM_GetScan(scanDesc);
+if (scan == NULL)
   {
    AM_Errno = AME_INVALID_SCANDESC;
    return(AME_INVALID_SCANDESC);
   }
-AM_scanTable[scanDesc].status = FREE;
+AM_FreeScan(scan);
 return(AME_OK);
 }
 
@@ -490,16 +696,41 @@ int fileDesc;
 {
 char *pageBuf;
 int pageNum;
+int nextPage;
+int depth;
+int fixed; /* whether the page is fixed, or a cached copy */
 int errVal;
+int leftPageNum;
+
+leftPageNum = AM_CacheLeftPage(fileDesc);
+if (leftPageNum != AM_NULL_PAGE)
+  return(leftPageNum);
 
-errVal = PF_GetFirstPage(fileDesc,&pageNum,&pageBuf);
+/* follow the first child down from the root */
+pageNum = AM_NULL_PAGE;
+depth = 0;
+errVal = AM_CacheGetPage(fileDesc,&pageNum,depth,&pageBuf,&fixed);
 AM_Check;
-if (*pageBuf == 'l')
-  AM_LeftPageNum = pageNum;
-else
-  AM_LeftPageNum = 2;
+while (!AM_IsLeaf(pageBuf))
+ {
+  bcopy(pageBuf + ((*pageBuf == 'I') ? AM_scint : AM_sint),(char *)&nextPage,
+	AM_si);
+  if (fixed)
+   {
+    errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
+    AM_Check;
+   }
+  else
+    AM_CacheRelease();
+  pageNum = nextPage;
+  depth++;
+  errVal = AM_CacheGetPage(fileDesc,&pageNum,depth,&pageBuf,&fixed);
+  AM_Check;
+ }
+leftPageNum = pageNum;
 errVal = PF_UnfixPage(fileDesc,pageNum,FALSE);
 AM_Check;
-return(AM_LeftPageNum);
+AM_CacheSetLeftPage(fileDesc,leftPageNum);
+return(leftPageNum);
 
 }
@@ -2,11 +2,12 @@
 # include "am.h"
 # include "pf.h"
 
-/* searches for a key in a binary tree - returns FOUND or NOTFOUND and
-returns the pagenumber and the offset where key is present or could 
-be inserted */
-AM_Search(fileDesc,attrType,attrLength,value,pageNum,pageBuf,indexPtr)
-int fileDesc;
+int (*AM_SearchKernel())();
+
+/* does the search of AM_Search, which times it */
+static AM_SearchPath(handle,attrType,attrLength,value,pageNum,pageBuf,
+		     indexPtr)
+AM_INDEXHANDLE *handle; /* operation the search is for */
 char attrType;
 int attrLength;
 char *value;
@@ -16,171 +17,142 @@ int *indexPtr; /* pointer to index in leaf where key is present or
                                                             can be inserted */
 
 {
+	int fileDesc; /* file descriptor of the index */
 	int errVal;
 	int nextPage; /* next page to be followed on the path from root to leaf*/
-	int retval; /* return value */
 	AM_LEAFHEADER lhead,*lheader; /* local pointer to leaf header */
 	AM_INTHEADER ihead,*iheader; /* local pointer to internal node header */
+	int (*search)(); /* search kernel for the attribute type */
+	int depth; /* of the page below the root */
+	int fixed; /* whether the page is fixed, or a cached copy */
 
         /* initialise the headeers */	
 	lheader = &lhead;
 	iheader = &ihead;
+	search = AM_SearchKernel(attrType);
+	fileDesc = handle->fileDesc;
 
         /* get the root of the B+ tree */
-
-	errVal = PF_GetFirstPage(fileDesc,pageNum,pageBuf);
+	*pageNum = AM_NULL_PAGE;
+	depth = 0;
+	errVal = AM_CacheGetPage(fileDesc,pageNum,depth,pageBuf,&fixed);
 	AM_Check;
-	if (**pageBuf == 'l' ) 
-		/* if root is a leaf page */
+	handle->rootPageNum = *pageNum;
+
+	/* find the leaf at which key is present or can be inserted */
+	for (;;)
 	{
-		bcopy(*pageBuf,lheader,AM_sl);
-		if (lheader->attrLength != attrLength)
+		if (AM_IsLeaf(*pageBuf))
+		{
+			/* leaves are never cached */
+			bcopy(*pageBuf,lheader,AM_sl);
+			if (lheader->attrLength == attrLength)
+				break;
+			PF_UnfixPage(fileDesc,*pageNum,FALSE);
 			return(AME_INVALIDATTRLENGTH);
-		
-	}
-	else /* root is not a leaf */
-	{
+		}
 		bcopy(*pageBuf,iheader,AM_sint);
 		if (iheader->attrLength != attrLength)
+		{
+			if (fixed)
+				PF_UnfixPage(fileDesc,*pageNum,FALSE);
+			else
+				AM_CacheRelease();
 			return(AME_INVALIDATTRLENGTH);
-	}
-	/* find the leaf at which key is present or can be inserted */
-	while ((**pageBuf) != 'l')
-	{
+		}
+
 		/* find the next page to be followed */
-		nextPage = AM_BinSearch(*pageBuf,attrType,attrLength,value,
-					indexPtr,iheader);
+		if (**pageBuf == 'I')
+			nextPage = AM_CBinSearch(*pageBuf,attrLength,value,
+						 indexPtr);
+		else
+			nextPage = AM_BinSearch(*pageBuf,search,attrLength,value,
+						indexPtr,iheader);
 
 		/* push onto stack for backtracking and splitting nodes if 
 		needed later */
-		AM_PushStack(*pageNum,*indexPtr);
+		errVal = AM_PushStack(handle,*pageNum,*indexPtr);
 
-		errVal = PF_UnfixPage(fileDesc,*pageNum,FALSE);
-		AM_Check;
+		if (fixed)
+		{
+			if (PF_UnfixPage(fileDesc,*pageNum,FALSE) != PFE_OK)
+				errVal = AME_PF;
+		}
+		else
+			AM_CacheRelease();
+		if (errVal != AME_OK)
+			return(errVal);
 
 		/* set pageNum to the next page to be followed */
 		*pageNum = nextPage;
+		depth++;
 
 		/* Get the next page to be followed */
-		errVal = PF_GetThisPage(fileDesc,*pageNum,pageBuf);
+		errVal = AM_CacheGetPage(fileDesc,pageNum,depth,pageBuf,&fixed);
 		AM_Check;
-
-		if (**pageBuf == 'l' ) 
-		{
-			/* if next page is a leaf */
-			bcopy(*pageBuf,lheader,AM_sl);
-			if (lheader->attrLength != attrLength)
-				return(AME_INVALIDATTRLENGTH);
-		}
-		else
-		{
-			/* if next page is an internal node */
-			bcopy(*pageBuf,iheader,AM_sint);
-			if (iheader->attrLength != attrLength)
-				return(AME_INVALIDATTRLENGTH);
-		}
 	}
+
 	/* find whether key is in leaf or not */
-	return(AM_SearchLeaf(*pageBuf,attrType,attrLength,value,indexPtr,lheader));
+	if (**pageBuf == 'L')
+		return(AM_CSearchLeaf(*pageBuf,attrLength,value,indexPtr));
+	return(AM_SearchLeaf(*pageBuf,search,attrLength,value,indexPtr,lheader));
+}
+
+
+/* searches for a key in a binary tree - returns FOUND or NOTFOUND and
+returns the pagenumber and the offset where key is present or could 
+be inserted. The path down to the leaf is pushed on the stack of handle. */
+AM_Search(handle,attrType,attrLength,value,pageNum,pageBuf,indexPtr)
+AM_INDEXHANDLE *handle; /* operation the search is for */
+char attrType;
+int attrLength;
+char *value;
+int *pageNum; /* page number of page where key is present or can be inserted*/
+char **pageBuf; /* buffer of the leaf page pageNum */
+int *indexPtr; /* index in leaf where key is present or can be inserted */
+
+{
+	long start; /* of the search, for the statistics */
+	int status;
+
+	start = PF_StatsStart();
+	status = AM_SearchPath(handle,attrType,attrLength,value,pageNum,
+			       pageBuf,indexPtr);
+	PF_StatsEnd(PF_HIST_AMSEARCH,start);
+	return(status);
 }
 
 
 /* Finds the place (index) from where the next page to be followed is got*/
-AM_BinSearch(pageBuf,attrType,attrLength,value,indexPtr,header)
+AM_BinSearch(pageBuf,search,attrLength,value,indexPtr,header)
 char *pageBuf; /* buffer where the page is found */
-char attrType; 
+int (*search)(); /* search kernel for the attribute type */
 int attrLength;
 char *value; /* attribute value for which search is called */
 int *indexPtr;  
 AM_INTHEADER *header;
 
 {
-	int low,high,mid; /* for binary search */
-	int compareVal; /* result of comparison of key with value */
 	int recSize; /* size in bytes of a key,ptr pair */
 	int pageNum; /* page number of node to be followed along the B+ tree */
 
 	recSize = AM_si  + attrLength;
-	low = 1;
-	high = header->numKeys;
-
-	while ((high - low ) > 1)
-	{
-		/* get the middle key */
-		mid = (low + high) / 2;
-
-		/* compare the value with the middle key */
-		compareVal = AM_Compare(pageBuf + AM_sint + AM_si + 
-		(mid - 1)*recSize,attrType,attrLength,value); 
-		
-		if (compareVal < 0) 
-			high = mid - 1 ;
-		else if (compareVal > 0)
-			low = mid + 1;
-		else 
-	        {   
-			/* value = middle key */
-			bcopy(pageBuf + AM_sint + mid*recSize,(char *)&pageNum,
-			      AM_si);
-			*indexPtr = mid;
-			return(pageNum);
-	        }
-	}
-
-	
-	/* check the border cases */
-	if ((high - low) == 0)
-		if(AM_Compare(pageBuf+AM_sint+AM_si +(low - 1)*recSize,attrType,
-		attrLength, value) < 0)
-		{
-			bcopy(pageBuf+AM_sint+(low-1)*recSize,(char *)&pageNum,
-			      AM_si);
-			*indexPtr = low -1;
-			return(pageNum);
-		}
-		else
-		{
-			bcopy(pageBuf+AM_sint+low*recSize,(char *)&pageNum,
-			      AM_si);
-			*indexPtr = low;
-			return(pageNum);
-		}
-
-	if ((high - low) == 1)
-		if(AM_Compare(pageBuf+AM_sint+AM_si +(low - 1)*recSize,attrType,
-		attrLength, value) < 0)
-		{
-			bcopy(pageBuf+AM_sint+(low-1)*recSize,(char *)&pageNum,
-		              AM_si);
-			*indexPtr = low -1;
-			return(pageNum);
-		}
-		else
-			if(AM_Compare(pageBuf+AM_sint+AM_si +low*recSize,
-			attrType,attrLength, value) < 0)
-			{
-				bcopy(pageBuf+AM_sint+low*recSize,
-				      (char *)&pageNum,AM_si);
-				*indexPtr = low;
-				return(pageNum);
-			}
-			else 
-		        {
-			bcopy(pageBuf+AM_sint+(low+1)*recSize,(char *)&pageNum,
-			      AM_si);
-			*indexPtr = low + 1;
-			return(pageNum);
-		        }
 
+	/* keys equal to value go right: follow the pointer after the last
+	key not greater than value */
+	*indexPtr = (*search)(pageBuf + AM_sint + AM_si,header->numKeys,recSize,
+			attrLength,value,TRUE);
+	bcopy(pageBuf + AM_sint + (*indexPtr)*recSize,(char *)&pageNum,AM_si);
+	return(pageNum);
 }
 
 
 
 /* search a leaf node for the key- returns the place where it is found or can
 be inserted */
-AM_SearchLeaf(pageBuf,attrType,attrLength,value,indexPtr,header)
+AM_SearchLeaf(pageBuf,search,attrLength,value,indexPtr,header)
 char *pageBuf; /* buffer where the leaf page resides */
-char attrType;
+int (*search)(); /* search kernel for the attribute type */
 int attrLength;
 char *value; /* attribute value to be compared with */
 int *indexPtr;/* pointer to the index where key is found or can be inserted */
@@ -188,102 +160,172 @@ AM_LEAFHEADER *header;
 
 
 {
-	int low,high,mid; /* for binary search */
-	int compareVal; /* result of comparison of key with value */
 	int recSize; /* size in bytes of a key,ptr pair */
+	char *keyPtr; /* first key not less than value */
 
 	recSize = AM_ss + attrLength;
-	low = 1;
-	high = header->numKeys;
 
-	/* The leaf is Empty */
-	if (high == 0) 
-	{
-		*indexPtr = 1;
+	/* the place of the first key not less than value */
+	*indexPtr = 1 + (*search)(pageBuf + AM_sl,header->numKeys,recSize,
+			attrLength,value,FALSE);
+	if (*indexPtr > header->numKeys)
 		return(AM_NOT_FOUND);
-	}
 
-	while ((high - low ) > 1)
+	/* that key is value if it is also not greater than value */
+	keyPtr = pageBuf + AM_sl + (*indexPtr - 1)*recSize;
+	if ((*search)(keyPtr,1,recSize,attrLength,value,TRUE) == 1)
+		return(AM_FOUND);
+	return(AM_NOT_FOUND);
+}
+
+
+
+/* Search kernels: each returns the number of keys, out of the numKeys keys
+recSize bytes apart from keyPtr, that are less than value (or not greater
+than value if orEqual). The keys are in ascending order. AM_SearchKernel
+chooses one per attribute type, so a search does not dispatch on the type
+or copy value for every comparison. */
+
+/* int keys: a branch-free lower bound. Halving the range by a multiply
+instead of a branch keeps mispredictions off the descent. */
+static int AM_SearchInt(keyPtr,numKeys,recSize,attrLength,value,orEqual)
+char *keyPtr;
+int numKeys;
+int recSize;
+int attrLength;
+char *value;
+int orEqual;
+
+{
+	int base; /* keys before base are all less than value */
+	int half;
+	int key,val;
+
+	if (numKeys == 0)
+		return(0);
+	bcopy(value,(char *)&val,AM_si);
+	base = 0;
+	while (numKeys > 1)
 	{
-		/* get the middle key */
-		mid = (low +high) / 2;
+		half = numKeys / 2;
+		bcopy(keyPtr + (base + half)*recSize,(char *)&key,AM_si);
+		base += half * ((key < val) | (orEqual & (key == val)));
+		numKeys -= half;
+	}
+	bcopy(keyPtr + base*recSize,(char *)&key,AM_si);
+	return(base + ((key < val) | (orEqual & (key == val))));
+}
 
-		/* compare value with the middle key */
-		compareVal = AM_Compare(pageBuf + AM_sl + (mid - 1)*recSize,
-		attrType,attrLength,value);
 
-		if (compareVal < 0) 
-			high = mid - 1 ;
-		else if (compareVal > 0)
-			low = mid + 1;
-		else 
-		    {   
-			*indexPtr = mid;
-			return(AM_FOUND);
-		}
+/* float keys: as for int keys */
+static int AM_SearchFloat(keyPtr,numKeys,recSize,attrLength,value,orEqual)
+char *keyPtr;
+int numKeys;
+int recSize;
+int attrLength;
+char *value;
+int orEqual;
+
+{
+	int base; /* keys before base are all less than value */
+	int half;
+	float key,val;
+
+	if (numKeys == 0)
+		return(0);
+	bcopy(value,(char *)&val,AM_sf);
+	base = 0;
+	while (numKeys > 1)
+	{
+		half = numKeys / 2;
+		bcopy(keyPtr + (base + half)*recSize,(char *)&key,AM_sf);
+		base += half * ((key < val) | (orEqual & (key == val)));
+		numKeys -= half;
 	}
+	bcopy(keyPtr + base*recSize,(char *)&key,AM_sf);
+	return(base + ((key < val) | (orEqual & (key == val))));
+}
 
-	if ((high - low) == 0)
-	{ 
-		compareVal = AM_Compare(pageBuf+AM_sl+(low - 1)*recSize,
-		attrType ,attrLength, value);
 
+/* the first AM_PREFIX characters of a char key, up to its first null, as
+an unsigned number that orders like strncmp orders the characters */
+# define AM_PREFIX 4
 
-		if (compareVal < 0)
-		{
-			*indexPtr = low; 
-			return(AM_NOT_FOUND);
-		}
-		else if (compareVal > 0)
-		{
-			*indexPtr = low + 1;
-			return(AM_NOT_FOUND);
-		}
-		else 
+static unsigned AM_CharPrefix(ptr,attrLength)
+char *ptr;
+int attrLength;
+
+{
+	unsigned prefix = 0;
+	unsigned c;
+	int i;
+
+	for (i = 0; i < AM_PREFIX; i++)
+	{
+		c = (i < attrLength) ? (unsigned char)ptr[i] : 0;
+		prefix = (prefix << 8) | c;
+		if (c == 0)
 		{
-			*indexPtr = low;
-			return(AM_FOUND);
+			/* nothing after a null counts */
+			prefix <<= 8*(AM_PREFIX - 1 - i);
+			break;
 		}
 	}
+	return(prefix);
+}
 
-	if ((high - low) == 1)
-	{
-		compareVal = AM_Compare(pageBuf+AM_sl+(low - 1)*recSize,
-		attrType ,attrLength, value); 
 
-		if (compareVal < 0)
-		{
-			*indexPtr = low; 
-			return(AM_NOT_FOUND);
-		}
-		else if (compareVal == 0)
-		{
-			*indexPtr = low;
-			return(AM_FOUND);
-		}
+/* char keys: compared by prefix first, the rest with strncmp only when
+the prefixes are equal and the key goes on past them */
+static int AM_SearchChar(keyPtr,numKeys,recSize,attrLength,value,orEqual)
+char *keyPtr;
+int numKeys;
+int recSize;
+int attrLength;
+char *value;
+int orEqual;
+
+{
+	int low,high,mid; /* keys before low are less, from high on not */
+	unsigned valPrefix,keyPrefix;
+	int more; /* whether value goes on past its prefix */
+	int compareVal; /* strncmp of the key with value */
+
+	valPrefix = AM_CharPrefix(value,attrLength);
+	more = (attrLength > AM_PREFIX) && ((valPrefix & 0xff) != 0);
+	low = 0;
+	high = numKeys;
+	while (low < high)
+	{
+		mid = (low + high) / 2;
+		keyPrefix = AM_CharPrefix(keyPtr + mid*recSize,attrLength);
+		if (keyPrefix != valPrefix)
+			compareVal = (keyPrefix < valPrefix) ? -1 : 1;
+		else if (more)
+			compareVal = strncmp(keyPtr + mid*recSize + AM_PREFIX,
+				value + AM_PREFIX,attrLength - AM_PREFIX);
 		else
-		{ 
-			compareVal = AM_Compare(pageBuf+AM_sl+low*recSize,
-			attrType, attrLength, value);
-
-			if (compareVal < 0)
-			{
-				*indexPtr = low + 1;
-				return(AM_NOT_FOUND);
-			}
-			else if (compareVal > 0) 
-			{
-				*indexPtr = low + 2;
-				return(AM_NOT_FOUND);
-			}
-			else
-			{
-				*indexPtr = low + 1;
-				return(AM_FOUND);
-			}
-		}
+			compareVal = 0;
+		if ((compareVal < 0) || (orEqual && (compareVal == 0)))
+			low = mid + 1;
+		else
+			high = mid;
 	}
+	return(low);
+}
 
+
+/* returns the search kernel for keys of type attrType */
+int (*AM_SearchKernel(attrType))()
+char attrType;
+
+{
+	switch(attrType)
+	{
+	case 'i' : return(AM_SearchInt);
+	case 'f' : return(AM_SearchFloat);
+	default : return(AM_SearchChar);
+	}
 }
 
 
@@ -0,0 +1,31 @@
+# include <stdio.h>
+# include "../pflayer/sort.h"
+# include "am.h"
+
+
+/* Input for AM_BulkLoad from an external sort, given as arg. Every item of
+the sort is a key followed by the int recId to index it under. */
+AM_SortedEntry(arg,value,recId)
+char *arg; /* the SORT_Sort to read, see ../pflayer/sort.h */
+char *value; /* gets the key */
+int *recId; /* gets the recId */
+
+{
+	char item[AM_MAXATTRLENGTH + AM_si]; /* key followed by recId */
+	int length; /* size of item, then length of the item read */
+	int status;
+
+	length = AM_MAXATTRLENGTH + AM_si;
+	status = SORT_Next((SORT_Sort *)arg,item,&length);
+	if (status == SORT_EOF)
+		return(AME_EOF);
+	if ((status != SORT_OK) || (length < AM_si))
+		{
+		 AM_Errno = AME_SORT;
+		 return(AME_SORT);
+                }
+
+	bcopy(item,value,length - AM_si);
+	bcopy(item + length - AM_si,(char *)recId,AM_si);
+	return(AME_OK);
+}
@@ -2,43 +2,45 @@
 # include "am.h"
 # include "pf.h"
 
-# define AM_MAXSTACK 50
+/* The path stack of an operation is kept in its AM_INDEXHANDLE */
 
-struct
-    {
-     int pageNumber;
-     int offset;
-    } AM_Stack[AM_MAXSTACK];
+/* Starts an operation on the index fileDesc, with an empty path */
+AM_InitHandle(handle,fileDesc)
+AM_INDEXHANDLE *handle;
+int fileDesc;
 
-int AM_topofStackPtr = -1;
+{
+handle->fileDesc = fileDesc;
+handle->rootPageNum = AM_NULL_PAGE;
+handle->topofStack = -1;
+}
 
-AM_PushStack(pageNum,offset)
+AM_PushStack(handle,pageNum,offset)
+AM_INDEXHANDLE *handle;
 int pageNum;
 int offset;
 
 {
-AM_topofStackPtr++;
-AM_Stack[AM_topofStackPtr].pageNumber  = pageNum;
-AM_Stack[AM_topofStackPtr].offset  = offset;
+if (handle->topofStack >= AM_MAXSTACK - 1)
+  return(AME_INTERROR);
+handle->topofStack++;
+handle->path[handle->topofStack].pageNumber = pageNum;
+handle->path[handle->topofStack].offset = offset;
+return(AME_OK);
 }
 
-AM_PopStack()
+AM_PopStack(handle)
+AM_INDEXHANDLE *handle;
 
 {
-AM_topofStackPtr--;
+handle->topofStack--;
 }
 
-AM_topofStack(pageNum,offset)
+AM_topofStack(handle,pageNum,offset)
+AM_INDEXHANDLE *handle;
 int *pageNum;
 int *offset;
 {
-*pageNum = AM_Stack[AM_topofStackPtr].pageNumber ;
-*offset = AM_Stack[AM_topofStackPtr].offset ;
+*pageNum = handle->path[handle->topofStack].pageNumber;
+*offset = handle->path[handle->topofStack].offset;
 }
-
-AM_EmptyStack()
-
-{
-AM_topofStackPtr = -1;
-}
-
@@ -0,0 +1,588 @@
+/* benchmark.c: times PF page access, RHF record operations and AM index
+operations under skewed workloads. Each test writes one CSV line:
+
+	test,workload,ops,seconds,ops_per_sec,p50_us,p99_us,
+	logical_reads,physical_reads,physical_writes
+
+the last three from PF_GetStats() over the test. Every random choice
+comes from a generator seeded with -s, so two runs with the same options
+do the same operations. Usage:
+
+	benchmark [-t pf|rhf|am|all] [-w workload|all] [-n ops]
+		  [-r records] [-b buffers] [-z theta] [-s seed]
+
+The workloads pick which page, record or key each operation is for:
+	uniform	every item alike
+	zipf	Zipfian over the items, with parameter -z; the items are
+		shuffled so that the hot ones are not neighbours
+	hotspot	4 operations in 5 on a fifth of the items
+	seq	the items in order, over and over
+	mix	zipf, but one operation in MIXSCANS starts a scan of
+		MIXSCANLEN items in order */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../pflayer/rhf.h"
+#include "am.h"
+#include "testam.h"
+
+#define PFNAME "bench.pf"	/* file of the PF tests */
+#define HEAPNAME "bench.heap"	/* heap file of the RHF tests */
+#define INDEXNAME "bench"	/* relation of the AM indexes */
+#define MINREC 16	/* shortest RHF record */
+#define MAXREC 400	/* longest RHF record */
+#define CHARKEY 20	/* attrLength of 'c' keys */
+#define RANGELEN 100	/* recIds read by each range scan */
+#define HOTSPOT 5	/* hotspot: 1/HOTSPOT of the items ... */
+#define HOTOPS 80	/* ... get HOTOPS % of the operations */
+#define MIXSCANS 10	/* mix: 1 in MIXSCANS operations starts a scan */
+#define MIXSCANLEN 32	/* of this many items */
+#define FNAME_LENGTH 80	/* file name size */
+
+extern double atof();
+extern long atol();
+
+/* workload kinds */
+#define W_UNIFORM 0
+#define W_ZIPF 1
+#define W_HOTSPOT 2
+#define W_SEQ 3
+#define W_MIX 4
+#define W_NUM 5
+char *wnames[W_NUM] = { "uniform", "zipf", "hotspot", "seq", "mix" };
+
+/* options */
+int optOps = 20000;	/* operations per test */
+int optRecords = 20000;	/* pages, records or keys of each test */
+int optBuffers = 200;	/* buffer pool size */
+double optTheta = 0.99;	/* zipf parameter, not 1 */
+unsigned long optSeed = 1;
+int optWorkload = -1;	/* workload to run, or -1 for all */
+char *optTest = "all";
+
+double *latency;	/* latency of each operation of a test, in seconds */
+
+/* state of the random number generator (xorshift64*) */
+unsigned long rngState;
+
+unsigned long nextRand()
+{
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return(rngState * 2685821657736338717UL);
+}
+
+/* uniform over [0,1) */
+double randUnit()
+{
+	return((nextRand() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/* uniform over [0,n) */
+int randBelow(n)
+int n;
+{
+	return((int)(nextRand() % (unsigned long)n));
+}
+
+/* workload generator over the items 0..n-1 */
+typedef struct {
+	int kind;
+	int n;
+	int *perm;	/* shuffled items, for zipf, hotspot and mix */
+	double zetan,alpha,eta;	/* zipf constants */
+	int next;	/* seq, and mix during a scan: next item */
+	int scanLeft;	/* mix: items left of the current scan */
+} Gen;
+
+/* a random permutation of 0..n-1 */
+int *shuffled(n)
+int n;
+{
+int *perm;
+int i,j,t;
+
+	if ((perm = (int *)malloc(n * sizeof(int))) == NULL){
+		fprintf(stderr,"out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < n; i++)
+		perm[i] = i;
+	for (i = n - 1; i > 0; i--){
+		j = randBelow(i + 1);
+		t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+	}
+	return(perm);
+}
+
+/* starts g on workload kind over n items: every run of a workload
+starts from the same seed, so it makes the same choices */
+genInit(g,kind,n)
+Gen *g;
+int kind;
+int n;
+{
+double zeta2;
+int i;
+
+	rngState = optSeed * 0x9E3779B97F4A7C15UL + kind + 1;
+	g->kind = kind;
+	g->n = n;
+	g->next = 0;
+	g->scanLeft = 0;
+	g->perm = shuffled(n);
+
+	/* Gray et al., "Quickly generating billion-record synthetic
+	databases" */
+	g->zetan = 0;
+	for (i = 1; i <= n; i++)
+		g->zetan += 1.0 / pow((double)i,optTheta);
+	zeta2 = 1.0 + 1.0 / pow(2.0,optTheta);
+	g->alpha = 1.0 / (1.0 - optTheta);
+	g->eta = (1.0 - pow(2.0 / n,1.0 - optTheta)) /
+			(1.0 - zeta2 / g->zetan);
+}
+
+genFree(g)
+Gen *g;
+{
+	free((char *)g->perm);
+}
+
+/* rank of the next zipf item, 0 the most frequent */
+int zipfRank(g)
+Gen *g;
+{
+double u,uz;
+int rank;
+
+	u = randUnit();
+	uz = u * g->zetan;
+	if (uz < 1.0)
+		return(0);
+	if (uz < 1.0 + pow(0.5,optTheta))
+		return(1);
+	rank = (int)(g->n * pow(g->eta * u - g->eta + 1.0,g->alpha));
+	return((rank < g->n) ? rank : g->n - 1);
+}
+
+/* the next item of the workload */
+int genNext(g)
+Gen *g;
+{
+int hot;
+
+	switch (g->kind){
+	case W_ZIPF:
+		return(g->perm[zipfRank(g)]);
+	case W_HOTSPOT:
+		hot = (g->n / HOTSPOT > 0) ? g->n / HOTSPOT : 1;
+		if (randBelow(100) < HOTOPS || hot == g->n)
+			return(g->perm[randBelow(hot)]);
+		return(g->perm[hot + randBelow(g->n - hot)]);
+	case W_SEQ:
+		g->next %= g->n;
+		return(g->next++);
+	case W_MIX:
+		if (g->scanLeft > 0){
+			g->scanLeft--;
+			g->next %= g->n;
+			return(g->next++);
+		}
+		if (randBelow(MIXSCANS) == 0){
+			g->next = randBelow(g->n);
+			g->scanLeft = MIXSCANLEN - 1;
+			return(g->next++);
+		}
+		return(g->perm[zipfRank(g)]);
+	default:
+		return(randBelow(g->n));
+	}
+}
+
+double now()
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+int compareDouble(a,b)
+double *a,*b;
+{
+	return((*a < *b) ? -1 : (*a > *b));
+}
+
+/* starts timing a test */
+double startTest()
+{
+	PF_ResetStats();
+	return(now());
+}
+
+/* writes the CSV line of a test of n operations started at start */
+report(test,workload,n,start)
+char *test;
+char *workload;
+int n;
+double start;
+{
+double secs;
+long logical,physRead,physWrite;
+
+	secs = now() - start;
+	PF_GetStats(&logical,&physRead,&physWrite);
+	if (n == 0){
+		printf("%s,%s,0,%.6f,0,0,0,%ld,%ld,%ld\n",test,workload,secs,
+		       logical,physRead,physWrite);
+		return;
+	}
+	qsort((char *)latency,n,sizeof(double),compareDouble);
+	printf("%s,%s,%d,%.6f,%.0f,%.2f,%.2f,%ld,%ld,%ld\n",test,workload,n,
+	       secs,(secs > 0) ? n / secs : 0.0,latency[n / 2] * 1e6,
+	       latency[(n * 99) / 100] * 1e6,logical,physRead,physWrite);
+	fflush(stdout);
+}
+
+/* TRUE if workload w is to be run */
+runs(w)
+int w;
+{
+	return(optWorkload < 0 || optWorkload == w);
+}
+
+fail(what)
+char *what;
+{
+	PF_PrintError(what);
+	exit(1);
+}
+
+/* PF: fix and unfix pages of a file of optRecords pages */
+benchPF()
+{
+Gen gen;
+char *pageBuf;
+double start,t;
+int fd,page,w,i;
+
+	PF_DestroyFile(PFNAME);
+	if (PF_CreateFile(PFNAME) != PFE_OK || (fd = PF_OpenFile(PFNAME)) < 0)
+		fail("PF_CreateFile");
+	for (i = 0; i < optRecords; i++){
+		if (PF_AllocPage(fd,&page,&pageBuf) != PFE_OK)
+			fail("PF_AllocPage");
+		memset(pageBuf,i,PF_PAGE_SIZE);
+		if (PF_UnfixPage(fd,page,TRUE) != PFE_OK)
+			fail("PF_UnfixPage");
+	}
+	if (PF_CloseFile(fd) != PFE_OK)
+		fail("PF_CloseFile");
+
+	for (w = 0; w < W_NUM; w++){
+		if (!runs(w))
+			continue;
+		if ((fd = PF_OpenFile(PFNAME)) < 0)
+			fail("PF_OpenFile");
+		genInit(&gen,w,optRecords);
+		start = startTest();
+		for (i = 0; i < optOps; i++){
+			page = genNext(&gen);
+			t = now();
+			if (PF_GetThisPage(fd,page,&pageBuf) != PFE_OK ||
+			    PF_UnfixPage(fd,page,FALSE) != PFE_OK)
+				fail("PF_GetThisPage");
+			latency[i] = now() - t;
+		}
+		report("pf_get",wnames[w],optOps,start);
+		genFree(&gen);
+		if (PF_CloseFile(fd) != PFE_OK)
+			fail("PF_CloseFile");
+	}
+	PF_DestroyFile(PFNAME);
+}
+
+/* RHF: insert optRecords records of MINREC to MAXREC bytes, get them,
+scan them and delete them */
+benchRHF()
+{
+Gen gen;
+RID *rids;
+RID rid;
+RHF_Scan scan;
+char record[MAXREC];
+double start,t;
+int fd,length,w,i,n;
+
+	if ((rids = (RID *)malloc(optRecords * sizeof(RID))) == NULL){
+		fprintf(stderr,"out of memory\n");
+		exit(1);
+	}
+	RHF_DestroyFile(HEAPNAME);
+	if (RHF_CreateFile(HEAPNAME) != RHF_OK ||
+	    (fd = RHF_OpenFile(HEAPNAME)) < 0)
+		fail("RHF_CreateFile");
+
+	rngState = optSeed;
+	start = startTest();
+	for (i = 0; i < optRecords; i++){
+		length = MINREC + randBelow(MAXREC - MINREC + 1);
+		memset(record,i,length);
+		t = now();
+		if (RHF_InsertRecord(fd,record,length,&rids[i]) != RHF_OK)
+			fail("RHF_InsertRecord");
+		latency[i] = now() - t;
+	}
+	report("rhf_insert","-",optRecords,start);
+	if (RHF_CloseFile(fd) != RHF_OK)
+		fail("RHF_CloseFile");
+
+	for (w = 0; w < W_NUM; w++){
+		if (!runs(w))
+			continue;
+		if ((fd = RHF_OpenFile(HEAPNAME)) < 0)
+			fail("RHF_OpenFile");
+		genInit(&gen,w,optRecords);
+		start = startTest();
+		for (i = 0; i < optOps; i++){
+			n = genNext(&gen);
+			t = now();
+			if (RHF_GetRecord(fd,&rids[n],record,&length) != RHF_OK)
+				fail("RHF_GetRecord");
+			latency[i] = now() - t;
+		}
+		report("rhf_get",wnames[w],optOps,start);
+		genFree(&gen);
+		if (RHF_CloseFile(fd) != RHF_OK)
+			fail("RHF_CloseFile");
+	}
+
+	if ((fd = RHF_OpenFile(HEAPNAME)) < 0)
+		fail("RHF_OpenFile");
+	if (RHF_StartScan(fd,&scan) != RHF_OK)
+		fail("RHF_StartScan");
+	start = startTest();
+	for (n = 0; n < optRecords; n++){
+		t = now();
+		if (RHF_GetNextRecord(&scan,record,&length,&rids[n]) != RHF_OK)
+			break;
+		latency[n] = now() - t;
+	}
+	report("rhf_scan","-",n,start);
+	RHF_EndScan(&scan);
+
+	/* in random order */
+	rngState = optSeed + 1;
+	for (i = optRecords - 1; i > 0; i--){
+		n = randBelow(i + 1);
+		rid = rids[i];
+		rids[i] = rids[n];
+		rids[n] = rid;
+	}
+	start = startTest();
+	for (i = 0; i < optRecords; i++){
+		t = now();
+		if (RHF_DeleteRecord(fd,&rids[i]) != RHF_OK)
+			fail("RHF_DeleteRecord");
+		latency[i] = now() - t;
+	}
+	report("rhf_delete","-",optRecords,start);
+	if (RHF_CloseFile(fd) != RHF_OK)
+		fail("RHF_CloseFile");
+	RHF_DestroyFile(HEAPNAME);
+	free((char *)rids);
+}
+
+/* makes the key of item k in value; keys are in the order of items */
+makeKey(attrType,k,value)
+char attrType;
+int k;
+char *value;
+{
+float f;
+
+	switch (attrType){
+	case INT_TYPE:
+		bcopy((char *)&k,value,INT_SIZE);
+		break;
+	case FLOAT_TYPE:
+		f = k * 0.5;
+		bcopy((char *)&f,value,FLOAT_SIZE);
+		break;
+	default:
+		memset(value,0,CHARKEY);
+		sprintf(value,"k%012d",k);
+	}
+}
+
+/* AM: insert optRecords keys of type attrType, look them up and scan
+ranges of them */
+benchAM(attrType,indexNo)
+char attrType;
+int indexNo;
+{
+Gen gen;
+char fname[FNAME_LENGTH];
+char test[FNAME_LENGTH];
+char value[CHARKEY];
+int attrLength;
+int *order;
+double start,t;
+int fd,sd,recId,k,w,i,j,n;
+
+	attrLength = (attrType == CHAR_TYPE) ? CHARKEY : INT_SIZE;
+	AM_DestroyIndex(INDEXNAME,indexNo);
+	if (AM_CreateIndex(INDEXNAME,indexNo,attrType,attrLength) != AME_OK){
+		AM_PrintError("AM_CreateIndex");
+		exit(1);
+	}
+	sprintf(fname,"%s.%d",INDEXNAME,indexNo);
+	if ((fd = PF_OpenFile(fname)) < 0)
+		fail("PF_OpenFile");
+
+	/* in random order */
+	rngState = optSeed;
+	order = shuffled(optRecords);
+	start = startTest();
+	for (i = 0; i < optRecords; i++){
+		makeKey(attrType,order[i],value);
+		t = now();
+		if (AM_InsertEntry(fd,attrType,attrLength,value,order[i]) !=
+		    AME_OK){
+			AM_PrintError("AM_InsertEntry");
+			exit(1);
+		}
+		latency[i] = now() - t;
+	}
+	free((char *)order);
+	sprintf(test,"am_insert_%c",attrType);
+	report(test,"-",optRecords,start);
+	if (PF_CloseFile(fd) != PFE_OK)
+		fail("PF_CloseFile");
+
+	for (w = 0; w < W_NUM; w++){
+		if (!runs(w))
+			continue;
+
+		/* point lookups */
+		if ((fd = PF_OpenFile(fname)) < 0)
+			fail("PF_OpenFile");
+		genInit(&gen,w,optRecords);
+		start = startTest();
+		for (i = 0; i < optOps; i++){
+			k = genNext(&gen);
+			makeKey(attrType,k,value);
+			t = now();
+			sd = AM_OpenIndexScan(fd,attrType,attrLength,EQ_OP,value);
+			recId = (sd >= 0) ? AM_FindNextEntry(sd) : sd;
+			if (sd >= 0)
+				AM_CloseIndexScan(sd);
+			latency[i] = now() - t;
+			if (recId != k){
+				fprintf(stderr,"key %d not found\n",k);
+				exit(1);
+			}
+		}
+		sprintf(test,"am_lookup_%c",attrType);
+		report(test,wnames[w],optOps,start);
+
+		/* range scans of RANGELEN recIds, a tenth as many */
+		n = optOps / 10;
+		start = startTest();
+		for (i = 0; i < n; i++){
+			k = genNext(&gen);
+			makeKey(attrType,k,value);
+			t = now();
+			sd = AM_OpenIndexScan(fd,attrType,attrLength,GE_OP,value);
+			if (sd < 0){
+				AM_PrintError("AM_OpenIndexScan");
+				exit(1);
+			}
+			for (j = 0; j < RANGELEN && AM_FindNextEntry(sd) >= 0; j++)
+				;
+			AM_CloseIndexScan(sd);
+			latency[i] = now() - t;
+		}
+		sprintf(test,"am_range_%c",attrType);
+		report(test,wnames[w],n,start);
+		genFree(&gen);
+		if (PF_CloseFile(fd) != PFE_OK)
+			fail("PF_CloseFile");
+	}
+	AM_DestroyIndex(INDEXNAME,indexNo);
+}
+
+usage()
+{
+	fprintf(stderr,"usage: benchmark [-t pf|rhf|am|all] [-w workload|all] "
+		"[-n ops] [-r records] [-b buffers] [-z theta] [-s seed]\n");
+	exit(1);
+}
+
+main(argc,argv)
+int argc;
+char **argv;
+{
+int i,w,n;
+
+	for (i = 1; i < argc; i++){
+		if (argv[i][0] != '-' || argv[i][2] != '\0' || i + 1 >= argc)
+			usage();
+		switch (argv[i++][1]){
+		case 't':
+			optTest = argv[i];
+			break;
+		case 'w':
+			optWorkload = -1;
+			for (w = 0; w < W_NUM; w++)
+				if (strcmp(argv[i],wnames[w]) == 0)
+					optWorkload = w;
+			if (optWorkload < 0 && strcmp(argv[i],"all") != 0)
+				usage();
+			break;
+		case 'n':
+			optOps = atoi(argv[i]);
+			break;
+		case 'r':
+			optRecords = atoi(argv[i]);
+			break;
+		case 'b':
+			optBuffers = atoi(argv[i]);
+			break;
+		case 'z':
+			optTheta = atof(argv[i]);
+			break;
+		case 's':
+			optSeed = (unsigned long)atol(argv[i]);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optOps <= 0 || optRecords < 2 || optBuffers <= 0 ||
+	    optTheta <= 0 || optTheta == 1.0)
+		usage();
+	n = (optOps > optRecords) ? optOps : optRecords;
+	if ((latency = (double *)malloc(n * sizeof(double))) == NULL){
+		fprintf(stderr,"out of memory\n");
+		exit(1);
+	}
+
+	PF_SetBufferSize(optBuffers);
+	PF_Init();
+	printf("test,workload,ops,seconds,ops_per_sec,p50_us,p99_us,"
+	       "logical_reads,physical_reads,physical_writes\n");
+	if (strcmp(optTest,"pf") == 0 || strcmp(optTest,"all") == 0)
+		benchPF();
+	if (strcmp(optTest,"rhf") == 0 || strcmp(optTest,"all") == 0)
+		benchRHF();
+	if (strcmp(optTest,"am") == 0 || strcmp(optTest,"all") == 0){
+		benchAM(INT_TYPE,0);
+		benchAM(FLOAT_TYPE,1);
+		benchAM(CHAR_TYPE,2);
+	}
+	exit(0);
+}
@@ -30,11 +30,41 @@
 #define PFE_HASHNOTFOUND -18	/* hash table entry not found */
 #define PFE_HASHPAGEEXIST -19	/* page already exist in hash table */
 
+/* Codes from -20 to -49 belong to the RHF, SORT and PAX layers, which
+pass PF codes through, so further PF codes start at -50 */
+#define PFE_VERSION	-50	/* unknown file format version */
+#define PFE_READONLY	-51	/* file is open read-only */
+#define PFE_NOSTAT	-52	/* no such histogram or counter */
+#define PFE_PAGESIZE	-53	/* invalid page size */
 
-/* page size */
+/* latency histograms and event counters of the PF statistics */
+#define PF_HIST_AMSEARCH 3	/* AM_Search() */
+#define PF_CNT_AMSPLIT	1	/* AM index nodes split */
+#define PF_CNT_AMSCANPAGES 2	/* leaves AM index scans went on to */
+
+/* PF_OpenFileMode() modes */
+#define PF_MODE_RDWR	0	/* pages go through the buffer pool */
+#define PF_MODE_MMAP	1	/* read-only, pages served from a mapping */
+
+
+/* page size: the size of an AM node on a file of the default size */
 #define PF_PAGE_SIZE	1020
 
+/* file page sizes: the default one, and the largest PF_CreateFileSize()
+takes */
+#define PF_FILE_PAGE_SIZE 4096
+#define PF_MAX_PAGE_SIZE 65536
+
 /* externs from the PF layer */
-extern int PFerrno;		/* error number of last error */
+extern __thread int PFerrno;	/* error number of last error, one
+				per thread */
 extern void PF_Init();
 extern void PF_PrintError();
+extern int PF_OpenFileMode();
+extern int PF_FileMode();
+extern int PF_FileStamp();
+extern int PF_CreateFileSize();
+extern int PF_PageSize();
+extern long PF_StatsStart();
+extern void PF_StatsEnd();
+extern void PF_StatsCount();
@@ -40,6 +40,16 @@ typedef struct smallrec {
 	int recval;
 } smallrec;
 
+/* key the index tests give many recIds, and how many more it gets */
+#define DUPKEY	1234
+#ifndef NUMDUPS
+#define NUMDUPS	100
+#endif
+
+/* in testutil.c */
+extern int countPages();	/* # of pages of an index */
+extern int newIndex();		/* creates and opens an empty index */
+
 /* successor function, assuming ch is a character */
 #define succ(ch) ((char)((int)(ch)+1))
 
@@ -0,0 +1,474 @@
+/* testbulk.c: tests bulk loading of an index. */
+#include <stdio.h>
+#include "../pflayer/sort.h"
+#include "am.h"
+#include "testam.h"
+
+#define MAXRECS	10000	/* # of keys to bulk load */
+#define NUMPROBES 3000	/* # of keys of the batch lookup */
+#define NUMBATCH 100	/* recIds a scan returns at a time */
+#define FNAME_LENGTH 80	/* file name size */
+#define HEAPNAME "testrel.heap"	/* heap file for the sorted load */
+#define FETCHKEY 2000	/* heap records with keys below it are fetched */
+
+extern AM_SortedEntry();	/* reads AM_BulkLoad input from a sort */
+
+/* input stream over the keys low..high-1, in steps of step. Key k has
+recId k, and DUPKEY has NUMDUPS more. */
+typedef struct {
+	int low,high,step;
+	int next;	/* next key to return */
+	int dups;	/* recIds of the current key returned so far */
+	int unsorted;	/* swap two keys halfway through */
+} Stream;
+
+nextEntry(arg,value,recId)
+char *arg;
+char *value;
+int *recId;
+{
+Stream *s = (Stream *)arg;
+int key;
+
+	if (s->next >= s->high)
+		return(AME_EOF);
+	key = s->next;
+	if (s->unsorted && key == (s->low + s->high)/2)
+		key = s->low;
+	bcopy((char *)&key,value,sizeof(int));
+	*recId = key + s->dups*MAXRECS;
+	if (key == DUPKEY && s->dups < NUMDUPS)
+		s->dups++;
+	else {
+		s->dups = 0;
+		s->next += s->step;
+	}
+	return(AME_OK);
+}
+
+/* builds the index entry of a heap record: its key, then its recId */
+int makeEntry(char *record, int length, RID *rid, char *item, void *arg)
+{
+	bcopy(record,item,2*sizeof(int));
+	return(2*sizeof(int));
+}
+
+/* bulk loads the keys low..high-1 in steps of step */
+bulkLoad(fd,low,high,step,fillFactor)
+int fd,low,high,step,fillFactor;
+{
+Stream s;
+
+	s.low = low; s.high = high; s.step = step;
+	s.next = low; s.dups = 0; s.unsorted = FALSE;
+	return(AM_BulkLoad(fd,INT_TYPE,sizeof(int),nextEntry,(char *)&s,
+		fillFactor));
+}
+
+/* # of recIds found by an equality scan for key */
+countEqual(fd,key)
+int fd,key;
+{
+int sd,n = 0;
+
+	sd = AM_OpenIndexScan(fd,INT_TYPE,sizeof(int),EQ_OP,(char *)&key);
+	while (AM_FindNextEntry(sd) >= 0)
+		n++;
+	AM_CloseIndexScan(sd);
+	return(n);
+}
+
+/* counts a recId of probe key i, for AM_LookupBatch */
+countFound(arg,i,recId)
+char *arg;
+int i;
+int recId;
+{
+	((int *)arg)[i]++;
+	return(AME_OK);
+}
+
+/* checks a heap record fetched through the index, for AM_FetchRecords;
+arg counts the records of keys below FETCHKEY */
+checkRecord(arg,rid,record,length)
+char *arg;
+RID *rid;
+char *record;
+int length;
+{
+int rec[2];
+
+	bcopy(record,(char *)rec,sizeof(rec));
+	if (length != sizeof(rec) || rec[0] >= FETCHKEY ||
+	    rec[0] != (rec[1] * 7919) % MAXRECS)
+		return(AME_INVALIDVALUE);
+	(*(int *)arg)++;
+	return(AME_OK);
+}
+
+main()
+{
+int fd,fd2;	/* file descriptors for the indexes */
+int recnum;	/* record number */
+int sd;	/* scan descriptor */
+int numrec;	/* # of records retrieved */
+int expected;
+int errors = 0;
+int error;
+int key,lastkey;
+Stream s;
+int hfd;	/* heap file descriptor */
+int rec[2];	/* heap record: key, then recId */
+RID rid;
+SORT_Sort *sort;
+SORT_Key sortKey;
+RHF_Scan heapScan;
+long reads,physReads,physWrites;	/* PF statistics */
+int probes[NUMPROBES];	/* keys of the batch lookup */
+int counts[NUMPROBES];	/* recIds it finds for each */
+int batch[NUMBATCH];	/* recIds from a scan */
+int i,n;
+int insertedPages;	/* pages of the index built by inserts */
+char fname[FNAME_LENGTH];
+
+	printf("initializing\n");
+	PF_Init();
+
+	/* bulk load, and compare with the same index built by inserts */
+	printf("bulk loading %d keys\n",MAXRECS);
+	fd = newIndex(0,INT_TYPE,sizeof(int));
+	if ((error = bulkLoad(fd,0,MAXRECS,1,100)) != AME_OK){
+		AM_PrintError("AM_BulkLoad");
+		exit(1);
+	}
+	fd2 = newIndex(1,INT_TYPE,sizeof(int));
+	for (recnum = 0; recnum < MAXRECS; recnum++)
+		AM_InsertEntry(fd2,INT_TYPE,sizeof(int),(char *)&recnum,recnum);
+	numrec = countPages(fd);
+	expected = countPages(fd2);
+	printf("bulk loaded index: %d pages, inserted index: %d pages\n",
+		numrec,expected);
+	if (numrec >= expected)
+		errors++;
+	insertedPages = expected;
+	PF_CloseFile(fd2);
+	AM_DestroyIndex(RELNAME,1);
+
+	/* every recId comes back once, in key order */
+	printf("scanning the whole index\n");
+	numrec = 0;
+	lastkey = -1;
+	sd = AM_OpenIndexScan(fd,INT_TYPE,sizeof(int),EQ_OP,NULL);
+	while ((recnum = AM_FindNextEntry(sd)) >= 0){
+		key = recnum % MAXRECS;
+		if (key < lastkey)
+			errors++;
+		lastkey = key;
+		numrec++;
+	}
+	AM_CloseIndexScan(sd);
+	expected = MAXRECS + NUMDUPS;
+	printf("retrieved %d records (expected %d)\n",numrec,expected);
+	if (numrec != expected)
+		errors++;
+
+	/* every key can be found from the root */
+	printf("searching for every key\n");
+	for (key = 0; key < MAXRECS; key++)
+		if (countEqual(fd,key) != ((key == DUPKEY) ? NUMDUPS + 1 : 1))
+			errors++;
+
+	/* with the internal nodes cached, a lookup only fixes its leaf: once
+	to search it and once to read the recId, and the next leaf to find
+	the end of the last key of a leaf */
+	expected = 2000 + countPages(fd);
+	PF_ResetStats();
+	for (key = 0; key < 1000; key++)
+		countEqual(fd,key);
+	PF_GetStats(&reads,&physReads,&physWrites);
+	printf("%ld pages fixed for 1000 lookups\n",reads);
+	if (reads > expected)
+		errors++;
+
+	/* a batch lookup in random order, with keys not in the index, fixes
+	no leaf twice */
+	for (i = 0; i < NUMPROBES; i++){
+		probes[i] = (i * 7919) % (MAXRECS + MAXRECS/2) - 100;
+		counts[i] = 0;
+	}
+	expected = countPages(fd);
+	PF_ResetStats();
+	if (AM_LookupBatch(fd,INT_TYPE,sizeof(int),(char *)probes,NUMPROBES,
+	    countFound,(char *)counts) != AME_OK){
+		AM_PrintError("AM_LookupBatch");
+		errors++;
+	}
+	PF_GetStats(&reads,&physReads,&physWrites);
+	printf("%ld pages fixed for a batch of %d lookups\n",reads,NUMPROBES);
+	if (reads > expected)
+		errors++;
+	for (i = 0; i < NUMPROBES; i++)
+		if (counts[i] != ((probes[i] < 0 || probes[i] >= MAXRECS) ? 0 :
+		    (probes[i] == DUPKEY) ? NUMDUPS + 1 : 1))
+			errors++;
+
+	/* a range scan many recIds at a time fixes each leaf once */
+	key = 100;
+	numrec = 0;
+	lastkey = -1;
+	PF_ResetStats();
+	sd = AM_OpenIndexScan(fd,INT_TYPE,sizeof(int),GT_OP,(char *)&key);
+	while ((n = AM_FindNextEntries(sd,batch,NUMBATCH)) > 0)
+		for (i = 0; i < n; i++){
+			if (batch[i] % MAXRECS <= key || batch[i] % MAXRECS < lastkey)
+				errors++;
+			lastkey = batch[i] % MAXRECS;
+			numrec++;
+		}
+	AM_CloseIndexScan(sd);
+	PF_GetStats(&reads,&physReads,&physWrites);
+	expected = MAXRECS - key - 1 + NUMDUPS;
+	printf("%d records greater than %d (expected %d), %ld pages fixed\n",
+		numrec,key,expected,reads);
+	if (numrec != expected || n != AME_EOF ||
+	    reads > countPages(fd) + (numrec + NUMBATCH - 1)/NUMBATCH)
+		errors++;
+
+	numrec = 0;
+	key = 100;
+	sd = AM_OpenIndexScan(fd,INT_TYPE,sizeof(int),LT_OP,(char *)&key);
+	while (AM_FindNextEntry(sd) >= 0)
+		numrec++;
+	AM_CloseIndexScan(sd);
+	printf("%d records less than 100\n",numrec);
+	if (numrec != 100)
+		errors++;
+
+	/* the loaded tree takes inserts and deletes as usual */
+	printf("inserting and deleting after the load\n");
+	for (recnum = MAXRECS; recnum < MAXRECS + 1000; recnum++)
+		AM_InsertEntry(fd,INT_TYPE,sizeof(int),(char *)&recnum,recnum);
+	for (recnum = 0; recnum < MAXRECS; recnum += 2)
+		AM_DeleteEntry(fd,INT_TYPE,sizeof(int),(char *)&recnum,recnum);
+	numrec = 0;
+	sd = AM_OpenIndexScan(fd,INT_TYPE,sizeof(int),EQ_OP,NULL);
+	while (AM_FindNextEntry(sd) >= 0)
+		numrec++;
+	AM_CloseIndexScan(sd);
+	expected = MAXRECS/2 + 1000 + NUMDUPS;
+	printf("retrieved %d records (expected %d)\n",numrec,expected);
+	if (numrec != expected)
+		errors++;
+
+	/* after most keys are deleted, reorganizing gives the pages of the
+	deleted keys back, and keeps the ones left */
+	printf("reorganizing an index after deletes\n");
+	fd2 = newIndex(1,INT_TYPE,sizeof(int));
+	for (recnum = 0; recnum < MAXRECS; recnum++)
+		AM_InsertEntry(fd2,INT_TYPE,sizeof(int),(char *)&recnum,recnum);
+	for (recnum = 0; recnum < MAXRECS; recnum++)
+		if (recnum % 10 != 0)
+			AM_DeleteEntry(fd2,INT_TYPE,sizeof(int),(char *)&recnum,
+				recnum);
+	expected = countPages(fd2);
+	if ((error = AM_Reorganize(fd2,INT_TYPE,sizeof(int),100)) != AME_OK)
+		AM_PrintError("AM_Reorganize");
+	numrec = countPages(fd2);
+	printf("%d pages before, %d after\n",expected,numrec);
+	if (error != AME_OK || numrec * 4 > expected)
+		errors++;
+	numrec = 0;
+	lastkey = -1;
+	sd = AM_OpenIndexScan(fd2,INT_TYPE,sizeof(int),EQ_OP,NULL);
+	while ((recnum = AM_FindNextEntry(sd)) >= 0){
+		if (recnum % 10 != 0 || recnum <= lastkey)
+			errors++;
+		lastkey = recnum;
+		numrec++;
+	}
+	AM_CloseIndexScan(sd);
+	for (key = 0; key < MAXRECS; key += 7)
+		if (countEqual(fd2,key) != ((key % 10 == 0) ? 1 : 0))
+			errors++;
+	for (recnum = 1; recnum < MAXRECS; recnum += 10)
+		AM_InsertEntry(fd2,INT_TYPE,sizeof(int),(char *)&recnum,recnum);
+	numrec += countEqual(fd2,MAXRECS - 9);
+	printf("retrieved %d records (expected %d)\n",numrec,MAXRECS/10 + 1);
+	if (numrec != MAXRECS/10 + 1)
+		errors++;
+	PF_CloseFile(fd2);
+	AM_DestroyIndex(RELNAME,1);
+
+	/* the index is no longer empty */
+	error = bulkLoad(fd,0,10,1,100);
+	printf("loading a non empty index: %s\n",
+		(error == AME_NOTEMPTY) ? "refused" : "NOT refused");
+	if (error != AME_NOTEMPTY)
+		errors++;
+	PF_CloseFile(fd);
+
+	/* a few keys fit on the root leaf; a low fill factor still works */
+	printf("loading small and sparse indexes\n");
+	fd = newIndex(0,INT_TYPE,sizeof(int));
+	if (bulkLoad(fd,0,10,1,100) != AME_OK || countPages(fd) != 1 ||
+	    countEqual(fd,7) != 1)
+		errors++;
+	PF_CloseFile(fd);
+	fd = newIndex(0,INT_TYPE,sizeof(int));
+	if (bulkLoad(fd,0,MAXRECS,3,1) != AME_OK || countEqual(fd,2997) != 1 ||
+	    countEqual(fd,2998) != 0)
+		errors++;
+	PF_CloseFile(fd);
+
+	/* input out of order */
+	fd = newIndex(0,INT_TYPE,sizeof(int));
+	s.low = 0; s.high = 1000; s.step = 1;
+	s.next = 0; s.dups = 0; s.unsorted = TRUE;
+	error = AM_BulkLoad(fd,INT_TYPE,sizeof(int),nextEntry,(char *)&s,100);
+	printf("loading unsorted input: %s\n",
+		(error == AME_UNSORTED) ? "refused" : "NOT refused");
+	if (error != AME_UNSORTED)
+		errors++;
+	PF_CloseFile(fd);
+
+	/* load from a heap file in random key order, through the sort */
+	printf("loading from an external sort\n");
+	RHF_DestroyFile(HEAPNAME);
+	if (RHF_CreateFile(HEAPNAME) != RHF_OK ||
+	    (hfd = RHF_OpenFile(HEAPNAME)) < 0){
+		printf("cannot create %s\n",HEAPNAME);
+		exit(1);
+	}
+	for (recnum = 0; recnum < MAXRECS; recnum++){
+		rec[0] = (recnum * 7919) % MAXRECS;
+		rec[1] = recnum;
+		RHF_InsertRecord(hfd,(char *)rec,sizeof(rec),&rid);
+	}
+	sortKey.offset = 0;
+	sortKey.attrType = INT_TYPE;
+	sortKey.attrLength = sizeof(int);
+	SORT_Begin(&sort,0,SORT_CompareKey,&sortKey);
+	SORT_InsertFile(sort,hfd,makeEntry,NULL);
+	fd = newIndex(0,INT_TYPE,sizeof(int));
+	if ((error = AM_BulkLoad(fd,INT_TYPE,sizeof(int),AM_SortedEntry,
+	     (char *)sort,100)) != AME_OK)
+		errors++;
+	SORT_End(sort);
+	numrec = 0;
+	for (recnum = 0; recnum < MAXRECS; recnum += 7){
+		key = (recnum * 7919) % MAXRECS;
+		sd = AM_OpenIndexScan(fd,INT_TYPE,sizeof(int),EQ_OP,(char *)&key);
+		if (AM_FindNextEntry(sd) == recnum && AM_FindNextEntry(sd) < 0)
+			numrec++;
+		AM_CloseIndexScan(sd);
+	}
+	expected = (MAXRECS + 6) / 7;
+	printf("found %d sampled keys (expected %d)\n",numrec,expected);
+	if (numrec != expected)
+		errors++;
+	PF_CloseFile(fd);
+
+	/* index the heap records by their RIDs, and fetch a range of them */
+	printf("fetching heap records through an index of RIDs\n");
+	fd = newIndex(0,INT_TYPE,sizeof(int));
+	RHF_StartScan(hfd,&heapScan);
+	while (RHF_GetNextRecord(&heapScan,(char *)rec,&n,&rid) == RHF_OK)
+		if (AM_InsertRID(fd,INT_TYPE,sizeof(int),(char *)&rec[0],&rid)
+		    != AME_OK){
+			AM_PrintError("AM_InsertRID");
+			exit(1);
+		}
+	RHF_EndScan(&heapScan);
+	key = FETCHKEY;
+	sd = AM_OpenIndexScan(fd,INT_TYPE,sizeof(int),LT_OP,(char *)&key);
+	numrec = 0;
+	PF_ResetStats();
+	error = AM_FetchRecords(sd,hfd,checkRecord,(char *)&numrec);
+	PF_GetStats(&reads,&physReads,&physWrites);
+	AM_CloseIndexScan(sd);
+	printf("fetched %d records (expected %d), %ld page requests\n",
+		numrec,FETCHKEY,reads);
+	if (error != AME_OK || numrec != FETCHKEY || reads >= FETCHKEY/2)
+		errors++;
+	key = MAXRECS;
+	rid.pageNum = 1 << 30;
+	rid.slotNum = 1 << 20;
+	if (AM_InsertRID(fd,INT_TYPE,sizeof(int),(char *)&key,&rid) != AME_OK){
+		AM_PrintError("AM_InsertRID");
+		exit(1);
+	}
+	sd = AM_OpenIndexScan(fd,INT_TYPE,sizeof(int),EQ_OP,(char *)&key);
+	n = (AM_FindNextRID(sd,&rid) == AME_OK && rid.pageNum == 1 << 30 &&
+	     rid.slotNum == 1 << 20 && AM_FindNextRID(sd,&rid) == AME_EOF);
+	AM_CloseIndexScan(sd);
+	printf("indexing a RID of page %d, slot %d: %s\n",1 << 30,1 << 20,
+		n ? "found whole" : "NOT found whole");
+	if (!n)
+		errors++;
+	rid.pageNum = 1 << 30;
+	rid.slotNum = 1 << 20;
+	if (AM_DeleteRID(fd,INT_TYPE,sizeof(int),(char *)&key,&rid) != AME_OK)
+		errors++;
+	rid.pageNum = -1;
+	printf("indexing a RID of page -1: %s\n",
+		(AM_InsertRID(fd,INT_TYPE,sizeof(int),(char *)&key,&rid) ==
+		 AME_INVALIDVALUE) ? "refused" : "NOT refused");
+	if (AM_Errno != AME_INVALIDVALUE)
+		errors++;
+	PF_CloseFile(fd);
+	RHF_CloseFile(hfd);
+	RHF_DestroyFile(HEAPNAME);
+
+	/* the same index on large nodes, by inserts and by a bulk load */
+	printf("indexing on %d byte pages\n",AM_MAXPAGESIZE);
+	AM_DestroyIndex(RELNAME,2);
+	if (AM_CreateIndexSize(RELNAME,2,INT_TYPE,sizeof(int),AM_MAXPAGESIZE)
+	    != AME_OK){
+		AM_PrintError("AM_CreateIndexSize");
+		exit(1);
+	}
+	sprintf(fname,"%s.2",RELNAME);
+	if ((fd = PF_OpenFile(fname)) < 0){
+		PF_PrintError("PF_OpenFile");
+		exit(1);
+	}
+	for (recnum = 0; recnum < MAXRECS; recnum++)
+		AM_InsertEntry(fd,INT_TYPE,sizeof(int),(char *)&recnum,recnum);
+	numrec = countPages(fd);
+	n = 0;
+	for (key = 0; key < MAXRECS; key++)
+		n += countEqual(fd,key);
+	printf("inserted index: %d pages (%d on %d byte pages), %d keys found\n",
+		numrec,insertedPages,PF_PAGE_SIZE,n);
+	if ((numrec >= insertedPages) || (n != MAXRECS))
+		errors++;
+	PF_CloseFile(fd);
+	AM_DestroyIndex(RELNAME,2);
+	if (AM_CreateIndexSize(RELNAME,2,INT_TYPE,sizeof(int),AM_MAXPAGESIZE)
+	    != AME_OK || (fd = PF_OpenFile(fname)) < 0 ||
+	    bulkLoad(fd,0,MAXRECS,1,100) != AME_OK)
+		errors++;
+	else {
+		numrec = 0;
+		sd = AM_OpenIndexScan(fd,INT_TYPE,sizeof(int),EQ_OP,NULL);
+		while (AM_FindNextEntry(sd) >= 0)
+			numrec++;
+		AM_CloseIndexScan(sd);
+		printf("bulk loaded index: retrieved %d records (expected %d)\n",
+			numrec,MAXRECS + NUMDUPS);
+		if (numrec != MAXRECS + NUMDUPS)
+			errors++;
+		PF_CloseFile(fd);
+	}
+	AM_DestroyIndex(RELNAME,2);
+	printf("index on %d byte pages: %s\n",AM_MAXPAGESIZE * 2,
+		(AM_CreateIndexSize(RELNAME,2,INT_TYPE,sizeof(int),
+		 AM_MAXPAGESIZE * 2) == AME_PAGESIZE) ? "refused" : "NOT refused");
+	if (AM_Errno != AME_PAGESIZE)
+		errors++;
+
+	printf("closing down\n");
+	AM_DestroyIndex(RELNAME,0);
+	printf("bulk load test %s\n",(errors == 0) ? "done!" : "FAILED");
+	exit(errors == 0 ? 0 : 1);
+}
@@ -0,0 +1,274 @@
+/* testcomp.c: tests an index on long char keys, which is kept on
+compressed pages. */
+#include <stdio.h>
+#include <string.h>
+#include "am.h"
+#include "pf.h"
+#include "testam.h"
+
+#define KEYLENGTH 40	/* attrLength of the index */
+#define NUMKEYS	3000	/* # of distinct keys */
+#define NUMRECIDS 50	/* recIds a scan returns at a time */
+
+char keys[NUMKEYS][KEYLENGTH];	/* key of each key number */
+int present[NUMKEYS];	/* # of recIds of each key in the index */
+int order[NUMKEYS];	/* key numbers in key order */
+char batch[NUMKEYS + 10][KEYLENGTH];	/* keys of a batch lookup */
+int counts[NUMKEYS + 10];	/* recIds it finds for each */
+
+/* makes the key of key number k in buf: a common start, then the key
+number scrambled, and now and then a long tail. Bytes after the null are
+garbage, as they are for a caller's buffer. */
+makeKey(k,buf)
+int k;
+char *buf;
+{
+	memset(buf,'#',KEYLENGTH);
+	if (k % 10 == 0)
+		sprintf(buf,"customer/%07d/with a longer tail",(k * 7919) % 10007);
+	else
+		sprintf(buf,"customer/%07d",(k * 7919) % 10007);
+}
+
+compareKeys(a,b)
+int *a,*b;
+{
+	return(strncmp(keys[*a],keys[*b],KEYLENGTH));
+}
+
+/* recId of the i th recId of key number k */
+#define RECID(k,i) ((k) + (i)*NUMKEYS)
+
+/* # of recIds in the index whose key compares with value as op says */
+expectedCount(value,op)
+char *value;
+int op;
+{
+int k,c,n = 0;
+
+	for (k = 0; k < NUMKEYS; k++){
+		c = strncmp(keys[k],value,KEYLENGTH);
+		if ((op == EQ_OP && c == 0) || (op == LT_OP && c < 0) ||
+		    (op == GT_OP && c > 0) || (op == LE_OP && c <= 0) ||
+		    (op == GE_OP && c >= 0) || (op == NE_OP && c != 0))
+			n += present[k];
+	}
+	return(n);
+}
+
+/* counts a recId of probe key i, for AM_LookupBatch */
+countFound(arg,i,recId)
+char *arg;
+int i;
+int recId;
+{
+	((int *)arg)[i]++;
+	return(AME_OK);
+}
+
+/* checks every scan of the index against the keys in present */
+checkIndex(fd)
+int fd;
+{
+static char *probes[] = { "customer/0005000", "customer/00050000",
+	"customer/", "a", "d", "customer/0001234/with", NULL };
+char value[KEYLENGTH];
+int errors = 0;
+int recIds[NUMRECIDS];
+int sd,recId,last,n,m,k,op,i;
+
+	/* the whole index, in key order */
+	n = 0;
+	last = -1;
+	sd = AM_OpenIndexScan(fd,CHAR_TYPE,KEYLENGTH,EQ_OP,NULL);
+	while ((recId = AM_FindNextEntry(sd)) >= 0){
+		if (last >= 0 && strncmp(keys[last],keys[recId % NUMKEYS],
+		    KEYLENGTH) > 0)
+			errors++;
+		last = recId % NUMKEYS;
+		n++;
+	}
+	AM_CloseIndexScan(sd);
+	if (n != expectedCount("",GE_OP))
+		errors++;
+
+	/* every key, with garbage after its null */
+	for (k = 0; k < NUMKEYS; k++){
+		makeKey(k,value);
+		n = 0;
+		sd = AM_OpenIndexScan(fd,CHAR_TYPE,KEYLENGTH,EQ_OP,value);
+		while (AM_FindNextEntry(sd) >= 0)
+			n++;
+		AM_CloseIndexScan(sd);
+		if (n != present[k])
+			errors++;
+	}
+
+	/* every key and every probe again, in one batch */
+	for (k = 0; k < NUMKEYS; k++){
+		makeKey(k,batch[k]);
+		counts[k] = 0;
+	}
+	for (i = 0; probes[i] != NULL; i++){
+		memset(batch[NUMKEYS + i],'%',KEYLENGTH);
+		strcpy(batch[NUMKEYS + i],probes[i]);
+		counts[NUMKEYS + i] = 0;
+	}
+	if (AM_LookupBatch(fd,CHAR_TYPE,KEYLENGTH,(char *)batch,NUMKEYS + i,
+	    countFound,(char *)counts) != AME_OK)
+		errors++;
+	for (k = 0; k < NUMKEYS + i; k++)
+		if (counts[k] != expectedCount(batch[k],EQ_OP))
+			errors++;
+
+	/* every operator, on keys in the index and between them */
+	for (i = 0; probes[i] != NULL; i++)
+		for (op = EQ_OP; op <= NE_OP; op++){
+			memset(value,'%',KEYLENGTH);
+			strcpy(value,probes[i]);
+			n = 0;
+			sd = AM_OpenIndexScan(fd,CHAR_TYPE,KEYLENGTH,op,value);
+			while (AM_FindNextEntry(sd) >= 0)
+				n++;
+			AM_CloseIndexScan(sd);
+
+			/* the same scan, many recIds at a time */
+			m = 0;
+			sd = AM_OpenIndexScan(fd,CHAR_TYPE,KEYLENGTH,op,value);
+			while ((k = AM_FindNextEntries(sd,recIds,NUMRECIDS)) > 0)
+				m += k;
+			AM_CloseIndexScan(sd);
+			if (m != n)
+				errors++;
+			if (n != expectedCount(value,op)){
+				printf("%s op %d: %d records (expected %d)\n",
+				       probes[i],op,n,expectedCount(value,op));
+				errors++;
+			}
+		}
+	return(errors);
+}
+
+/* input stream of the bulk loader: every key in order, with its recIds */
+typedef struct {
+	int next;	/* place in order of the next key */
+	int dups;	/* recIds of the current key returned so far */
+} Stream;
+
+nextEntry(arg,value,recId)
+char *arg;
+char *value;
+int *recId;
+{
+Stream *s = (Stream *)arg;
+int k;
+
+	while (s->next < NUMKEYS && present[order[s->next]] == 0)
+		s->next++;
+	if (s->next >= NUMKEYS)
+		return(AME_EOF);
+	k = order[s->next];
+	makeKey(k,value);
+	*recId = RECID(k,s->dups);
+	if (++s->dups == present[k]){
+		s->dups = 0;
+		s->next++;
+	}
+	return(AME_OK);
+}
+
+main()
+{
+int fd;	/* file descriptor for the index */
+int k,i;
+int errors = 0;
+int pages;
+char value[KEYLENGTH];
+Stream s;
+
+	printf("initializing\n");
+	PF_Init();
+	for (k = 0; k < NUMKEYS; k++){
+		makeKey(k,keys[k]);
+		order[k] = k;
+	}
+	qsort((char *)order,NUMKEYS,sizeof(int),compareKeys);
+
+	/* insert in scrambled order, so that leaves split everywhere */
+	printf("inserting %d keys of length %d\n",NUMKEYS,KEYLENGTH);
+	fd = newIndex(0,CHAR_TYPE,KEYLENGTH);
+	for (i = 0; i < NUMKEYS; i++){
+		k = (i * 1031) % NUMKEYS;
+		makeKey(k,value);
+		AM_InsertEntry(fd,CHAR_TYPE,KEYLENGTH,value,RECID(k,0));
+		present[k] = 1;
+	}
+	makeKey(DUPKEY,value);
+	for (i = 1; i < NUMDUPS; i++){
+		AM_InsertEntry(fd,CHAR_TYPE,KEYLENGTH,value,RECID(DUPKEY,i));
+		present[DUPKEY]++;
+	}
+	pages = countPages(fd);
+	printf("index of %d pages (%d uncompressed leaves at least)\n",pages,
+	       (NUMKEYS*(KEYLENGTH + 8) + NUMDUPS*6)/PF_PAGE_SIZE);
+	if (pages >= (NUMKEYS*(KEYLENGTH + 8) + NUMDUPS*6)/PF_PAGE_SIZE)
+		errors++;
+	errors += checkIndex(fd);
+
+	/* delete every third key, and all the recIds of DUPKEY but one */
+	printf("deleting and inserting again\n");
+	for (k = 0; k < NUMKEYS; k += 3){
+		makeKey(k,value);
+		AM_DeleteEntry(fd,CHAR_TYPE,KEYLENGTH,value,RECID(k,0));
+		present[k] = 0;
+	}
+	makeKey(DUPKEY,value);
+	for (i = 1; i < NUMDUPS; i++)
+		AM_DeleteEntry(fd,CHAR_TYPE,KEYLENGTH,value,RECID(DUPKEY,i));
+	present[DUPKEY] = 1;
+	for (k = 0; k < NUMKEYS; k += 6){
+		makeKey(k,value);
+		AM_InsertEntry(fd,CHAR_TYPE,KEYLENGTH,value,RECID(k,0));
+		present[k] = 1;
+	}
+	errors += checkIndex(fd);
+
+	/* rebuilt in place, the index keeps the same keys in fewer pages */
+	printf("reorganizing\n");
+	pages = countPages(fd);
+	if (AM_Reorganize(fd,CHAR_TYPE,KEYLENGTH,100) != AME_OK){
+		AM_PrintError("AM_Reorganize");
+		errors++;
+	}
+	printf("%d pages before, %d after\n",pages,countPages(fd));
+	if (countPages(fd) >= pages)
+		errors++;
+	errors += checkIndex(fd);
+	PF_CloseFile(fd);
+
+	/* the same keys, bulk loaded */
+	printf("bulk loading the same keys\n");
+	fd = newIndex(1,CHAR_TYPE,KEYLENGTH);
+	for (i = 1; i < NUMDUPS; i++)
+		present[DUPKEY]++;
+	s.next = 0; s.dups = 0;
+	if (AM_BulkLoad(fd,CHAR_TYPE,KEYLENGTH,nextEntry,(char *)&s,100) !=
+	    AME_OK){
+		AM_PrintError("AM_BulkLoad");
+		errors++;
+	}
+	errors += checkIndex(fd);
+	for (k = 1; k < NUMKEYS; k += 6){
+		makeKey(k,value);
+		AM_InsertEntry(fd,CHAR_TYPE,KEYLENGTH,value,RECID(k,1));
+		present[k]++;
+	}
+	errors += checkIndex(fd);
+	PF_CloseFile(fd);
+
+	printf("closing down\n");
+	AM_DestroyIndex(RELNAME,0);
+	AM_DestroyIndex(RELNAME,1);
+	printf("compressed index test %s\n",(errors == 0) ? "done!" : "FAILED");
+	exit(errors == 0 ? 0 : 1);
+}
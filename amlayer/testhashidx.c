@@ -0,0 +1,242 @@
+/* testhashidx.c: tests hash indexes. */
+#include <stdio.h>
+#include <string.h>
+#include "am.h"
+#include "pf.h"
+#define NUMDUPS	300	/* # of recIds for DUPKEY, more than a page holds */
+#include "testam.h"
+
+#define MAXRECS	20000	/* # of keys inserted */
+#define KEYLENGTH 20	/* attrLength of the char index */
+#define NUMCHARKEYS 3000	/* # of keys of the char index */
+#define FNAME_LENGTH 80	/* file name size */
+
+int recIdSum;	/* sum of the recIds found by a lookup */
+
+/* counts a recId found, for AM_LookupHashEntry */
+addRecId(arg,recId)
+char *arg;
+int recId;
+{
+	recIdSum += recId;
+	return(AME_OK);
+}
+
+/* stops the lookup at the first recId */
+stopLookup(arg,recId)
+char *arg;
+int recId;
+{
+	return(AME_EOF);
+}
+
+/* # of recIds of key in the hash index fd */
+countKey(fd,key)
+int fd,key;
+{
+	return(AM_LookupHashEntry(fd,INT_TYPE,sizeof(int),(char *)&key,
+		addRecId,NULL));
+}
+
+/* opens index indexno of RELNAME */
+openIndex(indexno)
+int indexno;
+{
+char fname[FNAME_LENGTH];
+int fd;
+
+	sprintf(fname,"%s.%d",RELNAME,indexno);
+	if ((fd = PF_OpenFile(fname)) < 0){
+		PF_PrintError("PF_OpenFile");
+		exit(1);
+	}
+	return(fd);
+}
+
+main()
+{
+int fd;	/* file descriptor for the index */
+int tfd;	/* file descriptor for the B+-tree of the same keys */
+int key;
+int numrec;	/* # of recIds found */
+int expected;
+int errors = 0;
+int error;
+int sd;	/* scan descriptor */
+long reads,treeReads,physReads,physWrites;	/* PF statistics */
+char charKey[KEYLENGTH];
+float floatKey;
+int i;
+
+	printf("initializing\n");
+	PF_Init();
+
+	/* insert the keys, with one key that needs overflow pages */
+	printf("inserting %d keys into a hash index\n",MAXRECS);
+	AM_DestroyIndex(RELNAME,0);
+	if (AM_CreateHashIndex(RELNAME,0,INT_TYPE,sizeof(int)) != AME_OK){
+		AM_PrintError("AM_CreateHashIndex");
+		exit(1);
+	}
+	fd = openIndex(0);
+	for (key = 0; key < MAXRECS; key++)
+		if (AM_InsertHashEntry(fd,INT_TYPE,sizeof(int),(char *)&key,key)
+		    != AME_OK){
+			AM_PrintError("AM_InsertHashEntry");
+			exit(1);
+		}
+	key = DUPKEY;
+	for (i = 1; i <= NUMDUPS; i++)
+		AM_InsertHashEntry(fd,INT_TYPE,sizeof(int),(char *)&key,
+			key + i*MAXRECS);
+
+	/* every key is found, with its recIds */
+	printf("looking up every key\n");
+	numrec = 0;
+	recIdSum = 0;
+	for (key = 0; key < MAXRECS; key++)
+		numrec += countKey(fd,key);
+	expected = MAXRECS + NUMDUPS;
+	printf("found %d recIds (expected %d)\n",numrec,expected);
+	if ((numrec != expected) || (recIdSum != (MAXRECS - 1)*(MAXRECS/2) +
+	    NUMDUPS*DUPKEY + MAXRECS*NUMDUPS*(NUMDUPS + 1)/2))
+		errors++;
+	recIdSum = 0;
+	if ((countKey(fd,MAXRECS) != 0) || (countKey(fd,-1) != 0))
+		errors++;
+
+	/* a lookup fixes only its bucket, whatever the index size, once the
+	header has been read; the B+-tree descends and goes through a scan */
+	AM_DestroyIndex(RELNAME,1);
+	AM_CreateIndex(RELNAME,1,INT_TYPE,sizeof(int));
+	tfd = openIndex(1);
+	for (key = 0; key < MAXRECS; key++)
+		AM_InsertEntry(tfd,INT_TYPE,sizeof(int),(char *)&key,key);
+	PF_ResetStats();
+	for (key = 0; key < MAXRECS; key += MAXRECS/1000)
+		countKey(fd,key);
+	PF_GetStats(&reads,&physReads,&physWrites);
+	PF_ResetStats();
+	for (key = 0; key < MAXRECS; key += MAXRECS/1000){
+		sd = AM_OpenIndexScan(tfd,INT_TYPE,sizeof(int),EQ_OP,
+			(char *)&key);
+		while (AM_FindNextEntry(sd) >= 0)
+			;
+		AM_CloseIndexScan(sd);
+	}
+	PF_GetStats(&treeReads,&physReads,&physWrites);
+	printf("%ld pages fixed for 1000 lookups (B+-tree: %ld)\n",
+		reads,treeReads);
+	if (reads > 1100)
+		errors++;
+	PF_CloseFile(tfd);
+	AM_DestroyIndex(RELNAME,1);
+
+	/* and a lookup can be stopped */
+	key = DUPKEY;
+	error = AM_LookupHashEntry(fd,INT_TYPE,sizeof(int),(char *)&key,
+		stopLookup,NULL);
+	printf("stopping a lookup: %s\n",
+		(error == AME_EOF) ? "stopped" : "NOT stopped");
+	if (error != AME_EOF)
+		errors++;
+
+	/* delete the odd keys, and the recIds of DUPKEY */
+	printf("deleting odd keys\n");
+	for (key = 1; key < MAXRECS; key += 2)
+		if (AM_DeleteHashEntry(fd,INT_TYPE,sizeof(int),(char *)&key,key)
+		    != AME_OK)
+			errors++;
+	key = DUPKEY;
+	for (i = 1; i <= NUMDUPS; i++)
+		if (AM_DeleteHashEntry(fd,INT_TYPE,sizeof(int),(char *)&key,
+		    key + i*MAXRECS) != AME_OK)
+			errors++;
+	key = 1;
+	error = AM_DeleteHashEntry(fd,INT_TYPE,sizeof(int),(char *)&key,key);
+	printf("deleting a deleted entry: %s\n",
+		(error == AME_NOTFOUND) ? "not found" : "FOUND");
+	if (error != AME_NOTFOUND)
+		errors++;
+
+	/* the index is the same after it is opened again */
+	PF_CloseFile(fd);
+	fd = openIndex(0);
+	numrec = 0;
+	for (key = 0; key < MAXRECS; key++)
+		if (countKey(fd,key) != ((key % 2 == 0) ? 1 : 0))
+			errors++;
+		else
+			numrec++;
+	printf("%d of %d keys right after reopening\n",numrec,MAXRECS);
+
+	/* the deleted pages are used again */
+	for (key = 1; key < MAXRECS; key += 2)
+		AM_InsertHashEntry(fd,INT_TYPE,sizeof(int),(char *)&key,key);
+	numrec = 0;
+	for (key = 0; key < MAXRECS; key++)
+		numrec += countKey(fd,key);
+	printf("found %d recIds after inserting again (expected %d)\n",
+		numrec,MAXRECS);
+	if (numrec != MAXRECS)
+		errors++;
+
+	/* the index knows its key type, and a B+-tree is not a hash index */
+	floatKey = 1.5;
+	error = AM_InsertHashEntry(fd,FLOAT_TYPE,sizeof(float),
+		(char *)&floatKey,0);
+	printf("inserting a float key into an int index: %s\n",
+		(error == AME_INVALIDATTRTYPE) ? "refused" : "NOT refused");
+	if (error != AME_INVALIDATTRTYPE)
+		errors++;
+	PF_CloseFile(fd);
+	AM_DestroyIndex(RELNAME,0);
+	AM_CreateIndex(RELNAME,0,INT_TYPE,sizeof(int));
+	fd = openIndex(0);
+	key = 0;
+	error = countKey(fd,key);
+	printf("looking up a B+-tree: %s\n",
+		(error == AME_NOTHASH) ? "refused" : "NOT refused");
+	if (error != AME_NOTHASH)
+		errors++;
+	PF_CloseFile(fd);
+	AM_DestroyIndex(RELNAME,0);
+
+	/* char keys end at their first null, floats 0 and -0 are the same */
+	printf("char and float keys\n");
+	AM_CreateHashIndex(RELNAME,0,CHAR_TYPE,KEYLENGTH);
+	fd = openIndex(0);
+	for (i = 0; i < NUMCHARKEYS; i++){
+		memset(charKey,'#',KEYLENGTH);
+		sprintf(charKey,"key%d",i);
+		AM_InsertHashEntry(fd,CHAR_TYPE,KEYLENGTH,charKey,i);
+	}
+	numrec = 0;
+	recIdSum = 0;
+	for (i = 0; i < NUMCHARKEYS; i++){
+		memset(charKey,'$',KEYLENGTH);
+		sprintf(charKey,"key%d",i);
+		numrec += AM_LookupHashEntry(fd,CHAR_TYPE,KEYLENGTH,charKey,
+			addRecId,NULL);
+	}
+	printf("found %d char keys (expected %d)\n",numrec,NUMCHARKEYS);
+	if ((numrec != NUMCHARKEYS) ||
+	    (recIdSum != (NUMCHARKEYS - 1)*NUMCHARKEYS/2))
+		errors++;
+	PF_CloseFile(fd);
+	AM_DestroyIndex(RELNAME,0);
+	AM_CreateHashIndex(RELNAME,0,FLOAT_TYPE,sizeof(float));
+	fd = openIndex(0);
+	floatKey = 0.0;
+	AM_InsertHashEntry(fd,FLOAT_TYPE,sizeof(float),(char *)&floatKey,7);
+	floatKey = -floatKey;
+	if (AM_LookupHashEntry(fd,FLOAT_TYPE,sizeof(float),(char *)&floatKey,
+	    addRecId,NULL) != 1)
+		errors++;
+	PF_CloseFile(fd);
+
+	printf("closing down\n");
+	AM_DestroyIndex(RELNAME,0);
+	printf("hash index test %s\n",(errors == 0) ? "done!" : "FAILED");
+	exit(errors == 0 ? 0 : 1);
+}
@@ -0,0 +1,136 @@
+/* testthreads.c: tests lookups and scans of two indexes by several
+threads at the same time. */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "am.h"
+#include "pf.h"
+#include "testam.h"
+
+#define NUMKEYS	4000	/* # of keys in each index */
+#define KEYLENGTH 24	/* attrLength of the char index */
+#define NUMTHREADS 4	/* # of threads looking up keys */
+#define OPENSCANS 12	/* scans each thread keeps open at once */
+
+int intfd,charfd;	/* file descriptors of the indexes */
+
+/* makes the char key of key number k in buf */
+makeKey(k,buf)
+int k;
+char *buf;
+{
+	memset(buf,0,KEYLENGTH);
+	sprintf(buf,"key/%07d",k);
+}
+
+/* # of recIds a scan of fd finds, or -1 if one is not k */
+countScan(sd,k)
+int sd;
+int k;
+{
+int recId,n = 0;
+
+	while ((recId = AM_FindNextEntry(sd)) >= 0){
+		if (k >= 0 && recId != k)
+			return(-1);
+		n++;
+	}
+	AM_CloseIndexScan(sd);
+	return(n);
+}
+
+/* looks up the keys from *arg on, in steps of NUMTHREADS, in both
+indexes, with OPENSCANS scans open at a time; returns the # of errors */
+void *lookup(arg)
+void *arg;
+{
+int first = *(int *)arg;
+int sd[OPENSCANS];
+int key[OPENSCANS];
+char value[KEYLENGTH];
+int k,i,n;
+static int errors[NUMTHREADS];
+
+	for (k = first; k < NUMKEYS; k += NUMTHREADS*OPENSCANS){
+		/* open the scans, half of them on each index */
+		n = 0;
+		for (i = 0; i < OPENSCANS; i++){
+			key[i] = k + i*NUMTHREADS;
+			if (key[i] >= NUMKEYS)
+				break;
+			if (i % 2 == 0)
+				sd[i] = AM_OpenIndexScan(intfd,INT_TYPE,sizeof(int),
+					EQ_OP,(char *)&key[i]);
+			else {
+				makeKey(key[i],value);
+				sd[i] = AM_OpenIndexScan(charfd,CHAR_TYPE,
+					KEYLENGTH,EQ_OP,value);
+			}
+			if (sd[i] < 0){
+				AM_PrintError("AM_OpenIndexScan");
+				errors[first]++;
+				break;
+			}
+			n++;
+		}
+		for (i = 0; i < n; i++)
+			if (countScan(sd[i],key[i]) != 1)
+				errors[first]++;
+	}
+
+	/* a range of each index */
+	k = first*NUMKEYS/NUMTHREADS;
+	sd[0] = AM_OpenIndexScan(intfd,INT_TYPE,sizeof(int),GE_OP,(char *)&k);
+	if (countScan(sd[0],-1) != NUMKEYS - k)
+		errors[first]++;
+	makeKey(k,value);
+	sd[0] = AM_OpenIndexScan(charfd,CHAR_TYPE,KEYLENGTH,LT_OP,value);
+	if (countScan(sd[0],-1) != k)
+		errors[first]++;
+	return((void *)&errors[first]);
+}
+
+main()
+{
+pthread_t threads[NUMTHREADS];
+int first[NUMTHREADS];
+int errors = 0;
+char value[KEYLENGTH];
+void *result;
+int k,i;
+
+	printf("initializing\n");
+	PF_Init();
+	intfd = newIndex(0,INT_TYPE,sizeof(int));
+	charfd = newIndex(1,CHAR_TYPE,KEYLENGTH);
+
+	printf("inserting %d keys into each index\n",NUMKEYS);
+	for (i = 0; i < NUMKEYS; i++){
+		k = (i * 1031) % NUMKEYS;
+		makeKey(k,value);
+		if (AM_InsertEntry(intfd,INT_TYPE,sizeof(int),(char *)&k,k) !=
+		    AME_OK ||
+		    AM_InsertEntry(charfd,CHAR_TYPE,KEYLENGTH,value,k) != AME_OK){
+			AM_PrintError("AM_InsertEntry");
+			exit(1);
+		}
+	}
+
+	printf("looking up every key in %d threads\n",NUMTHREADS);
+	for (i = 0; i < NUMTHREADS; i++){
+		first[i] = i;
+		pthread_create(&threads[i],NULL,lookup,(void *)&first[i]);
+	}
+	for (i = 0; i < NUMTHREADS; i++){
+		pthread_join(threads[i],&result);
+		errors += *(int *)result;
+	}
+
+	printf("closing down\n");
+	PF_CloseFile(intfd);
+	PF_CloseFile(charfd);
+	AM_DestroyIndex(RELNAME,0);
+	AM_DestroyIndex(RELNAME,1);
+	printf("thread test %s\n",(errors == 0) ? "done!" : "FAILED");
+	exit(errors == 0 ? 0 : 1);
+}
@@ -0,0 +1,43 @@
+/* testutil.c: helpers shared by the index tests */
+#include <stdio.h>
+#include "am.h"
+#include "pf.h"
+#include "testam.h"
+
+#define FNAME_LENGTH 80	/* file name size */
+
+/* counts the pages of the index */
+countPages(fd)
+int fd;
+{
+int pagenum = -1, count = 0;
+char *buf;
+
+	while (PF_GetNextPage(fd,&pagenum,&buf) == PFE_OK){
+		count++;
+		PF_UnfixPage(fd,pagenum,FALSE);
+	}
+	return(count);
+}
+
+/* creates and opens an empty index */
+newIndex(indexno,attrType,attrLength)
+int indexno;
+char attrType;
+int attrLength;
+{
+char fname[FNAME_LENGTH];
+int fd;
+
+	AM_DestroyIndex(RELNAME,indexno);
+	if (AM_CreateIndex(RELNAME,indexno,attrType,attrLength) != AME_OK){
+		AM_PrintError("AM_CreateIndex");
+		exit(1);
+	}
+	sprintf(fname,"%s.%d",RELNAME,indexno);
+	if ((fd = PF_OpenFile(fname)) < 0){
+		PF_PrintError("PF_OpenFile");
+		exit(1);
+	}
+	return(fd);
+}
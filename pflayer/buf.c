@@ -1,10 +1,16 @@
 /* buf.c: buffer management routines. The interface routines are:
-PFbufGet(), PFbufUnfix(), PFbufAlloc(), PFbufReleaseFile(), PFbufUsed() and
-PFbufPrint() */
+PFbufGet(), PFbufGetSole(), PFbufUnfix(), PFbufAlloc(), PFbufReleaseFile(), PFbufUsed(),
+PFbufPrefetch(), PFbufFlush(), PFbufSetWriteBehind(), PFbufLatch(), PFbufUnlatch()
+and PFbufPrint().
+They may be called by several threads at once. */
 #include <stdio.h>
 #include "pf.h"
 #include "pftypes.h"
 #include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
 
 /* --- Configuration Globals --- */
 /* Replaces PF_MAX_BUFS define from pftypes.h */
@@ -12,30 +18,242 @@ static int g_pf_max_bufs = PF_MAX_BUFS;
 static int g_pf_strategy = PF_STRAT_LRU;
 
 /* --- Statistics Globals --- */
+/* Counted with atomic adds, since any thread may do I/O */
 static long g_logical_reads = 0;
 static long g_physical_reads = 0;
 static long g_physical_writes = 0;
+#define PFstatAdd(counter,n)	__atomic_fetch_add(&(counter),(n),__ATOMIC_RELAXED)
+
+/* --- Locking --- */
+/* PFbuflock protects the used and free lists, PFnumbpage, the arena and
+the replacement state. The pages themselves are protected by their hash
+table partition (see pftypes.h). A thread holding a partition lock may
+take PFbuflock, but a thread holding PFbuflock only tries partition
+locks (PFbufClaim()), so the two never deadlock. No lock is held while
+a page is read or written: the page is marked "io" instead. */
+static pthread_mutex_t PFbuflock = PTHREAD_MUTEX_INITIALIZER;
 
 static int PFnumbpage = 0;	/* # of buffer pages in memory */
 static PFbpage *PFfirstbpage= NULL;	/* ptr to first buffer page, or NULL */
 static PFbpage *PFlastbpage = NULL;	/* ptr to last buffer page, or NULL */
 static PFbpage *PFfreebpage= NULL;	/* list of free buffer pages */
+static PFbpage *PFfilebpages[PF_FTAB_SIZE];	/* pages of each file on the
+				used list, linked by "fnext", so that the
+				pages of one file are found without looking
+				at the others */
+
+/* --- Buffer Pool Arena --- */
+/* The g_pf_max_bufs buffer pages are allocated at once, on first use:
+their headers as the dense array PFframes, and their data as the arena
+PFarena, frame i owning bytes i*PF_PAGE_SIZE .. (i+1)*PF_PAGE_SIZE-1.
+PFnumbpage frames have been handed out so far. A frame given a page of
+a file with larger pages gets a block of its own for its data, which it
+keeps from then on (see PFbufGrowFrame()), so frames come in the size
+classes of the files used. */
+static PFbpage *PFframes = NULL;	/* buffer page headers, or NULL */
+static char *PFarena = NULL;	/* page data of the buffer pages */
+static size_t PFarenasize = 0;	/* # of bytes mapped for PFarena */
+static int g_pf_hugepages = FALSE;	/* TRUE to try huge pages */
+static int PFfilepagesize[PF_FTAB_SIZE];	/* page size of each open file */
+
+/* --- Replacement State --- */
+/* PF_STRAT_CLOCK sweeps the used list; the hand is the next page to look at.
+PF_STRAT_2Q and PF_STRAT_LRU2 keep each used page on one of two queues
+PFq[PF_Q_FIRST] and PFq[PF_Q_HOT], most recent at the head.
+	2Q: PF_Q_FIRST is A1in, a FIFO of pages referenced once, and PF_Q_HOT
+	is Am, an LRU list of pages referenced again after leaving A1in.
+	Pages evicted from A1in are remembered in the A1out ghost list.
+	LRU-2: PF_Q_FIRST holds pages referenced once, and PF_Q_HOT the others
+	ordered by the time of their next to last reference. PF_Q_HOT is
+	then not a list but a binary min-heap on "prevref" in PFhot, of
+	PFq[PF_Q_HOT].len pages, so that a page moves in it in log time. */
+typedef struct PFbufqueue {
+	PFbpage *head;	/* most recent page, or NULL */
+	PFbpage *tail;	/* least recent page, or NULL */
+	int len;	/* # of pages on the queue */
+} PFbufqueue;
+
+static PFbpage *PFclockhand = NULL;	/* CLOCK hand, or NULL for head */
+static PFbufqueue PFq[2];	/* 2Q and LRU-2 queues */
+static PFbpage **PFhot = NULL;	/* LRU-2 PF_Q_HOT heap, g_pf_max_bufs slots */
+static long PFreftime = 0;	/* LRU-2 reference clock */
+
+/* 2Q A1out: ring of the keys of pages recently evicted from A1in */
+typedef struct PFghostkey {
+	int fd;		/* file descriptor, or -1 if slot not used */
+	int page;	/* page number */
+} PFghostkey;
+static PFghostkey *PFghost = NULL;	/* the ring, allocated on first use */
+static int PFghostsize = 0;	/* # of slots in the ring */
+static int PFghostlen = 0;	/* # of slots filled */
+static int PFghostnext = 0;	/* slot for the next key */
+
+/* 2Q queue sizes: A1in gets a quarter of the pool, A1out remembers half */
+#define PF2Q_KIN()	(g_pf_max_bufs/4 > 0 ? g_pf_max_bufs/4 : 1)
+#define PF2Q_KOUT()	(g_pf_max_bufs/2 > 0 ? g_pf_max_bufs/2 : 1)
+
+/* TRUE if hits relink pages on the used list (LRU and MRU) */
+#define PFbufRecency()	(g_pf_strategy == PF_STRAT_LRU || \
+				g_pf_strategy == PF_STRAT_MRU)
+
+/* TRUE if hits move pages on a queue, so PFbufHit() needs PFbuflock
+(2Q and LRU-2) */
+#define PFbufHitLocked()	(g_pf_strategy == PF_STRAT_2Q || \
+				g_pf_strategy == PF_STRAT_LRU2)
+
+/* --- Write-behind --- */
+/* With write-behind on, a flusher thread writes dirty pages out before
+they are chosen as victims, so that at least g_pf_wb_clean percent of
+the frames stay clean and misses seldom wait for a write. It is woken
+when a page gets dirty with too few clean frames left. PFwblock protects
+PFwbstop and is held by the flusher only while it waits. */
+static int g_pf_wb_clean = 0;	/* % of frames kept clean, 0 if off */
+static int PFdirtycount = 0;	/* # of dirty buffer pages, changed
+				atomically under the page's partition lock */
+static int (*PFwbwritevfcn)() = NULL;	/* writes runs of pages */
+static pthread_t PFwbthread;	/* the flusher */
+static int PFwbrunning = FALSE;	/* TRUE while the flusher runs */
+static int PFwbstop = FALSE;	/* TRUE to make the flusher stop */
+static pthread_mutex_t PFwblock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t PFwbcond = PTHREAD_COND_INITIALIZER;
+
+/* # of dirty pages over what write-behind allows, <= 0 if none */
+#define PFwbExcess()	(__atomic_load_n(&PFdirtycount,__ATOMIC_RELAXED) - \
+		g_pf_max_bufs * (100 - __atomic_load_n(&g_pf_wb_clean, \
+				__ATOMIC_RELAXED)) / 100)
+
+static void PFbufResetQueues(void);
+static void PFbufQueueUnlink(PFbpage *bpage);
+static void PFbufHeapRemove(PFbpage *bpage);
+static void PFbufStopFlusher(void);
 
 /* --- NEW Public Configuration Functions --- */
 
-/**
- * @brief Initializes all buffer manager static globals.
- * Called by PF_Init().
- */
+static void PFbufArenaFree()
+/****************************************************************************
+SPECIFICATIONS:
+	Give back the buffer pool arena, if allocated. All the buffer
+	pages are lost.
+
+GLOBAL VARIABLES MODIFIED:
+	PFframes, PFhot, PFarena, PFarenasize
+*****************************************************************************/
+{
+int i;
+
+	if (PFarena != NULL)
+		munmap(PFarena,PFarenasize);
+	if (PFframes != NULL)
+		for (i=0; i < g_pf_max_bufs; i++){
+			pthread_rwlock_destroy(&PFframes[i].latch);
+			if (PFframes[i].bufsize > PF_PAGE_SIZE)
+				free(PFframes[i].fpage.pagebuf);
+		}
+	free((char *)PFframes);
+	free((char *)PFhot);
+	PFframes = NULL;
+	PFhot = NULL;
+	PFarena = NULL;
+	PFarenasize = 0;
+}
+
+static int PFbufArenaAlloc()
+/****************************************************************************
+SPECIFICATIONS:
+	Allocate the g_pf_max_bufs buffer pages: a dense array of headers,
+	and one anonymous mapping for their data so that every page is
+	aligned on PF_PAGE_SIZE. With g_pf_hugepages, the mapping is first
+	tried with explicit huge pages, then with a transparent huge page
+	hint. The memory is only touched as frames get used.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_NOMEM	if no memory.
+
+GLOBAL VARIABLES MODIFIED:
+	PFframes, PFhot, PFarena, PFarenasize
+*****************************************************************************/
+{
+size_t size;	/* # of bytes of page data */
+void *arena;
+int i;
+
+	size = (size_t)g_pf_max_bufs * PF_PAGE_SIZE;
+	arena = MAP_FAILED;
+	if (g_pf_hugepages){
+		size = (size + PF_HUGE_PAGE_SIZE - 1) / PF_HUGE_PAGE_SIZE
+					* PF_HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+		arena = mmap(NULL,size,PROT_READ|PROT_WRITE,
+				MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+#endif
+	}
+	if (arena == MAP_FAILED){
+		arena = mmap(NULL,size,PROT_READ|PROT_WRITE,
+				MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if (arena == MAP_FAILED){
+			PFerrno = PFE_NOMEM;
+			return(PFerrno);
+		}
+#ifdef MADV_HUGEPAGE
+		if (g_pf_hugepages)
+			(void)madvise(arena,size,MADV_HUGEPAGE);
+#endif
+	}
+
+	PFframes = (PFbpage *)calloc(g_pf_max_bufs,sizeof(PFbpage));
+	PFhot = (PFbpage **)malloc(g_pf_max_bufs*sizeof(PFbpage *));
+	if (PFframes == NULL || PFhot == NULL){
+		munmap(arena,size);
+		free((char *)PFframes);
+		free((char *)PFhot);
+		PFframes = NULL;
+		PFhot = NULL;
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	PFarena = (char *)arena;
+	PFarenasize = size;
+	for (i=0; i < g_pf_max_bufs; i++){
+		PFframes[i].fpage.pagebuf = PFarena + (size_t)i * PF_PAGE_SIZE;
+		PFframes[i].bufsize = PF_PAGE_SIZE;
+		pthread_rwlock_init(&PFframes[i].latch,NULL);
+	}
+	return(PFE_OK);
+}
+
 void PFbufInit()
+/****************************************************************************
+SPECIFICATIONS:
+	Initialize all the buffer manager globals: stop the write-behind
+	flusher, give back the arena, and set back the strategy, the
+	queues and the statistics. Called by PF_Init(); no other thread
+	may use PF meanwhile.
+
+GLOBAL VARIABLES MODIFIED:
+	all the static globals of the buffer manager
+*****************************************************************************/
 {
+int i;
+
+	/* no other thread may use PF meanwhile */
+	PFbufStopFlusher();
+	PFdirtycount = 0;
+	PFbufArenaFree();
 	PFnumbpage = 0;
 	PFfirstbpage = NULL;
 	PFlastbpage = NULL;
 	PFfreebpage = NULL;
+	for (i=0; i < PF_FTAB_SIZE; i++)
+		PFfilebpages[i] = NULL;
+	PFclockhand = NULL;
+	PFreftime = 0;
+	free((char *)PFghost);
+	PFghost = NULL;
 	
 	/* Set defaults, in case user doesn't call setters */
 	g_pf_strategy = PF_STRAT_LRU;
+	PFbufResetQueues();
 	
 	/* Reset stats */
 	g_logical_reads = 0;
@@ -48,6 +266,7 @@ void PF_SetBufferSize(int size)
 	if (PFnumbpage == 0 && size > 0)
 	{
 		g_pf_max_bufs = size;
+		PFhashReserve(size);
 	}
 	else if (PFnumbpage > 0)
 	{
@@ -56,9 +275,30 @@ void PF_SetBufferSize(int size)
 	}
 }
 
+int PF_GetBufferSize(void)
+{
+	return g_pf_max_bufs;
+}
+
+void PF_SetHugePages(int on)
+{
+	if (PFnumbpage == 0)
+	{
+		g_pf_hugepages = on;
+	}
+	else
+	{
+		/* Cannot change the arena after it's allocated */
+		PFerrno = PFE_FILEOPEN; /* Re-using error code */
+	}
+}
+
 void PF_SetStrategy(int strategy) {
-    if (strategy == PF_STRAT_LRU || strategy == PF_STRAT_MRU) {
+    if (strategy >= PF_STRAT_LRU && strategy <= PF_STRAT_LRU2) {
+        pthread_mutex_lock(&PFbuflock);
         g_pf_strategy = strategy;
+        PFbufResetQueues();
+        pthread_mutex_unlock(&PFbuflock);
     }
     /* Could set PFerrno to an error otherwise */
 }
@@ -66,15 +306,15 @@ void PF_SetStrategy(int strategy) {
 /* --- NEW Statistics Functions (called by pf.c) --- */
 
 void PFbufResetStats(void) {
-    g_logical_reads = 0;
-    g_physical_reads = 0;
-    g_physical_writes = 0;
+    __atomic_store_n(&g_logical_reads, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_physical_reads, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_physical_writes, 0, __ATOMIC_RELAXED);
 }
 
 int PFbufGetStats(long *logical_reads, long *physical_reads, long *physical_writes) {
-    *logical_reads = g_logical_reads;
-    *physical_reads = g_physical_reads;
-    *physical_writes = g_physical_writes;
+    *logical_reads = __atomic_load_n(&g_logical_reads, __ATOMIC_RELAXED);
+    *physical_reads = __atomic_load_n(&g_physical_reads, __ATOMIC_RELAXED);
+    *physical_writes = __atomic_load_n(&g_physical_writes, __ATOMIC_RELAXED);
     return PFE_OK;
 }
 
@@ -83,6 +323,7 @@ PFbpage *bpage;
 /****************************************************************************
 SPECIFICATIONS:
 	Insert the buffer page pointed by "bpage" into the free list.
+	PFbuflock must be held.
 
 AUTHOR: clc
 *****************************************************************************/
@@ -99,6 +340,7 @@ SPECIFICATIONS:
 
 	Link the buffer page pointed by "bpage" as the head
 	of the used buffer list. No other field of bpage is modified.
+	PFbuflock must be held.
 
 AUTHOR: clc
 
@@ -126,9 +368,10 @@ PFbpage *bpage;		/* buffer page to be unlinked from the used list */
 SPECIFICATIONS:
 	Unlink the page pointed by bpage from the buffer list. Assume
 	that bpage is a valid pointer.  Set the "prevpage" and "nextpage"
-	fields to NULL. The caller is responsible to either place
+	fields to NULL, and take it off its replacement queue.
+	The caller is responsible to either place
 	the unlinked page into the free list, or insert it back
-	into the used list.
+	into the used list. PFbuflock must be held.
 
 AUTHOR: clc
 
@@ -140,6 +383,10 @@ GLOBAL VARIABLES MODIFIED:
 *****************************************************************************/
 {
 
+	if (PFclockhand == bpage)
+		PFclockhand = bpage->nextpage;
+	PFbufQueueUnlink(bpage);
+
 	if (PFfirstbpage == bpage)
 		PFfirstbpage = bpage->nextpage;
 	
@@ -156,26 +403,610 @@ GLOBAL VARIABLES MODIFIED:
 
 }
 
+/************************* Replacement Queues ****************************/
+
+static void PFbufQueueLink(bpage,q,next)
+PFbpage *bpage;	/* page to link */
+int q;		/* PF_Q_FIRST or PF_Q_HOT */
+PFbpage *next;	/* page on queue "q" to link in front of, or NULL for tail */
+/****************************************************************************
+SPECIFICATIONS:
+	Link "bpage", which must not be on a queue, into queue "q" just
+	in front of (more recent than) "next".
+*****************************************************************************/
+{
+PFbufqueue *queue = &PFq[q];
+
+	bpage->queue = q;
+	bpage->qnext = next;
+	bpage->qprev = (next == NULL) ? queue->tail : next->qprev;
+	if (bpage->qprev != NULL)
+		bpage->qprev->qnext = bpage;
+	else	queue->head = bpage;
+	if (next != NULL)
+		next->qprev = bpage;
+	else	queue->tail = bpage;
+	queue->len++;
+}
+
+static void PFbufQueueUnlink(bpage)
+PFbpage *bpage;	/* page to unlink */
+/****************************************************************************
+SPECIFICATIONS:
+	Take "bpage" off its queue. Nothing is done if it is not on one.
+*****************************************************************************/
+{
+PFbufqueue *queue;
+
+	if (bpage->queue == PF_Q_NONE)
+		return;
+	if (bpage->queue == PF_Q_HOT && g_pf_strategy == PF_STRAT_LRU2){
+		PFbufHeapRemove(bpage);
+		return;
+	}
+	queue = &PFq[bpage->queue];
+	if (bpage->qprev != NULL)
+		bpage->qprev->qnext = bpage->qnext;
+	else	queue->head = bpage->qnext;
+	if (bpage->qnext != NULL)
+		bpage->qnext->qprev = bpage->qprev;
+	else	queue->tail = bpage->qprev;
+	queue->len--;
+	bpage->qnext = bpage->qprev = NULL;
+	bpage->queue = PF_Q_NONE;
+}
+
+/* TRUE if page "bpage" looks fixed. Only a hint, read without its lock
+(pincount is only ever changed atomically, for it):
+PFbufClaim() checks again */
+#define PFbufPinned(bpage)	(__atomic_load_n(&(bpage)->pincount,__ATOMIC_RELAXED) > 0)
+
+/* LRU-2: parent and first child of slot "i" of the PF_Q_HOT heap */
+#define PFheapParent(i)	(((i) - 1) / 2)
+#define PFheapChild(i)	(2 * (i) + 1)
+
+static void PFbufHeapPut(bpage,i)
+PFbpage *bpage;	/* page to place */
+int i;		/* slot of PFhot */
+/****************************************************************************
+SPECIFICATIONS:
+	LRU-2: put "bpage" in slot "i" of the PF_Q_HOT heap, then move it
+	up or down until it is in order with the pages around it.
+*****************************************************************************/
+{
+int len = PFq[PF_Q_HOT].len;
+int child;
+
+	while (i > 0 && PFhot[PFheapParent(i)]->prevref > bpage->prevref){
+		PFhot[i] = PFhot[PFheapParent(i)];
+		PFhot[i]->hotidx = i;
+		i = PFheapParent(i);
+	}
+	while ((child=PFheapChild(i)) < len){
+		if (child + 1 < len &&
+				PFhot[child + 1]->prevref < PFhot[child]->prevref)
+			child++;
+		if (PFhot[child]->prevref >= bpage->prevref)
+			break;
+		PFhot[i] = PFhot[child];
+		PFhot[i]->hotidx = i;
+		i = child;
+	}
+	PFhot[i] = bpage;
+	bpage->hotidx = i;
+}
 
-static int PFbufInternalAlloc(bpage,writefcn)
+static void PFbufHeapAdd(bpage)
+PFbpage *bpage;	/* page to add, on no queue */
+/****************************************************************************
+SPECIFICATIONS:
+	LRU-2: add "bpage" to PF_Q_HOT, by its "prevref".
+*****************************************************************************/
+{
+	bpage->queue = PF_Q_HOT;
+	PFq[PF_Q_HOT].len++;
+	PFbufHeapPut(bpage,PFq[PF_Q_HOT].len - 1);
+}
+
+static void PFbufHeapRemove(bpage)
+PFbpage *bpage;	/* page on PF_Q_HOT */
+/****************************************************************************
+SPECIFICATIONS:
+	LRU-2: take "bpage" off PF_Q_HOT. The last page of the heap takes
+	its slot.
+*****************************************************************************/
+{
+PFbpage *last;
+
+	last = PFhot[--PFq[PF_Q_HOT].len];
+	if (last != bpage)
+		PFbufHeapPut(last,bpage->hotidx);
+	bpage->queue = PF_Q_NONE;
+}
+
+static PFbpage *PFbufHeapBest(i,best)
+int i;		/* slot of PFhot to look from */
+PFbpage *best;	/* best page found so far, or NULL */
+/****************************************************************************
+SPECIFICATIONS:
+	LRU-2: find the page with the oldest "prevref" that does not look
+	fixed in the subtree of the PF_Q_HOT heap at slot "i", if it is
+	older than "best".
+
+RETURN VALUE:
+	That page, or else "best".
+
+IMPLEMENTATION NOTES:
+	The pages below a page are younger, so each path stops at its first
+	page that is not fixed: only the fixed pages at the top of the heap
+	are gone past.
+*****************************************************************************/
+{
+	if (i >= PFq[PF_Q_HOT].len ||
+			(best != NULL && PFhot[i]->prevref >= best->prevref))
+		return(best);
+	if (!PFbufPinned(PFhot[i]))
+		return(PFhot[i]);
+	best = PFbufHeapBest(PFheapChild(i),best);
+	return(PFbufHeapBest(PFheapChild(i) + 1,best));
+}
+
+static void PFbufResetQueues()
+/****************************************************************************
+SPECIFICATIONS:
+	Rebuild the replacement state for the current strategy: all the
+	used pages count as referenced once, in their LRU order, and
+	the 2Q ghost list is emptied.
+*****************************************************************************/
+{
+PFbpage *bpage;
+
+	PFq[PF_Q_FIRST].head = PFq[PF_Q_FIRST].tail = NULL;
+	PFq[PF_Q_FIRST].len = 0;
+	PFq[PF_Q_HOT].head = PFq[PF_Q_HOT].tail = NULL;
+	PFq[PF_Q_HOT].len = 0;
+	PFghostlen = PFghostnext = 0;
+	PFclockhand = NULL;
+
+	for (bpage=PFlastbpage; bpage != NULL; bpage=bpage->prevpage){
+		bpage->queue = PF_Q_NONE;
+		bpage->qnext = bpage->qprev = NULL;
+		__atomic_store_n(&bpage->ref,FALSE,__ATOMIC_RELAXED);
+		bpage->prevref = 0;
+		bpage->lastref = ++PFreftime;
+		if (g_pf_strategy == PF_STRAT_2Q || g_pf_strategy == PF_STRAT_LRU2)
+			PFbufQueueLink(bpage,PF_Q_FIRST,PFq[PF_Q_FIRST].head);
+	}
+}
+
+static void PFbufGhostAdd(fd,page)
+int fd;		/* file descriptor */
+int page;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	2Q: remember that page "page" of file "fd" was evicted from A1in,
+	forgetting the oldest key if A1out is full.
+*****************************************************************************/
+{
+	if (PFghost == NULL || PFghostsize != PF2Q_KOUT()){
+		free((char *)PFghost);
+		PFghostsize = PF2Q_KOUT();
+		PFghostlen = PFghostnext = 0;
+		if ((PFghost=(PFghostkey *)malloc(PFghostsize*sizeof(PFghostkey)))
+					== NULL)
+			/* A1out is only a hint: do without */
+			return;
+	}
+	PFghost[PFghostnext].fd = fd;
+	PFghost[PFghostnext].page = page;
+	PFghostnext = (PFghostnext + 1) % PFghostsize;
+	if (PFghostlen < PFghostsize)
+		PFghostlen++;
+}
+
+static int PFbufGhostRemove(fd,page)
+int fd;		/* file descriptor */
+int page;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	2Q: look for page "page" of file "fd" in A1out, and forget it.
+
+RETURN VALUE:
+	TRUE	if it was there.
+	FALSE	otherwise.
+
+IMPLEMENTATION NOTES:
+	A1out is searched linearly. This is only done when a page is read
+	from the file, and A1out is half the buffer pool.
+*****************************************************************************/
+{
+int i;
+
+	for (i=0; i < PFghostlen; i++){
+		if (PFghost[i].fd == fd && PFghost[i].page == page){
+			PFghost[i].fd = -1;
+			return(TRUE);
+		}
+	}
+	return(FALSE);
+}
+
+static void PFbufAdmit(bpage,referenced)
+PFbpage *bpage;	/* page just brought into the buffer */
+int referenced;	/* TRUE if requested, FALSE if only prefetched */
+/****************************************************************************
+SPECIFICATIONS:
+	Set up the replacement state of a page that has just been read or
+	allocated. The "fd" and "page" fields must be set.
+*****************************************************************************/
+{
+	bpage->queue = PF_Q_NONE;
+	bpage->qnext = bpage->qprev = NULL;
+	switch(g_pf_strategy){
+	case PF_STRAT_CLOCK:
+		/* a prefetched page is about to be used: give it one turn */
+		__atomic_store_n(&bpage->ref,TRUE,__ATOMIC_RELAXED);
+		break;
+	case PF_STRAT_2Q:
+		/* pages evicted from A1in not long ago go straight to Am */
+		if (referenced && PFghostlen > 0 &&
+				PFbufGhostRemove(bpage->fd,bpage->page))
+			PFbufQueueLink(bpage,PF_Q_HOT,PFq[PF_Q_HOT].head);
+		else	PFbufQueueLink(bpage,PF_Q_FIRST,PFq[PF_Q_FIRST].head);
+		break;
+	case PF_STRAT_LRU2:
+		bpage->prevref = 0;
+		bpage->lastref = referenced ? ++PFreftime : 0;
+		PFbufQueueLink(bpage,PF_Q_FIRST,PFq[PF_Q_FIRST].head);
+		break;
+	}
+}
+
+static void PFbufHit(bpage)
+PFbpage *bpage;	/* page found in the buffer */
+/****************************************************************************
+SPECIFICATIONS:
+	Record a request for a page that is already in the buffer.
+	(For LRU and MRU this is done by relinking when it is unfixed.)
+	PFbuflock must be held if PFbufHitLocked(); CLOCK only sets the
+	reference bit, atomically.
+*****************************************************************************/
+{
+	switch(g_pf_strategy){
+	case PF_STRAT_CLOCK:
+		__atomic_store_n(&bpage->ref,TRUE,__ATOMIC_RELAXED);
+		break;
+	case PF_STRAT_2Q:
+		/* a hit in A1in is not moved: it may just be correlated */
+		if (bpage->queue == PF_Q_HOT && PFq[PF_Q_HOT].head != bpage){
+			PFbufQueueUnlink(bpage);
+			PFbufQueueLink(bpage,PF_Q_HOT,PFq[PF_Q_HOT].head);
+		}
+		break;
+	case PF_STRAT_LRU2:
+		if (bpage->lastref == 0 || PFreftime - bpage->lastref < PF_LRU2_CRP){
+			/* first real reference, or correlated with the last one:
+			the reference history is not shifted */
+			bpage->lastref = ++PFreftime;
+			if (bpage->queue != PF_Q_FIRST)
+				break;
+			PFbufQueueUnlink(bpage);
+			PFbufQueueLink(bpage,PF_Q_FIRST,PFq[PF_Q_FIRST].head);
+		}
+		else {
+			bpage->prevref = bpage->lastref;
+			bpage->lastref = ++PFreftime;
+			PFbufQueueUnlink(bpage);
+			PFbufHeapAdd(bpage);
+		}
+		break;
+	}
+}
+
+static int PFbufClaim(bpage)
+PFbpage *bpage;	/* page on the used list */
+/****************************************************************************
+SPECIFICATIONS:
+	Try to take the page "bpage" for replacement. PFbuflock must be
+	held. The page must not be fixed, and no I/O may be going on for it.
+	A claimed page is fixed and marked "io", so that it is not chosen
+	again, and a thread asking for it waits until PFbufEvict() is done.
+
+RETURN VALUE:
+	TRUE	if the page is claimed.
+	FALSE	if not, also when its hash table partition is busy.
+*****************************************************************************/
+{
+int claimed;
+
+	if (!PFhashTryLock(bpage->fd,bpage->page))
+		return(FALSE);
+	claimed = (bpage->pincount == 0 && !bpage->io);
+	if (claimed){
+		__atomic_store_n(&bpage->pincount,1,__ATOMIC_RELAXED);
+		bpage->io = TRUE;
+	}
+	PFhashUnlock(bpage->fd,bpage->page);
+	return(claimed);
+}
+
+static PFbpage *PFbufQueueVictim(q)
+int q;		/* PF_Q_FIRST or PF_Q_HOT */
+/****************************************************************************
+SPECIFICATIONS:
+	Find and claim the least recent page on queue "q" that is not fixed.
+
+RETURN VALUE:
+	The page, or NULL if there is none.
+*****************************************************************************/
+{
+PFbpage *bpage;
+
+	for (bpage=PFq[q].tail; bpage != NULL && !PFbufClaim(bpage);
+				bpage=bpage->qprev);
+	return(bpage);
+}
+
+static PFbpage *PFbufChooseVictim()
+/****************************************************************************
+SPECIFICATIONS:
+	Choose a page that is not fixed to be replaced, according to the
+	current strategy, and claim it with PFbufClaim(). PFbuflock must
+	be held.
+
+RETURN VALUE:
+	The page, or NULL if all pages are fixed.
+*****************************************************************************/
+{
+PFbpage *tbpage;	/* temporary pointer to buffer page */
+int steps;		/* # of pages looked at by the CLOCK hand */
+
+	switch(g_pf_strategy){
+	case PF_STRAT_MRU:
+		/* MRU: Find victim from the HEAD (Most Recently Used) */
+		for (tbpage = PFfirstbpage; tbpage != NULL; tbpage = tbpage->nextpage) {
+			if (PFbufClaim(tbpage))
+				break; /* Found victim */
+		}
+		return(tbpage);
+
+	case PF_STRAT_CLOCK:
+		/* Sweep, clearing reference bits, until an unreferenced page
+		is found. Two turns are enough: the first clears every bit. */
+		tbpage = (PFclockhand != NULL) ? PFclockhand : PFfirstbpage;
+		for (steps=0; steps < 2*PFnumbpage && tbpage != NULL; steps++){
+			if (!PFbufPinned(tbpage)){
+				if (!__atomic_load_n(&tbpage->ref,__ATOMIC_RELAXED) &&
+						PFbufClaim(tbpage)){
+					/* unlinking the victim moves the hand on */
+					PFclockhand = tbpage;
+					return(tbpage);
+				}
+				__atomic_store_n(&tbpage->ref,FALSE,__ATOMIC_RELAXED);
+			}
+			tbpage = (tbpage->nextpage != NULL) ? tbpage->nextpage :
+						PFfirstbpage;
+		}
+		return(NULL);
+
+	case PF_STRAT_2Q:
+		/* reclaim from A1in while it is over its share */
+		if (PFq[PF_Q_FIRST].len > PF2Q_KIN()){
+			if ((tbpage=PFbufQueueVictim(PF_Q_FIRST)) == NULL)
+				tbpage = PFbufQueueVictim(PF_Q_HOT);
+		}
+		else if ((tbpage=PFbufQueueVictim(PF_Q_HOT)) == NULL)
+			tbpage = PFbufQueueVictim(PF_Q_FIRST);
+		if (tbpage != NULL && tbpage->queue == PF_Q_FIRST)
+			PFbufGhostAdd(tbpage->fd,tbpage->page);
+		return(tbpage);
+
+	case PF_STRAT_LRU2:
+		/* pages referenced once have an infinite backward 2-distance */
+		if ((tbpage=PFbufQueueVictim(PF_Q_FIRST)) != NULL)
+			return(tbpage);
+		if ((tbpage=PFbufHeapBest(0,NULL)) != NULL && PFbufClaim(tbpage))
+			return(tbpage);
+		/* it was fixed after all, or its partition was busy */
+		for (steps=0; steps < PFq[PF_Q_HOT].len; steps++)
+			if (PFbufClaim(PFhot[steps]))
+				return(PFhot[steps]);
+		return(NULL);
+
+	default:
+		/* LRU: Find victim from the TAIL (Least Recently Used) */
+		for (tbpage = PFlastbpage; tbpage != NULL; tbpage = tbpage->prevpage) {
+			if (PFbufClaim(tbpage))
+				break; /* Found victim */
+		}
+		return(tbpage);
+	}
+}
+
+static void PFbufFileUnlink(bpage)
+PFbpage *bpage;	/* page unlinked from the used list for good */
+/****************************************************************************
+SPECIFICATIONS:
+	Take the page "bpage" off the list of the pages of its file.
+	PFbuflock must be held.
+*****************************************************************************/
+{
+	if (bpage->fprev != NULL)
+		bpage->fprev->fnext = bpage->fnext;
+	else	PFfilebpages[bpage->fd] = bpage->fnext;
+	if (bpage->fnext != NULL)
+		bpage->fnext->fprev = bpage->fprev;
+	bpage->fnext = bpage->fprev = NULL;
+}
+
+static void PFbufLinkNew(bpage)
+PFbpage *bpage;	/* page that now holds a file page */
+/****************************************************************************
+SPECIFICATIONS:
+	Link a page returned by PFbufInternalAlloc() into the used list,
+	and into the list of the pages of its file.
+	PFbuflock must be held. Under PF_STRAT_CLOCK the page is linked
+	just before the hand, so it is looked at last; otherwise it is
+	linked as the head.
+*****************************************************************************/
+{
+	bpage->fprev = NULL;
+	bpage->fnext = PFfilebpages[bpage->fd];
+	if (bpage->fnext != NULL)
+		bpage->fnext->fprev = bpage;
+	PFfilebpages[bpage->fd] = bpage;
+
+	if (g_pf_strategy == PF_STRAT_CLOCK && PFclockhand != NULL
+				&& PFclockhand->prevpage != NULL){
+		/* Link the page just before the hand */
+		bpage->nextpage = PFclockhand;
+		bpage->prevpage = PFclockhand->prevpage;
+		PFclockhand->prevpage->nextpage = bpage;
+		PFclockhand->prevpage = bpage;
+	}
+	else
+		/* Link the page as the head of the used list */
+		PFbufLinkHead(bpage);
+}
+
+static void PFbufGiveBack(bpage)
+PFbpage *bpage;	/* page from PFbufInternalAlloc(), not linked */
+/****************************************************************************
+SPECIFICATIONS:
+	Put a page that could not be used into the free list.
+*****************************************************************************/
+{
+	pthread_mutex_lock(&PFbuflock);
+	PFbufInsertFree(bpage);
+	pthread_mutex_unlock(&PFbuflock);
+}
+
+static void PFbufSetDirty(bpage)
+PFbpage *bpage;	/* fixed page, its partition locked */
+/****************************************************************************
+SPECIFICATIONS:
+	Mark the page "bpage" dirty, and wake the write-behind flusher
+	if too few frames are left clean.
+*****************************************************************************/
+{
+	if (bpage->dirty)
+		return;
+	bpage->dirty = TRUE;
+	__atomic_fetch_add(&PFdirtycount,1,__ATOMIC_RELAXED);
+	if (__atomic_load_n(&g_pf_wb_clean,__ATOMIC_RELAXED) > 0 &&
+			PFwbExcess() > 0){
+		pthread_mutex_lock(&PFwblock);
+		pthread_cond_signal(&PFwbcond);
+		pthread_mutex_unlock(&PFwblock);
+	}
+}
+
+/* Mark the page "bpage", whose partition is locked, clean */
+#define PFbufSetClean(bpage) { \
+	if ((bpage)->dirty) \
+		__atomic_fetch_sub(&PFdirtycount,1,__ATOMIC_RELAXED); \
+	(bpage)->dirty = FALSE; \
+}
+
+static int PFbufEvict(bpage,writefcn)
+PFbpage *bpage;	/* page claimed and unlinked from the used list */
+int (*writefcn)();
+/****************************************************************************
+SPECIFICATIONS:
+	Write out the page "bpage", claimed by PFbufClaim(), if it is
+	dirty, and take it out of the hash table. No lock may be held:
+	the write is done without any.
+
+RETURN VALUE:
+	PFE_OK	if no error.
+	PF error code if error. The page is then linked back into the
+	used list, and not fixed any more.
+*****************************************************************************/
+{
+int error;
+long start;	/* start of the write, for the statistics */
+
+	if (bpage->dirty){
+		start = PFstatStart();
+		error = (*writefcn)(bpage->fd,bpage->page,&bpage->fpage);
+		PFstatEnd(PF_HIST_WRITE,start);
+		if (error != PFE_OK){
+			pthread_mutex_lock(&PFbuflock);
+			PFbufLinkNew(bpage);
+			PFbufAdmit(bpage,FALSE);
+			pthread_mutex_unlock(&PFbuflock);
+			PFhashLock(bpage->fd,bpage->page);
+			bpage->io = FALSE;
+			__atomic_store_n(&bpage->pincount,0,__ATOMIC_RELAXED);
+			PFhashWakeup(bpage->fd,bpage->page);
+			PFhashUnlock(bpage->fd,bpage->page);
+			return(error);
+		}
+		PFstatAdd(g_physical_writes,1); /* STATS: Increment physical write */
+		PFstatFile(bpage->fd,writes,1);
+	}
+
+	/* unlink from hash table, and let waiters read it again */
+	PFhashLock(bpage->fd,bpage->page);
+	PFbufSetClean(bpage);
+	bpage->io = FALSE;
+	error = PFhashDelete(bpage->fd,bpage->page);
+	PFhashWakeup(bpage->fd,bpage->page);
+	PFhashUnlock(bpage->fd,bpage->page);
+	return(error);
+}
+
+static int PFbufGrowFrame(bpage,size)
+PFbpage *bpage;	/* page from PFbufInternalAlloc(), not linked */
+int size;	/* page size it must hold */
+/****************************************************************************
+SPECIFICATIONS:
+	Give the frame "bpage" a block of its own, aligned on "size", for
+	pages of "size" bytes, in place of its smaller one.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_NOMEM	if no memory.
+*****************************************************************************/
+{
+void *data;
+
+	if (posix_memalign(&data,size,size) != 0){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	if (bpage->bufsize > PF_PAGE_SIZE)
+		free(bpage->fpage.pagebuf);
+	bpage->fpage.pagebuf = (char *)data;
+	bpage->bufsize = size;
+	return(PFE_OK);
+}
+
+static int PFbufInternalAlloc(bpage,size,writefcn)
 PFbpage **bpage;	/* pointer to pointer to buffer bpage to be allocated*/
+int size;	/* page size of the file the page is for */
 int (*writefcn)();
 /****************************************************************************
 SPECIFICATIONS:
-	Allocate a buffer page and set *bpage to point to it. *bpage
-	is set to NULL if one can not be allocated.
-	The "nextpage" and "prevpage" fields of *bpage are linked as
-	the head of the list of used buffers.All the other fields are undefined.
-	writefcn() is used to write pages. (See PFbufGet()).
+	Allocate a buffer page for a page of "size" bytes and set *bpage
+	to point to it. *bpage is set to NULL if one can not be allocated.
+	The page is fixed (pincount 1), not dirty, and neither in the
+	hash table nor linked into any list, so no other thread can see it.
+	The caller links it with PFbufLinkNew() once it holds a file page,
+	or gives it back with PFbufGiveBack(). All the other fields are
+	undefined. writefcn() is used to write pages. (See PFbufGet()).
 
 ALGORITHM:
 	If there is something on the free list, then use it.
 	If free list is empty, and there are less than PF_MAX_BUFS 
-	number of pages allocated, then malloc() one.
+	number of pages allocated, then take the next one from the
+	arena, allocating the arena the first time.
 	Otherwise, choose a victim to write out, and then use that
 	page as the page to be used.
 	If a victim cannot be chosen (because all the pages are fixed),
 	then return error.
+	The victim is chosen by PFbufChooseVictim() according to the
+	replacement strategy, and written out once PFbuflock is released.
 
 AUTHOR: clc
 
@@ -191,84 +1022,82 @@ GLOBAL VARIABLES MODIFIED:
 {
 PFbpage *tbpage;	/* temporary pointer to buffer page */
 int error;		/* error value returned*/
+int dirty;		/* TRUE if the victim was dirty */
+
+	*bpage = NULL;		/* set initial return value */
 
-	/* Set *bpage to the buffer page to be returned */
+	pthread_mutex_lock(&PFbuflock);
 	if (PFfreebpage != NULL){
 		/* Free list not empty, use the one from the free list. */
-		*bpage = PFfreebpage;
-		PFfreebpage = (*bpage)->nextpage;
+		tbpage = PFfreebpage;
+		PFfreebpage = tbpage->nextpage;
+		pthread_mutex_unlock(&PFbuflock);
 	}
 	else if (PFnumbpage < g_pf_max_bufs){
 		/* We have not reached max buffer limit, so
-		malloc() a new one */
-		if ((*bpage=(PFbpage *)malloc(sizeof(PFbpage)))==NULL){
+		use a new one */
+		if (PFframes == NULL && PFbufArenaAlloc() != PFE_OK){
 			/* no mem */
-			*bpage = NULL;
+			pthread_mutex_unlock(&PFbuflock);
 			PFerrno = PFE_NOMEM;
 			return(PFerrno);
 		}
+		tbpage = &PFframes[PFnumbpage];
 		/* increment # of pages allocated */
 		PFnumbpage++;
+		pthread_mutex_unlock(&PFbuflock);
 	}
 	else {
 		/* we have reached max buffer limit */
 		/* choose a victim from the buffer*/
-
-		*bpage = NULL;		/* set initial return value */
-
-		if (g_pf_strategy == PF_STRAT_LRU) {
-            /* LRU: Find victim from the TAIL (Least Recently Used) */
-            for (tbpage = PFlastbpage; tbpage != NULL; tbpage = tbpage->prevpage) {
-                if (!tbpage->fixed)
-                    break; /* Found victim */
-            }
-        } else {
-            /* MRU: Find victim from the HEAD (Most Recently Used) */
-            for (tbpage = PFfirstbpage; tbpage != NULL; tbpage = tbpage->nextpage) {
-                if (!tbpage->fixed)
-                    break; /* Found victim */
-            }
-        }
-
-		if (tbpage == NULL){
+		if ((tbpage=PFbufChooseVictim()) == NULL){
 			/* couldn't find a free page */
+			pthread_mutex_unlock(&PFbuflock);
+			PFstatCount(PF_CNT_NOBUF,1);
 			PFerrno = PFE_NOBUF;
 			return(PFerrno);
 		}
 
-		/* write out the dirty page */
-		if (tbpage->dirty) {
-            if ((error = (*writefcn)(tbpage->fd, tbpage->page, &tbpage->fpage)) != PFE_OK)
-                return(error);
-            g_physical_writes++; /* STATS: Increment physical write */
-        }
-        tbpage->dirty = FALSE;
-
-		/* unlink from hash table */
-		if ((error=PFhashDelete(tbpage->fd,tbpage->page))!= PFE_OK)
-			return(error);
-		
 		/* unlink from buffer list */
 		PFbufUnlink(tbpage);
+		PFbufFileUnlink(tbpage);
+		pthread_mutex_unlock(&PFbuflock);
 
-		*bpage = tbpage;
-
+		/* write out the dirty page */
+		dirty = tbpage->dirty;
+		if ((error=PFbufEvict(tbpage,writefcn)) != PFE_OK)
+			return(error);
+		PFstatFile(tbpage->fd,evictions,1);
+		if (dirty)
+			PFstatFile(tbpage->fd,dirty_evictions,1);
 	}
 
-	/* Link the page as the head of the used list */
-	PFbufLinkHead(*bpage);
+	tbpage->nextpage = tbpage->prevpage = NULL;
+	tbpage->queue = PF_Q_NONE;
+	tbpage->qnext = tbpage->qprev = NULL;
+	__atomic_store_n(&tbpage->pincount,1,__ATOMIC_RELAXED);
+	tbpage->io = FALSE;
+	tbpage->dirty = FALSE;
+	tbpage->prefetched = FALSE;
+	if (tbpage->bufsize < size &&
+			(error=PFbufGrowFrame(tbpage,size)) != PFE_OK){
+		PFbufGiveBack(tbpage);
+		return(error);
+	}
+	*bpage = tbpage;
 	return(PFE_OK);
 }
 
 
 /************************* Interface to the Outside World ****************/
 
-int PFbufGet(fd,pagenum,fpage,readfcn,writefcn)
+static int PFbufFix(fd,pagenum,fpage,readfcn,writefcn,sole)
 int fd;	/* file descriptor */
 int pagenum;	/* page number */
 PFfpage **fpage;	/* pointer to pointer to file page */
 int (*readfcn)();	/* function to read a page */
 int (*writefcn)();	/* function to write a page */
+int sole;	/* TRUE if the page must not be fixed already */
 /****************************************************************************
 SPECIFICATIONS:
 	Get a page whose number is "pagenum" from the file pointed
@@ -285,78 +1114,183 @@ SPECIFICATIONS:
 		in pagenum;
 		PFpage *fpage;
 	which will write one page into the file.
-	It is an error to read a page already fixed in the buffer.
+	If "sole" is FALSE, a page may be fixed any number of times, by
+	one caller or several: the callers then share the buffer page, and
+	it stays fixed until each fix is matched by a PFbufUnfix().
 
 RETURN VALUE:
 	PFE_OK	if no error.
 	PF error code if error.
-	If error code is PFE_PAGEFIXED, *fpage is still set to point to the buffer
-	page of the page in memory.
+	PFE_PAGEFIXED if "sole" and the page is already fixed. *fpage is
+	still set to point to the buffer page of the page in memory.
+
+IMPLEMENTATION NOTES:
+	A thread asking for a page that another one is reading or writing
+	out waits for it. Two threads missing on the same page both get a
+	frame, and the one that does not insert it first gives it back.
 
 GLOBAL VARIABLES MODIFIED:
 *****************************************************************************/
 {
 PFbpage *bpage;	/* pointer to buffer */
 int error;
+long start;	/* start of the read, for the statistics */
+
+	PFstatAdd(g_logical_reads,1); /* STATS: Increment logical read */
+
+	for (;;){
+		PFhashLock(fd,pagenum);
+		if ((bpage=PFhashFind(fd,pagenum)) != NULL){
+			if (!bpage->io)
+				/* page in buffer */
+				break;
+			/* page being read or written out: look again later */
+			PFhashWait(fd,pagenum);
+			PFhashUnlock(fd,pagenum);
+			continue;
+		}
+		PFhashUnlock(fd,pagenum);
 
-g_logical_reads++; /* STATS: Increment logical read */
-
-	if ((bpage=PFhashFind(fd,pagenum)) == NULL){
 		/* page not in buffer. */
 		
 		/* allocate an empty page */
-		if ((error=PFbufInternalAlloc(&bpage,writefcn))!= PFE_OK){
+		if ((error=PFbufInternalAlloc(&bpage,PFfilepagesize[fd],writefcn))!= PFE_OK){
 			/* error */
 			*fpage = NULL;
 			return(error);
 		}
+		bpage->fd = fd;
+		bpage->page = pagenum;
 		
-		/* read the page */
-		if ((error=(*readfcn)(fd,pagenum,&bpage->fpage))!= PFE_OK){
-			/* error reading the page. put buffer back into 
-			the free list, and return gracefully */
-			PFbufUnlink(bpage);
-			PFbufInsertFree(bpage);
-			*fpage = NULL;
-			return(error);
+		/* insert new page into hash table, unless another thread
+		did meanwhile */
+		PFhashLock(fd,pagenum);
+		if (PFhashFind(fd,pagenum) != NULL){
+			PFhashUnlock(fd,pagenum);
+			PFbufGiveBack(bpage);
+			continue;
 		}
-		g_physical_reads++; /* STATS: Increment physical read */
-
-		/* insert new page into hash table */
 		if ((error=PFhashInsert(fd,pagenum,bpage))!=PFE_OK){
 			/* failed to insert into hash table */
 			/* put page into free list */
-			PFbufUnlink(bpage);
-			PFbufInsertFree(bpage);
+			PFhashUnlock(fd,pagenum);
+			PFbufGiveBack(bpage);
+			*fpage = NULL;
+			return(error);
+		}
+		bpage->io = TRUE;
+		PFhashUnlock(fd,pagenum);
+
+		/* read the page */
+		start = PFstatStart();
+		error = (*readfcn)(fd,pagenum,&bpage->fpage);
+		PFstatEnd(PF_HIST_READ,start);
+		if (error != PFE_OK){
+			/* error reading the page. put buffer back into 
+			the free list, and return gracefully */
+			PFhashLock(fd,pagenum);
+			(void)PFhashDelete(fd,pagenum);
+			bpage->io = FALSE;
+			PFhashWakeup(fd,pagenum);
+			PFhashUnlock(fd,pagenum);
+			PFbufGiveBack(bpage);
+			*fpage = NULL;
 			return(error);
 		}
+		PFstatAdd(g_physical_reads,1); /* STATS: Increment physical read */
+		PFstatFile(fd,misses,1);
+		PFstatFile(fd,reads,1);
 
 		/* set the fields for this page*/
-		bpage->fd = fd;
-		bpage->page = pagenum;
-		bpage->dirty = FALSE;
+		pthread_mutex_lock(&PFbuflock);
+		PFbufLinkNew(bpage);
+		PFbufAdmit(bpage,TRUE);
+		pthread_mutex_unlock(&PFbuflock);
+
+		PFhashLock(fd,pagenum);
+		bpage->io = FALSE;
+		PFhashWakeup(fd,pagenum);
+		PFhashUnlock(fd,pagenum);
+		*fpage = &bpage->fpage;
+		return(PFE_OK);
 	}
-	else if (bpage->fixed){
+
+	/* page in buffer, and its partition is locked */
+	*fpage = &bpage->fpage;
+	if (sole && bpage->pincount > 0){
 		/* page already in memory, and is fixed, so we can't
-		get it again. */
-		*fpage = &bpage->fpage;
+		get it for ourselves. */
+		PFhashUnlock(fd,pagenum);
 		PFerrno = PFE_PAGEFIXED;
 		return(PFerrno);
 	}
 
 	/* Fix the page in the buffer then return*/
-	bpage->fixed = TRUE;
-	*fpage = &bpage->fpage;
+	__atomic_add_fetch(&bpage->pincount,1,__ATOMIC_RELAXED);
+	if (bpage->prefetched){
+		bpage->prefetched = FALSE;
+		PFstatFile(fd,prefetch_hits,1);
+	}
+	PFhashUnlock(fd,pagenum);
+	PFstatFile(fd,hits,1);
+	if (PFbufHitLocked()){
+		pthread_mutex_lock(&PFbuflock);
+		PFbufHit(bpage);
+		pthread_mutex_unlock(&PFbuflock);
+	}
+	else	PFbufHit(bpage);
 	return(PFE_OK);
 }
 
+int PFbufGet(fd,pagenum,fpage,readfcn,writefcn)
+int fd;	/* file descriptor */
+int pagenum;	/* page number */
+PFfpage **fpage;	/* pointer to pointer to file page */
+int (*readfcn)();	/* function to read a page */
+int (*writefcn)();	/* function to write a page */
+/****************************************************************************
+SPECIFICATIONS:
+	Fix page "pagenum" of file "fd" in the buffer, reading it if
+	needed, and set *fpage to point to its data. The page may already
+	be fixed: see PFbufFix().
+
+RETURN VALUE:
+	PFE_OK	if no error.
+	PF error code if error.
+*****************************************************************************/
+{
+	return(PFbufFix(fd,pagenum,fpage,readfcn,writefcn,FALSE));
+}
+
+int PFbufGetSole(fd,pagenum,fpage,readfcn,writefcn)
+int fd;	/* file descriptor */
+int pagenum;	/* page number */
+PFfpage **fpage;	/* pointer to pointer to file page */
+int (*readfcn)();	/* function to read a page */
+int (*writefcn)();	/* function to write a page */
+/****************************************************************************
+SPECIFICATIONS:
+	Same as PFbufGet(), but only if nobody has the page fixed, for
+	callers that are about to change what the page is (PF_DisposePage()).
+
+RETURN VALUE:
+	PFE_OK	if no error.
+	PFE_PAGEFIXED if the page is already fixed. *fpage is still set
+	to point to the buffer page of the page in memory.
+	other PF error code if error.
+*****************************************************************************/
+{
+	return(PFbufFix(fd,pagenum,fpage,readfcn,writefcn,TRUE));
+}
+
 int PFbufUnfix(fd,pagenum,dirty)
 int fd;		/* file descriptor */
 int pagenum;	/* page number */
 int dirty;	/* TRUE if page is dirty */
 /****************************************************************************
 SPECIFICATIONS:
-	Unfix the file page whose number is "pagenum" from the buffer.
+	Unfix the file page whose number is "pagenum" from the buffer,
+	once: a page fixed several times stays fixed until the last unfix.
 	If dirty is TRUE, then mark the buffer as having been modified.
 	Otherwise, the dirty flag is left unchanged.
 
@@ -370,30 +1304,37 @@ RETURN VALUE:
 {
 PFbpage *bpage;
 
+	PFhashLock(fd,pagenum);
 	if ((bpage= PFhashFind(fd,pagenum))==NULL){
 		/* page not in buffer */
+		PFhashUnlock(fd,pagenum);
 		PFerrno = PFE_PAGENOTINBUF;
 		return(PFerrno);
 	}
 
-	if (!bpage->fixed){
+	if (bpage->pincount == 0 || bpage->io){
 		/* page already unfixed */
+		PFhashUnlock(fd,pagenum);
 		PFerrno = PFE_PAGEUNFIXED;
 		return(PFerrno);
 	}
 
 	if (dirty)
 		/* mark this page dirty */
-		bpage->dirty = TRUE;
-	
-	/* unfix the page */
-	bpage->fixed = FALSE;
+		PFbufSetDirty(bpage);
 	
-	/* unlink this page */
-	PFbufUnlink(bpage);
+	if (PFbufRecency()){
+		/* insert it as head of linked list to make it most recently
+		used, while it is still fixed */
+		pthread_mutex_lock(&PFbuflock);
+		PFbufUnlink(bpage);
+		PFbufLinkHead(bpage);
+		pthread_mutex_unlock(&PFbuflock);
+	}
 
-	/* insert it as head of linked list to make it most recently used*/
-	PFbufLinkHead(bpage);
+	/* unfix the page */
+	__atomic_sub_fetch(&bpage->pincount,1,__ATOMIC_RELAXED);
+	PFhashUnlock(fd,pagenum);
 
 	return(PFE_OK);
 }
@@ -421,45 +1362,62 @@ int error;
 
 	*fpage = NULL;	/* initial value of fpage */
 
-	g_logical_reads++; /* STATS: Increment logical read (alloc is a request) */
+	PFstatAdd(g_logical_reads,1); /* STATS: Increment logical read (alloc is a request) */
 
-	if ((bpage=PFhashFind(fd,pagenum))!= NULL){
+	PFhashLock(fd,pagenum);
+	bpage = PFhashFind(fd,pagenum);
+	PFhashUnlock(fd,pagenum);
+	if (bpage != NULL){
 		/* page already in buffer*/
 		PFerrno = PFE_PAGEINBUF;
 		return(PFerrno);
 	}
 
-	if ((error=PFbufInternalAlloc(&bpage,writefcn))!= PFE_OK)
+	if ((error=PFbufInternalAlloc(&bpage,PFfilepagesize[fd],writefcn))!= PFE_OK)
 		/* can't get any buffer */
 		return(error);
+	bpage->fd = fd;
+	bpage->page = pagenum;
 	
 	/* put ourselves into the hash table */
+	PFhashLock(fd,pagenum);
+	if (PFhashFind(fd,pagenum) != NULL){
+		/* another thread got there first */
+		PFhashUnlock(fd,pagenum);
+		PFbufGiveBack(bpage);
+		PFerrno = PFE_PAGEINBUF;
+		return(PFerrno);
+	}
 	if ((error=PFhashInsert(fd,pagenum,bpage))!= PFE_OK){
 		/* can't insert into the hash table */
-		/* unlink bpage, and put it into the free list */
-		PFbufUnlink(bpage);
-		PFbufInsertFree(bpage);
+		/* put bpage into the free list */
+		PFhashUnlock(fd,pagenum);
+		PFbufGiveBack(bpage);
 		return(error);
 	}
+	PFhashUnlock(fd,pagenum);
 
-	/* init the fields of bpage and return */
-	bpage->fd = fd;
-	bpage->page = pagenum;
-	bpage->fixed = TRUE;
-	bpage->dirty = FALSE;
+	/* link it: it is fixed, so no other thread can take it */
+	pthread_mutex_lock(&PFbuflock);
+	PFbufLinkNew(bpage);
+	PFbufAdmit(bpage,TRUE);
+	pthread_mutex_unlock(&PFbuflock);
 
 	*fpage = &bpage->fpage;
 	return(PFE_OK);
 }
 
 
-int PFbufReleaseFile(fd,writefcn)
+int PFbufReleaseFile(fd,writefcn,writevfcn)
 int fd;		/* file descriptor */
 int (*writefcn)();	/* function to write a page of file */
+int (*writevfcn)();	/* function to write several consecutive pages */
 /****************************************************************************
 SPECIFICATIONS:
 	Release all pages of file "fd" from the buffer and
-	put them into the free list 
+	put them into the free list. No other thread may use the file
+	meanwhile. The dirty pages are first written out in page order,
+	as by PFbufFlush().
 
 AUTHOR: clc
 
@@ -468,47 +1426,356 @@ RETURN VALUE:
 	PF error code if error.
 
 IMPLEMENTATION NOTES:
-	A linear search of the buffer is performed.
-	A better method is not needed because # of buffers are small.
+	The list of the pages of the file is searched, claiming and
+	unlinking them, so the cost does not depend on the size of the
+	pool. They are written out once PFbuflock is released. Pages whose hash table partition is busy (because of
+	another file), and pages being written out by a flush, are left
+	for another search.
 *****************************************************************************/
 {
 PFbpage *bpage;	/* ptr to buffer pages to search */
 PFbpage *temppage;
+PFbpage *claimed;	/* pages claimed, linked by "nextpage" */
+int busy;	/* TRUE if a page could not be claimed yet */
+int fixed;	/* TRUE if a page of the file is fixed */
 int error;		/* error code */
 
-	/* Do linear scan of the buffer to find pages belonging to the file */
-	bpage = PFfirstbpage;
-	while (bpage != NULL){
-		if (bpage->fd == fd){
-			/* The file descriptor matches*/
-			if (bpage->fixed){
-				PFerrno = PFE_PAGEFIXED;
-				return(PFerrno);
-			}
+	if ((error=PFbufFlush(fd,writevfcn)) != PFE_OK)
+		return(error);
+
+	do {
+		claimed = NULL;
+		busy = fixed = FALSE;
+
+		/* claim the pages of the file */
+		pthread_mutex_lock(&PFbuflock);
+		bpage = PFfilebpages[fd];
+		while (bpage != NULL && !fixed){
+			temppage = bpage;
+			bpage = bpage->fnext;
 
-			/* write out dirty page */
-			if (bpage->dirty) {
-                if ((error = (*writefcn)(fd, bpage->page, &bpage->fpage)) != PFE_OK)
-                    return(error);
-                g_physical_writes++; /* STATS: Increment physical write */
-            }
-            bpage->dirty = FALSE;
+			if (!PFhashTryLock(fd,temppage->page)){
+				busy = TRUE;
+				continue;
+			}
+			if (temppage->io){
+				/* being written out by a flush */
+				PFhashUnlock(fd,temppage->page);
+				busy = TRUE;
+				continue;
+			}
+			if (temppage->pincount > 0)
+				fixed = TRUE;
+			else {
+				__atomic_store_n(&temppage->pincount,1,__ATOMIC_RELAXED);
+				temppage->io = TRUE;
+			}
+			PFhashUnlock(fd,temppage->page);
+			if (fixed)
+				break;
 
-			/* get rid of it from the hash table */
-			if ((error=PFhashDelete(fd,bpage->page))!= PFE_OK){
+			PFbufUnlink(temppage);
+			PFbufFileUnlink(temppage);
+			temppage->nextpage = claimed;
+			claimed = temppage;
+		}
+		pthread_mutex_unlock(&PFbuflock);
+
+		/* write out the pages, and put them into the free list */
+		error = PFE_OK;
+		while (claimed != NULL){
+			temppage = claimed;
+			claimed = claimed->nextpage;
+			if (error != PFE_OK){
+				/* give the rest back as unfixed used pages */
+				PFhashLock(fd,temppage->page);
+				__atomic_store_n(&temppage->pincount,0,__ATOMIC_RELAXED);
+				temppage->io = FALSE;
+				PFhashWakeup(fd,temppage->page);
+				PFhashUnlock(fd,temppage->page);
+				pthread_mutex_lock(&PFbuflock);
+				PFbufLinkNew(temppage);
+				PFbufAdmit(temppage,FALSE);
+				pthread_mutex_unlock(&PFbuflock);
+			}
+			else if ((error=PFbufEvict(temppage,writefcn)) == PFE_OK)
+				PFbufGiveBack(temppage);
+			else if (error == PFE_HASHNOTFOUND){
 				/* internal error */
 				printf("Internal error:PFbufReleaseFile()\n");
 				exit(1);
 			}
+		}
+		if (error != PFE_OK)
+			return(error);
+		if (fixed){
+			PFerrno = PFE_PAGEFIXED;
+			return(PFerrno);
+		}
+		if (busy)
+			sched_yield();
+	} while (busy);
+	return(PFE_OK);
+}
 
-			/* put the page into free list */
-			temppage = bpage;
-			bpage = bpage->nextpage;
-			PFbufUnlink(temppage);
-			PFbufInsertFree(temppage);
 
+static int PFbufComparePages(a,b)
+const void *a;
+const void *b;
+/****************************************************************************
+SPECIFICATIONS:
+	Order two buffer pages by file descriptor, then page number, for
+	qsort().
+*****************************************************************************/
+{
+PFbpage *x = *(PFbpage **)a;
+PFbpage *y = *(PFbpage **)b;
+
+	if (x->fd != y->fd)
+		return((x->fd < y->fd) ? -1 : 1);
+	return((x->page < y->page) ? -1 : (x->page > y->page));
+}
+
+static int PFbufCollectDirty(fd,pages,max,busy)
+int fd;		/* file descriptor, or -1 for every file */
+PFbpage **pages;	/* set to the pages claimed */
+int max;	/* max # of pages to claim */
+int *busy;	/* set to TRUE if a page could not be looked at */
+/****************************************************************************
+SPECIFICATIONS:
+	Claim up to "max" dirty pages of file "fd" that are not fixed, for
+	PFbufWriteDirty(): the least recently used first for every file, or
+	from the list of the pages of the file for one. The pages
+	stay on the used list, fixed and marked "io", so that they are not
+	chosen as victims and threads asking for them wait. Pages whose
+	hash table partition is busy are left.
+
+RETURN VALUE:
+	# of pages claimed.
+*****************************************************************************/
+{
+PFbpage *bpage;
+int n = 0;
+
+	*busy = FALSE;
+	pthread_mutex_lock(&PFbuflock);
+	for (bpage = (fd >= 0) ? PFfilebpages[fd] : PFlastbpage;
+			bpage != NULL && n < max;
+			bpage = (fd >= 0) ? bpage->fnext : bpage->prevpage){
+		if (!PFhashTryLock(bpage->fd,bpage->page)){
+			*busy = TRUE;
+			continue;
 		}
-		else	bpage = bpage->nextpage;
+		if (bpage->dirty && bpage->pincount == 0 && !bpage->io){
+			__atomic_store_n(&bpage->pincount,1,__ATOMIC_RELAXED);
+			bpage->io = TRUE;
+			pages[n++] = bpage;
+		}
+		PFhashUnlock(bpage->fd,bpage->page);
+	}
+	pthread_mutex_unlock(&PFbuflock);
+	return(n);
+}
+
+static int PFbufWriteDirty(pages,n,writevfcn)
+PFbpage **pages;	/* pages from PFbufCollectDirty() */
+int n;		/* # of pages */
+int (*writevfcn)();	/* function to write several consecutive pages */
+/****************************************************************************
+SPECIFICATIONS:
+	Write out the "n" pages claimed by PFbufCollectDirty(), and give
+	them back unfixed. The pages are sorted by file and page number,
+	and each run of consecutive pages of a file is written with one
+	call of writevfcn(fd,pagenum,fpages,count), which writes "count"
+	consecutive pages starting at "pagenum" from fpages[0..count-1]
+	and returns the # of pages it wrote, or a PF error code. No lock
+	is held meanwhile. Pages not written stay dirty.
+
+RETURN VALUE:
+	PFE_OK	if no error.
+	PF error code of the first write that failed.
+*****************************************************************************/
+{
+PFfpage *fpages[PF_PREFETCH_MAX];	/* data of the current run */
+int error = PFE_OK;
+int first;	/* first page of the current run */
+int count;	/* # of pages in it */
+int got;	/* # of them written */
+long start;	/* start of a write, for the statistics */
+int i;
+
+	qsort((char *)pages,n,sizeof(PFbpage *),PFbufComparePages);
+	for (first = 0; first < n; first += count){
+		/* collect the run */
+		fpages[0] = &pages[first]->fpage;
+		for (count = 1; first + count < n && count < PF_PREFETCH_MAX &&
+				pages[first+count]->fd == pages[first]->fd &&
+				pages[first+count]->page ==
+					pages[first]->page + count; count++)
+			fpages[count] = &pages[first+count]->fpage;
+
+		start = PFstatStart();
+		got = (error == PFE_OK) ? (*writevfcn)(pages[first]->fd,
+				pages[first]->page,fpages,count) : 0;
+		PFstatEnd(PF_HIST_WRITE,start);
+		if (got < 0){
+			error = got;
+			got = 0;
+		}
+		else if (got > 0){
+			PFstatAdd(g_physical_writes,got);
+			PFstatFile(pages[first]->fd,writes,got);
+		}
+		if (got < count)
+			/* the rest of the run is tried again as a new run */
+			count = (got > 0) ? got : count;
+
+		for (i = first; i < first + count; i++){
+			PFhashLock(pages[i]->fd,pages[i]->page);
+			if (i < first + got)
+				PFbufSetClean(pages[i]);
+			pages[i]->io = FALSE;
+			__atomic_store_n(&pages[i]->pincount,0,__ATOMIC_RELAXED);
+			PFhashWakeup(pages[i]->fd,pages[i]->page);
+			PFhashUnlock(pages[i]->fd,pages[i]->page);
+		}
+	}
+	return(error);
+}
+
+int PFbufFlush(fd,writevfcn)
+int fd;		/* file descriptor */
+int (*writevfcn)();	/* function to write several consecutive pages */
+/****************************************************************************
+SPECIFICATIONS:
+	Write out the dirty pages of file "fd" that are in the buffer, in
+	page order, and keep them there clean. Pages fixed meanwhile are
+	left dirty. See PFbufWriteDirty() for "writevfcn".
+
+RETURN VALUE:
+	PFE_OK	if no error.
+	PF error code if error.
+*****************************************************************************/
+{
+PFbpage *pages[PF_FLUSH_MAX];	/* pages claimed */
+int n;		/* # of them */
+int busy;	/* TRUE if a page could not be looked at */
+int rounds;	/* rounds left, so that a file made dirty again and
+		again does not keep the caller forever */
+int error;
+
+	rounds = g_pf_max_bufs / PF_FLUSH_MAX + 2;
+	do {
+		n = PFbufCollectDirty(fd,pages,PF_FLUSH_MAX,&busy);
+		if (n > 0 && (error=PFbufWriteDirty(pages,n,writevfcn)) != PFE_OK)
+			return(error);
+		if (busy)
+			sched_yield();
+	} while ((n == PF_FLUSH_MAX || busy) && --rounds > 0);
+	return(PFE_OK);
+}
+
+static void *PFbufFlusher(arg)
+void *arg;
+/****************************************************************************
+SPECIFICATIONS:
+	Body of the write-behind flusher: wait until more pages are dirty
+	than g_pf_wb_clean allows, then write out the least recently used
+	dirty pages, down to an eighth of the pool below that limit.
+*****************************************************************************/
+{
+PFbpage *pages[PF_FLUSH_MAX];	/* pages claimed */
+struct timespec until;	/* end of a wait with every dirty page fixed */
+int want;	/* # of pages to write out */
+int n;		/* # of them claimed */
+int busy;
+
+	(void)arg;
+	pthread_mutex_lock(&PFwblock);
+	while (!PFwbstop){
+		if (PFwbExcess() <= 0){
+			pthread_cond_wait(&PFwbcond,&PFwblock);
+			continue;
+		}
+		pthread_mutex_unlock(&PFwblock);
+
+		want = PFwbExcess() + g_pf_max_bufs / 8;
+		if (want > PF_FLUSH_MAX)
+			want = PF_FLUSH_MAX;
+		n = (want > 0) ? PFbufCollectDirty(-1,pages,want,&busy) : 0;
+		if (n > 0)
+			/* an error is seen again by whoever evicts the page */
+			(void)PFbufWriteDirty(pages,n,PFwbwritevfcn);
+
+		pthread_mutex_lock(&PFwblock);
+		if (n == 0 && !PFwbstop){
+			/* the dirty pages are fixed: look again shortly */
+			clock_gettime(CLOCK_REALTIME,&until);
+			until.tv_nsec += PF_WB_RETRY_MS * 1000000L;
+			if (until.tv_nsec >= 1000000000L){
+				until.tv_sec++;
+				until.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&PFwbcond,&PFwblock,&until);
+		}
+	}
+	pthread_mutex_unlock(&PFwblock);
+	return(NULL);
+}
+
+static void PFbufStopFlusher()
+/****************************************************************************
+SPECIFICATIONS:
+	Stop the write-behind flusher, if it runs, and wait for it.
+*****************************************************************************/
+{
+	if (!PFwbrunning)
+		return;
+	pthread_mutex_lock(&PFwblock);
+	PFwbstop = TRUE;
+	pthread_cond_signal(&PFwbcond);
+	pthread_mutex_unlock(&PFwblock);
+	pthread_join(PFwbthread,NULL);
+	PFwbrunning = FALSE;
+	PFwbstop = FALSE;
+}
+
+int PFbufSetWriteBehind(percent,writevfcn)
+int percent;	/* % of frames to keep clean, 0 to stop write-behind */
+int (*writevfcn)();	/* function to write several consecutive pages */
+/****************************************************************************
+SPECIFICATIONS:
+	Start write-behind, keeping "percent" percent of the buffer frames
+	clean, or stop it if "percent" is 0. See PFbufWriteDirty() for
+	"writevfcn". Must not be called by two threads at once.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PFE_NOMEM	if the flusher thread cannot be started.
+*****************************************************************************/
+{
+	if (percent <= 0){
+		PFbufStopFlusher();
+		__atomic_store_n(&g_pf_wb_clean,0,__ATOMIC_RELAXED);
+		return(PFE_OK);
+	}
+	if (percent > 100)
+		percent = 100;
+	PFwbwritevfcn = writevfcn;
+	__atomic_store_n(&g_pf_wb_clean,percent,__ATOMIC_RELAXED);
+	if (!PFwbrunning){
+		if (pthread_create(&PFwbthread,NULL,PFbufFlusher,NULL) != 0){
+			__atomic_store_n(&g_pf_wb_clean,0,__ATOMIC_RELAXED);
+			PFerrno = PFE_NOMEM;
+			return(PFerrno);
+		}
+		PFwbrunning = TRUE;
+	}
+	else {
+		/* the new limit may already be passed */
+		pthread_mutex_lock(&PFwblock);
+		pthread_cond_signal(&PFwbcond);
+		pthread_mutex_unlock(&PFwblock);
 	}
 	return(PFE_OK);
 }
@@ -532,28 +1799,251 @@ RETURN VALUE: PF error codes.
 PFbpage *bpage;	/* pointer to the bpage we are looking for */
 
 	/* Find page in the buffer */
+	PFhashLock(fd,pagenum);
 	if ((bpage=PFhashFind(fd,pagenum))==NULL){
 		/* page not in the buffer */
+		PFhashUnlock(fd,pagenum);
 		PFerrno = PFE_PAGENOTINBUF;
 		return(PFerrno);
 	}
 
-	if (!(bpage->fixed)){
+	if (bpage->pincount == 0 || bpage->io){
 		/* page not fixed */
+		PFhashUnlock(fd,pagenum);
 		PFerrno = PFE_PAGEUNFIXED;
 		return(PFerrno);
 	}
 
 	/* mark this page dirty */
-	bpage->dirty = TRUE;
+	PFbufSetDirty(bpage);
 
 	/* make this page head of the list of buffers*/
-	PFbufUnlink(bpage);
-	PFbufLinkHead(bpage);
+	if (PFbufRecency()){
+		pthread_mutex_lock(&PFbuflock);
+		PFbufUnlink(bpage);
+		PFbufLinkHead(bpage);
+		pthread_mutex_unlock(&PFbuflock);
+	}
+	PFhashUnlock(fd,pagenum);
 
 	return(PFE_OK);
 }
 
+static int PFbufPresent(fd,pagenum)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell whether page "pagenum" of file "fd" is in the buffer.
+	This may change as soon as it returns.
+*****************************************************************************/
+{
+int present;
+
+	PFhashLock(fd,pagenum);
+	present = (PFhashFind(fd,pagenum) != NULL);
+	PFhashUnlock(fd,pagenum);
+	return(present);
+}
+
+int PFbufPrefetch(fd,first,count,readvfcn,writefcn)
+int fd;		/* file descriptor */
+int first;	/* first page to prefetch */
+int count;	/* # of pages to prefetch */
+int (*readvfcn)();	/* function to read several consecutive pages */
+int (*writefcn)();	/* function to write a page */
+/****************************************************************************
+SPECIFICATIONS:
+	Bring pages "first" .. "first"+"count"-1 of file "fd" into the
+	buffer without fixing them. Pages already in the buffer are skipped.
+	Each run of consecutive pages not in the buffer is read with one call
+	of readvfcn(fd,pagenum,fpages,n), which reads "n" consecutive pages
+	starting at "pagenum" into the buffers fpages[0..n-1] and returns
+	the number of pages read completely, or a PF error code.
+	The caller must make sure the pages are within the file.
+
+ALGORITHM:
+	At most a quarter of the buffer pool (and PF_PREFETCH_MAX pages) is
+	used by one call, so read-ahead cannot flush the whole pool.
+	Frames of the current run are put into the hash table marked "io"
+	while it is read, so that threads asking for them wait, and are not
+	linked into the used list until then, so they are not chosen as
+	victims for the rest of the run.
+	Prefetched pages are linked as most recently used, but do not
+	count as referenced for 2Q and LRU-2. Nothing is
+	prefetched under PF_STRAT_MRU, which would pick those frames as the
+	next victims.
+
+RETURN VALUE:
+	# of pages from "first" on that are now in the buffer (this is less
+	than "count" if frames ran out), or PF error code if a read failed.
+*****************************************************************************/
+{
+PFbpage *run[PF_PREFETCH_MAX];	/* frames of the current run */
+PFfpage *fpages[PF_PREFETCH_MAX];	/* their page data */
+int limit;	/* max # of pages for this call */
+int page;	/* next page to look at */
+int n;		/* # of pages in current run */
+int got;	/* # of pages read for current run */
+long start;	/* start of the read, for the statistics */
+int i;
+
+	if (g_pf_strategy == PF_STRAT_MRU)
+		return(0);
+
+	limit = g_pf_max_bufs / 4;
+	if (limit > PF_PREFETCH_MAX)
+		limit = PF_PREFETCH_MAX;
+	if (count > limit)
+		count = limit;
+
+	page = first;
+	while (page < first + count){
+		if (PFbufPresent(fd,page)){
+			/* already in buffer */
+			page++;
+			continue;
+		}
+
+		/* collect a run of pages not in the buffer */
+		for (n=0; page+n < first+count; n++){
+			if (n > 0 && PFbufPresent(fd,page+n))
+				break;
+			if (PFbufInternalAlloc(&run[n],PFfilepagesize[fd],writefcn) != PFE_OK)
+				break;
+			run[n]->fd = fd;
+			run[n]->page = page + n;
+			PFhashLock(fd,page+n);
+			if (PFhashFind(fd,page+n) != NULL ||
+					PFhashInsert(fd,page+n,run[n]) != PFE_OK){
+				/* another thread brought it in meanwhile */
+				PFhashUnlock(fd,page+n);
+				PFbufGiveBack(run[n]);
+				break;
+			}
+			run[n]->io = TRUE;
+			PFhashUnlock(fd,page+n);
+			fpages[n] = &run[n]->fpage;
+		}
+		if (n == 0)
+			/* no frame left: stop quietly, this is only a hint */
+			break;
+
+		start = PFstatStart();
+		got = (*readvfcn)(fd,page,fpages,n);
+		PFstatEnd(PF_HIST_READ,start);
+
+		pthread_mutex_lock(&PFbuflock);
+		for (i=0; i < got && i < n; i++){
+			PFbufLinkNew(run[i]);
+			PFbufAdmit(run[i],FALSE);
+		}
+		pthread_mutex_unlock(&PFbuflock);
+		for (i=0; i < n; i++){
+			PFhashLock(fd,page+i);
+			run[i]->io = FALSE;
+			__atomic_store_n(&run[i]->pincount,0,__ATOMIC_RELAXED);
+			run[i]->prefetched = (got > i);
+			if (got <= i)
+				/* not read: take it out again */
+				(void)PFhashDelete(fd,page+i);
+			PFhashWakeup(fd,page+i);
+			PFhashUnlock(fd,page+i);
+			if (got <= i)
+				/* and put the frame back into the free list */
+				PFbufGiveBack(run[i]);
+		}
+		if (got < 0)
+			return(got);
+		PFstatAdd(g_physical_reads,got); /* STATS: one physical read per page */
+		PFstatFile(fd,reads,got);
+
+		page += got;
+		if (got < n)
+			break;
+	}
+	return(page - first);
+}
+
+int PFbufLatch(fd,pagenum,exclusive)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+int exclusive;	/* TRUE for an exclusive latch, FALSE for a shared one */
+/****************************************************************************
+SPECIFICATIONS:
+	Latch the data of page "pagenum" of file "fd", which must be fixed
+	in the buffer, waiting until no other thread holds a conflicting
+	latch on it. Readers take shared latches, a writer an exclusive one.
+	The latch is not recursive, and must be released with PFbufUnlatch()
+	before the page is unfixed.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_PAGENOTINBUF if the page is not in the buffer.
+	PFE_PAGEUNFIXED if the page is not fixed.
+*****************************************************************************/
+{
+PFbpage *bpage;
+
+	PFhashLock(fd,pagenum);
+	if ((bpage=PFhashFind(fd,pagenum)) == NULL){
+		PFhashUnlock(fd,pagenum);
+		PFerrno = PFE_PAGENOTINBUF;
+		return(PFerrno);
+	}
+	if (bpage->pincount == 0 || bpage->io){
+		PFhashUnlock(fd,pagenum);
+		PFerrno = PFE_PAGEUNFIXED;
+		return(PFerrno);
+	}
+	PFhashUnlock(fd,pagenum);
+
+	/* the page is fixed, so it stays in this frame while we wait */
+	if (exclusive)
+		pthread_rwlock_wrlock(&bpage->latch);
+	else	pthread_rwlock_rdlock(&bpage->latch);
+	return(PFE_OK);
+}
+
+int PFbufUnlatch(fd,pagenum)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Release a latch taken with PFbufLatch() on page "pagenum" of
+	file "fd".
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_PAGENOTINBUF if the page is not in the buffer.
+*****************************************************************************/
+{
+PFbpage *bpage;
+
+	PFhashLock(fd,pagenum);
+	bpage = PFhashFind(fd,pagenum);
+	PFhashUnlock(fd,pagenum);
+	if (bpage == NULL){
+		PFerrno = PFE_PAGENOTINBUF;
+		return(PFerrno);
+	}
+	pthread_rwlock_unlock(&bpage->latch);
+	return(PFE_OK);
+}
+
+void PFbufSetPageSize(fd,size)
+int fd;		/* file descriptor, just opened */
+int size;	/* its page size */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell the buffer manager the page size of file "fd", so that its
+	pages are given frames big enough. The file has no page in the
+	buffer yet.
+*****************************************************************************/
+{
+	PFfilepagesize[fd] = size;
+}
+
 void PFbufPrint()
 /****************************************************************************
 SPECIFICATIONS:
@@ -565,14 +2055,16 @@ AUTHOR: clc
 {
 PFbpage *bpage;
 
+	pthread_mutex_lock(&PFbuflock);
 	printf("buffer content:\n");
 	if (PFfirstbpage == NULL)
 		printf("empty\n");
 	else {
 		printf("fd\tpage\tfixed\tdirty\tfpage\n");
 		for(bpage = PFfirstbpage; bpage != NULL; bpage= bpage->nextpage)
-			printf("%d\t%d\t%d\t%d\t%d\n",
-				bpage->fd,bpage->page,(int)bpage->fixed,
-				(int)bpage->dirty,(int)&bpage->fpage);
+			printf("%d\t%d\t%d\t%d\t%p\n",
+				bpage->fd,bpage->page,bpage->pincount,
+				(int)bpage->dirty,(void *)bpage->fpage.pagebuf);
 	}
+	pthread_mutex_unlock(&PFbuflock);
 }
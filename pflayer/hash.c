@@ -2,32 +2,224 @@
 a file descriptor and a page number */
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "pf.h"
 #include "pftypes.h"
 
-/* hash table */
-static PFhash_entry *PFhashtbl[PF_HASH_TBL_SIZE];
+/* The hash table is split into PF_HASH_PARTS partitions, picked by the
+top bits of the hash value, so that threads looking up different pages
+seldom wait for each other. Each partition is an open addressing table
+of "size" slots (a power of 2), "count" of them used, with its own
+mutex. The functions below expect the caller to hold the lock of the
+partition of the page: see PFhashLock(). */
+typedef struct PFhashpart {
+	pthread_mutex_t lock;	/* protects the partition */
+	pthread_cond_t iodone;	/* signalled when I/O on a page completes */
+	PFhash_entry *tbl;	/* slots, or NULL if not allocated yet */
+	int size;		/* # of slots */
+	int count;		/* # of slots used */
+} PFhashpart;
+
+static PFhashpart PFhashparts[PF_HASH_PARTS];
+static int PFhashready = FALSE;	/* TRUE once the locks are initialized */
+
+/* # of entries the table should hold without growing, normally the
+# of buffers. Kept across PFhashInit() so PF_SetBufferSize() can be
+called before PF_Init(). */
+static int PFhashexpect = PF_MAX_BUFS;
+
+/* partition holding page "page" of file "fd" */
+#define PFhashPartOf(fd,page) \
+	(&PFhashparts[PFhash(fd,page) >> (32 - PF_HASH_PART_BITS)])
+
+
+unsigned PFhashMix(key)
+unsigned key;
+/****************************************************************************
+SPECIFICATIONS:
+	Scramble the bits of "key" so that every bit of the key affects
+	the low order bits used to pick a slot (murmur3 finalizer).
+*****************************************************************************/
+{
+	key ^= key >> 16;
+	key *= 0x85EBCA6Bu;
+	key ^= key >> 13;
+	key *= 0xC2B2AE35u;
+	key ^= key >> 16;
+	return(key);
+}
+
+static int PFhashResize(part,newsize)
+PFhashpart *part;	/* partition to resize */
+int newsize;	/* new # of slots, a power of 2 */
+/****************************************************************************
+SPECIFICATIONS:
+	Allocate a table of "newsize" slots for partition "part" and move
+	every entry into it.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PFE_NOMEM	if no memory. The old table is left untouched.
+*****************************************************************************/
+{
+PFhash_entry *newtbl;	/* new table */
+unsigned bucket;
+int i;
 
-// extern char *malloc();
+	if ((newtbl=(PFhash_entry *)malloc(newsize*sizeof(PFhash_entry)))==NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	for (i=0; i < newsize; i++)
+		newtbl[i].fd = PF_HASH_EMPTY;
+
+	for (i=0; i < part->size; i++){
+		if (part->tbl[i].fd == PF_HASH_EMPTY)
+			continue;
+		bucket = PFhash(part->tbl[i].fd,part->tbl[i].page) & (newsize-1);
+		while (newtbl[bucket].fd != PF_HASH_EMPTY)
+			bucket = (bucket + 1) & (newsize-1);
+		newtbl[bucket] = part->tbl[i];
+	}
+
+	free((char *)part->tbl);
+	part->tbl = newtbl;
+	part->size = newsize;
+	return(PFE_OK);
+}
+
+/* # of slots of a partition holding "n" entries at most half full */
+static int PFhashPartSize(n)
+int n;		/* # of entries expected in the whole table */
+{
+int size;
+
+	n = n / PF_HASH_PARTS + 1;
+	for (size=PF_HASH_MIN_SIZE; size < 2*n; size *= 2);
+	return(size);
+}
 
 void PFhashInit()
 /****************************************************************************
 SPECIFICATIONS:
 	Init the hash table entries. Must be called before any of the other
-	hash functions are used.
+	hash functions are used, and while no other thread uses PF.
+	The partitions are allocated by their first PFhashInsert(), sized
+	for the expected # of entries.
 
 AUTHOR: clc
 
 RETURN VALUE: none
 
 GLOBAL VARIABLES MODIFIED:
-	PFhashtbl
+	PFhashparts
+*****************************************************************************/
+{
+int i;
+
+	for (i=0; i < PF_HASH_PARTS; i++){
+		if (!PFhashready){
+			pthread_mutex_init(&PFhashparts[i].lock,NULL);
+			pthread_cond_init(&PFhashparts[i].iodone,NULL);
+		}
+		free((char *)PFhashparts[i].tbl);
+		PFhashparts[i].tbl = NULL;
+		PFhashparts[i].size = 0;
+		PFhashparts[i].count = 0;
+	}
+	PFhashready = TRUE;
+}
+
+void PFhashReserve(nentries)
+int nentries;	/* # of entries expected */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell the hash table how many entries to expect (the # of buffers),
+	so that it is sized once instead of growing one step at a time.
+	The partitions are kept at most half full. Must not be called
+	while other threads use PF.
+
+GLOBAL VARIABLES MODIFIED:
+	PFhashexpect, and PFhashparts if they have to grow.
 *****************************************************************************/
 {
+int size;
 int i;
 
-	for (i=0; i < PF_HASH_TBL_SIZE; i++)
-		PFhashtbl[i] = NULL;
+	PFhashexpect = nentries;
+	size = PFhashPartSize(nentries);
+	for (i=0; i < PF_HASH_PARTS; i++)
+		if (PFhashparts[i].tbl != NULL && PFhashparts[i].size < size)
+			(void)PFhashResize(&PFhashparts[i],size);
+}
+
+void PFhashLock(fd,page)
+int fd;		/* file descriptor */
+int page;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Lock the partition of the hash table that holds page "page" of
+	file "fd". PFhashFind(), PFhashInsert() and PFhashDelete() of that
+	page, and the buffer page found, are then protected until
+	PFhashUnlock(). No other partition may be locked meanwhile, except
+	with PFhashTryLock().
+*****************************************************************************/
+{
+	pthread_mutex_lock(&PFhashPartOf(fd,page)->lock);
+}
+
+int PFhashTryLock(fd,page)
+int fd;		/* file descriptor */
+int page;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Same as PFhashLock(), but don't wait if the partition is locked.
+
+RETURN VALUE:
+	TRUE	if the partition is now locked
+	FALSE	if it was already locked, by this thread or another.
+*****************************************************************************/
+{
+	return(pthread_mutex_trylock(&PFhashPartOf(fd,page)->lock) == 0);
+}
+
+void PFhashUnlock(fd,page)
+int fd;		/* file descriptor */
+int page;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Unlock the partition locked by PFhashLock(fd,page).
+*****************************************************************************/
+{
+	pthread_mutex_unlock(&PFhashPartOf(fd,page)->lock);
+}
+
+void PFhashWait(fd,page)
+int fd;		/* file descriptor */
+int page;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Wait, with the partition of page "page" of file "fd" locked, until
+	PFhashWakeup() is called for a page of that partition. The
+	partition is unlocked while waiting, and locked again on return,
+	so the page must be looked up again.
+*****************************************************************************/
+{
+PFhashpart *part = PFhashPartOf(fd,page);
+
+	pthread_cond_wait(&part->iodone,&part->lock);
+}
+
+void PFhashWakeup(fd,page)
+int fd;		/* file descriptor */
+int page;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Wake up the threads waiting in PFhashWait() on the partition of
+	page "page" of file "fd". The partition must be locked.
+*****************************************************************************/
+{
+	pthread_cond_broadcast(&PFhashPartOf(fd,page)->iodone);
 }
 
 
@@ -47,23 +239,25 @@ RETURN VALUE:
 
 *****************************************************************************/
 {
-int bucket;	/* bucket to look for the page*/
-PFhash_entry *entry; /* ptr to entries to search */
-
+PFhashpart *part = PFhashPartOf(fd,page);
+unsigned mask;	/* part->size - 1 */
+unsigned bucket; /* slot to look at */
+PFhash_entry *entry;
 
-	/* See which bucket it is in */
-	bucket = PFhash(fd,page);
+	if (part->tbl == NULL)
+		return(NULL);
 
-	/* go through the linked list of this bucket */
-	for (entry=PFhashtbl[bucket]; entry != NULL; 
-				entry = entry->nextentry){
-		if (entry->fd == fd && entry->page == page )
+	/* probe from the home slot until the page or an empty slot is found */
+	mask = part->size - 1;
+	for (bucket=PFhash(fd,page) & mask; ; bucket=(bucket+1) & mask){
+		entry = &part->tbl[bucket];
+		if (entry->fd == fd && entry->page == page)
 			/* found it */
 			return(entry->bpage);
+		if (entry->fd == PF_HASH_EMPTY)
+			/* not found */
+			return(NULL);
 	}
-
-	/* not found */
-	return(NULL);
 }
 
 int PFhashInsert(fd,page,bpage)
@@ -83,12 +277,14 @@ RETURN VALUE:
 	PFE_HASHPAGEEXIST if the page already exists.
 	
 GLOBAL VARIABLES MODIFIED:
-	PFhashtbl
+	PFhashparts
 *****************************************************************************/
 {
-int bucket;	/* bucket to insert the page */
-PFhash_entry *entry; /* pointer to new entry */
-
+PFhashpart *part = PFhashPartOf(fd,page);
+unsigned mask;	/* part->size - 1 */
+unsigned bucket; /* slot to insert the page */
+int size;
+int error;
 
 	if (PFhashFind(fd,page) != NULL){
 		/* page already inserted */
@@ -96,25 +292,23 @@ PFhash_entry *entry; /* pointer to new entry */
 		return(PFerrno);
 	}
 
-	/* find the bucket for this page */
-	bucket = PFhash(fd,page);
-	
-	/* allocate mem for new entry */
-	if ((entry=(PFhash_entry *)malloc(sizeof(PFhash_entry)))== NULL){
-		/* no mem */
-		PFerrno = PFE_NOMEM;
-		return(PFerrno);
+	/* keep the partition at most half full */
+	if (2*(part->count+1) > part->size){
+		if (part->size == 0)
+			size = PFhashPartSize(PFhashexpect);
+		else	size = 2*part->size;
+		if ((error=PFhashResize(part,size)) != PFE_OK)
+			return(error);
 	}
 
-	/* Insert entry as head of list for this bucket */
-	entry->fd = fd;
-	entry->page = page;
-	entry->bpage = bpage;
-	entry->nextentry = PFhashtbl[bucket];
-	entry->preventry = NULL;
-	if (PFhashtbl[bucket] != NULL)
-		PFhashtbl[bucket]->preventry = entry;
-	PFhashtbl[bucket] = entry;
+	/* take the first empty slot from the home slot on */
+	mask = part->size - 1;
+	for (bucket=PFhash(fd,page) & mask; part->tbl[bucket].fd != PF_HASH_EMPTY;
+				bucket=(bucket+1) & mask);
+	part->tbl[bucket].fd = fd;
+	part->tbl[bucket].page = page;
+	part->tbl[bucket].bpage = bpage;
+	part->count++;
 
 	return(PFE_OK);
 }
@@ -133,35 +327,51 @@ RETURN VALUE:
 	PFE_OK	if OK
 	PFE_HASHNOTFOUND if can't find the entry
 
+IMPLEMENTATION NOTES:
+	Entries after the deleted one in the same probe run are shifted
+	back into the hole, so no tombstones are needed and lookups never
+	have to probe past deleted entries.
+
 GLOBAL VARIABLES MODIFIED:
-	PFhashtbl
+	PFhashparts
 *****************************************************************************/
 {
-int bucket;	/* bucket for this page */
-PFhash_entry *entry;	/* entry to look for */
-
-	/* find the bucket */
-	bucket = PFhash(fd,page);
-
-	/* See if the entry is in this bucket */
-	for (entry=PFhashtbl[bucket]; entry != NULL; entry = entry->nextentry)
-		if (entry->fd == fd && entry->page == page)
-			break;
-
-	if (entry == NULL){
-		/* not found */
+PFhashpart *part = PFhashPartOf(fd,page);
+PFhash_entry *tbl = part->tbl;
+unsigned mask;	/* part->size - 1 */
+unsigned hole;	/* slot of the entry being deleted */
+unsigned next;	/* slot after the hole being examined */
+unsigned home;	/* home slot of the entry in "next" */
+
+	if (tbl == NULL){
 		PFerrno = PFE_HASHNOTFOUND;
 		return(PFerrno);
 	}
 
-	/* get rid of this entry */
-	if (entry == PFhashtbl[bucket])
-		PFhashtbl[bucket] = entry->nextentry;
-	if (entry->preventry != NULL)
-		entry->preventry->nextentry = entry->nextentry;
-	if (entry->nextentry != NULL)
-		entry->nextentry->preventry = entry->preventry;
-	free((char *)entry);
+	/* find the entry */
+	mask = part->size - 1;
+	for (hole=PFhash(fd,page) & mask; ; hole=(hole+1) & mask){
+		if (tbl[hole].fd == fd && tbl[hole].page == page)
+			break;
+		if (tbl[hole].fd == PF_HASH_EMPTY){
+			/* not found */
+			PFerrno = PFE_HASHNOTFOUND;
+			return(PFerrno);
+		}
+	}
+
+	/* get rid of this entry, moving back any entry whose probe run
+	passes over the hole */
+	for (next=(hole+1) & mask; tbl[next].fd != PF_HASH_EMPTY;
+				next=(next+1) & mask){
+		home = PFhash(tbl[next].fd,tbl[next].page) & mask;
+		if (((next - home) & mask) >= ((next - hole) & mask)){
+			tbl[hole] = tbl[next];
+			hole = next;
+		}
+	}
+	tbl[hole].fd = PF_HASH_EMPTY;
+	part->count--;
 
 	return(PFE_OK);
 }
@@ -170,25 +380,32 @@ PFhash_entry *entry;	/* entry to look for */
 void PFhashPrint()
 /****************************************************************************
 SPECIFICATIONS:
-	Print the hash table entries.
+	Print the hash table entries. No other thread may use PF meanwhile.
 
 AUTHOR: clc
 
 RETURN VALUE: None
 *****************************************************************************/
 {
-int i;
-PFhash_entry *entry;
+int size = 0, count = 0;	/* totals over the partitions */
+PFhashpart *part;
+int p, i;
 
-	for (i=0; i < PF_HASH_TBL_SIZE; i++){
-		printf("bucket %d\n",i);
-		if (PFhashtbl[i] == NULL)
-			printf("\tempty\n");
-		else{
-			for (entry = PFhashtbl[i]; entry != NULL;
-					entry = entry->nextentry)
-				printf("\tfd: %d, page: %d %d\n",
-					entry->fd, entry->page,entry->bpage);
+	for (p=0; p < PF_HASH_PARTS; p++){
+		size += PFhashparts[p].size;
+		count += PFhashparts[p].count;
+	}
+	printf("hash table: %d slots in %d partitions, %d used\n",
+		size,PF_HASH_PARTS,count);
+	if (count == 0)
+		printf("\tempty\n");
+	for (p=0; p < PF_HASH_PARTS; p++){
+		part = &PFhashparts[p];
+		for (i=0; i < part->size; i++){
+			if (part->tbl[i].fd != PF_HASH_EMPTY)
+				printf("\tpartition %d slot %d: fd: %d, page: %d %p\n",
+					p,i,part->tbl[i].fd,part->tbl[i].page,
+					(void *)part->tbl[i].bpage);
 		}
 	}
 }
@@ -0,0 +1,477 @@
+/* pax.c: Implementation of PAX files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pax.h"
+
+/* # of pages hinted to PF when a selection starts */
+#define PAX_SCAN_PREFETCH 8
+
+/* Bits of a word of the slot bitmap */
+#define PAX_WORDBITS 32
+
+#define pax_Align(n) (((n) + PAX_ALIGN - 1) / PAX_ALIGN * PAX_ALIGN)
+
+/* Gets a pointer to the slot bitmap of a data page */
+#define GET_BITMAP(hdr, page) ((unsigned int *)((page) + (hdr)->bitmapOffset))
+
+/* Whether slot i is in use on a data page */
+#define pax_SlotUsed(bitmap, i) \
+    (((bitmap)[(i) / PAX_WORDBITS] >> ((i) % PAX_WORDBITS)) & 1)
+
+/* Gets a pointer to the value of attribute a of slot i on a data page */
+#define GET_VALUE(hdr, page, a, i) \
+    ((page) + (hdr)->minipage[a] + (i) * (hdr)->schema.attrLength[a])
+
+
+int PAX_RowLength(PAX_Schema *schema)
+{
+    int a, length = 0;
+
+    for (a = 0; a < schema->numAttrs; a++)
+        length += schema->attrLength[a];
+    return length;
+}
+
+/*
+ * Helper to lay out the data pages of 'pageSize' bytes for the schema of
+ * fh: the most slots for which the bitmap and all the minipages fit.
+ * Returns PAX_BADSCHEMA if not even one row fits.
+ */
+static int pax_Layout(PAX_FileHeader *fh, int pageSize)
+{
+    PAX_Schema *schema = &fh->schema;
+    int a, n, offset;
+
+    if (schema->numAttrs < 1 || schema->numAttrs > PAX_MAXATTRS)
+        return PAX_BADSCHEMA;
+    for (a = 0; a < schema->numAttrs; a++) {
+        if ((schema->attrType[a] != 'i' && schema->attrType[a] != 'f' &&
+             schema->attrType[a] != 'c') ||
+            schema->attrLength[a] < 1 || schema->attrLength[a] > 255 ||
+            (schema->attrType[a] != 'c' && schema->attrLength[a] != 4))
+            return PAX_BADSCHEMA;
+    }
+    fh->rowLength = PAX_RowLength(schema);
+    fh->bitmapOffset = sizeof(PAX_PageHeader);
+
+    /* Start from the count that ignores padding and come down */
+    for (n = (pageSize - fh->bitmapOffset) * 8 / (8 * fh->rowLength + 1);
+         n > 0; n--) {
+        offset = pax_Align(fh->bitmapOffset +
+                           (n + PAX_WORDBITS - 1) / PAX_WORDBITS * sizeof(int));
+        for (a = 0; a < schema->numAttrs; a++) {
+            fh->minipage[a] = offset;
+            offset = pax_Align(offset + n * schema->attrLength[a]);
+        }
+        if (offset <= pageSize)
+            break;
+    }
+    fh->rowsPerPage = n;
+    return (n > 0) ? RHF_OK : PAX_BADSCHEMA;
+}
+
+/*
+ * Helper to copy the header of the PAX file fd into fh
+ */
+static int pax_ReadHeader(int fd, PAX_FileHeader *fh)
+{
+    int error;
+    char *pageBuf;
+
+    if ((error = PF_GetThisPage(fd, PAX_HDR_PAGE, &pageBuf)) != PFE_OK) {
+        return (error == PFE_INVALIDPAGE) ? PAX_BADFILE : error;
+    }
+    memcpy(fh, pageBuf, sizeof(PAX_FileHeader));
+    PF_UnfixPage(fd, PAX_HDR_PAGE, FALSE);
+    return (fh->mark == PAX_MARK) ? RHF_OK : PAX_BADFILE;
+}
+
+/*
+ * Helper to fix the data page of rid and check that its slot is in use
+ */
+static int pax_FixRecord(int fd, RID *rid, PAX_FileHeader *fh, char **pageBuf)
+{
+    int error;
+
+    if ((error = pax_ReadHeader(fd, fh)) != RHF_OK) {
+        return error;
+    }
+    if (rid->pageNum == PAX_HDR_PAGE || rid->slotNum < 0 ||
+        rid->slotNum >= fh->rowsPerPage) {
+        return RHF_INVALIDRID;
+    }
+    if ((error = PF_GetThisPage(fd, rid->pageNum, pageBuf)) != PFE_OK) {
+        return (error == PFE_INVALIDPAGE) ? RHF_INVALIDRID : error;
+    }
+    if (!pax_SlotUsed(GET_BITMAP(fh, *pageBuf), rid->slotNum)) {
+        PF_UnfixPage(fd, rid->pageNum, FALSE);
+        return RHF_NORECORD;
+    }
+    return RHF_OK;
+}
+
+/* --- Public PAX API Functions --- */
+
+int PAX_CreateFile(char *fname, PAX_Schema *schema)
+{
+    return PAX_CreateFileSize(fname, schema, PF_PAGE_SIZE);
+}
+
+int PAX_CreateFileSize(char *fname, PAX_Schema *schema, int pageSize)
+{
+    int error, fd, pageNum;
+    char *pageBuf;
+    PAX_FileHeader fh;
+
+    memset(&fh, 0, sizeof(fh));
+    fh.mark = PAX_MARK;
+    fh.firstFree = -1;
+    fh.schema = *schema;
+    if ((error = pax_Layout(&fh, pageSize)) != RHF_OK) {
+        return error;
+    }
+
+    if ((error = PF_CreateFileSize(fname, pageSize)) != PFE_OK) {
+        return error;
+    }
+    if ((fd = PF_OpenFile(fname)) < 0) {
+        return fd;
+    }
+    if ((error = PF_AllocPage(fd, &pageNum, &pageBuf)) != PFE_OK) {
+        PF_CloseFile(fd);
+        return error;
+    }
+    memset(pageBuf, 0, pageSize);
+    memcpy(pageBuf, &fh, sizeof(fh));
+    if ((error = PF_UnfixPage(fd, pageNum, TRUE)) != PFE_OK) {
+        PF_CloseFile(fd);
+        return error;
+    }
+    return PF_CloseFile(fd);
+}
+
+int PAX_DestroyFile(char *fname)
+{
+    return PF_DestroyFile(fname);
+}
+
+int PAX_OpenFile(char *fname)
+{
+    return PAX_OpenFileMode(fname, PF_MODE_RDWR);
+}
+
+int PAX_OpenFileMode(char *fname, int mode)
+{
+    int fd, error;
+    PAX_FileHeader fh;
+
+    if ((fd = PF_OpenFileMode(fname, mode)) < 0) {
+        return fd;
+    }
+    if ((error = pax_ReadHeader(fd, &fh)) != RHF_OK) {
+        PF_CloseFile(fd);
+        return error;
+    }
+    return fd;
+}
+
+int PAX_CloseFile(int fd)
+{
+    return PF_CloseFile(fd);
+}
+
+int PAX_GetSchema(int fd, PAX_Schema *schema)
+{
+    int error;
+    PAX_FileHeader fh;
+
+    if ((error = pax_ReadHeader(fd, &fh)) != RHF_OK) {
+        return error;
+    }
+    *schema = fh.schema;
+    return RHF_OK;
+}
+
+int PAX_InsertRecord(int fd, char *row, RID *rid)
+{
+    int error, pageNum, a, i, w;
+    char *hdrBuf, *pageBuf;
+    PAX_FileHeader *fh;
+    PAX_PageHeader *header;
+    unsigned int *bitmap;
+
+    /* Pages of a file opened with PF_MODE_MMAP are read-only memory */
+    if (PF_FileMode(fd) == PF_MODE_MMAP) {
+        PFerrno = PFE_READONLY;
+        return PFE_READONLY;
+    }
+    if ((error = PF_GetThisPage(fd, PAX_HDR_PAGE, &hdrBuf)) != PFE_OK) {
+        return (error == PFE_INVALIDPAGE) ? PAX_BADFILE : error;
+    }
+    fh = (PAX_FileHeader *)hdrBuf;
+    if (fh->mark != PAX_MARK) {
+        PF_UnfixPage(fd, PAX_HDR_PAGE, FALSE);
+        return PAX_BADFILE;
+    }
+
+    /* Take the first page with a free slot, or a new one */
+    if (fh->firstFree < 0) {
+        if ((error = PF_AllocPage(fd, &pageNum, &pageBuf)) != PFE_OK) {
+            PF_UnfixPage(fd, PAX_HDR_PAGE, FALSE);
+            return error;
+        }
+        memset(pageBuf, 0, PF_PageSize(fd));
+        header = (PAX_PageHeader *)pageBuf;
+        header->nextFree = -1;
+        header->onFreeChain = TRUE;
+        fh->firstFree = pageNum;
+    }
+    else {
+        pageNum = fh->firstFree;
+        if ((error = PF_GetThisPage(fd, pageNum, &pageBuf)) != PFE_OK) {
+            PF_UnfixPage(fd, PAX_HDR_PAGE, FALSE);
+            return error;
+        }
+        header = (PAX_PageHeader *)pageBuf;
+    }
+
+    /* First free slot of the page */
+    bitmap = GET_BITMAP(fh, pageBuf);
+    for (w = 0; bitmap[w] == ~0u; w++)
+        ;
+    for (i = w * PAX_WORDBITS; pax_SlotUsed(bitmap, i); i++)
+        ;
+
+    bitmap[w] |= 1u << (i % PAX_WORDBITS);
+    for (a = 0; a < fh->schema.numAttrs; a++) {
+        memcpy(GET_VALUE(fh, pageBuf, a, i), row, fh->schema.attrLength[a]);
+        row += fh->schema.attrLength[a];
+    }
+    if (++header->numRows == fh->rowsPerPage) {
+        fh->firstFree = header->nextFree;
+        header->nextFree = -1;
+        header->onFreeChain = FALSE;
+    }
+    rid->pageNum = pageNum;
+    rid->slotNum = i;
+
+    error = PF_UnfixPage(fd, pageNum, TRUE);
+    if (PF_UnfixPage(fd, PAX_HDR_PAGE, TRUE) != PFE_OK && error == PFE_OK) {
+        error = PFerrno;
+    }
+    return (error == PFE_OK) ? RHF_OK : error;
+}
+
+int PAX_DeleteRecord(int fd, RID *rid)
+{
+    int error;
+    char *pageBuf, *hdrBuf;
+    PAX_FileHeader fh;
+    PAX_PageHeader *header;
+
+    /* Pages of a file opened with PF_MODE_MMAP are read-only memory */
+    if (PF_FileMode(fd) == PF_MODE_MMAP) {
+        PFerrno = PFE_READONLY;
+        return PFE_READONLY;
+    }
+    if ((error = pax_FixRecord(fd, rid, &fh, &pageBuf)) != RHF_OK) {
+        return error;
+    }
+    GET_BITMAP(&fh, pageBuf)[rid->slotNum / PAX_WORDBITS] &=
+        ~(1u << (rid->slotNum % PAX_WORDBITS));
+    header = (PAX_PageHeader *)pageBuf;
+    header->numRows--;
+
+    /* A full page has a free slot again: put it on the free chain */
+    if (!header->onFreeChain) {
+        if ((error = PF_GetThisPage(fd, PAX_HDR_PAGE, &hdrBuf)) != PFE_OK) {
+            PF_UnfixPage(fd, rid->pageNum, TRUE);
+            return error;
+        }
+        header->nextFree = ((PAX_FileHeader *)hdrBuf)->firstFree;
+        header->onFreeChain = TRUE;
+        ((PAX_FileHeader *)hdrBuf)->firstFree = rid->pageNum;
+        if ((error = PF_UnfixPage(fd, PAX_HDR_PAGE, TRUE)) != PFE_OK) {
+            PF_UnfixPage(fd, rid->pageNum, TRUE);
+            return error;
+        }
+    }
+    return PF_UnfixPage(fd, rid->pageNum, TRUE);
+}
+
+int PAX_GetRecord(int fd, RID *rid, char *row)
+{
+    int error, a;
+    char *pageBuf;
+    PAX_FileHeader fh;
+
+    if ((error = pax_FixRecord(fd, rid, &fh, &pageBuf)) != RHF_OK) {
+        return error;
+    }
+    for (a = 0; a < fh.schema.numAttrs; a++) {
+        memcpy(row, GET_VALUE(&fh, pageBuf, a, rid->slotNum),
+               fh.schema.attrLength[a]);
+        row += fh.schema.attrLength[a];
+    }
+    return PF_UnfixPage(fd, rid->pageNum, FALSE);
+}
+
+/*
+ * Selection kernels: each ANDs into sel[i], for the n slots of a
+ * minipage, whether value i of the minipage satisfies the predicate.
+ * sel holds 0 or 1 per slot, so that the loops are free of branches and
+ * the compiler can vectorize them.
+ */
+#define PAX_KERNEL(name, type) \
+static void name(char *minipage, int n, int op, char *value, unsigned char *sel) \
+{ \
+    type *col = (type *)minipage; \
+    type v; \
+    int i; \
+\
+    memcpy(&v, value, sizeof(type)); \
+    switch (op) { \
+        case PAX_EQ: for (i = 0; i < n; i++) sel[i] &= (col[i] == v); break; \
+        case PAX_LT: for (i = 0; i < n; i++) sel[i] &= (col[i] < v); break; \
+        case PAX_GT: for (i = 0; i < n; i++) sel[i] &= (col[i] > v); break; \
+        case PAX_LE: for (i = 0; i < n; i++) sel[i] &= (col[i] <= v); break; \
+        case PAX_GE: for (i = 0; i < n; i++) sel[i] &= (col[i] >= v); break; \
+        case PAX_NE: for (i = 0; i < n; i++) sel[i] &= (col[i] != v); break; \
+    } \
+}
+
+PAX_KERNEL(pax_SelectInt, int)
+PAX_KERNEL(pax_SelectFloat, float)
+
+/* char values: strncmp() only for the slots still selected */
+static void pax_SelectChar(char *minipage, int n, int length, int op,
+                           char *value, unsigned char *sel)
+{
+    int i, c;
+
+    for (i = 0; i < n; i++) {
+        if (!sel[i])
+            continue;
+        c = strncmp(minipage + i * length, value, length);
+        switch (op) {
+            case PAX_EQ: sel[i] = (c == 0); break;
+            case PAX_LT: sel[i] = (c < 0); break;
+            case PAX_GT: sel[i] = (c > 0); break;
+            case PAX_LE: sel[i] = (c <= 0); break;
+            case PAX_GE: sel[i] = (c >= 0); break;
+            case PAX_NE: sel[i] = (c != 0); break;
+        }
+    }
+}
+
+int PAX_Select(int fd, PAX_Pred *preds, int npreds,
+               int (*found)(void *arg, RID *rid, char *row),
+               void *arg)
+{
+    int error, pageNum, numSelected, n, p, a, i;
+    char *pageBuf, *row, *out;
+    unsigned char *sel;
+    unsigned int *bitmap;
+    PAX_FileHeader fh;
+    RID rid;
+
+    if ((error = pax_ReadHeader(fd, &fh)) != RHF_OK) {
+        return error;
+    }
+    for (p = 0; p < npreds; p++) {
+        if (preds[p].attr < 0 || preds[p].attr >= fh.schema.numAttrs ||
+            preds[p].op < PAX_EQ || preds[p].op > PAX_NE ||
+            preds[p].value == NULL) {
+            return PAX_BADPRED;
+        }
+    }
+    sel = (unsigned char *)malloc(fh.rowsPerPage);
+    row = (char *)malloc(fh.rowLength);
+    if (sel == NULL || row == NULL) {
+        free(sel);
+        free(row);
+        return RHF_NOMEM;
+    }
+
+    PF_Prefetch(fd, 0, PAX_SCAN_PREFETCH);
+    numSelected = 0;
+    pageNum = PAX_HDR_PAGE;
+    error = RHF_OK;
+    while (error == RHF_OK &&
+           (error = PF_GetNextPage(fd, &pageNum, &pageBuf)) == PFE_OK) {
+        if (((PAX_PageHeader *)pageBuf)->numRows == 0) {
+            error = PF_UnfixPage(fd, pageNum, FALSE);
+            continue;
+        }
+
+        /* Start from the slots in use, then narrow down by predicate */
+        n = fh.rowsPerPage;
+        bitmap = GET_BITMAP(&fh, pageBuf);
+        for (i = 0; i < n; i++)
+            sel[i] = pax_SlotUsed(bitmap, i);
+        for (p = 0; p < npreds; p++) {
+            a = preds[p].attr;
+            switch (fh.schema.attrType[a]) {
+                case 'i':
+                    pax_SelectInt(pageBuf + fh.minipage[a], n, preds[p].op,
+                                  preds[p].value, sel);
+                    break;
+                case 'f':
+                    pax_SelectFloat(pageBuf + fh.minipage[a], n, preds[p].op,
+                                    preds[p].value, sel);
+                    break;
+                default:
+                    pax_SelectChar(pageBuf + fh.minipage[a], n,
+                                   fh.schema.attrLength[a], preds[p].op,
+                                   preds[p].value, sel);
+                    break;
+            }
+        }
+
+        /* Put together only the rows selected */
+        rid.pageNum = pageNum;
+        for (i = 0; i < n && error == RHF_OK; i++) {
+            if (!sel[i])
+                continue;
+            numSelected++;
+            if (found == NULL)
+                continue;
+            out = row;
+            for (a = 0; a < fh.schema.numAttrs; a++) {
+                memcpy(out, GET_VALUE(&fh, pageBuf, a, i),
+                       fh.schema.attrLength[a]);
+                out += fh.schema.attrLength[a];
+            }
+            rid.slotNum = i;
+            error = found(arg, &rid, row);
+        }
+        if (PF_UnfixPage(fd, pageNum, FALSE) != PFE_OK && error == RHF_OK) {
+            error = PFerrno;
+        }
+    }
+    free(sel);
+    free(row);
+    if (error == PFE_EOF) {
+        return numSelected;
+    }
+    return error;
+}
+
+void PAX_PrintError(char *s, int err)
+{
+    switch(err) {
+        case PAX_BADSCHEMA:
+            fprintf(stderr, "%s: Bad schema, or a row too long for a page.\n", s);
+            break;
+        case PAX_BADFILE:
+            fprintf(stderr, "%s: Not a PAX file (no header page).\n", s);
+            break;
+        case PAX_BADPRED:
+            fprintf(stderr, "%s: Bad attribute or operator in a predicate.\n", s);
+            break;
+        default:
+            RHF_PrintError(s, err);
+            break;
+    }
+}
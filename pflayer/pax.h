@@ -0,0 +1,110 @@
+/* pax.h: Public interface for PAX files, heap files of fixed-schema rows
+   kept column by column on each page */
+#ifndef PAX_H
+#define PAX_H
+
+#include "rhf.h"
+
+/* --- Error Codes --- */
+/* PAX files also return RHF_INVALIDRID, RHF_NORECORD, RHF_NOMEM and PF
+   error codes */
+#define PAX_BADSCHEMA -40  /* Bad attribute, or a row too long for a page */
+#define PAX_BADFILE   -41  /* File has no PAX header page */
+#define PAX_BADPRED   -42  /* Bad attribute or operator in a predicate */
+
+/*
+ * The rows of a PAX file all have the attributes of its schema. A row is
+ * passed in and out as the values of its attributes one after the other,
+ * unaligned, PAX_RowLength() bytes in all.
+ */
+#define PAX_MAXATTRS 32
+
+typedef struct {
+    int numAttrs;
+    char attrType[PAX_MAXATTRS];   /* 'i', 'f' or 'c' */
+    int attrLength[PAX_MAXATTRS];  /* 4 for 'i' or 'f', 1-255 for 'c' */
+} PAX_Schema;
+
+/*
+ * Page 0 is the file header page; the other pages each hold up to
+ * rowsPerPage rows. A data page has a PAX_PageHeader, a bitmap of the
+ * slots in use, and then one minipage per attribute, holding the values
+ * of that attribute for every slot, contiguous and PAX_ALIGN aligned. A
+ * row is deleted by clearing its bit. Pages with a free slot are chained
+ * from firstFree.
+ */
+#define PAX_HDR_PAGE   0
+#define PAX_MARK       0x50415831  /* "PAX1": mark of the header page */
+#define PAX_ALIGN      16          /* alignment of each minipage */
+
+typedef struct {
+    int mark;           /* PAX_MARK; RHF_OpenFile() refuses the file */
+    int rowsPerPage;    /* slots of a data page */
+    int rowLength;      /* bytes of a row, see PAX_RowLength() */
+    int firstFree;      /* first data page with a free slot, or -1 */
+    int bitmapOffset;   /* offset of the slot bitmap on a data page */
+    int minipage[PAX_MAXATTRS];  /* offset of each minipage */
+    PAX_Schema schema;
+} PAX_FileHeader;
+
+typedef struct {
+    int numRows;        /* slots in use */
+    int nextFree;       /* next page on the free chain, or -1 */
+    int onFreeChain;    /* whether the page is on the free chain */
+    int pad;
+} PAX_PageHeader;
+
+/* Predicate "attribute attr op value": op is one of the AM layer's
+   comparison operators, value points to a value of the attribute, and
+   char values compare as strncmp() */
+#define PAX_EQ 1
+#define PAX_LT 2
+#define PAX_GT 3
+#define PAX_LE 4
+#define PAX_GE 5
+#define PAX_NE 6
+
+typedef struct {
+    int attr;           /* attribute number, from 0 */
+    int op;             /* PAX_EQ ... PAX_NE */
+    char *value;
+} PAX_Pred;
+
+
+/* --- Public PAX API Functions --- */
+
+extern int PAX_RowLength(PAX_Schema *schema);
+
+/* File Management */
+extern int PAX_CreateFile(char *fname, PAX_Schema *schema);
+/* pageSize is a page size for PF_CreateFileSize() */
+extern int PAX_CreateFileSize(char *fname, PAX_Schema *schema, int pageSize);
+extern int PAX_DestroyFile(char *fname);
+extern int PAX_OpenFile(char *fname);
+/* mode is PF_MODE_RDWR or PF_MODE_MMAP, read-only: inserts and deletes
+   then return PFE_READONLY */
+extern int PAX_OpenFileMode(char *fname, int mode);
+extern int PAX_CloseFile(int fd);
+extern int PAX_GetSchema(int fd, PAX_Schema *schema);
+
+/* Record Management */
+extern int PAX_InsertRecord(int fd, char *row, RID *rid);
+extern int PAX_DeleteRecord(int fd, RID *rid);
+extern int PAX_GetRecord(int fd, RID *rid, char *row);
+
+/* Selection */
+/* Scans the file for the rows that satisfy all the npreds predicates.
+   Each predicate is evaluated over a whole minipage at a time, for the
+   slots still selected, and only the rows selected in the end are put
+   together, in a buffer valid until found(arg, rid, row) returns. found
+   may be NULL to only count them, else it returns RHF_OK to go on or a
+   negative code to stop. Returns the number of rows selected, or what
+   found returned to stop. */
+extern int PAX_Select(int fd, PAX_Pred *preds, int npreds,
+                      int (*found)(void *arg, RID *rid, char *row),
+                      void *arg);
+
+/* Utility */
+extern void PAX_PrintError(char *s, int err);
+
+#endif
@@ -1,9 +1,18 @@
-/* pf.c: Paged File Interface Routines+ support routines */
+/* pf.c: Paged File Interface Routines+ support routines.
+The routines may be called by several threads at once, each thread
+with its own PFerrno. A file must not be used while it is being opened
+or closed. */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/file.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "pf.h"
 #include "pftypes.h"
 
@@ -12,18 +21,38 @@
 #define L_SET 0
 #endif
 
-int PFerrno = PFE_OK;	/* last error message */
+__thread int PFerrno = PFE_OK;	/* last error message */
 
 static PFftab_ele PFftab[PF_FTAB_SIZE]; /* table of opened files */
+static pthread_mutex_t PFftablock = PTHREAD_MUTEX_INITIALIZER; /* protects
+				the "fname" fields of PFftab, and is held
+				while a file is opened or closed */
+
+static int PFftabready = FALSE;	/* TRUE once the PFftab locks are initialized */
+
+static int PFftabstamp = 0;	/* stamp of the last file opened */
+
+static int PFraPages = PF_RA_DEFAULT;	/* read-ahead window, 0 if disabled */
 
 /* true if file descriptor fd is invaild */
 #define PFinvalidFd(fd) ((fd) < 0 || (fd) >= PF_FTAB_SIZE \
 				|| PFftab[fd].fname == NULL)
 
+/* # of pages in file "fd". PF_AllocPage() may change it at any time */
+#define PFnumpages(fd) __atomic_load_n(&PFftab[fd].hdr.numpages,__ATOMIC_ACQUIRE)
+
+/* true if "size" is not a valid page size */
+#define PFbadPagesize(size) ((size) < PF_PAGE_SIZE || \
+		(size) > PF_MAX_PAGE_SIZE || ((size) & ((size) - 1)) != 0)
+
 /* true if page number "pagenum" of file "fd" is invalid in the
 sense that it's <0 or >= # of pages in the file */
 #define PFinvalidPagenum(fd,pagenum) ((pagenum)<0 || (pagenum) >= \
-				PFftab[fd].hdr.numpages)
+				PFnumpages(fd))
+
+/* lock and unlock the header and bitmap of file "fd" */
+#define PFfileLock(fd)		pthread_mutex_lock(&PFftab[fd].lock)
+#define PFfileUnlock(fd)	pthread_mutex_unlock(&PFftab[fd].lock)
 
 // extern char *malloc();
 
@@ -98,6 +127,206 @@ int i;
 	return(-1);
 }
 
+/* page size of file "fd", and the # of bytes each page takes in it */
+#define PFpagesize(fd)	(PFftab[fd].pagesize)
+#define PFblocksize(fd)	(PFftab[fd].version == PF_VERSION_1 ? \
+		(int)PF_FPAGE_SIZE : PFpagesize(fd))
+
+/* version 2: # of pages in a bitmap group of file "fd" */
+#define PFmapPages(fd)	PF_MAP_PAGES(PFpagesize(fd))
+
+/* file offset of page "pagenum" of file "fd" */
+#define PFpageOffset(fd,pagenum) (PFftab[fd].version == PF_VERSION_1 ? \
+		(off_t)(pagenum)*(off_t)PF_FPAGE_SIZE+(off_t)PF_HDR_SIZE : \
+		(off_t)PF_PAGE_BLOCK(pagenum,PFpagesize(fd))*PFpagesize(fd))
+
+/* version 2: TRUE if page "pagenum" of file "fd" is used */
+#define PFmapUsed(fd,pagenum) \
+	(PFftab[fd].usedmap[(pagenum)>>3] & (1 << ((pagenum)&7)))
+
+static int PFmapGrow(fd,pagenum)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Make sure the bitmap of used pages of file "fd" covers "pagenum".
+	Nothing is done for a version 1 file.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_NOMEM	if no memory.
+*****************************************************************************/
+{
+PFftab_ele *ft = &PFftab[fd];
+unsigned char *map;
+int groups;	/* # of groups needed */
+
+	if (ft->version == PF_VERSION_1)
+		return(PFE_OK);
+	groups = pagenum / PFmapPages(fd) + 1;
+	if (groups <= ft->mapgroups)
+		return(PFE_OK);
+
+	if ((map=(unsigned char *)realloc((char *)ft->usedmap,
+				(size_t)groups*ft->pagesize)) == NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	bzero((char *)map + (size_t)ft->mapgroups*ft->pagesize,
+				(size_t)(groups - ft->mapgroups)*ft->pagesize);
+	ft->usedmap = map;
+	ft->mapgroups = groups;
+	ft->mapchanged = TRUE;
+	return(PFE_OK);
+}
+
+static void PFmapSet(fd,pagenum,used)
+int fd;		/* file descriptor */
+int pagenum;	/* page number, covered by the bitmap */
+int used;	/* TRUE if the page is now used */
+/****************************************************************************
+SPECIFICATIONS:
+	Record in the bitmap of file "fd" whether "pagenum" is used.
+	Nothing is done for a version 1 file.
+*****************************************************************************/
+{
+PFftab_ele *ft = &PFftab[fd];
+
+	if (ft->version == PF_VERSION_1)
+		return;
+	if (used)
+		ft->usedmap[pagenum>>3] |= 1 << (pagenum&7);
+	else	ft->usedmap[pagenum>>3] &= ~(1 << (pagenum&7));
+	ft->mapchanged = TRUE;
+}
+
+static int PFmapIO(unixfd,map,groups,size,write)
+int unixfd;	/* unix file descriptor */
+unsigned char *map;	/* bitmap of used pages */
+int groups;	/* # of groups in map */
+int size;	/* page size of the file */
+int write;	/* TRUE to write the bitmap blocks, FALSE to read them */
+/****************************************************************************
+SPECIFICATIONS:
+	Read or write the bitmap blocks of the first "groups" groups of a
+	version 2 file with pages of "size" bytes.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not ok.
+*****************************************************************************/
+{
+off_t offset;	/* offset of the bitmap block */
+int g;
+int n;
+
+	for (g=0; g < groups; g++){
+		offset = (off_t)PF_MAP_BLOCK(g*PF_MAP_PAGES(size),size)*size;
+		n = write ? pwrite(unixfd,map+(size_t)g*size,size,offset)
+			: pread(unixfd,map+(size_t)g*size,size,offset);
+		if (n != size){
+			if (n < 0)
+				PFerrno = PFE_UNIX;
+			else	PFerrno = write ? PFE_HDRWRITE : PFE_HDRREAD;
+			return(PFerrno);
+		}
+	}
+	return(PFE_OK);
+}
+
+/* version 2: set "nextfree" of page "pagenum" just read into "buf" */
+#define PFsetNextfree(fd,pagenum,buf) { \
+	if (PFmapUsed(fd,pagenum)) \
+		(buf)->nextfree = PF_PAGE_USED; \
+	else	bcopy((buf)->pagebuf,(char *)&(buf)->nextfree,sizeof(int)); \
+}
+
+/* TRUE if file "fd" was opened with PF_MODE_MMAP */
+#define PFisMapped(fd) (PFftab[fd].mapbase != NULL)
+
+static int PFmapPage(fd,pagenum,pagebuf)
+int fd;		/* file descriptor, opened with PF_MODE_MMAP */
+int pagenum;	/* valid page number */
+char **pagebuf;	/* set to the page data in the mapping */
+/****************************************************************************
+SPECIFICATIONS:
+	Fix page "pagenum" of a mapped file: count one more fix, and
+	set *pagebuf to point to its data in the mapping.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_INVALIDPAGE if the page is free.
+	PFE_INCOMPLETEREAD if the page is beyond the end of the mapping.
+*****************************************************************************/
+{
+PFftab_ele *ft = &PFftab[fd];
+off_t offset;	/* offset of the page in the file */
+int nextfree;	/* version 1: link of the page */
+
+	offset = PFpageOffset(fd,pagenum);
+	if (ft->version == PF_VERSION_1){
+		if (offset + (off_t)PF_FPAGE_SIZE > (off_t)ft->maplen){
+			PFerrno = PFE_INCOMPLETEREAD;
+			return(PFerrno);
+		}
+		bcopy(ft->mapbase + offset,(char *)&nextfree,sizeof(int));
+		if (nextfree != PF_PAGE_USED){
+			PFerrno = PFE_INVALIDPAGE;
+			return(PFerrno);
+		}
+		offset += sizeof(int);
+	}
+	else {
+		if (!PFmapUsed(fd,pagenum)){
+			PFerrno = PFE_INVALIDPAGE;
+			return(PFerrno);
+		}
+		if (offset + ft->pagesize > (off_t)ft->maplen){
+			PFerrno = PFE_INCOMPLETEREAD;
+			return(PFerrno);
+		}
+	}
+
+	__atomic_fetch_add(&ft->pins[pagenum],1,__ATOMIC_RELAXED);
+	__atomic_fetch_add(&ft->npinned,1,__ATOMIC_RELAXED);
+	*pagebuf = ft->mapbase + offset;
+	return(PFE_OK);
+}
+
+#ifndef PF_NO_PREADV
+/* version 1: read or write a page at "offset" of file "fd", without
+moving the file offset shared by the threads */
+#define PFreadvAt(fd,iov,offset)	preadv(PFftab[fd].unixfd,iov,2,offset)
+#define PFwritevAt(fd,iov,offset)	pwritev(PFftab[fd].unixfd,iov,2,offset)
+#else
+static int PFvectorAt(fd,iov,offset,write)
+int fd;		/* file descriptor */
+struct iovec *iov;	/* nextfree, then the page data */
+off_t offset;	/* where to read or write */
+int write;	/* TRUE to write, FALSE to read */
+/****************************************************************************
+SPECIFICATIONS:
+	Without preadv(): seek to "offset" then read or write, with the
+	file locked so that no other thread moves the offset meanwhile.
+
+RETURN VALUE:
+	# of bytes read or written, or -1 if error.
+*****************************************************************************/
+{
+int n;
+
+	PFfileLock(fd);
+	if (lseek(PFftab[fd].unixfd,offset,L_SET) == -1)
+		n = -1;
+	else	n = write ? writev(PFftab[fd].unixfd,iov,2)
+			: readv(PFftab[fd].unixfd,iov,2);
+	PFfileUnlock(fd);
+	return(n);
+}
+#define PFreadvAt(fd,iov,offset)	PFvectorAt(fd,iov,offset,FALSE)
+#define PFwritevAt(fd,iov,offset)	PFvectorAt(fd,iov,offset,TRUE)
+#endif
+
 int PFreadfcn(fd,pagenum,buf)
 int fd;	/* file descriptor */
 int pagenum; /* page number */
@@ -115,17 +344,29 @@ RETURN VALUE:
 *****************************************************************************/
 {
 int error;
+struct iovec iov[2];	/* nextfree, then the page data */
 
-	/* seek to the appropriate place */
-	if ((error=lseek(PFftab[fd].unixfd,pagenum*sizeof(PFfpage)+PF_HDR_SIZE,
-				L_SET)) == -1){
-		PFerrno = PFE_UNIX;
-		return(PFerrno);
+	if (PFftab[fd].version != PF_VERSION_1){
+		/* the page is one block */
+		if ((error=pread(PFftab[fd].unixfd,buf->pagebuf,PFpagesize(fd),
+				PFpageOffset(fd,pagenum))) != PFpagesize(fd)){
+			if (error <0)
+				PFerrno = PFE_UNIX;
+			else	PFerrno = PFE_INCOMPLETEREAD;
+			return(PFerrno);
+		}
+		PFfileLock(fd);
+		PFsetNextfree(fd,pagenum,buf);
+		PFfileUnlock(fd);
+		return(PFE_OK);
 	}
 
-	/* read the data */
-	if((error=read(PFftab[fd].unixfd,(char *)buf,sizeof(PFfpage)))
-			!=sizeof(PFfpage)){
+	/* read the data at the appropriate place */
+	iov[0].iov_base = (char *)&buf->nextfree;
+	iov[0].iov_len = sizeof(int);
+	iov[1].iov_base = buf->pagebuf;
+	iov[1].iov_len = PF_PAGE_SIZE;
+	if((error=PFreadvAt(fd,iov,PFpageOffset(fd,pagenum))) != PF_FPAGE_SIZE){
 		if (error <0)
 			PFerrno = PFE_UNIX;
 		else	PFerrno = PFE_INCOMPLETEREAD;
@@ -135,6 +376,72 @@ int error;
 	return(PFE_OK);
 }
 
+int PFreadvfcn(fd,pagenum,bufs,count)
+int fd;		/* file descriptor */
+int pagenum;	/* first page to read */
+PFfpage **bufs;	/* buffers for the pages */
+int count;	/* # of consecutive pages to read */
+/****************************************************************************
+SPECIFICATIONS:
+	Read "count" consecutive pages starting at "pagenum" from the file
+	indexed by "fd" into bufs[0..count-1], with a single system call
+	where possible.
+
+RETURN VALUE:
+	# of pages read completely (less than "count" at end of file)
+	PF error code if error.
+*****************************************************************************/
+{
+int n;
+#ifndef PF_NO_PREADV
+struct iovec iov[2*PF_PREFETCH_MAX];
+int i;
+
+	if (count > PF_PREFETCH_MAX)
+		count = PF_PREFETCH_MAX;
+
+	if (PFftab[fd].version != PF_VERSION_1){
+		/* pages are blocks, contiguous within a bitmap group */
+		if (pagenum % PFmapPages(fd) + count > PFmapPages(fd))
+			count = PFmapPages(fd) - pagenum % PFmapPages(fd);
+		for (i=0; i < count; i++){
+			iov[i].iov_base = bufs[i]->pagebuf;
+			iov[i].iov_len = PFpagesize(fd);
+		}
+		if ((n=preadv(PFftab[fd].unixfd,iov,count,
+				PFpageOffset(fd,pagenum))) < 0){
+			PFerrno = PFE_UNIX;
+			return(PFerrno);
+		}
+		n /= PFpagesize(fd);
+		PFfileLock(fd);
+		for (i=0; i < n; i++)
+			PFsetNextfree(fd,pagenum+i,bufs[i]);
+		PFfileUnlock(fd);
+		return(n);
+	}
+
+	for (i=0; i < count; i++){
+		iov[2*i].iov_base = (char *)&bufs[i]->nextfree;
+		iov[2*i].iov_len = sizeof(int);
+		iov[2*i+1].iov_base = bufs[i]->pagebuf;
+		iov[2*i+1].iov_len = PF_PAGE_SIZE;
+	}
+	if ((n=preadv(PFftab[fd].unixfd,iov,2*count,
+			PFpageOffset(fd,pagenum))) < 0){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	return(n / PF_FPAGE_SIZE);
+#else
+	/* no vectored read: fall back to one read per page */
+	for (n=0; n < count; n++)
+		if (PFreadfcn(fd,pagenum+n,bufs[n]) != PFE_OK)
+			break;
+	return(n);
+#endif
+}
+
 int PFwritefcn(fd,pagenum,buf)
 int fd;		/* file descriptor */
 int pagenum;	/* page to read */
@@ -153,17 +460,28 @@ RETURN VALUE:
 *****************************************************************************/
 {
 int error;
-
-	/* seek to the right place */
-	if ((error=lseek(PFftab[fd].unixfd,pagenum*sizeof(PFfpage)+PF_HDR_SIZE,
-				L_SET)) == -1){
-		PFerrno = PFE_UNIX;
-		return(PFerrno);
+struct iovec iov[2];	/* nextfree, then the page data */
+
+	if (PFftab[fd].version != PF_VERSION_1){
+		/* the page is one block; a free page keeps its link in it */
+		if (buf->nextfree != PF_PAGE_USED)
+			bcopy((char *)&buf->nextfree,buf->pagebuf,sizeof(int));
+		if ((error=pwrite(PFftab[fd].unixfd,buf->pagebuf,PFpagesize(fd),
+				PFpageOffset(fd,pagenum))) != PFpagesize(fd)){
+			if (error <0)
+				PFerrno = PFE_UNIX;
+			else	PFerrno = PFE_INCOMPLETEWRITE;
+			return(PFerrno);
+		}
+		return(PFE_OK);
 	}
 
-	/* write out the page */
-	if((error=write(PFftab[fd].unixfd,(char *)buf,sizeof(PFfpage)))
-			!=sizeof(PFfpage)){
+	/* write out the page at the right place */
+	iov[0].iov_base = (char *)&buf->nextfree;
+	iov[0].iov_len = sizeof(int);
+	iov[1].iov_base = buf->pagebuf;
+	iov[1].iov_len = PF_PAGE_SIZE;
+	if((error=PFwritevAt(fd,iov,PFpageOffset(fd,pagenum))) != PF_FPAGE_SIZE){
 		if (error <0)
 			PFerrno = PFE_UNIX;
 		else	PFerrno = PFE_INCOMPLETEWRITE;
@@ -174,6 +492,159 @@ int error;
 
 }
 
+int PFwritevfcn(fd,pagenum,bufs,count)
+int fd;		/* file descriptor */
+int pagenum;	/* first page to write */
+PFfpage **bufs;	/* buffers of the pages */
+int count;	/* # of consecutive pages to write */
+/****************************************************************************
+SPECIFICATIONS:
+	Write "count" consecutive pages starting at "pagenum" from
+	bufs[0..count-1] into the file indexed by "fd", with a single system
+	call where possible.
+
+RETURN VALUE:
+	# of pages written completely (less than "count" if the pages cross
+	a bitmap group, or on a short write)
+	PF error code if error.
+*****************************************************************************/
+{
+int n;
+#ifndef PF_NO_PREADV
+struct iovec iov[2*PF_PREFETCH_MAX];
+int i;
+
+	if (count > PF_PREFETCH_MAX)
+		count = PF_PREFETCH_MAX;
+
+	if (PFftab[fd].version != PF_VERSION_1){
+		/* pages are blocks, contiguous within a bitmap group */
+		if (pagenum % PFmapPages(fd) + count > PFmapPages(fd))
+			count = PFmapPages(fd) - pagenum % PFmapPages(fd);
+		for (i=0; i < count; i++){
+			/* a free page keeps its link in it */
+			if (bufs[i]->nextfree != PF_PAGE_USED)
+				bcopy((char *)&bufs[i]->nextfree,bufs[i]->pagebuf,
+					sizeof(int));
+			iov[i].iov_base = bufs[i]->pagebuf;
+			iov[i].iov_len = PFpagesize(fd);
+		}
+		if ((n=pwritev(PFftab[fd].unixfd,iov,count,
+				PFpageOffset(fd,pagenum))) < 0){
+			PFerrno = PFE_UNIX;
+			return(PFerrno);
+		}
+		return(n / PFpagesize(fd));
+	}
+
+	for (i=0; i < count; i++){
+		iov[2*i].iov_base = (char *)&bufs[i]->nextfree;
+		iov[2*i].iov_len = sizeof(int);
+		iov[2*i+1].iov_base = bufs[i]->pagebuf;
+		iov[2*i+1].iov_len = PF_PAGE_SIZE;
+	}
+	if ((n=pwritev(PFftab[fd].unixfd,iov,2*count,
+			PFpageOffset(fd,pagenum))) < 0){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	return(n / PF_FPAGE_SIZE);
+#else
+	/* no vectored write: fall back to one write per page */
+	for (n=0; n < count; n++)
+		if (PFwritefcn(fd,pagenum+n,bufs[n]) != PFE_OK)
+			return((n > 0) ? n : PFerrno);
+	return(n);
+#endif
+}
+
+
+static void PFreadAhead(fd,pagenum)
+int fd;		/* file descriptor */
+int pagenum;	/* page about to be read */
+/****************************************************************************
+SPECIFICATIONS:
+	Keep track of sequential access to file "fd". Once PF_RA_TRIGGER
+	consecutive pages have been requested, read the next window of
+	PFraPages pages (starting with "pagenum" itself) into the buffer in
+	one go, and ask the kernel to start reading the window after that.
+	A new window is read when the reader is half way through the last.
+	The tracking is done with atomics, so that a request which starts
+	no window takes no lock; the file lock is only taken to claim one.
+	Readers of one file that race may lose an update, which only
+	starts a window late or not at all.
+*****************************************************************************/
+{
+PFftab_ele *ft = &PFftab[fd];
+int start, count;
+int got;	/* # of pages brought into the buffer */
+int last, run, next;
+
+	last = __atomic_exchange_n(&ft->lastpage,pagenum,__ATOMIC_RELAXED);
+	if (pagenum == last + 1)
+		run = __atomic_add_fetch(&ft->seqrun,1,__ATOMIC_RELAXED);
+	else {
+		run = 0;
+		__atomic_store_n(&ft->seqrun,0,__ATOMIC_RELAXED);
+		__atomic_store_n(&ft->ranext,-1,__ATOMIC_RELAXED);
+	}
+
+	if (PFraPages <= 0 || run < PF_RA_TRIGGER ||
+			pagenum + PFraPages/2 <
+			__atomic_load_n(&ft->ranext,__ATOMIC_RELAXED))
+		return;
+
+	PFfileLock(fd);
+	/* another reader may have claimed the window meanwhile */
+	next = __atomic_load_n(&ft->ranext,__ATOMIC_RELAXED);
+	if (pagenum + PFraPages/2 < next){
+		PFfileUnlock(fd);
+		return;
+	}
+	start = (next > pagenum) ? next : pagenum;
+	count = PFraPages;
+	if (start + count > ft->hdr.numpages)
+		count = ft->hdr.numpages - start;
+	/* claim the window, so that other readers of the file skip it */
+	if (count > 0)
+		__atomic_store_n(&ft->ranext,start + count,__ATOMIC_RELAXED);
+	PFfileUnlock(fd);
+	if (count <= 0)
+		return;
+
+	if ((got = PFbufPrefetch(fd,start,count,PFreadvfcn,PFwritefcn)) < count){
+		/* frames ran out: the window only goes as far as was read */
+		next = start + count;
+		__atomic_compare_exchange_n(&ft->ranext,&next,
+				start + (got > 0 ? got : 0),0,
+				__ATOMIC_RELAXED,__ATOMIC_RELAXED);
+		if (got <= 0)
+			return;
+	}
+
+#ifdef POSIX_FADV_WILLNEED
+	/* let the kernel fetch the following window in the background */
+	posix_fadvise(ft->unixfd,PFpageOffset(fd,start+got),
+			(off_t)PFraPages*PFblocksize(fd),POSIX_FADV_WILLNEED);
+#endif
+}
+
+static void PFfileLockInit(lock)
+pthread_mutex_t *lock;	/* lock of a PFftab entry */
+/****************************************************************************
+SPECIFICATIONS:
+	Initialize the lock of a file table entry. It is recursive, since
+	reading a page while the file is locked (by PF_AllocPage()) locks
+	it again.
+*****************************************************************************/
+{
+pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr,PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(lock,&attr);
+	pthread_mutexattr_destroy(&attr);
+}
 
 /************************* Interface Routines ****************************/
 
@@ -181,7 +652,7 @@ void PF_Init()
 /****************************************************************************
 SPECIFICATIONS:
 	Initialize the PF interface. Must be the first function called
-	in order to use the PF ADT.
+	in order to use the PF ADT, before any other thread uses it.
 
 AUTHOR: clc
 
@@ -200,39 +671,74 @@ int i;
 
 	/* init the file table to be not used*/
 	for (i=0; i < PF_FTAB_SIZE; i++){
+		if (!PFftabready)
+			PFfileLockInit(&PFftab[i].lock);
 		PFftab[i].fname = NULL;
 	}
+	PFftabready = TRUE;
 }
 
 int PF_CreateFile(fname)
 char *fname;	/* name of file to create */
 /****************************************************************************
 SPECIFICATIONS:
-	Create a paged file called "fname". The file should not have
-	already existed before.
+	Create a paged file called "fname", with pages of PF_PAGE_SIZE
+	bytes. Same as PF_CreateFileSize(fname,PF_PAGE_SIZE).
+*****************************************************************************/
+{
+	return(PF_CreateFileSize(fname,PF_PAGE_SIZE));
+}
+
+int PF_CreateFileSize(fname,pagesize)
+char *fname;	/* name of file to create */
+int pagesize;	/* page size of the file */
+/****************************************************************************
+SPECIFICATIONS:
+	Create a paged file called "fname", with pages of "pagesize"
+	bytes, a power of two from PF_PAGE_SIZE to PF_MAX_PAGE_SIZE. The
+	file should not have already existed before. It is created in
+	format PF_VERSION.
 
 AUTHOR: clc
 
 RETURN VALUE:
 	PFE_OK	if OK
+	PFE_PAGESIZE	if "pagesize" is invalid.
 	PF error code if error.
 *****************************************************************************/
 {
 int fd;	/* unix file descripotr */
-PFhdr_str hdr;	/* file header */
+char *block;	/* header block */
+PFhdrpage_str *hdrpage;
 int error;
 
+	if (PFbadPagesize(pagesize)){
+		PFerrno = PFE_PAGESIZE;
+		return(PFerrno);
+	}
+	if ((block=calloc(1,pagesize)) == NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	hdrpage = (PFhdrpage_str *)block;
+
 	/* create file for exclusive use */
 	if ((fd=open(fname,O_CREAT|O_EXCL|O_WRONLY,0664))<0){
 		/* unix error on open */
+		free(block);
 		PFerrno = PFE_UNIX;
 		return(PFE_UNIX);
 	}
 
-	/* write out the file header */
-	hdr.firstfree = PF_PAGE_LIST_END;	/* no free pag yet */
-	hdr.numpages = 0;
-	if ((error=write(fd,(char *)&hdr,sizeof(hdr))) != sizeof(hdr)){
+	/* write out the file header, which has a block of its own */
+	hdrpage->magic = PF_MAGIC;
+	hdrpage->version = PF_VERSION;
+	hdrpage->hdr.firstfree = PF_PAGE_LIST_END;	/* no free pag yet */
+	hdrpage->hdr.numpages = 0;
+	hdrpage->pagesize = pagesize;
+	error = write(fd,block,pagesize);
+	free(block);
+	if (error != pagesize){
 		/* error while writing. Abort everything. */
 		if (error < 0)
 			PFerrno = PFE_UNIX;
@@ -268,13 +774,17 @@ RETURN VALUE:
 {
 int error;
 
+	pthread_mutex_lock(&PFftablock);
 	if (PFtabFindFname(fname)!= -1){
 		/* file is open */
+		pthread_mutex_unlock(&PFftablock);
 		PFerrno = PFE_FILEOPEN;
 		return(PFerrno);
 	}
 
-	if ((error =unlink(fname))!= 0){
+	error = unlink(fname);
+	pthread_mutex_unlock(&PFftablock);
+	if (error != 0){
 		/* unix error */
 		PFerrno = PFE_UNIX;
 		return(PFerrno);
@@ -289,26 +799,25 @@ int PF_OpenFile(fname)
 char *fname;		/* name of the file to open */
 /****************************************************************************
 SPECIFICATIONS:
-	Open the paged file whose name is fname.  It is possible to open
-	a file more than once. Warning: Openinging a file more than once for 
-	write operations is not prevented. The possible consequence is
-	the corruption of the file structure, which will crash
-	the Paged File functions. On the other hand, opening a file
-	more than once for reading is OK.
-
-AUTHOR: clc
-
-RETURN VALUE:
-	The file descriptor, which is >= 0, if no error.
-	PF error codes otherwise.
+	Open the paged file whose name is fname for reading and writing.
+	Same as PF_OpenFileMode(fname,PF_MODE_RDWR).
+*****************************************************************************/
+{
+	return(PF_OpenFileMode(fname,PF_MODE_RDWR));
+}
 
-IMPLEMENTATION NOTES:
-	A file opened more than once will have different file descriptors
-	returned. Separate buffers are used.
+static int PFftabOpen(fname,mode)
+char *fname;		/* name of the file to open */
+int mode;		/* PF_MODE_RDWR or PF_MODE_MMAP */
+/****************************************************************************
+SPECIFICATIONS:
+	PF_OpenFileMode(), with PFftablock held.
 *****************************************************************************/
 {
 int count;	/* # of bytes in read */
 int fd; /* file descriptor */
+PFhdrpage_str hdrpage;	/* start of the file */
+struct stat st;		/* to find the size of the file */
 
 	/* find a free entry in the file table */
 	if ((fd=PFftabFindFree())< 0){
@@ -318,15 +827,16 @@ int fd; /* file descriptor */
 	}
 
 	/* open the file */
-	if ((PFftab[fd].unixfd = open(fname,O_RDWR))< 0){
+	if ((PFftab[fd].unixfd = open(fname,
+			mode == PF_MODE_MMAP ? O_RDONLY : O_RDWR))< 0){
 		/* can't open the file */
 		PFerrno = PFE_UNIX;
 		return(PFerrno);
 	}
 
-	/* Read the file header */
-	if ((count=read(PFftab[fd].unixfd,(char *)&PFftab[fd].hdr,PF_HDR_SIZE))
-				!= PF_HDR_SIZE){
+	/* Read the file header, and find out the format from it */
+	if ((count=read(PFftab[fd].unixfd,(char *)&hdrpage,sizeof(hdrpage)))
+				< (int)PF_HDR_SIZE){
 		if (count < 0)
 			/* unix error */
 			PFerrno = PFE_UNIX;
@@ -335,18 +845,323 @@ int fd; /* file descriptor */
 		close(PFftab[fd].unixfd);
 		return(PFerrno);
 	}
+	PFftab[fd].usedmap = NULL;
+	PFftab[fd].mapgroups = 0;
+	PFftab[fd].mapchanged = FALSE;
+	if (count == sizeof(hdrpage) && hdrpage.magic == PF_MAGIC){
+		if (hdrpage.version != PF_VERSION){
+			close(PFftab[fd].unixfd);
+			PFerrno = PFE_VERSION;
+			return(PFerrno);
+		}
+		if (hdrpage.pagesize == 0)
+			hdrpage.pagesize = PF_PAGE_SIZE;
+		if (PFbadPagesize(hdrpage.pagesize)){
+			close(PFftab[fd].unixfd);
+			PFerrno = PFE_PAGESIZE;
+			return(PFerrno);
+		}
+		PFftab[fd].version = PF_VERSION;
+		PFftab[fd].pagesize = hdrpage.pagesize;
+		PFftab[fd].hdr = hdrpage.hdr;
+
+		/* read the bitmap of used pages */
+		if (PFftab[fd].hdr.numpages > 0 &&
+			(PFmapGrow(fd,PFftab[fd].hdr.numpages-1) != PFE_OK ||
+			PFmapIO(PFftab[fd].unixfd,PFftab[fd].usedmap,
+				PFftab[fd].mapgroups,PFftab[fd].pagesize,
+				FALSE) != PFE_OK)){
+			free((char *)PFftab[fd].usedmap);
+			close(PFftab[fd].unixfd);
+			return(PFerrno);
+		}
+		PFftab[fd].mapchanged = FALSE;
+	}
+	else {
+		/* version 1: the header is just a PFhdr_str */
+		PFftab[fd].version = PF_VERSION_1;
+		PFftab[fd].pagesize = PF_PAGE_SIZE;
+		bcopy((char *)&hdrpage,(char *)&PFftab[fd].hdr,PF_HDR_SIZE);
+	}
 	/* set file header to be not changed */
 	PFftab[fd].hdrchanged = FALSE;
 
-	/* save the file name */
-	if ((PFftab[fd].fname = savestr(fname)) == NULL){
-		/* no memory */
-		close(PFftab[fd].unixfd);
-		PFerrno = PFE_NOMEM;
+	/* map the file, with a fix count for every page */
+	PFftab[fd].mapbase = NULL;
+	PFftab[fd].maplen = 0;
+	PFftab[fd].pins = NULL;
+	PFftab[fd].npinned = 0;
+	if (mode == PF_MODE_MMAP){
+		if (fstat(PFftab[fd].unixfd,&st) == -1 ||
+			(PFftab[fd].mapbase=mmap(NULL,(size_t)st.st_size,PROT_READ,
+			MAP_SHARED,PFftab[fd].unixfd,0)) == MAP_FAILED){
+			free((char *)PFftab[fd].usedmap);
+			close(PFftab[fd].unixfd);
+			PFftab[fd].mapbase = NULL;
+			PFerrno = PFE_UNIX;
+			return(PFerrno);
+		}
+		PFftab[fd].maplen = st.st_size;
+		if ((PFftab[fd].pins=(int *)calloc(PFftab[fd].hdr.numpages+1,
+					sizeof(int))) == NULL){
+			munmap(PFftab[fd].mapbase,PFftab[fd].maplen);
+			PFftab[fd].mapbase = NULL;
+			free((char *)PFftab[fd].usedmap);
+			close(PFftab[fd].unixfd);
+			PFerrno = PFE_NOMEM;
+			return(PFerrno);
+		}
+	}
+
+	PFftab[fd].stamp = ++PFftabstamp;
+	PFstatResetFile(fd);
+	PFbufSetPageSize(fd,PFftab[fd].pagesize);
+
+	/* no access pattern seen yet */
+	PFftab[fd].lastpage = -2;
+	PFftab[fd].seqrun = 0;
+	PFftab[fd].ranext = -1;
+
+	/* save the file name */
+	if ((PFftab[fd].fname = savestr(fname)) == NULL){
+		/* no memory */
+		if (PFisMapped(fd)){
+			munmap(PFftab[fd].mapbase,PFftab[fd].maplen);
+			PFftab[fd].mapbase = NULL;
+			free((char *)PFftab[fd].pins);
+		}
+		free((char *)PFftab[fd].usedmap);
+		close(PFftab[fd].unixfd);
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+
+	return(fd);
+}
+
+int PF_OpenFileMode(fname,mode)
+char *fname;		/* name of the file to open */
+int mode;		/* PF_MODE_RDWR or PF_MODE_MMAP */
+/****************************************************************************
+SPECIFICATIONS:
+	Open the paged file whose name is fname.  It is possible to open
+	a file more than once. Warning: Openinging a file more than once for 
+	write operations is not prevented. The possible consequence is
+	the corruption of the file structure, which will crash
+	the Paged File functions. On the other hand, opening a file
+	more than once for reading is OK.
+
+AUTHOR: clc
+
+RETURN VALUE:
+	The file descriptor, which is >= 0, if no error.
+	PF error codes otherwise.
+
+IMPLEMENTATION NOTES:
+	A file opened more than once will have different file descriptors
+	returned. Separate buffers are used.
+	Both file formats are accepted: see pftypes.h.
+
+	With PF_MODE_MMAP the file is opened read-only and mapped into
+	memory. PF_GetFirstPage(), PF_GetNextPage() and PF_GetThisPage()
+	then return pointers into the mapping without using the buffer
+	pool. As in the buffer pool, a page may be fixed any number of
+	times: fixing and unfixing only count. Functions that modify the file fail with
+	PFE_READONLY. The file must not be modified by anybody else
+	while it is open this way.
+*****************************************************************************/
+{
+int fd;
+
+	pthread_mutex_lock(&PFftablock);
+	fd = PFftabOpen(fname,mode);
+	pthread_mutex_unlock(&PFftablock);
+	return(fd);
+}
+
+int PF_FileMode(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell how the file indexed by "fd" was opened.
+
+RETURN VALUE:
+	PF_MODE_RDWR or PF_MODE_MMAP
+	PFE_FD	if "fd" is invalid.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	return(PFisMapped(fd) ? PF_MODE_MMAP : PF_MODE_RDWR);
+}
+
+int PF_FileStamp(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell this opening of the file indexed by "fd" from every other
+	opening of a file, so that a layer above can tell whether what it
+	remembers about "fd" is still about the same open file.
+
+RETURN VALUE:
+	a number > 0, different for each PF_OpenFile(), as long as the
+	file stays open
+	PFE_FD	if "fd" is invalid.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	return(PFftab[fd].stamp);
+}
+
+int PF_PageSize(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell the page size of the file indexed by "fd".
+
+RETURN VALUE:
+	the page size, from PF_PAGE_SIZE to PF_MAX_PAGE_SIZE
+	PFE_FD	if "fd" is invalid.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	return(PFpagesize(fd));
+}
+
+int PF_NumPages(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell the # of pages of the file indexed by "fd", used or free:
+	the valid page numbers are below it. Pages may be allocated
+	meanwhile by other threads.
+
+RETURN VALUE:
+	the # of pages, >= 0
+	PFE_FD	if "fd" is invalid.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	return(PFnumpages(fd));
+}
+
+static int PFftabWriteHdr(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Write the header and the bitmap of used pages of file "fd" back,
+	if they have changed.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+int error;
+PFhdrpage_str hdrpage;	/* version 2 header block */
+
+	PFfileLock(fd);
+	if (PFftab[fd].hdrchanged){
+		/* write the header back to the file */
+		if (PFftab[fd].version == PF_VERSION_1)
+			error = pwrite(PFftab[fd].unixfd, (char *)&PFftab[fd].hdr,
+				PF_HDR_SIZE, (off_t)0);
+		else {
+			hdrpage.magic = PF_MAGIC;
+			hdrpage.version = PF_VERSION;
+			hdrpage.hdr = PFftab[fd].hdr;
+			hdrpage.pagesize = PFftab[fd].pagesize;
+			error = pwrite(PFftab[fd].unixfd, (char *)&hdrpage,
+				sizeof(hdrpage), (off_t)0);
+			if (error == sizeof(hdrpage))
+				error = PF_HDR_SIZE;
+		}
+		if(error!=PF_HDR_SIZE){
+			if (error <0)
+				PFerrno = PFE_UNIX;
+			else	PFerrno = PFE_HDRWRITE;
+			PFfileUnlock(fd);
+			return(PFerrno);
+		}
+		PFftab[fd].hdrchanged = FALSE;
+	}
+
+	if (PFftab[fd].mapchanged){
+		/* write the bitmap of used pages back */
+		if ((error=PFmapIO(PFftab[fd].unixfd,PFftab[fd].usedmap,
+				PFftab[fd].mapgroups,PFftab[fd].pagesize,
+				TRUE)) != PFE_OK){
+			PFfileUnlock(fd);
+			return(error);
+		}
+		PFftab[fd].mapchanged = FALSE;
+	}
+	PFfileUnlock(fd);
+	return(PFE_OK);
+}
+
+static int PFftabClose(fd)
+int fd;		/* file descriptor to close */
+/****************************************************************************
+SPECIFICATIONS:
+	PF_CloseFile(), with PFftablock held.
+*****************************************************************************/
+{
+int error;
+
+	if (PFinvalidFd(fd)){
+		/* invalid file descriptor */
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	
+
+	if (PFisMapped(fd)){
+		/* nothing in the buffer, nothing to write */
+		if (__atomic_load_n(&PFftab[fd].npinned,__ATOMIC_RELAXED) > 0){
+			PFerrno = PFE_PAGEFIXED;
+			return(PFerrno);
+		}
+		munmap(PFftab[fd].mapbase,PFftab[fd].maplen);
+		PFftab[fd].mapbase = NULL;
+		free((char *)PFftab[fd].pins);
+		PFftab[fd].pins = NULL;
+	}
+
+	/* Flush all buffers for this file */
+	if ( (error=PFbufReleaseFile(fd,PFwritefcn,PFwritevfcn)) != PFE_OK)
+		return(error);
+
+	if ((error=PFftabWriteHdr(fd)) != PFE_OK)
+		return(error);
+	free((char *)PFftab[fd].usedmap);
+	PFftab[fd].usedmap = NULL;
+	PFftab[fd].mapgroups = 0;
+
+
+		
+	/* close the file */
+	if ((error=close(PFftab[fd].unixfd))== -1){
+		PFerrno = PFE_UNIX;
 		return(PFerrno);
 	}
 
-	return(fd);
+	/* free the file name space */
+	free((char *)PFftab[fd].fname);
+	PFftab[fd].fname = NULL;
+
+	return(PFE_OK);
 }
 
 int PF_CloseFile(fd)
@@ -367,53 +1182,171 @@ RETURN VALUE:
 {
 int error;
 
-	if (PFinvalidFd(fd)){
-		/* invalid file descriptor */
-		PFerrno = PFE_FD;
-		return(PFerrno);
-	}
-	
+	pthread_mutex_lock(&PFftablock);
+	error = PFftabClose(fd);
+	pthread_mutex_unlock(&PFftablock);
+	return(error);
+}
 
-	/* Flush all buffers for this file */
-	if ( (error=PFbufReleaseFile(fd,PFwritefcn)) != PFE_OK)
-		return(error);
 
-	if (PFftab[fd].hdrchanged){
-		/* write the header back to the file */
-		/* First seek to the appropriate place */
-		if ((error=lseek(PFftab[fd].unixfd,(unsigned)0,L_SET)) == -1){
-			/* seek error */
-			PFerrno = PFE_UNIX;
+static int PFconvertCopy(oldfd,newfd,hdrpage,map,groups)
+int oldfd;	/* unix file descriptor of the version 1 file */
+int newfd;	/* unix file descriptor of the new file */
+PFhdrpage_str *hdrpage;	/* header for the new file */
+unsigned char *map;	/* zeroed bitmap for "groups" groups */
+int groups;	/* # of bitmap groups */
+/****************************************************************************
+SPECIFICATIONS:
+	Write out the version 1 file "oldfd" in format PF_VERSION to
+	"newfd": the pages, moving the link of free pages into their data,
+	then the bitmap blocks and the header block.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+int nextfree;	/* link of the page being converted */
+char block[PF_PAGE_SIZE];	/* page data, or header block */
+struct iovec iov[2];	/* nextfree, then the page data */
+int count;	/* # of bytes read or written */
+int page;
+
+	iov[0].iov_base = (char *)&nextfree;
+	iov[0].iov_len = sizeof(int);
+	iov[1].iov_base = block;
+	iov[1].iov_len = PF_PAGE_SIZE;
+	for (page=0; page < hdrpage->hdr.numpages; page++){
+		if ((count=preadv(oldfd,iov,2,
+			(off_t)page*PF_FPAGE_SIZE+PF_HDR_SIZE)) != PF_FPAGE_SIZE){
+			PFerrno = (count < 0) ? PFE_UNIX : PFE_INCOMPLETEREAD;
 			return(PFerrno);
 		}
-
-		/* write header*/
-		if((error=write(PFftab[fd].unixfd, (char *)&PFftab[fd].hdr,
-				PF_HDR_SIZE))!=PF_HDR_SIZE){
-			if (error <0)
-				PFerrno = PFE_UNIX;
-			else	PFerrno = PFE_HDRWRITE;
+		if (nextfree == PF_PAGE_USED)
+			map[page>>3] |= 1 << (page&7);
+		else	bcopy((char *)&nextfree,block,sizeof(int));
+		if ((count=pwrite(newfd,block,PF_PAGE_SIZE,
+			(off_t)PF_PAGE_BLOCK(page,PF_PAGE_SIZE)*PF_PAGE_SIZE))
+				!= PF_PAGE_SIZE){
+			PFerrno = (count < 0) ? PFE_UNIX : PFE_INCOMPLETEWRITE;
 			return(PFerrno);
 		}
-		PFftab[fd].hdrchanged = FALSE;
 	}
 
+	if (PFmapIO(newfd,map,groups,PF_PAGE_SIZE,TRUE) != PFE_OK)
+		return(PFerrno);
 
-		
-	/* close the file */
-	if ((error=close(PFftab[fd].unixfd))== -1){
+	bzero(block,PF_PAGE_SIZE);
+	bcopy((char *)hdrpage,block,sizeof(PFhdrpage_str));
+	if ((count=pwrite(newfd,block,PF_PAGE_SIZE,(off_t)0)) != PF_PAGE_SIZE){
+		PFerrno = (count < 0) ? PFE_UNIX : PFE_HDRWRITE;
+		return(PFerrno);
+	}
+
+	if (fsync(newfd) == -1){
 		PFerrno = PFE_UNIX;
 		return(PFerrno);
 	}
+	return(PFE_OK);
+}
 
-	/* free the file name space */
-	free((char *)PFftab[fd].fname);
-	PFftab[fd].fname = NULL;
+int PF_ConvertFile(fname)
+char *fname;	/* name of the file to convert */
+/****************************************************************************
+SPECIFICATIONS:
+	Convert the paged file "fname" from version 1 to format PF_VERSION.
+	The file must not be open. Page numbers, the free list and the
+	page data are kept. A file already in format PF_VERSION is left
+	alone.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error. The original file is then unchanged.
+
+IMPLEMENTATION NOTES:
+	The new file is written as "fname" followed by ".pfconv", and
+	renamed over "fname" once complete.
+*****************************************************************************/
+{
+int oldfd;	/* unix file descriptor of the file to convert */
+int newfd;	/* unix file descriptor of the converted file */
+char *newname;	/* name of the converted file */
+PFhdrpage_str hdrpage;	/* start of the old file, then new header */
+unsigned char *map;	/* bitmap of used pages */
+int groups;	/* # of bitmap groups */
+int count;	/* # of bytes read */
+int error;
 
+	pthread_mutex_lock(&PFftablock);
+	error = (PFtabFindFname(fname) != -1);
+	pthread_mutex_unlock(&PFftablock);
+	if (error){
+		/* file is open */
+		PFerrno = PFE_FILEOPEN;
+		return(PFerrno);
+	}
+
+	if ((oldfd=open(fname,O_RDONLY)) < 0){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	if ((count=read(oldfd,(char *)&hdrpage,sizeof(hdrpage))) < (int)PF_HDR_SIZE){
+		PFerrno = (count < 0) ? PFE_UNIX : PFE_HDRREAD;
+		close(oldfd);
+		return(PFerrno);
+	}
+	if (count == sizeof(hdrpage) && hdrpage.magic == PF_MAGIC){
+		/* nothing to do, unless it is a version we don't know */
+		close(oldfd);
+		if (hdrpage.version != PF_VERSION){
+			PFerrno = PFE_VERSION;
+			return(PFerrno);
+		}
+		return(PFE_OK);
+	}
+	bcopy((char *)&hdrpage,(char *)&hdrpage.hdr,PF_HDR_SIZE);
+	hdrpage.magic = PF_MAGIC;
+	hdrpage.version = PF_VERSION;
+	hdrpage.pagesize = PF_PAGE_SIZE;
+
+	groups = (hdrpage.hdr.numpages + PF_MAP_PAGES(PF_PAGE_SIZE) - 1)
+			/ PF_MAP_PAGES(PF_PAGE_SIZE);
+	map = (unsigned char *)calloc(groups > 0 ? groups : 1,PF_PAGE_SIZE);
+	newname = malloc(strlen(fname)+sizeof(".pfconv"));
+	if (map == NULL || newname == NULL){
+		free((char *)map);
+		free(newname);
+		close(oldfd);
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	strcpy(newname,fname);
+	strcat(newname,".pfconv");
+
+	/* write the new file, then put it in place of the old one */
+	if ((newfd=open(newname,O_CREAT|O_TRUNC|O_WRONLY,0664)) < 0)
+		error = PFE_UNIX;
+	else {
+		error = PFconvertCopy(oldfd,newfd,&hdrpage,map,groups);
+		if (close(newfd) == -1 && error == PFE_OK)
+			error = PFE_UNIX;
+	}
+	if (error == PFE_OK && rename(newname,fname) == -1)
+		error = PFE_UNIX;
+	if (error != PFE_OK)
+		/* leave the original file alone */
+		unlink(newname);
+
+	close(oldfd);
+	free((char *)map);
+	free(newname);
+	if (error != PFE_OK){
+		PFerrno = error;
+		return(PFerrno);
+	}
 	return(PFE_OK);
 }
 
-
 int PF_GetFirstPage(fd,pagenum,pagebuf)
 int fd;	/* file descriptor */
 int *pagenum;	/* page number of first page */
@@ -474,13 +1407,25 @@ PFfpage *fpage;	/* pointer to file page */
 	}
 
 
-	if (*pagenum < -1 || *pagenum >= PFftab[fd].hdr.numpages){
+	if (*pagenum < -1 || *pagenum >= PFnumpages(fd)){
 		PFerrno = PFE_INVALIDPAGE;
 		return(PFerrno);
 	}
 
 	/* scan the file until a valid used page is found */
-	for (temppage= *pagenum+1;temppage<PFftab[fd].hdr.numpages;temppage++){
+	for (temppage= *pagenum+1;temppage<PFnumpages(fd);temppage++){
+		if (PFisMapped(fd)){
+			if ((error=PFmapPage(fd,temppage,pagebuf)) == PFE_OK){
+				*pagenum = temppage;
+				return(PFE_OK);
+			}
+			if (error != PFE_INVALIDPAGE)
+				return(error);
+			/* page is free */
+			continue;
+		}
+
+		PFreadAhead(fd,temppage);
 		if ( (error=PFbufGet(fd,temppage,&fpage,PFreadfcn,
 					PFwritefcn))!= PFE_OK)
 			return(error);
@@ -510,15 +1455,15 @@ char **pagebuf;	/* pointer to pointer to page data */
 SPECIFICATIONS:
 	Read the page specifeid by "pagenum" and set *pagebuf to point
 	to the page data. The page number should be valid.
+	The page may already be fixed, by this caller or another one: the
+	buffer is then shared, and the page stays fixed until every fix
+	has been matched by PF_UnfixPage().
 
 AUTHOR: clc
 
 RETURN VALUE:
 	PFE_OK	if no error.
 	PFE_INVALIDPAGE if invalid page number is specified.
-	PFE_PAGEFIXED if page already fixed in memory. In this case,
-		*pagebuf  is still set to point to the buffer that contains
-		the page data.
 	other PF error codes if other error encountered.
 *****************************************************************************/
 {
@@ -535,11 +1480,12 @@ PFfpage *fpage;
 		return(PFerrno);
 	}
 
-	if ( (error=PFbufGet(fd,pagenum,&fpage,PFreadfcn,PFwritefcn))!= PFE_OK){
-		if (error== PFE_PAGEFIXED)
-			*pagebuf = fpage->pagebuf;
+	if (PFisMapped(fd))
+		return(PFmapPage(fd,pagenum,pagebuf));
+
+	PFreadAhead(fd,pagenum);
+	if ( (error=PFbufGet(fd,pagenum,&fpage,PFreadfcn,PFwritefcn))!= PFE_OK)
 		return(error);
-	}
 
 	if (fpage->nextfree == PF_PAGE_USED){
 		/* page is used*/
@@ -584,25 +1530,39 @@ int error;
 		return(PFerrno);
 	}
 
+	if (PFisMapped(fd)){
+		PFerrno = PFE_READONLY;
+		return(PFerrno);
+	}
+
+	/* the free list and the # of pages change: one allocation
+	at a time */
+	PFfileLock(fd);
 	if (PFftab[fd].hdr.firstfree != PF_PAGE_LIST_END){
 		/* get a page from the free list */
 		*pagenum = PFftab[fd].hdr.firstfree;
 		if ((error=PFbufGet(fd,*pagenum,&fpage,PFreadfcn,
-					PFwritefcn))!= PFE_OK)
+					PFwritefcn))!= PFE_OK){
 			/* can't get the page */
+			PFfileUnlock(fd);
 			return(error);
+		}
 		PFftab[fd].hdr.firstfree = fpage->nextfree;
 		PFftab[fd].hdrchanged = TRUE;
 	}
 	else {
 		/* Free list empty, allocate one more page from the file */
 		*pagenum = PFftab[fd].hdr.numpages;
-		if ((error=PFbufAlloc(fd,*pagenum,&fpage,PFwritefcn))!= PFE_OK)
+		if ((error=PFmapGrow(fd,*pagenum)) != PFE_OK ||
+			(error=PFbufAlloc(fd,*pagenum,&fpage,PFwritefcn))!= PFE_OK){
 			/* can't allocate a page */
+			PFfileUnlock(fd);
 			return(error);
+		}
 	
 		/* increment # of pages for this file */
-		PFftab[fd].hdr.numpages++;
+		__atomic_store_n(&PFftab[fd].hdr.numpages,*pagenum+1,
+					__ATOMIC_RELEASE);
 		PFftab[fd].hdrchanged = TRUE;
 
 		/* mark this page dirty */
@@ -616,11 +1576,13 @@ int error;
 	/* zero out the page. Seems to be a nice thing to do,
 	at least for debugging. */
 	/*
-	bzero(fpage->pagebuf,PF_PAGE_SIZE);
+	bzero(fpage->pagebuf,PFpagesize(fd));
 	*/
 
 	/* Mark the new page used */
 	fpage->nextfree = PF_PAGE_USED;
+	PFmapSet(fd,*pagenum,TRUE);
+	PFfileUnlock(fd);
 
 	/* set return value */
 	*pagebuf = fpage->pagebuf;
@@ -634,7 +1596,8 @@ int pagenum;	/* page number */
 /****************************************************************************
 SPECIFICATIONS:
 	Dispose the page numbered "pagenum" of the file "fd".
-	Only a page that is not fixed in the buffer can be disposed.
+	Only a page that is not fixed in the buffer can be disposed:
+	PFE_PAGEFIXED is returned otherwise.
 
 AUTHOR: clc
 
@@ -657,8 +1620,13 @@ int error;
 		return(PFerrno);
 	}
 
-	if ((error=PFbufGet(fd,pagenum,&fpage,PFreadfcn,PFwritefcn))!= PFE_OK)
-		/* can't get this page */
+	if (PFisMapped(fd)){
+		PFerrno = PFE_READONLY;
+		return(PFerrno);
+	}
+
+	if ((error=PFbufGetSole(fd,pagenum,&fpage,PFreadfcn,PFwritefcn))!= PFE_OK)
+		/* can't get this page, or somebody has it fixed */
 		return(error);
 	
 	if (fpage->nextfree != PF_PAGE_USED){
@@ -672,9 +1640,12 @@ int error;
 	}
 
 	/* put this page into the free list */
+	PFfileLock(fd);
 	fpage->nextfree = PFftab[fd].hdr.firstfree;
 	PFftab[fd].hdr.firstfree = pagenum;
 	PFftab[fd].hdrchanged = TRUE;
+	PFmapSet(fd,pagenum,FALSE);
+	PFfileUnlock(fd);
 
 	/* unfix this page */
 	return(PFbufUnfix(fd,pagenum,TRUE));
@@ -687,7 +1658,8 @@ int dirty;	/* true if file is dirty */
 /****************************************************************************
 SPECIFICATIONS:
 	Tell the Paged File Interface that the page numbered "pagenum"
-	of the file "fd" is no longer needed in the buffer.
+	of the file "fd" is no longer needed in the buffer. This undoes
+	one fix: a page fixed several times stays fixed until the last.
 	Set the variable "dirty" to TRUE if page has been modified.
 
 AUTHOR: clc
@@ -709,6 +1681,25 @@ RETURN VALUE:
 		return(PFerrno);
 	}
 
+	if (PFisMapped(fd)){
+		if (__atomic_sub_fetch(&PFftab[fd].pins[pagenum],1,
+					__ATOMIC_RELAXED) < 0){
+			/* page already unfixed */
+			__atomic_fetch_add(&PFftab[fd].pins[pagenum],1,
+					__ATOMIC_RELAXED);
+			PFerrno = PFE_PAGEUNFIXED;
+			return(PFerrno);
+		}
+		__atomic_fetch_sub(&PFftab[fd].npinned,1,__ATOMIC_RELAXED);
+		/* the page is unfixed all the same: a mapping cannot be
+		written, so a dirty page is an error */
+		if (dirty){
+			PFerrno = PFE_READONLY;
+			return(PFerrno);
+		}
+		return(PFE_OK);
+	}
+
 	return(PFbufUnfix(fd,pagenum,dirty));
 }
 
@@ -732,19 +1723,190 @@ SPECIFICATIONS:
 		return(PFerrno);
 	}
 
+	if (PFisMapped(fd)){
+		PFerrno = PFE_READONLY;
+		return(PFerrno);
+	}
+
 	/* PFbufUsed finds the page, checks if fixed, 
 	   marks dirty, and moves to head of list */
 	return(PFbufUsed(fd, pagenum));
 }
 
 
+int PF_LatchPage(int fd, int pagenum, int mode)
+/****************************************************************************
+SPECIFICATIONS:
+	Latch the data of page "pagenum" of file "fd", which must be fixed,
+	in "mode" PF_LATCH_SHARED or PF_LATCH_EXCLUSIVE. See PFbufLatch().
+	A file opened with PF_MODE_MMAP cannot change, so shared latches
+	on its pages are not needed and not taken.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PFE_READONLY if an exclusive latch is asked for a mapped file.
+	PF error code if error.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+
+	if (PFinvalidPagenum(fd,pagenum)){
+		PFerrno = PFE_INVALIDPAGE;
+		return(PFerrno);
+	}
+
+	if (PFisMapped(fd)){
+		if (mode == PF_LATCH_EXCLUSIVE){
+			PFerrno = PFE_READONLY;
+			return(PFerrno);
+		}
+		return(PFE_OK);
+	}
+
+	return(PFbufLatch(fd,pagenum,mode == PF_LATCH_EXCLUSIVE));
+}
+
+
+int PF_UnlatchPage(int fd, int pagenum)
+/****************************************************************************
+SPECIFICATIONS:
+	Release a latch taken by PF_LatchPage().
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+
+	if (PFinvalidPagenum(fd,pagenum)){
+		PFerrno = PFE_INVALIDPAGE;
+		return(PFerrno);
+	}
+
+	if (PFisMapped(fd))
+		return(PFE_OK);
+
+	return(PFbufUnlatch(fd,pagenum));
+}
+
+
+int PF_Prefetch(int fd, int first, int count)
+/****************************************************************************
+SPECIFICATIONS:
+	Hint that pages "first" .. "first"+"count"-1 of file "fd" will be
+	needed soon. The part of the range beyond the end of the file is
+	ignored. See PFbufPrefetch(). For a file opened with PF_MODE_MMAP
+	this only asks the OS to read the range ahead.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PF error code if error.
+*****************************************************************************/
+{
+int error;
+off_t start, end;	/* PF_MODE_MMAP: range of the file to read */
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+
+	if (first < 0 || count < 0){
+		PFerrno = PFE_INVALIDPAGE;
+		return(PFerrno);
+	}
+
+	if (first + count > PFnumpages(fd))
+		count = PFnumpages(fd) - first;
+	if (count <= 0)
+		return(PFE_OK);
+
+	if (PFisMapped(fd)){
+		/* let the OS read the range into its page cache */
+		start = PFpageOffset(fd,first);
+		end = PFpageOffset(fd,first+count-1) + PFblocksize(fd);
+		if (end > (off_t)PFftab[fd].maplen)
+			end = PFftab[fd].maplen;
+		start -= start % sysconf(_SC_PAGESIZE);
+		if (end > start)
+			(void)madvise(PFftab[fd].mapbase+start,(size_t)(end-start),
+					MADV_WILLNEED);
+		return(PFE_OK);
+	}
+
+	if ((error=PFbufPrefetch(fd,first,count,PFreadvfcn,PFwritefcn)) < 0)
+		return(error);
+	return(PFE_OK);
+}
+
+
+int PF_FlushFile(int fd)
+/****************************************************************************
+SPECIFICATIONS:
+	Write out the dirty pages of file "fd" in the buffer, sorted and
+	coalesced (see PFbufFlush()), then its header and bitmap, and keep
+	the file open. Nothing is written for a file opened with
+	PF_MODE_MMAP.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PF error code if error.
+*****************************************************************************/
+{
+int error;
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+
+	if (PFisMapped(fd))
+		return(PFE_OK);
+
+	if ((error=PFbufFlush(fd,PFwritevfcn)) != PFE_OK)
+		return(error);
+	return(PFftabWriteHdr(fd));
+}
+
+
+int PF_SetWriteBehind(int percent)
+/****************************************************************************
+SPECIFICATIONS:
+	Keep "percent" percent of the buffer frames clean with a background
+	flusher, or stop it if "percent" is 0. See PFbufSetWriteBehind().
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PF error code if error.
+*****************************************************************************/
+{
+	return(PFbufSetWriteBehind(percent,PFwritevfcn));
+}
+
+
+void PF_SetReadAhead(int npages)
+/****************************************************************************
+SPECIFICATIONS:
+	Set the read-ahead window for sequential access. 0 disables it.
+*****************************************************************************/
+{
+	if (npages >= 0)
+		PFraPages = (npages > PF_PREFETCH_MAX) ? PF_PREFETCH_MAX : npages;
+}
+
+
 void PF_ResetStats(void)
 /****************************************************************************
 SPECIFICATIONS:
-	Wrapper for PFbufResetStats()
+	Wrapper for PFbufResetStats(), which also resets the detailed
+	statistics.
 *****************************************************************************/
 {
 	PFbufResetStats();
+	PFstatReset();
 }
 
 
@@ -757,6 +1919,52 @@ SPECIFICATIONS:
 	return PFbufGetStats(logical_reads, physical_reads, physical_writes);
 }
 
+
+int PF_GetFileStats(int fd, PF_FileStats *stats)
+/****************************************************************************
+SPECIFICATIONS:
+	Set *stats to the counters of file "fd" since it was opened.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PFE_FD	if "fd" is invalid.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	PFstatGetFile(fd,stats);
+	return(PFE_OK);
+}
+
+
+int PF_DumpStats(FILE *fp, int format)
+/****************************************************************************
+SPECIFICATIONS:
+	Write every statistic onto "fp" as JSON or CSV. The file table is
+	locked meanwhile, so no file is opened or closed.
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PFE_NOSTAT	if "format" is invalid.
+*****************************************************************************/
+{
+char *fnames[PF_FTAB_SIZE];	/* names of the open files */
+int i;
+
+	if (format != PF_STATS_JSON && format != PF_STATS_CSV){
+		PFerrno = PFE_NOSTAT;
+		return(PFerrno);
+	}
+	pthread_mutex_lock(&PFftablock);
+	for (i=0; i < PF_FTAB_SIZE; i++)
+		fnames[i] = PFftab[i].fname;
+	PFstatDump(fp,format,fnames);
+	pthread_mutex_unlock(&PFftablock);
+	return(PFE_OK);
+}
+
 /* error messages */
 static char *PFerrormsg[]={
 "No error",
@@ -781,6 +1989,14 @@ static char *PFerrormsg[]={
 "page already in hash table"
 };
 
+/* error messages of the codes from PFE_VERSION down */
+static char *PFerrormsg2[]={
+"unknown file format version",
+"file is open read-only",
+"no such histogram or counter",
+"invalid page size"
+};
+
 void PF_PrintError(s)
 char *s;	/* string to write */
 /****************************************************************************
@@ -796,7 +2012,9 @@ RETURN VALUE: none
 {
 
 	fprintf(stderr,"%s",s);
-	fprintf(stderr,":%s",PFerrormsg[-1*PFerrno]);
+	if (PFerrno <= PFE_VERSION)
+		fprintf(stderr,":%s",PFerrormsg2[PFE_VERSION - PFerrno]);
+	else	fprintf(stderr,":%s",PFerrormsg[-1*PFerrno]);
 	if (PFerrno == PFE_UNIX)
 		/* print the unix error message */
 		perror(" ");
@@ -1,4 +1,5 @@
 /* pf.h: externs and error codes for Paged File Interface*/
+#include <stdio.h>
 #ifndef TRUE
 #define TRUE 1		
 #endif
@@ -6,9 +7,40 @@
 #define FALSE 0
 #endif
 
+/* PF_OpenFileMode() modes */
+#define PF_MODE_RDWR 0		/* pages go through the buffer pool */
+#define PF_MODE_MMAP 1		/* read-only, pages served from a mapping */
+
+/* PF_LatchPage() modes */
+#define PF_LATCH_SHARED 0	/* several readers at once */
+#define PF_LATCH_EXCLUSIVE 1	/* one writer, no readers */
+
 /* Page Replacement Strategies */
 #define PF_STRAT_LRU 0
 #define PF_STRAT_MRU 1
+#define PF_STRAT_CLOCK 2	/* CLOCK sweep with one reference bit */
+#define PF_STRAT_2Q 3		/* simplified 2Q (A1in, A1out, Am queues) */
+#define PF_STRAT_LRU2 4		/* LRU-K with K = 2 */
+
+/* PF_DumpStats() formats */
+#define PF_STATS_JSON 0
+#define PF_STATS_CSV 1
+
+/* Latency histograms, see PF_StatsStart(). Bucket 0 counts latencies
+of less than 1 microsecond, bucket i those of 2^(i-1) to 2^i - 1
+microseconds, and the last bucket everything longer. */
+#define PF_HIST_READ 0		/* physical reads, one per system call */
+#define PF_HIST_WRITE 1		/* physical writes, one per system call */
+#define PF_HIST_RHFINSERT 2	/* RHF_InsertRecord() */
+#define PF_HIST_AMSEARCH 3	/* AM_Search() */
+#define PF_HIST_NUM 4
+#define PF_HIST_BUCKETS 24
+
+/* Event counters, see PF_StatsCount() */
+#define PF_CNT_NOBUF 0		/* frames asked for with every frame fixed */
+#define PF_CNT_AMSPLIT 1	/* AM index nodes split */
+#define PF_CNT_AMSCANPAGES 2	/* leaves AM index scans went on to */
+#define PF_CNT_NUM 3
 
 /************** Error Codes *********************************/
 #define PFE_OK		0	/* OK */
@@ -34,16 +66,31 @@
 #define PFE_HASHNOTFOUND -18	/* hash table entry not found */
 #define PFE_HASHPAGEEXIST -19	/* page already exist in hash table */
 
+/* Codes from -20 to -49 belong to the RHF, SORT and PAX layers, which
+pass PF codes through, so further PF codes start at -50 */
+#define PFE_VERSION	-50	/* unknown file format version */
+#define PFE_READONLY	-51	/* file is open read-only */
+#define PFE_NOSTAT	-52	/* no such histogram or counter */
+#define PFE_PAGESIZE	-53	/* invalid page size */
 
-/* page size */
+
+/* page size: the default, and the smallest one. A file may have pages
+of any power of two from PF_PAGE_SIZE to PF_MAX_PAGE_SIZE bytes, see
+PF_CreateFileSize(). */
 #define PF_PAGE_SIZE	4096
+#define PF_MAX_PAGE_SIZE	65536
 
 /* externs from the PF layer */
-extern int PFerrno;		/* error number of last error */
+extern __thread int PFerrno;	/* error number of last error, one
+				per thread */
 extern void PF_Init();
 extern int PF_CreateFile(char *fname);
 extern int PF_DestroyFile(char *fname);
 extern int PF_OpenFile(char *fname);
+extern int PF_OpenFileMode(char *fname, int mode);
+extern int PF_FileMode(int fd);
+extern int PF_FileStamp(int fd);
+extern int PF_NumPages(int fd);
 extern int PF_CloseFile(int fd);
 extern int PF_GetFirstPage(int fd, int *pagenum, char **pagebuf);
 extern int PF_GetNextPage(int fd, int *pagenum, char **pagebuf);
@@ -53,6 +100,33 @@ extern int PF_DisposePage(int fd, int pagenum);
 extern int PF_UnfixPage(int fd, int pagenum, int dirty);
 extern void PF_PrintError(char *s);
 
+/**
+ * @brief Converts a paged file from the old (version 1) format, whose
+ * pages are not block aligned, to the current format, in place.
+ * Files already in the current format are left alone.
+ * @param fname Name of the file, which must not be open.
+ * @return PFE_OK on success, or an error code.
+ */
+extern int PF_ConvertFile(char *fname);
+
+/**
+ * @brief Creates a paged file with pages of "pagesize" bytes.
+ * PF_CreateFile() makes files with pages of PF_PAGE_SIZE bytes.
+ * @param fname Name of the file, which must not exist.
+ * @param pagesize A power of two from PF_PAGE_SIZE to PF_MAX_PAGE_SIZE.
+ * @return PFE_OK on success, PFE_PAGESIZE if "pagesize" is invalid,
+ * or another error code.
+ */
+extern int PF_CreateFileSize(char *fname, int pagesize);
+
+/**
+ * @brief Tells the page size of an open file: the # of bytes of the
+ * data of each of its pages.
+ * @param fd File descriptor.
+ * @return The page size, or PFE_FD.
+ */
+extern int PF_PageSize(int fd);
+
 /* --- NEW FUNCTIONS TO BE ADDED --- */
 
 /**
@@ -62,9 +136,27 @@ extern void PF_PrintError(char *s);
  */
 extern void PF_SetBufferSize(int size);
 
+/**
+ * @brief Gets the size of the buffer pool.
+ * @return Number of pages the buffer pool has, or will have once allocated.
+ */
+extern int PF_GetBufferSize(void);
+
+/**
+ * @brief Asks for the buffer pool to be backed by huge pages.
+ * Must be called before any files are opened. Falls back to normal
+ * pages (with a transparent huge page hint) if none are available.
+ * @param on TRUE to use huge pages, FALSE for normal pages (default).
+ */
+extern void PF_SetHugePages(int on);
+
 /**
  * @brief Sets the global page replacement strategy.
- * @param strategy PF_STRAT_LRU or PF_STRAT_MRU.
+ * May be changed while pages are buffered; the buffered pages then
+ * start over as if referenced once, in their current LRU order.
+ * PF_Init() resets it to PF_STRAT_LRU.
+ * @param strategy PF_STRAT_LRU, PF_STRAT_MRU, PF_STRAT_CLOCK, PF_STRAT_2Q
+ *        or PF_STRAT_LRU2. Other values are ignored.
  */
 extern void PF_SetStrategy(int strategy);
 
@@ -77,6 +169,65 @@ extern void PF_SetStrategy(int strategy);
  */
 extern int PF_MarkDirty(int fd, int pagenum);
 
+/**
+ * @brief Latches the data of a fixed page for reading or writing.
+ * The buffer manager may be used by several threads at once: fixing a
+ * page keeps it in memory, and the latch keeps other threads from
+ * reading it while it is being changed. Threads that share a page take
+ * PF_LATCH_SHARED to read it and PF_LATCH_EXCLUSIVE to change it, and
+ * release the latch before unfixing the page. Latches are not recursive.
+ * @param fd File descriptor.
+ * @param pagenum Page number, fixed by the caller.
+ * @param mode PF_LATCH_SHARED or PF_LATCH_EXCLUSIVE.
+ * @return PFE_OK on success, or an error code.
+ */
+extern int PF_LatchPage(int fd, int pagenum, int mode);
+
+/**
+ * @brief Releases a latch taken with PF_LatchPage().
+ * @return PFE_OK on success, or an error code.
+ */
+extern int PF_UnlatchPage(int fd, int pagenum);
+
+/**
+ * @brief Hints that pages [first, first+count) will be needed soon.
+ * Pages not in the buffer are read with one vectored read per run into
+ * unfixed buffer frames, so later fixes are buffer hits. At most a
+ * quarter of the buffer pool is used by one call. This is only a hint:
+ * running out of free frames is not an error.
+ * @return PFE_OK, or an error code for an invalid fd/page or I/O error.
+ */
+extern int PF_Prefetch(int fd, int first, int count);
+
+/**
+ * @brief Writes out the dirty pages of a file that are in the buffer,
+ * without closing it, and writes its header.
+ * The pages are written in page order, each run of consecutive pages
+ * with one vectored write, and stay in the buffer clean. Pages fixed
+ * meanwhile are left dirty.
+ * @param fd File descriptor.
+ * @return PFE_OK on success, or an error code.
+ */
+extern int PF_FlushFile(int fd);
+
+/**
+ * @brief Turns write-behind on or off.
+ * With write-behind on, a background thread writes dirty pages out,
+ * least recently used first and sorted as by PF_FlushFile(), whenever
+ * fewer than the given share of the buffer frames is clean, so that
+ * misses seldom wait for the write of a victim. PF_Init() turns it off.
+ * @param percent Percentage of the frames to keep clean, 1 to 100,
+ *        or 0 to turn write-behind off (default).
+ * @return PFE_OK on success, or an error code.
+ */
+extern int PF_SetWriteBehind(int percent);
+
+/**
+ * @brief Sets the read-ahead window used when a file is read sequentially.
+ * @param npages Pages to read ahead, or 0 to disable read-ahead.
+ */
+extern void PF_SetReadAhead(int npages);
+
 /**
  * @brief Resets the I/O statistics counters to zero.
  */
@@ -91,4 +242,82 @@ extern void PF_ResetStats(void);
  */
 extern int PF_GetStats(long *logical_reads, 
                        long *physical_reads, 
-                       long *physical_writes);
\ No newline at end of file
+                       long *physical_writes);
+
+/*
+ * Counters of one open file, kept while the detailed statistics are
+ * on (see PF_SetStats()), from when the file was opened.
+ */
+typedef struct {
+    long hits;            /* pages found in the buffer */
+    long misses;          /* pages read because they were not */
+    long evictions;       /* pages replaced to make room for others */
+    long dirty_evictions; /* of those, pages written out first */
+    long prefetch_hits;   /* prefetched pages found in the buffer */
+    long reads;           /* pages read, prefetches included */
+    long writes;          /* pages written */
+} PF_FileStats;
+
+/**
+ * @brief Turns the detailed statistics (per-file counters, latency
+ * histograms and event counters) on or off. They are off by default,
+ * and are not compiled in at all with PF_NO_STATS. The counters of
+ * PF_GetStats() are always kept.
+ * @param on TRUE to keep them, FALSE to stop.
+ */
+extern void PF_SetStats(int on);
+
+/**
+ * @brief Retrieves the counters of an open file.
+ * @param fd File descriptor.
+ * @param stats Set to the counters.
+ * @return PFE_OK, or PFE_FD for an invalid fd.
+ */
+extern int PF_GetFileStats(int fd, PF_FileStats *stats);
+
+/**
+ * @brief Retrieves a latency histogram.
+ * @param hist One of the PF_HIST_* values.
+ * @param counts Set to the PF_HIST_BUCKETS counts of the histogram.
+ * @return PFE_OK, or PFE_NOSTAT for an invalid hist.
+ */
+extern int PF_GetHistogram(int hist, long *counts);
+
+/**
+ * @brief Retrieves an event counter.
+ * @param counter One of the PF_CNT_* values.
+ * @return The count, or PFE_NOSTAT for an invalid counter.
+ */
+extern long PF_GetCounter(int counter);
+
+/**
+ * @brief Starts timing an operation for a latency histogram.
+ * @return A start time for PF_StatsEnd(), or 0 if the statistics are off.
+ */
+extern long PF_StatsStart(void);
+
+/**
+ * @brief Records the latency of an operation in a histogram.
+ * @param hist One of the PF_HIST_* values.
+ * @param start What PF_StatsStart() returned; nothing is recorded if 0.
+ */
+extern void PF_StatsEnd(int hist, long start);
+
+/**
+ * @brief Adds to an event counter, if the statistics are on.
+ * @param counter One of the PF_CNT_* values.
+ * @param n Amount to add.
+ */
+extern void PF_StatsCount(int counter, long n);
+
+/**
+ * @brief Writes every statistic: the counters of PF_GetStats(), the
+ * counters of each open file, the event counters and the histograms.
+ * PF_STATS_JSON writes one JSON object. PF_STATS_CSV writes lines of
+ * "kind,name,key,value", with the kinds "global", "file", "counter"
+ * and "hist" (whose key is the bucket number).
+ * @param fp Where to write them.
+ * @param format PF_STATS_JSON or PF_STATS_CSV.
+ * @return PFE_OK on success, or PFE_NOSTAT for an invalid format.
+ */
+extern int PF_DumpStats(FILE *fp, int format);
\ No newline at end of file
@@ -0,0 +1,24 @@
+/* pfconvert.c: converts paged files to the current (page aligned) format */
+#include <stdio.h>
+#include "pf.h"
+
+int main(int argc, char *argv[])
+{
+int i;
+int status = 0;
+
+	if (argc < 2){
+		fprintf(stderr,"usage: %s file ...\n",argv[0]);
+		return(1);
+	}
+
+	PF_Init();
+	for (i=1; i < argc; i++){
+		if (PF_ConvertFile(argv[i]) != PFE_OK){
+			PF_PrintError(argv[i]);
+			status = 1;
+		}
+		else	printf("%s: converted\n",argv[i]);
+	}
+	return(status);
+}
@@ -1,27 +1,64 @@
 /* pftypes.h: declarations for Paged File interface */
+#include <pthread.h>
 
 /**************************** File Page Decls *********************/
 /* Each file contains a header, which is a integer pointing
 to the first free page, or -1 if no more free pages in the file.
-Followed by this header are the file pages as declared in struct PFfpage */
+There are two file formats:
+
+Version 1 (old files): the header is followed by the file pages,
+PF_FPAGE_SIZE bytes each: the "nextfree" field of struct PFfpage
+followed by the page data. Pages are not aligned on disk blocks.
+
+Version 2 (PF_VERSION): the file is a sequence of blocks of the page
+size of the file, chosen when it is created (PF_PAGE_SIZE for version
+1 files). Block 0 holds a PFhdrpage_str. Then come groups of one
+bitmap block, with one bit set for every used page of the group,
+followed by PF_MAP_PAGES(size) data pages. The data of a free page starts
+with its "nextfree" link. Old files are converted by PF_ConvertFile(). */
 typedef struct PFhdr_str {
 	int	firstfree;	/* first free page in the linked list of
 				free pages */
 	int	numpages;	/* # of pages in the file */
 } PFhdr_str;
 
-#define PF_HDR_SIZE sizeof(PFhdr_str)	/* size of file header */
+#define PF_HDR_SIZE sizeof(PFhdr_str)	/* size of version 1 file header */
+
+#define PF_MAGIC	0x32644650	/* "PFd2": starts a version 2 file */
+#define PF_VERSION_1	1	/* old format, no magic number */
+#define PF_VERSION	2	/* format of new files */
+
+/* block 0 of a version 2 file */
+typedef struct PFhdrpage_str {
+	int	magic;		/* PF_MAGIC */
+	int	version;	/* PF_VERSION */
+	PFhdr_str hdr;		/* file header */
+	int	pagesize;	/* page size, or 0 in files made before page
+				sizes could be chosen: PF_PAGE_SIZE */
+} PFhdrpage_str;
 
-/* actual page struct to be written onto the file */
+/* version 2, with pages of "size" bytes: # of pages covered by one
+bitmap block, and the block of the bitmap covering page "p" and of
+page "p" itself */
+#define PF_MAP_PAGES(size)	((size)*8)
+#define PF_MAP_BLOCK(p,size)	(1 + ((p)/PF_MAP_PAGES(size))*(PF_MAP_PAGES(size)+1))
+#define PF_PAGE_BLOCK(p,size)	(PF_MAP_BLOCK(p,size) + 1 + (p)%PF_MAP_PAGES(size))
+
+/* file page in memory. The data is kept apart in the buffer pool arena,
+so that it is aligned on PF_PAGE_SIZE, or for larger pages in a block
+of its own aligned on its size */
 #define PF_PAGE_LIST_END	-1	/* end of list of free pages */
 #define PF_PAGE_USED		-2	/* page is being used */
 typedef struct PFfpage {
 	int nextfree;	/* page number of next free page in the linked
 			list of free pages, or PF_PAGE_LIST_END if
 			end of list, or PF_PAGE_USED if this page is not free */
-	char pagebuf[PF_PAGE_SIZE];	/* actual page data */
+	char *pagebuf;	/* actual page data, the page size of the file */
 } PFfpage;
 
+#define PF_FPAGE_SIZE	(sizeof(int) + PF_PAGE_SIZE)	/* size of a page
+							in a version 1 file */
+
 /*************************** Opened File Table **********************/
 #define PF_FTAB_SIZE	20	/* size of open file table */
 
@@ -31,44 +68,116 @@ typedef struct PFftab_ele {
 	int unixfd;	/* unix file descriptor*/
 	PFhdr_str hdr;	/* file header */
 	short hdrchanged; /* TRUE if file header has changed */
+	int version;	/* PF_VERSION_1 or PF_VERSION */
+	int pagesize;	/* page size of the file */
+	unsigned char *usedmap;	/* version 2: bitmap of used pages,
+				"pagesize" bytes per group, or NULL */
+	int mapgroups;	/* # of groups in usedmap */
+	short mapchanged; /* TRUE if usedmap has changed */
+	char *mapbase;	/* PF_MODE_MMAP: mapping of the file, else NULL */
+	size_t maplen;	/* # of bytes mapped */
+	int *pins;	/* PF_MODE_MMAP: # of fixes of each page */
+	int npinned;	/* PF_MODE_MMAP: total # of fixes */
+	int lastpage;	/* last page requested, for sequential detection */
+	int seqrun;	/* # of consecutive sequential requests */
+	int ranext;	/* first page not yet covered by read-ahead */
+	int stamp;	/* tells this opening from others of the slot */
+	pthread_mutex_t lock;	/* protects hdr and usedmap while the file
+				is open (recursive); read-ahead only takes
+				it to claim a window */
 } PFftab_ele;
 
+/*************************** Read-ahead **************************/
+#define PF_PREFETCH_MAX	32	/* max # of pages read by one prefetch */
+#define PF_RA_DEFAULT	8	/* default read-ahead window in pages */
+#define PF_RA_TRIGGER	2	/* # of sequential requests before read-ahead */
+
+/*************************** Write-behind ************************/
+#define PF_FLUSH_MAX	64	/* max # of pages claimed at once by a flush */
+#define PF_WB_RETRY_MS	10	/* wait of the flusher when every dirty page
+				is fixed */
+
 /************************** Buffer Page Decls *********************/
 #define PF_MAX_BUFS	20	/* max # of buffers */
+#define PF_HUGE_PAGE_SIZE	(2*1024*1024)	/* arena rounding for huge pages */
+
+/* Replacement queues used by PF_STRAT_2Q and PF_STRAT_LRU2 */
+#define PF_Q_NONE	-1	/* not on a queue */
+#define PF_Q_FIRST	0	/* 2Q: A1in. LRU-2: referenced once */
+#define PF_Q_HOT	1	/* 2Q: Am. LRU-2: referenced twice or more */
+#define PF_LRU2_CRP	1	/* LRU-2: a re-reference with fewer than
+				this many references to other pages since
+				the last one is correlated */
 
-/* buffer page decl */
+/* buffer page decl. The buffer pages are one dense array, and their
+data one aligned arena: see PFbufArenaAlloc().
+Locking: "pincount", "io", "dirty" and "prefetched" are protected by the hash table
+partition of the page (PFhashLock()), and the list and queue links
+(including the list of the pages of the file) and the replacement fields
+by the buffer lock in buf.c. "latch" is taken by
+users of the page data, only while it is fixed. */
 typedef struct PFbpage {
 	struct PFbpage *nextpage;	/* next in the linked list of
 					buffer page */
 	struct PFbpage *prevpage;	/* previous in the linked list
 					of buffer pages */
+	struct PFbpage *fnext;		/* next page of the same file */
+	struct PFbpage *fprev;		/* previous page of the same file */
 	short	dirty:1,		/* TRUE if page is dirty */
-		fixed:1;		/* TRUE if page is fixed in buffer*/
+		io:1,			/* TRUE while the page is being read
+					or written out: wait, see PFhashWait() */
+		prefetched:1;		/* TRUE if prefetched and not fixed
+					since, for the statistics */
+	short	ref;			/* CLOCK reference bit (not in the
+					bit field above: other lock) */
+	int	pincount;		/* # of fixes of the page, 0 if
+					it can be replaced */
+	short	queue;			/* 2Q/LRU-2 queue, or PF_Q_NONE */
+	struct PFbpage *qnext;		/* next in that queue */
+	struct PFbpage *qprev;		/* previous in that queue */
+	long	lastref;		/* LRU-2: time of last reference,
+					or 0 if never referenced */
+	long	prevref;		/* LRU-2: time of the reference
+					before that, or 0 */
+	int	hotidx;			/* LRU-2: slot in the PF_Q_HOT heap */
+	int	bufsize;		/* # of bytes fpage.pagebuf can hold */
 	int	page;			/* page number of this page */
 	int	fd;			/* file desciptor of this page */
-	PFfpage fpage; /* page data from the file */
+	PFfpage fpage; /* page from the file, data in the arena */
+	pthread_rwlock_t latch;		/* shared/exclusive latch on the data */
 } PFbpage;
 
 
 
 /******************** Hash Table Decls ****************************/
-#define PF_HASH_TBL_SIZE	20	/* size of PF hash table */
+#define PF_HASH_PART_BITS	4	/* log2 of the # of partitions */
+#define PF_HASH_PARTS	(1 << PF_HASH_PART_BITS) /* # of partitions, each
+					with its own lock */
+#define PF_HASH_MIN_SIZE	8	/* min # of slots in a partition */
 
-/* Hash table bucket entries*/
+/* Hash table slot. The table uses open addressing with linear probing,
+so entries live inline in one array; fd == PF_HASH_EMPTY marks a free slot */
+#define PF_HASH_EMPTY	-1
 typedef struct PFhash_entry {
-	struct PFhash_entry *nextentry; /* next hash table element, or NULL */
-	struct PFhash_entry *preventry;/*previous hash table element,or NULL*/
-	int fd;		/* file descriptor */
+	int fd;		/* file descriptor, or PF_HASH_EMPTY */
 	int page;	/* page number */
 	struct PFbpage *bpage; /* pointer to buffer holding this page */
 } PFhash_entry;
 
-/* Hash function for hash table */
-#define PFhash(fd,page) (((fd)+(page)) % PF_HASH_TBL_SIZE)
+/* Hash function for hash table: mixes fd and page so that neighbouring
+pages of different files do not collide. Take it modulo the table size. */
+#define PFhash(fd,page) PFhashMix((unsigned)(fd)*0x9E3779B1u ^ (unsigned)(page))
 
 /******************* Interface functions from Hash Table ****************/
 /* --- MODIFIED --- */
 extern void PFhashInit(void);
+extern void PFhashReserve(int nentries);
+extern void PFhashLock(int fd, int page);
+extern int PFhashTryLock(int fd, int page);
+extern void PFhashUnlock(int fd, int page);
+extern void PFhashWait(int fd, int page);
+extern void PFhashWakeup(int fd, int page);
+extern unsigned PFhashMix(unsigned key);
 extern PFbpage *PFhashFind(int fd, int page);
 extern int PFhashInsert(int fd, int page, PFbpage *bpage);
 extern int PFhashDelete(int fd, int page);
@@ -78,12 +187,54 @@ extern void PFhashPrint(void);
 /* --- MODIFIED --- */
 extern void PFbufInit(void);
 extern int PFbufGet(int fd, int pagenum, PFfpage **fpage, int (*readfcn)(), int (*writefcn)());
+extern int PFbufGetSole(int fd, int pagenum, PFfpage **fpage, int (*readfcn)(), int (*writefcn)());
 extern int PFbufUnfix(int fd, int pagenum, int dirty);
 extern int PFbufAlloc(int fd, int pagenum, PFfpage **fpage, int (*writefcn)());
-extern int PFbufReleaseFile(int fd, int (*writefcn)());
+extern int PFbufReleaseFile(int fd, int (*writefcn)(), int (*writevfcn)());
 extern int PFbufUsed(int fd, int pagenum);
+extern int PFbufPrefetch(int fd, int first, int count, int (*readvfcn)(), int (*writefcn)());
+extern int PFbufFlush(int fd, int (*writevfcn)());
+extern int PFbufSetWriteBehind(int percent, int (*writevfcn)());
+extern int PFbufLatch(int fd, int pagenum, int exclusive);
+extern int PFbufUnlatch(int fd, int pagenum);
+extern void PFbufSetPageSize(int fd, int size);
 extern void PFbufPrint(void);
 
 /* --- NEW --- */
 extern void PFbufResetStats(void);
 extern int PFbufGetStats(long *logical_reads, long *physical_reads, long *physical_writes);
+
+/****************** Statistics (stats.c) *************************/
+/* The detailed statistics are kept only while PFstatson is TRUE, and
+are not compiled in with PF_NO_STATS. */
+#ifndef PF_NO_STATS
+extern int PFstatson;
+extern PF_FileStats PFfilestats[PF_FTAB_SIZE];
+#define PFstatOn()	__atomic_load_n(&PFstatson,__ATOMIC_RELAXED)
+
+/* add "n" to counter "field" of file "fd" */
+#define PFstatFile(fd,field,n) { \
+	if (PFstatOn()) \
+		__atomic_fetch_add(&PFfilestats[fd].field,(n),__ATOMIC_RELAXED); \
+}
+
+/* start and end the timing of an operation for histogram "hist" */
+#define PFstatStart()	(PFstatOn() ? PFstatClock() : 0L)
+#define PFstatEnd(hist,start) { \
+	if ((start) != 0) \
+		PFstatRecord(hist,start); \
+}
+#else
+#define PFstatOn()	FALSE
+#define PFstatFile(fd,field,n)	{ }
+#define PFstatStart()	0L
+#define PFstatEnd(hist,start)	{ }
+#endif
+
+extern long PFstatClock(void);
+extern void PFstatRecord(int hist, long start);
+extern void PFstatCount(int counter, long n);
+extern void PFstatReset(void);
+extern void PFstatResetFile(int fd);
+extern void PFstatGetFile(int fd, PF_FileStats *stats);
+extern void PFstatDump(FILE *fp, int format, char **fnames);
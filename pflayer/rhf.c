@@ -2,66 +2,489 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "rhf.h"
 
+/* # of pages hinted to PF when a scan starts */
+#define RHF_SCAN_PREFETCH 8
+
+/* # of pages handed out at once to a worker of a parallel scan */
+#define RHF_MORSEL_PAGES 16
+
 /*
  * Helper function to initialize a new page as a slotted page
  */
-static void rhf_InitPage(char *page)
+static void rhf_InitPage(char *page, int pageSize)
 {
     RHF_PageHeader *header = GET_HEADER(page);
     header->numSlots = 0;
     //* Free space starts at the END of the page */
-    header->freeSpacePtr = PF_PAGE_SIZE; 
+    header->freeSpacePtr = pageSize;
     header->nextFreeSlot = -1; /* No free slots yet */
 }
 
+/*
+ * Helper function to compute how many contiguous bytes a new record can use
+ * on a data page, counting the slot it would need if no deleted slot is free.
+ */
+static int rhf_PageFreeBytes(char *page)
+{
+    RHF_PageHeader *header = GET_HEADER(page);
+    int freeSpace = header->freeSpacePtr -
+        (int)(sizeof(RHF_PageHeader) + header->numSlots * sizeof(RHF_Slot));
+
+    if (header->nextFreeSlot == -1)
+        freeSpace -= sizeof(RHF_Slot);
+    return (freeSpace > 0) ? freeSpace : 0;
+}
+
+/*
+ * Helper function to compute the bytes held by deleted records, i.e. the
+ * bytes between freeSpacePtr and the end of the page that no live slot uses.
+ * Sets *numLive to the number of live records if it is not NULL.
+ */
+static int rhf_PageDeadBytes(char *page, int pageSize, int *numLive)
+{
+    RHF_PageHeader *header = GET_HEADER(page);
+    int i, live = 0, used = 0;
+    RHF_Slot *slot;
+
+    for (i = 0; i < header->numSlots; i++) {
+        slot = GET_SLOT(page, i);
+        if (slot->recordLength != -1) {
+            used += slot->recordLength;
+            live++;
+        }
+    }
+    if (numLive != NULL) *numLive = live;
+    return (pageSize - header->freeSpacePtr) - used;
+}
+
+/* Bytes a new record can use once the page has been compacted */
+#define rhf_PageAvailBytes(page, pageSize) \
+    (rhf_PageFreeBytes(page) + rhf_PageDeadBytes(page, pageSize, NULL))
+
+/*
+ * Helper function to compact a data page: slide the live records together
+ * at the end of the page so the bytes of deleted records join the free
+ * space. Slot numbers do not change, so RIDs stay valid. Trailing deleted
+ * slots are dropped and the free slot list is rebuilt in slot order.
+ * Returns RHF_NOMEM, with the page unchanged, if no copy can be made.
+ */
+static int rhf_CompactPage(char *page, int pageSize)
+{
+    RHF_PageHeader *header = GET_HEADER(page);
+    char *tempPage; /* live records are copied here first */
+    int ptr = pageSize;
+    int i, lastUsed = -1, freeHead = -1;
+    RHF_Slot *slot;
+
+    if ((tempPage = (char *)malloc(pageSize)) == NULL) {
+        return RHF_NOMEM;
+    }
+    for (i = 0; i < header->numSlots; i++) {
+        slot = GET_SLOT(page, i);
+        if (slot->recordLength == -1) continue;
+        ptr -= slot->recordLength;
+        memcpy(tempPage + ptr, GET_RECORD(page, slot), slot->recordLength);
+        slot->recordOffset = ptr;
+        lastUsed = i;
+    }
+    memcpy(page + ptr, tempPage + ptr, pageSize - ptr);
+    free(tempPage);
+    header->freeSpacePtr = ptr;
+
+    header->numSlots = lastUsed + 1;
+    for (i = header->numSlots - 1; i >= 0; i--) {
+        slot = GET_SLOT(page, i);
+        if (slot->recordLength == -1) {
+            slot->recordOffset = freeHead;
+            freeHead = i;
+        }
+    }
+    header->nextFreeSlot = freeHead;
+    return RHF_OK;
+}
+
+/* FSM entry for a page with 'bytes' free, and the smallest entry that
+   guarantees room for a record of 'length' bytes, in a file with pages
+   of 'pageSize' bytes. Entry 0 is also that of the header and map pages,
+   so even an empty record needs entry 1. */
+#define RHF_FSM_CAT(bytes, pageSize) \
+    ((bytes) >> RHF_FSM_SHIFT(pageSize))
+#define RHF_FSM_NEED(length, pageSize) \
+    (((length) > 0) ? \
+     (((length) + (1 << RHF_FSM_SHIFT(pageSize)) - 1) >> RHF_FSM_SHIFT(pageSize)) : 1)
+
+/*
+ * Helpers to fix/unfix directory block b while the header page is fixed.
+ * Block 0 is the header page itself, so it is never fixed twice; changes
+ * to it are folded into *hdrDirty instead. The blocks before b are fixed
+ * and unfixed in turn on the way.
+ */
+static int rhf_UnfixDirBlock(int fd, char *hdrBuf, char *dirBuf, int dirty, int *hdrDirty)
+{
+    if (dirBuf == hdrBuf) {
+        if (dirty) *hdrDirty = TRUE;
+        return PFE_OK;
+    }
+    return PF_UnfixPage(fd, ((RHF_FileHeader *)dirBuf)->mapPages[0], dirty);
+}
+
+static int rhf_FixDirBlock(int fd, char *hdrBuf, int b, char **dirBuf)
+{
+    char *buf = hdrBuf;
+    char *next;
+    int error, nextDir;
+
+    for (; b > 0; b--) {
+        nextDir = ((RHF_FileHeader *)buf)->nextDir;
+        error = PF_GetThisPage(fd, nextDir, &next);
+        if (rhf_UnfixDirBlock(fd, hdrBuf, buf, FALSE, NULL) != PFE_OK
+            && error == PFE_OK) {
+            error = PFerrno;
+            PF_UnfixPage(fd, nextDir, FALSE);
+        }
+        if (error != PFE_OK) {
+            return error;
+        }
+        buf = next;
+    }
+    *dirBuf = buf;
+    return PFE_OK;
+}
+
+/*
+ * Helpers to fix/unfix entry i of the fixed directory block dirBuf.
+ * Entry 0 is the page holding the block, so it is never fixed twice;
+ * changes to it are folded into *dirDirty instead.
+ */
+static int rhf_FixMapPage(int fd, char *dirBuf, int i, char **mapBuf)
+{
+    if (i == 0) {
+        *mapBuf = dirBuf;
+        return PFE_OK;
+    }
+    return PF_GetThisPage(fd, ((RHF_FileHeader *)dirBuf)->mapPages[i], mapBuf);
+}
+
+static int rhf_UnfixMapPage(int fd, char *dirBuf, int i, int dirty, int *dirDirty)
+{
+    if (i == 0) {
+        if (dirty) *dirDirty = TRUE;
+        return PFE_OK;
+    }
+    return PF_UnfixPage(fd, ((RHF_FileHeader *)dirBuf)->mapPages[i], dirty);
+}
+
+/*
+ * Helper function to set the FSM entry of 'pageNum'. The header page must
+ * be fixed and the map must already cover 'pageNum'.
+ */
+static int rhf_SetFSMEntry(int fd, char *hdrBuf, int pageNum, int category, int *hdrDirty)
+{
+    int entries = RHF_FSM_ENTRIES(PF_PageSize(fd));
+    int k = pageNum / entries;
+    int i = k % RHF_DIR_MAPPAGES;
+    RHF_FileHeader *dir;
+    char *dirBuf, *mapBuf;
+    int error, dirDirty = FALSE;
+
+    if ((error = rhf_FixDirBlock(fd, hdrBuf, k / RHF_DIR_MAPPAGES, &dirBuf)) != PFE_OK) {
+        return error;
+    }
+    dir = (RHF_FileHeader *)dirBuf;
+
+    if ((error = rhf_FixMapPage(fd, dirBuf, i, &mapBuf)) == PFE_OK) {
+        GET_FSM(mapBuf)[pageNum % entries] = (unsigned char)category;
+
+        /* mapMax only has to be an upper bound, so it is never lowered here */
+        if (category > dir->mapMax[i]) {
+            dir->mapMax[i] = (unsigned char)category;
+            dirDirty = TRUE;
+        }
+        error = rhf_UnfixMapPage(fd, dirBuf, i, TRUE, &dirDirty);
+    }
+
+    if (rhf_UnfixDirBlock(fd, hdrBuf, dirBuf, dirDirty, hdrDirty) != PFE_OK
+        && error == PFE_OK) {
+        error = PFerrno;
+    }
+    return error;
+}
+
+/*
+ * Helper function to allocate one more map page. The header page must be
+ * fixed. Every RHF_DIR_MAPPAGES map pages, the new page also starts a new
+ * directory block. The new map page gets an FSM entry of 0 so it is never
+ * picked for records.
+ */
+static int rhf_AllocMapPage(int fd, char *hdrBuf, int *hdrDirty)
+{
+    RHF_FileHeader *fh = (RHF_FileHeader *)hdrBuf;
+    RHF_FileHeader *mh;
+    int b = fh->numMapPages / RHF_DIR_MAPPAGES;
+    int i = fh->numMapPages % RHF_DIR_MAPPAGES;
+    int error, pnum;
+    char *buf, *dirBuf;
+
+    if ((error = PF_AllocPage(fd, &pnum, &buf)) != PFE_OK) {
+        return error;
+    }
+    memset(buf, 0, PF_PageSize(fd));
+    mh = (RHF_FileHeader *)buf;
+    mh->mapMark = RHF_MAPPAGE;
+    mh->nextDir = -1;
+    mh->mapPages[0] = pnum;
+
+    if ((error = PF_UnfixPage(fd, pnum, TRUE)) != PFE_OK) {
+        return error;
+    }
+
+    /* List the page in its block, or link its block from the last one */
+    if ((error = rhf_FixDirBlock(fd, hdrBuf, (i == 0) ? b - 1 : b, &dirBuf)) != PFE_OK) {
+        return error;
+    }
+    mh = (RHF_FileHeader *)dirBuf;
+    if (i == 0) {
+        mh->nextDir = pnum;
+    } else {
+        mh->mapPages[i] = pnum;
+        mh->mapMax[i] = 0;
+    }
+    if ((error = rhf_UnfixDirBlock(fd, hdrBuf, dirBuf, TRUE, hdrDirty)) != PFE_OK) {
+        return error;
+    }
+    fh->numMapPages++;
+    *hdrDirty = TRUE;
+
+    /* The page may have been a data page that went back to the PF free
+       list, so clear its entry if the map covers it */
+    if (pnum / RHF_FSM_ENTRIES(PF_PageSize(fd)) < fh->numMapPages) {
+        return rhf_SetFSMEntry(fd, hdrBuf, pnum, 0, hdrDirty);
+    }
+    return PFE_OK;
+}
+
+/*
+ * Helper function to record 'category' as the FSM entry of 'pageNum',
+ * growing the map if the page is not covered yet.
+ */
+static int rhf_SetPageSpace(int fd, int pageNum, int category)
+{
+    char *hdrBuf;
+    RHF_FileHeader *fh;
+    int error, hdrDirty = FALSE;
+    int entries = RHF_FSM_ENTRIES(PF_PageSize(fd));
+
+    if ((error = PF_GetThisPage(fd, RHF_HDR_PAGE, &hdrBuf)) != PFE_OK) {
+        return error;
+    }
+    fh = (RHF_FileHeader *)hdrBuf;
+
+    error = PFE_OK;
+    while (error == PFE_OK && pageNum / entries >= fh->numMapPages) {
+        error = rhf_AllocMapPage(fd, hdrBuf, &hdrDirty);
+    }
+
+    if (error == PFE_OK) {
+        error = rhf_SetFSMEntry(fd, hdrBuf, pageNum, category, &hdrDirty);
+    }
+
+    if (PF_UnfixPage(fd, RHF_HDR_PAGE, hdrDirty) != PFE_OK && error == PFE_OK) {
+        error = PFerrno;
+    }
+    return error;
+}
+
+/* Records the space a fixed data page offers after compaction in the FSM */
+#define rhf_UpdateFSM(fd, pageNum, pageBuf) \
+    rhf_SetPageSpace((fd), (pageNum), \
+        RHF_FSM_CAT(rhf_PageAvailBytes(pageBuf, PF_PageSize(fd)), PF_PageSize(fd)))
+
+/*
+ * Helper function to find the first of the 'n' FSM entries at 'fsm' that
+ * is at least 'need' (need >= 1), or -1. The entries are read a word at a
+ * time, and only a word that may hold such an entry is looked into.
+ */
+static int rhf_ScanFSM(unsigned char *fsm, int n, int need)
+{
+    unsigned long ones = ~0UL / 255;  /* 0x01 in every byte */
+    unsigned long high = ones << 7;   /* 0x80 in every byte */
+    unsigned long w;
+    int i = 0, j;
+
+    for (; i + (int)sizeof(w) <= n; i += sizeof(w)) {
+        memcpy(&w, fsm + i, sizeof(w));
+        /* For need <= 128, adding 128 - need to a byte sets its high bit
+           iff the byte is at least need (a carry out only comes from a
+           byte that has it already); otherwise need itself has it */
+        if (need <= 128) {
+            if (((w + ones * (128 - need)) | w) & high) break;
+        } else if (w & high) {
+            for (j = i; j < i + (int)sizeof(w); j++) {
+                if (fsm[j] >= need) return j;
+            }
+        }
+    }
+    for (; i < n; i++) {
+        if (fsm[i] >= need) return i;
+    }
+    return -1;
+}
+
+/*
+ * Helper function to search the first 'count' map pages listed by the
+ * fixed directory block dirBuf, map pages k0 onwards, for a page with at
+ * least 'need' as its FSM entry. Sets *found as rhf_SearchFSM() does.
+ */
+static int rhf_SearchDirBlock(int fd, char *dirBuf, int k0, int count, int need,
+                              int *found, int *dirDirty)
+{
+    RHF_FileHeader *dir = (RHF_FileHeader *)dirBuf;
+    int entries = RHF_FSM_ENTRIES(PF_PageSize(fd));
+    int numPages = PF_NumPages(fd);
+    int i, j, n, error;
+    char *mapBuf;
+
+    for (i = 0; i < count && *found < 0; i++)
+    {
+        if (dir->mapMax[i] < need) continue;
+
+        /* The entries past the end of the file are all 0 */
+        n = numPages - (k0 + i) * entries;
+        if (n > entries) n = entries;
+
+        if ((error = rhf_FixMapPage(fd, dirBuf, i, &mapBuf)) != PFE_OK) {
+            return error;
+        }
+        if ((j = rhf_ScanFSM(GET_FSM(mapBuf), n, need)) >= 0) {
+            *found = (k0 + i) * entries + j;
+        } else {
+            /* mapMax was stale; every entry is below need, so lower it
+               to skip this page next time */
+            dir->mapMax[i] = (unsigned char)(need - 1);
+            *dirDirty = TRUE;
+        }
+        if ((error = rhf_UnfixMapPage(fd, dirBuf, i, FALSE, dirDirty)) != PFE_OK) {
+            return error;
+        }
+    }
+    return RHF_OK;
+}
+
+/*
+ * Helper function to find, through the FSM, a page with at least 'length'
+ * bytes of free space. Sets *found to the page number, or to -1 if no page
+ * qualifies. The header page must be fixed.
+ */
+static int rhf_SearchFSM(int fd, char *hdrBuf, int length, int *found, int *hdrDirty)
+{
+    RHF_FileHeader *fh = (RHF_FileHeader *)hdrBuf;
+    int need = RHF_FSM_NEED(length, PF_PageSize(fd));
+    int k, count, nextDir, error, dirDirty = FALSE;
+    char *dirBuf = hdrBuf;
+
+    *found = -1;
+    for (k = 0; ; k += RHF_DIR_MAPPAGES)
+    {
+        count = fh->numMapPages - k;
+        if (count > RHF_DIR_MAPPAGES) count = RHF_DIR_MAPPAGES;
+        error = rhf_SearchDirBlock(fd, dirBuf, k, count, need, found, &dirDirty);
+
+        nextDir = ((RHF_FileHeader *)dirBuf)->nextDir;
+        if (rhf_UnfixDirBlock(fd, hdrBuf, dirBuf, dirDirty, hdrDirty) != PFE_OK
+            && error == RHF_OK) {
+            error = PFerrno;
+        }
+        if (error != RHF_OK || *found >= 0 || k + count >= fh->numMapPages) {
+            return error;
+        }
+        if ((error = PF_GetThisPage(fd, nextDir, &dirBuf)) != PFE_OK) {
+            return error;
+        }
+        dirDirty = FALSE;
+    }
+}
+
+/*
+ * Helper function to allocate a new data page, and return it fixed.
+ * Its FSM entry is set once records are in.
+ */
+static int rhf_AllocDataPage(int fd, int *pageNum, char **pageBuf)
+{
+    int error;
+
+    if ((error = PF_AllocPage(fd, pageNum, pageBuf)) != PFE_OK) {
+        return error;
+    }
+    rhf_InitPage(*pageBuf, PF_PageSize(fd));
+    return RHF_OK;
+}
+
 /*
  * Helper function to find a page with at least 'length' bytes of free space
- * If no such page exists, it allocates a new one.
+ * If no such page exists, it allocates a new one, and sets *isNew to TRUE
+ * if isNew is not NULL.
  * Returns the page number and a pointer to the *fixed* page buffer.
+ * The FSM is consulted instead of the pages themselves, so this costs a
+ * few page reads, plus one per directory block of the map searched.
  */
-static int rhf_GetPageWithSpace(int fd, int length, int *pageNum, char **pageBuf)
+static int rhf_GetPageWithSpace(int fd, int length, int *pageNum, char **pageBuf,
+                                int *isNew)
 {
-    int error;
-    int pnum = -1;
-    char *buf;
+    int error, pnum;
+    int hdrDirty;
+    char *hdrBuf, *buf;
 
-    /* Start scanning from the first page */
-    while ((error = PF_GetNextPage(fd, &pnum, &buf)) == PFE_OK)
+    while (TRUE)
     {
-        RHF_PageHeader *header = GET_HEADER(buf);
-        RHF_Slot *slots = GET_SLOTS(buf);
-        
-        /* Calculate available space on this page */
-        /* Space = (Start of Free Space) - (End of Slot Array) */
-        int spaceNeededForSlot = (header->nextFreeSlot == -1) ? sizeof(RHF_Slot) : 0;
-        int freeSpace = header->freeSpacePtr - (sizeof(RHF_PageHeader) + header->numSlots * sizeof(RHF_Slot));
-        
-        if (freeSpace >= (length + spaceNeededForSlot))
+        if ((error = PF_GetThisPage(fd, RHF_HDR_PAGE, &hdrBuf)) != PFE_OK) {
+            return error;
+        }
+        hdrDirty = FALSE;
+        error = rhf_SearchFSM(fd, hdrBuf, length, &pnum, &hdrDirty);
+        if (PF_UnfixPage(fd, RHF_HDR_PAGE, hdrDirty) != PFE_OK && error == RHF_OK) {
+            error = PFerrno;
+        }
+        if (error != RHF_OK) return error;
+
+        if (pnum < 0) break; /* No page in the map has enough space */
+
+        error = PF_GetThisPage(fd, pnum, &buf);
+        if (error == PFE_OK && rhf_PageAvailBytes(buf, PF_PageSize(fd)) >= length)
         {
+            if (isNew != NULL) *isNew = FALSE;
             *pageNum = pnum;
             *pageBuf = buf;
             return RHF_OK; /* Found a page */
         }
-        
-        /* Unfix the page before getting the next one */
-        if (PF_UnfixPage(fd, pnum, FALSE) != PFE_OK) {
-            return PFerrno;
+        if (error == PFE_OK) {
+            /* Entry was out of date; correct it and search again */
+            error = rhf_UpdateFSM(fd, pnum, buf);
+            if (PF_UnfixPage(fd, pnum, FALSE) != PFE_OK) return PFerrno;
+            if (error != PFE_OK) return error;
+        }
+        else if (error == PFE_INVALIDPAGE) {
+            /* Page was disposed behind the map's back; forget it */
+            if ((error = PF_GetThisPage(fd, RHF_HDR_PAGE, &hdrBuf)) != PFE_OK) {
+                return error;
+            }
+            hdrDirty = FALSE;
+            error = rhf_SetFSMEntry(fd, hdrBuf, pnum, 0, &hdrDirty);
+            if (PF_UnfixPage(fd, RHF_HDR_PAGE, hdrDirty) != PFE_OK && error == PFE_OK) {
+                error = PFerrno;
+            }
+            if (error != PFE_OK) return error;
+        }
+        else {
+            return error; /* A real error occurred */
         }
     }
 
-    /* If we're here, no page had enough space (or file was empty) */
-    if (error != PFE_EOF) return error; /* A real error occurred */
-
     /* Allocate a new page */
-    if ((error = PF_AllocPage(fd, pageNum, pageBuf)) != PFE_OK) {
-        return error;
-    }
-
-    /* Initialize the new page */
-    rhf_InitPage(*pageBuf);
-    return RHF_OK;
+    if (isNew != NULL) *isNew = TRUE;
+    return rhf_AllocDataPage(fd, pageNum, pageBuf);
 }
 
 
@@ -69,7 +492,39 @@ static int rhf_GetPageWithSpace(int fd, int length, int *pageNum, char **pageBuf
 
 int RHF_CreateFile(char *fname) 
 {
-    return PF_CreateFile(fname);
+    return RHF_CreateFileSize(fname, PF_PAGE_SIZE);
+}
+
+int RHF_CreateFileSize(char *fname, int pageSize)
+{
+    int error, fd, pageNum;
+    char *pageBuf;
+    RHF_FileHeader *fh;
+
+    if ((error = PF_CreateFileSize(fname, pageSize)) != PFE_OK) {
+        return error;
+    }
+    if ((fd = PF_OpenFile(fname)) < 0) {
+        return fd;
+    }
+
+    /* The first page becomes the file header and the first map page */
+    if ((error = PF_AllocPage(fd, &pageNum, &pageBuf)) != PFE_OK) {
+        PF_CloseFile(fd);
+        return error;
+    }
+    memset(pageBuf, 0, PF_PageSize(fd));
+    fh = (RHF_FileHeader *)pageBuf;
+    fh->mapMark = RHF_MAPPAGE;
+    fh->numMapPages = 1;
+    fh->nextDir = -1;
+    fh->mapPages[0] = pageNum;
+
+    if ((error = PF_UnfixPage(fd, pageNum, TRUE)) != PFE_OK) {
+        PF_CloseFile(fd);
+        return error;
+    }
+    return PF_CloseFile(fd);
 }
 
 int RHF_DestroyFile(char *fname)
@@ -79,30 +534,61 @@ int RHF_DestroyFile(char *fname)
 
 int RHF_OpenFile(char *fname)
 {
-    return PF_OpenFile(fname);
+    return RHF_OpenFileMode(fname, PF_MODE_RDWR);
 }
 
-int RHF_CloseFile(int fd)
+int RHF_OpenFileMode(char *fname, int mode)
 {
-    return PF_CloseFile(fd);
+    int fd, error, isRHF;
+    char *pageBuf;
+
+    if ((fd = PF_OpenFileMode(fname, mode)) < 0) {
+        return fd;
+    }
+
+    /* Make sure the file starts with an RHF header page */
+    if ((error = PF_GetThisPage(fd, RHF_HDR_PAGE, &pageBuf)) != PFE_OK) {
+        PF_CloseFile(fd);
+        return (error == PFE_INVALIDPAGE) ? RHF_BADFILE : error;
+    }
+    isRHF = (((RHF_FileHeader *)pageBuf)->mapMark == RHF_MAPPAGE);
+    PF_UnfixPage(fd, RHF_HDR_PAGE, FALSE);
+    if (!isRHF) {
+        PF_CloseFile(fd);
+        return RHF_BADFILE;
+    }
+    return fd;
 }
 
-int RHF_InsertRecord(int fd, char *record, int length, RID *rid)
+int RHF_CloseFile(int fd)
 {
-    int error, pageNum;
-    char *pageBuf;
+    return PF_CloseFile(fd);
+}
 
-    /* 1. Find a page with enough space */
-    if ((error = rhf_GetPageWithSpace(fd, length, &pageNum, &pageBuf)) != RHF_OK) {
-        return error;
-    }
+/* TRUE if a record of 'length' bytes fits on an empty page of 'pageSize'
+   bytes */
+#define rhf_RecordFits(length, pageSize) \
+    ((length) >= 0 && \
+     (length) <= (pageSize) - (int)(sizeof(RHF_PageHeader) + sizeof(RHF_Slot)))
 
+/*
+ * Helper function to write a record on a fixed data page with at least
+ * 'length' bytes available, compacting the page if needed.
+ * Returns the slot number of the record, or RHF_NOMEM.
+ */
+static int rhf_PutRecord(char *pageBuf, int pageSize, char *record, int length)
+{
     RHF_PageHeader *header = GET_HEADER(pageBuf);
-    RHF_Slot *slots = GET_SLOTS(pageBuf);
     RHF_Slot *slot;
-
-    /* 2. Find a slot for the record */
     int slotNum;
+
+    /* The page has room only counting deleted records; reclaim it now */
+    if (rhf_PageFreeBytes(pageBuf) < length &&
+        rhf_CompactPage(pageBuf, pageSize) != RHF_OK) {
+        return RHF_NOMEM;
+    }
+
+    /* Find a slot for the record */
     if (header->nextFreeSlot != -1)
     {
         /* Reuse a deleted slot */
@@ -118,21 +604,119 @@ int RHF_InsertRecord(int fd, char *record, int length, RID *rid)
         header->numSlots++;
     }
 
-    /* 3. Write the record to the page */
+    /* Write the record to the page */
     /* Records are stored from the *end* of the page, growing backwards */
     header->freeSpacePtr -= length;
     slot->recordOffset = header->freeSpacePtr;
     slot->recordLength = length;
     memcpy(GET_RECORD(pageBuf, slot), record, length);
-    
-    /* 4. Set the output RID */
+    return slotNum;
+}
+
+/* Does the work of RHF_InsertRecord, which times it */
+static int rhf_InsertRecord(int fd, char *record, int length, RID *rid)
+{
+    int error, pageNum;
+    char *pageBuf;
+
+    /* Pages of a file opened with PF_MODE_MMAP are read-only memory */
+    if (PF_FileMode(fd) == PF_MODE_MMAP) {
+        PFerrno = PFE_READONLY;
+        return PFE_READONLY;
+    }
+
+    /* A record must fit on an empty page */
+    if (!rhf_RecordFits(length, PF_PageSize(fd))) {
+        return RHF_PAGEFULL;
+    }
+
+    /* 1. Find a page with enough space */
+    if ((error = rhf_GetPageWithSpace(fd, length, &pageNum, &pageBuf, NULL)) != RHF_OK) {
+        return error;
+    }
+
+    /* 2. Write the record and set the output RID */
     rid->pageNum = pageNum;
-    rid->slotNum = slotNum;
+    rid->slotNum = rhf_PutRecord(pageBuf, PF_PageSize(fd), record, length);
+    if (rid->slotNum < 0) {
+        PF_UnfixPage(fd, pageNum, FALSE);
+        return rid->slotNum;
+    }
 
-    /* 5. Unfix the page, marking it dirty */
+    /* 3. Record the page's remaining space in the FSM */
+    if ((error = rhf_UpdateFSM(fd, pageNum, pageBuf)) != PFE_OK) {
+        PF_UnfixPage(fd, pageNum, TRUE);
+        return error;
+    }
+
+    /* 4. Unfix the page, marking it dirty */
     return PF_UnfixPage(fd, pageNum, TRUE);
 }
 
+int RHF_InsertRecord(int fd, char *record, int length, RID *rid)
+{
+    long start = PF_StatsStart();
+    int error = rhf_InsertRecord(fd, record, length, rid);
+
+    PF_StatsEnd(PF_HIST_RHFINSERT, start);
+    return error;
+}
+
+int RHF_InsertRecords(int fd, char **records, int *lengths, int n, RID *rids)
+{
+    int pageSize = PF_PageSize(fd);
+    int error = RHF_OK, pageNum, isNew = FALSE;
+    char *pageBuf;
+    int i;
+
+    /* Pages of a file opened with PF_MODE_MMAP are read-only memory */
+    if (PF_FileMode(fd) == PF_MODE_MMAP) {
+        PFerrno = PFE_READONLY;
+        return PFE_READONLY;
+    }
+
+    /* Refuse the whole batch rather than stop half way */
+    for (i = 0; i < n; i++) {
+        if (!rhf_RecordFits(lengths[i], pageSize)) return RHF_PAGEFULL;
+    }
+
+    i = 0;
+    while (i < n)
+    {
+        /* Once no page had room, the rest is appended to new pages
+           without searching the FSM again */
+        if (isNew)
+            error = rhf_AllocDataPage(fd, &pageNum, &pageBuf);
+        else
+            error = rhf_GetPageWithSpace(fd, lengths[i], &pageNum, &pageBuf, &isNew);
+        if (error != RHF_OK) return error;
+
+        /* Fill the page under this one fix */
+        do {
+            rids[i].pageNum = pageNum;
+            rids[i].slotNum = rhf_PutRecord(pageBuf, pageSize, records[i], lengths[i]);
+            if (rids[i].slotNum < 0) {
+                /* Keep the records already put on the page */
+                error = rids[i].slotNum;
+                rhf_UpdateFSM(fd, pageNum, pageBuf);
+                PF_UnfixPage(fd, pageNum, TRUE);
+                return error;
+            }
+            i++;
+        } while (i < n && (rhf_PageFreeBytes(pageBuf) >= lengths[i] ||
+                           rhf_PageAvailBytes(pageBuf, pageSize) >= lengths[i]));
+
+        if ((error = rhf_UpdateFSM(fd, pageNum, pageBuf)) != PFE_OK) {
+            PF_UnfixPage(fd, pageNum, TRUE);
+            return error;
+        }
+        if ((error = PF_UnfixPage(fd, pageNum, TRUE)) != PFE_OK) {
+            return error;
+        }
+    }
+    return RHF_OK;
+}
+
 int RHF_GetRecord(int fd, RID *rid, char *recordBuf, int *length)
 {
     char *pageBuf;
@@ -154,7 +738,7 @@ int RHF_GetRecord(int fd, RID *rid, char *recordBuf, int *length)
     RHF_Slot *slot = GET_SLOT(pageBuf, rid->slotNum);
 
     /* 3. Check if record exists (i.e., not deleted) */
-    if (slot->recordOffset == -1) {
+    if (slot->recordLength == -1) {
         PF_UnfixPage(fd, rid->pageNum, FALSE);
         return RHF_NORECORD;
     }
@@ -168,11 +752,145 @@ int RHF_GetRecord(int fd, RID *rid, char *recordBuf, int *length)
 }
 
 
+/* one RID of a batch passed to RHF_GetRecords, with its place in it */
+typedef struct {
+    RID rid;
+    int index;
+} rhf_BatchEntry;
+
+static int rhf_CompareBatchEntries(const void *a, const void *b)
+{
+    const rhf_BatchEntry *x = (const rhf_BatchEntry *)a;
+    const rhf_BatchEntry *y = (const rhf_BatchEntry *)b;
+
+    if (x->rid.pageNum != y->rid.pageNum)
+        return (x->rid.pageNum < y->rid.pageNum) ? -1 : 1;
+    if (x->rid.slotNum != y->rid.slotNum)
+        return (x->rid.slotNum < y->rid.slotNum) ? -1 : 1;
+    return x->index - y->index;
+}
+
+int RHF_GetRecords(int fd, RID *rids, int n,
+                   int (*found)(void *arg, int i, char *record, int length),
+                   void *arg)
+{
+    rhf_BatchEntry *batch;
+    char *pageBuf = NULL;
+    int pageNum = -1;   /* page fixed in pageBuf, or -1 */
+    RHF_Slot *slot;
+    int error = RHF_OK;
+    int i;
+
+    if (n <= 0) return RHF_OK;
+
+    /* Visit the records in page order, so each page is fixed once */
+    if ((batch = (rhf_BatchEntry *)malloc(n * sizeof(rhf_BatchEntry))) == NULL)
+        return RHF_NOMEM;
+    for (i = 0; i < n; i++) {
+        batch[i].rid = rids[i];
+        batch[i].index = i;
+    }
+    qsort(batch, n, sizeof(rhf_BatchEntry), rhf_CompareBatchEntries);
+
+    for (i = 0; i < n && error == RHF_OK; i++) {
+        if (batch[i].rid.pageNum != pageNum) {
+            if (pageNum != -1 &&
+                (error = PF_UnfixPage(fd, pageNum, FALSE)) != PFE_OK) {
+                pageNum = -1;
+                break;
+            }
+            pageNum = -1;
+            if ((error = PF_GetThisPage(fd, batch[i].rid.pageNum, &pageBuf))
+                != PFE_OK)
+                break;
+            pageNum = batch[i].rid.pageNum;
+        }
+
+        if (batch[i].rid.slotNum < 0 ||
+            batch[i].rid.slotNum >= GET_HEADER(pageBuf)->numSlots) {
+            error = RHF_INVALIDRID;
+            break;
+        }
+        slot = GET_SLOT(pageBuf, batch[i].rid.slotNum);
+        if (slot->recordLength == -1) {
+            error = RHF_NORECORD;
+            break;
+        }
+        error = (*found)(arg, batch[i].index, GET_RECORD(pageBuf, slot),
+                         slot->recordLength);
+    }
+
+    if (pageNum != -1 && PF_UnfixPage(fd, pageNum, FALSE) != PFE_OK &&
+        error == RHF_OK)
+        error = PFerrno;
+    free(batch);
+    return error;
+}
+
+
+void RHF_InitView(RHF_RecordView *view)
+{
+    view->fd = -1;
+    view->pageNum = -1;
+    view->pageBuf = NULL;
+    view->record = NULL;
+    view->length = 0;
+}
+
+int RHF_PinRecord(int fd, RID *rid, RHF_RecordView *view)
+{
+    RHF_Slot *slot;
+    int error;
+
+    /* Keep the page of the last record if this one is on it too */
+    if (view->pageNum != -1 &&
+        (view->fd != fd || view->pageNum != rid->pageNum) &&
+        (error = RHF_UnpinRecord(view)) != RHF_OK)
+        return error;
+
+    if (view->pageNum == -1) {
+        if ((error = PF_GetThisPage(fd, rid->pageNum, &view->pageBuf)) != PFE_OK)
+            return error;
+        view->fd = fd;
+        view->pageNum = rid->pageNum;
+    }
+
+    if (rid->slotNum < 0 || rid->slotNum >= GET_HEADER(view->pageBuf)->numSlots) {
+        RHF_UnpinRecord(view);
+        return RHF_INVALIDRID;
+    }
+    slot = GET_SLOT(view->pageBuf, rid->slotNum);
+    if (slot->recordLength == -1) {
+        RHF_UnpinRecord(view);
+        return RHF_NORECORD;
+    }
+    view->record = GET_RECORD(view->pageBuf, slot);
+    view->length = slot->recordLength;
+    return RHF_OK;
+}
+
+int RHF_UnpinRecord(RHF_RecordView *view)
+{
+    int error = RHF_OK;
+
+    if (view->pageNum != -1)
+        error = PF_UnfixPage(view->fd, view->pageNum, FALSE);
+    RHF_InitView(view);
+    return error;
+}
+
+
 int RHF_DeleteRecord(int fd, RID *rid)
 {
     char *pageBuf;
     int error;
 
+    /* Pages of a file opened with PF_MODE_MMAP are read-only memory */
+    if (PF_FileMode(fd) == PF_MODE_MMAP) {
+        PFerrno = PFE_READONLY;
+        return PFE_READONLY;
+    }
+
     /* 1. Get the page */
     if ((error = PF_GetThisPage(fd, rid->pageNum, &pageBuf)) != PFE_OK) {
         return error;
@@ -189,26 +907,85 @@ int RHF_DeleteRecord(int fd, RID *rid)
     RHF_Slot *slot = GET_SLOT(pageBuf, rid->slotNum);
     
     /* 3. Check if already deleted */
-    if (slot->recordOffset == -1) {
+    if (slot->recordLength == -1) {
         PF_UnfixPage(fd, rid->pageNum, FALSE);
         return RHF_NORECORD; /* Already deleted */
     }
 
     /* 4. "Delete" the record by marking the slot as free */
     /* We add this slot to the front of the free list */
-    int oldOffset = slot->recordOffset;
     slot->recordOffset = header->nextFreeSlot; /* Point to old head of free list */
     slot->recordLength = -1; /* Mark as empty */
     header->nextFreeSlot = rid->slotNum; /* This slot is now the head */
 
-    /* Note: We don't reclaim the data space. Compaction is complex. */
-    /* This is a simple "tombstone" implementation. */
+    /* The record bytes stay in place until an insert needs them
+       (see rhf_CompactPage). A page with no live record left is reset
+       right away, which needs no compaction. */
+    int numLive;
+    rhf_PageDeadBytes(pageBuf, PF_PageSize(fd), &numLive);
+    if (numLive == 0) {
+        rhf_InitPage(pageBuf, PF_PageSize(fd));
+    }
 
-    /* 5. Unfix the page, marking it dirty */
+    /* 5. The freed bytes are available to inserts again; tell the FSM */
+    if ((error = rhf_UpdateFSM(fd, rid->pageNum, pageBuf)) != PFE_OK) {
+        PF_UnfixPage(fd, rid->pageNum, TRUE);
+        return error;
+    }
+
+    /* 6. Unfix the page, marking it dirty */
     return PF_UnfixPage(fd, rid->pageNum, TRUE);
 }
 
 
+int RHF_Vacuum(int fd)
+{
+    int error, pnum = -1;
+    int numLive, dead;
+    char *buf;
+
+    /* Pages of a file opened with PF_MODE_MMAP are read-only memory */
+    if (PF_FileMode(fd) == PF_MODE_MMAP) {
+        PFerrno = PFE_READONLY;
+        return PFE_READONLY;
+    }
+
+    while ((error = PF_GetNextPage(fd, &pnum, &buf)) == PFE_OK)
+    {
+        /* Map pages are never vacuumed */
+        if (GET_HEADER(buf)->numSlots == RHF_MAPPAGE) {
+            if ((error = PF_UnfixPage(fd, pnum, FALSE)) != PFE_OK) return error;
+            continue;
+        }
+
+        dead = rhf_PageDeadBytes(buf, PF_PageSize(fd), &numLive);
+        if (numLive == 0)
+        {
+            /* Empty page: give it back to PF, and make sure the FSM
+               never hands it out while it sits on the PF free list */
+            if ((error = PF_UnfixPage(fd, pnum, FALSE)) != PFE_OK) return error;
+            if ((error = PF_DisposePage(fd, pnum)) != PFE_OK) return error;
+            if ((error = rhf_SetPageSpace(fd, pnum, 0)) != PFE_OK) return error;
+        }
+        else if (dead > 0)
+        {
+            if ((error = rhf_CompactPage(buf, PF_PageSize(fd))) != RHF_OK) {
+                PF_UnfixPage(fd, pnum, FALSE);
+                return error;
+            }
+            if ((error = rhf_UpdateFSM(fd, pnum, buf)) != PFE_OK) {
+                PF_UnfixPage(fd, pnum, TRUE);
+                return error;
+            }
+            if ((error = PF_UnfixPage(fd, pnum, TRUE)) != PFE_OK) return error;
+        }
+        else if ((error = PF_UnfixPage(fd, pnum, FALSE)) != PFE_OK) {
+            return error;
+        }
+    }
+    return (error == PFE_EOF) ? RHF_OK : error;
+}
+
 int RHF_StartScan(int fd, RHF_Scan *scan)
 {
     scan->fd = fd;
@@ -216,14 +993,18 @@ int RHF_StartScan(int fd, RHF_Scan *scan)
     scan->currentSlot = -1; 
     scan->pageBuf = NULL;   /* No page fixed yet */
     scan->page_is_fixed = 0; /* False */
+
+    /* Scans read the file front to back; get the first pages in one go.
+       PF's read-ahead takes over from there. */
+    PF_Prefetch(fd, 0, RHF_SCAN_PREFETCH);
     return RHF_OK;
 }
 
-int RHF_GetNextRecord(RHF_Scan *scan, char *recordBuf, int *length, RID *rid)
+/* Fixes the next page of the scan with a slot left to look at, unless
+   the current page still has one */
+static int rhf_ScanPage(RHF_Scan *scan)
 {
     int error;
-    RHF_PageHeader *header;
-    RHF_Slot *slot;
 
     while (TRUE)
     {
@@ -236,41 +1017,99 @@ int RHF_GetNextRecord(RHF_Scan *scan, char *recordBuf, int *length, RID *rid)
             scan->page_is_fixed = 1; /* TRUE */
             scan->currentSlot = 0;   /* Reset slot for new page */
         }
-        
-        header = GET_HEADER(scan->pageBuf);
 
-        /* 2. Check if we're past the last slot on this page */
-        if (scan->currentSlot >= header->numSlots)
-        {
-            /* We are. Unfix this page and loop to get the next one */
-            if ((error = PF_UnfixPage(scan->fd, scan->currentPage, FALSE)) != PFE_OK) {
-                return error;
-            }
-            scan->page_is_fixed = 0; /* FALSE */
-            continue; /* Loop will call PF_GetNextPage */
+        /* 2. Check if we're past the last slot on this page.
+              Map pages have numSlots == RHF_MAPPAGE, so they are skipped here. */
+        if (scan->currentSlot < GET_HEADER(scan->pageBuf)->numSlots)
+            return RHF_OK;
+
+        /* We are. Unfix this page and loop to get the next one */
+        if ((error = PF_UnfixPage(scan->fd, scan->currentPage, FALSE)) != PFE_OK) {
+            return error;
         }
-        
-        /* 3. We have a valid slot, check if it's used */
-        slot = GET_SLOT(scan->pageBuf, scan->currentSlot);
-        
-        /* 4. Prepare to advance to the next slot for the *next* call */
+        scan->page_is_fixed = 0; /* FALSE */
+    }
+}
+
+/* Moves the scan on to its next record, and sets *slot to the slot of it */
+static int rhf_ScanNext(RHF_Scan *scan, RID *rid, RHF_Slot **slot)
+{
+    int error;
+
+    while (TRUE)
+    {
+        if ((error = rhf_ScanPage(scan)) != RHF_OK)
+            return error;
+
+        /* 3. We have a valid slot; advance past it for the next call */
+        *slot = GET_SLOT(scan->pageBuf, scan->currentSlot);
         scan->currentSlot++;
 
-        if (slot->recordLength != -1)
+        if ((*slot)->recordLength != -1)
         {
-            /* Found a valid record! */
-            *length = slot->recordLength;
-            memcpy(recordBuf, GET_RECORD(scan->pageBuf, slot), *length);
-            
+            /* Found a valid record! We *do not* unfix the page. We leave
+               it fixed for the next call. */
             rid->pageNum = scan->currentPage;
             rid->slotNum = scan->currentSlot - 1; /* We just incremented it */
-            
-            /* We *do not* unfix the page. We leave it fixed for the next call. */
             return RHF_OK;
         }
 
-        /* 5. This slot was empty (deleted). Loop to check the next slot. */
+        /* 4. This slot was empty (deleted). Loop to check the next slot. */
+    }
+}
+
+int RHF_GetNextRecord(RHF_Scan *scan, char *recordBuf, int *length, RID *rid)
+{
+    int error;
+    RHF_Slot *slot;
+
+    if ((error = rhf_ScanNext(scan, rid, &slot)) != RHF_OK)
+        return error;
+    *length = slot->recordLength;
+    memcpy(recordBuf, GET_RECORD(scan->pageBuf, slot), *length);
+    return RHF_OK;
+}
+
+int RHF_GetNextRecordView(RHF_Scan *scan, char **record, int *length, RID *rid)
+{
+    int error;
+    RHF_Slot *slot;
+
+    if ((error = rhf_ScanNext(scan, rid, &slot)) != RHF_OK)
+        return error;
+    *length = slot->recordLength;
+    *record = GET_RECORD(scan->pageBuf, slot);
+    return RHF_OK;
+}
+
+int RHF_ScanPage(RHF_Scan *scan,
+                 int (*visit)(void *arg, RID *rid, char *record, int length),
+                 void *arg)
+{
+    int error;
+    RHF_Slot *slot;
+    RID rid;
+
+    if ((error = rhf_ScanPage(scan)) != RHF_OK)
+        return error;
+
+    rid.pageNum = scan->currentPage;
+    while (scan->currentSlot < GET_HEADER(scan->pageBuf)->numSlots)
+    {
+        slot = GET_SLOT(scan->pageBuf, scan->currentSlot);
+        rid.slotNum = scan->currentSlot++;
+        if (slot->recordLength == -1)
+            continue;
+        if ((error = (*visit)(arg, &rid, GET_RECORD(scan->pageBuf, slot),
+                              slot->recordLength)) != RHF_OK)
+            return error;
     }
+
+    /* Done with the page */
+    if ((error = PF_UnfixPage(scan->fd, scan->currentPage, FALSE)) != PFE_OK)
+        return error;
+    scan->page_is_fixed = 0;
+    return RHF_OK;
 }
 
 int RHF_EndScan(RHF_Scan *scan)
@@ -294,6 +1133,131 @@ int RHF_EndScan(RHF_Scan *scan)
     return RHF_OK;
 }
 
+/* --- Parallel Scan --- */
+
+/* State shared by the workers of a parallel scan */
+typedef struct {
+    int fd;
+    int numPages;     /* pages [0, numPages) are scanned */
+    int nextMorsel;   /* first page of the next morsel to hand out */
+    int error;        /* first error of a worker, RHF_OK if none */
+    int (*visit)(void *local, RID *rid, char *record, int length);
+} rhf_ParScan;
+
+/* One worker of a parallel scan */
+typedef struct {
+    rhf_ParScan *shared;
+    void *local;      /* the worker's partial result */
+} rhf_Worker;
+
+/* Visits the records of the morsels a worker takes, until none is left
+   or some worker fails */
+static void *rhf_ScanWorker(void *arg)
+{
+    rhf_Worker *worker = (rhf_Worker *)arg;
+    rhf_ParScan *ps = worker->shared;
+    int first, last, pageNum, numSlots;
+    int error = RHF_OK;
+    char *pageBuf;
+    RHF_Slot *slot;
+    RID rid;
+
+    while (error == RHF_OK &&
+           __atomic_load_n(&ps->error, __ATOMIC_RELAXED) == RHF_OK)
+    {
+        first = __atomic_fetch_add(&ps->nextMorsel, RHF_MORSEL_PAGES,
+                                   __ATOMIC_RELAXED);
+        if (first >= ps->numPages) break;
+        last = first + RHF_MORSEL_PAGES;
+        if (last > ps->numPages) last = ps->numPages;
+
+        /* Only a hint: the read-ahead of PF cannot follow interleaved
+           workers */
+        PF_Prefetch(ps->fd, first, last - first);
+
+        for (pageNum = first; pageNum < last && error == RHF_OK; pageNum++)
+        {
+            if ((error = PF_GetThisPage(ps->fd, pageNum, &pageBuf)) != PFE_OK) {
+                if (error == PFE_INVALIDPAGE) error = RHF_OK; /* free page */
+                continue;
+            }
+
+            /* Map pages have numSlots == RHF_MAPPAGE and have no record */
+            numSlots = GET_HEADER(pageBuf)->numSlots;
+            rid.pageNum = pageNum;
+            for (rid.slotNum = 0; rid.slotNum < numSlots && error == RHF_OK;
+                 rid.slotNum++)
+            {
+                slot = GET_SLOT(pageBuf, rid.slotNum);
+                if (slot->recordLength != -1)
+                    error = (*ps->visit)(worker->local, &rid,
+                                         GET_RECORD(pageBuf, slot),
+                                         slot->recordLength);
+            }
+            if (PF_UnfixPage(ps->fd, pageNum, FALSE) != PFE_OK && error == RHF_OK)
+                error = PFerrno;
+        }
+    }
+
+    if (error != RHF_OK) {
+        /* Keep the first error, and make the other workers stop */
+        int none = RHF_OK;
+        __atomic_compare_exchange_n(&ps->error, &none, error, FALSE,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+int RHF_ParallelScan(int fd, int nworkers,
+                     int (*visit)(void *local, RID *rid, char *record, int length),
+                     void **locals,
+                     void (*merge)(void *result, void *local), void *result)
+{
+    rhf_ParScan ps;
+    rhf_Worker *workers;
+    pthread_t *threads;
+    int i, started;
+
+    if (nworkers < 1) nworkers = 1;
+    if ((ps.numPages = PF_NumPages(fd)) < 0)
+        return ps.numPages;
+    ps.fd = fd;
+    ps.nextMorsel = 0;
+    ps.error = RHF_OK;
+    ps.visit = visit;
+
+    workers = (rhf_Worker *)malloc(nworkers * sizeof(rhf_Worker));
+    threads = (pthread_t *)malloc(nworkers * sizeof(pthread_t));
+    if (workers == NULL || threads == NULL) {
+        free(workers);
+        free(threads);
+        return RHF_NOMEM;
+    }
+    for (i = 0; i < nworkers; i++) {
+        workers[i].shared = &ps;
+        workers[i].local = (locals != NULL) ? locals[i] : NULL;
+    }
+
+    /* Worker 0 is the caller. If a thread cannot be had, the workers
+       started so far do the whole scan */
+    for (started = 1; started < nworkers; started++) {
+        if (pthread_create(&threads[started], NULL, rhf_ScanWorker,
+                           &workers[started]) != 0)
+            break;
+    }
+    rhf_ScanWorker(&workers[0]);
+    for (i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    if (ps.error == RHF_OK && merge != NULL) {
+        for (i = 0; i < nworkers; i++)
+            (*merge)(result, workers[i].local);
+    }
+    free(workers);
+    free(threads);
+    return ps.error;
+}
+
 /*
  * Helper for printing RHF-layer errors
  */
@@ -316,6 +1280,9 @@ void RHF_PrintError(char *s, int err)
         case RHF_NOMEM:
             fprintf(stderr, "Out of memory.\n");
             break;
+        case RHF_BADFILE:
+            fprintf(stderr, "Not an RHF file (no header page).\n");
+            break;
         default:
             /* Assume it's a PF error and call its printer */
             PF_PrintError(s);
@@ -11,6 +11,7 @@
 #define RHF_INVALIDRID -22 /* Invalid Record ID */
 #define RHF_NORECORD   -23 /* Record does not exist */
 #define RHF_NOMEM      -24 /* Out of memory */
+#define RHF_BADFILE    -25 /* File has no RHF header page */
 
 /*
  * Record ID (RID)
@@ -36,6 +37,20 @@ typedef struct {
 } RHF_Scan;
 
 
+/*
+ * RHF_RecordView
+ * A record read in place: record points into the page, which stays
+ * fixed until the view is released with RHF_UnpinRecord.
+ */
+typedef struct {
+    int fd;           /* File of the fixed page */
+    int pageNum;      /* Page number of the fixed page, -1 if none */
+    char *pageBuf;    /* The fixed page */
+    char *record;     /* The record, in pageBuf */
+    int length;       /* Length of the record */
+} RHF_RecordView;
+
+
 /* --- Slotted Page Structures --- */
 /*
  * This is the metadata header stored at the START of every page.
@@ -55,6 +70,48 @@ typedef struct {
     int recordLength;  /* Length of the record */
 } RHF_Slot;
 
+/* --- Free-Space Map --- */
+/*
+ * Page 0 of every RHF file is the file header page. It holds the
+ * RHF_FileHeader followed by the first block of the free-space map (FSM).
+ * The FSM keeps one byte per page of the file: the number of bytes still
+ * available for a record on that page, in units of (1 << RHF_FSM_SHIFT),
+ * which grows with the page size so that an entry stays below 256.
+ * Map page k covers pages [k * RHF_FSM_ENTRIES, (k+1) * RHF_FSM_ENTRIES).
+ * Both depend on the page size of the file, see PF_CreateFileSize().
+ *
+ * The map pages are listed in directory blocks of RHF_DIR_MAPPAGES
+ * entries, chained through nextDir. Block 0 is the header of page 0;
+ * block b > 0 is the header area of map page b * RHF_DIR_MAPPAGES, so
+ * the first entry of every block is the page holding it. The map thus
+ * grows with the file. numMapPages is only kept in page 0; the header
+ * area of the other map pages is unused apart from mapMark.
+ */
+#define RHF_HDR_PAGE      0   /* page number of the file header page */
+#define RHF_MAPPAGE      -1   /* mapMark value; data pages have numSlots >= 0 */
+#define RHF_DIR_MAPPAGES  64  /* # of map pages listed by a directory block */
+/* FSM granularity is 16 bytes for pages of PF_PAGE_SIZE (4096) bytes,
+   256 for pages of PF_MAX_PAGE_SIZE bytes */
+#define RHF_FSM_SHIFT(pageSize) \
+    ((pageSize) > 32768 ? 8 : (pageSize) > 16384 ? 7 : \
+     (pageSize) > 8192 ? 6 : (pageSize) > 4096 ? 5 : 4)
+
+typedef struct {
+    int mapMark;      /* RHF_MAPPAGE (overlays RHF_PageHeader.numSlots) */
+    int numMapPages;  /* # of map pages in the file, including page 0 */
+    int nextDir;      /* page of the next directory block, or -1 */
+    int mapPages[RHF_DIR_MAPPAGES];  /* page number of each map page */
+    unsigned char mapMax[RHF_DIR_MAPPAGES]; /* upper bound of the largest
+                                               entry in each map page */
+} RHF_FileHeader;
+
+/* # of FSM entries held by one map page of 'pageSize' bytes */
+#define RHF_FSM_ENTRIES(pageSize) ((int)((pageSize) - sizeof(RHF_FileHeader)))
+
+/* Gets a pointer to the FSM entries of a map page */
+#define GET_FSM(page) ((unsigned char *)(page) + sizeof(RHF_FileHeader))
+
+
 /* --- Page Utility Macros --- */
 /* Gets a pointer to the page's header */
 #define GET_HEADER(page) ((RHF_PageHeader *)(page))
@@ -73,20 +130,81 @@ typedef struct {
 
 /* File Management */
 extern int RHF_CreateFile(char *fname);
+/* pageSize is a page size for PF_CreateFileSize; RHF_CreateFile uses
+   PF_PAGE_SIZE */
+extern int RHF_CreateFileSize(char *fname, int pageSize);
 extern int RHF_DestroyFile(char *fname);
 extern int RHF_OpenFile(char *fname);
+/* mode is PF_MODE_RDWR or PF_MODE_MMAP (read-only, zero-copy scans) */
+extern int RHF_OpenFileMode(char *fname, int mode);
 extern int RHF_CloseFile(int fd);
 
 /* Record Management */
 extern int RHF_InsertRecord(int fd, char *record, int length, RID *rid);
+/* Inserts the n records records[i] of lengths[i] bytes and sets rids[i]
+   to their RIDs. Each page is filled with as many records as fit under
+   one fix; once no page has room the rest go to new pages. If a record
+   is too long for a page nothing is inserted; on other errors the
+   records before the failing one are in. */
+extern int RHF_InsertRecords(int fd, char **records, int *lengths, int n, RID *rids);
 extern int RHF_DeleteRecord(int fd, RID *rid);
 extern int RHF_GetRecord(int fd, RID *rid, char *recordBuf, int *length);
+/* Calls found(arg, i, record, length) for the record of each of the n
+   RIDs, i being its place in rids. The records are visited in page
+   order, so each page is fixed once; record points into the fixed page
+   and is only valid until found returns. Stops at the first RID with no
+   record, or when found returns other than RHF_OK, and returns that.
+   Works in PF_MODE_MMAP. */
+extern int RHF_GetRecords(int fd, RID *rids, int n,
+                          int (*found)(void *arg, int i, char *record, int length),
+                          void *arg);
+
+/* Zero-copy access */
+/* A view must be set up with RHF_InitView before its first use. */
+extern void RHF_InitView(RHF_RecordView *view);
+/* Points view at the record of rid, which stays valid until the view is
+   released or pinned again. Keeps the page fixed if view already pins a
+   record of it, else releases that record first. Works in PF_MODE_MMAP. */
+extern int RHF_PinRecord(int fd, RID *rid, RHF_RecordView *view);
+extern int RHF_UnpinRecord(RHF_RecordView *view);
+
+/* Space Reclamation */
+/* Compacts every page holding deleted records and returns pages with no
+   live record to the PF free list. The file must have no scan open. */
+extern int RHF_Vacuum(int fd);
 
 /* Scan Management */
 extern int RHF_StartScan(int fd, RHF_Scan *scan);
 extern int RHF_GetNextRecord(RHF_Scan *scan, char *recordBuf, int *length, RID *rid);
+/* Like RHF_GetNextRecord, but sets *record to the record in the fixed
+   page instead of copying it. It is valid until the next call on the
+   scan or RHF_EndScan. */
+extern int RHF_GetNextRecordView(RHF_Scan *scan, char **record, int *length, RID *rid);
+/* Calls visit(arg, rid, record, length) in place for each record left
+   on the current page of the scan, or on the next page if none is left,
+   then releases that page. record is only valid until visit returns.
+   Returns RHF_OK after a page, RHF_EOF at the end of the file, or what
+   visit returned if other than RHF_OK: the scan then resumes after that
+   record. */
+extern int RHF_ScanPage(RHF_Scan *scan,
+                        int (*visit)(void *arg, RID *rid, char *record, int length),
+                        void *arg);
 extern int RHF_EndScan(RHF_Scan *scan);
 
+/* Parallel Scan */
+/* Scans the file with nworkers threads, the caller being one of them.
+   The pages are handed out in small runs to whichever worker is free,
+   and worker i calls visit(locals[i], rid, record, length) in place for
+   each record of its pages, record being valid until visit returns.
+   Then, unless merge is NULL, calls merge(result, locals[i]) for each
+   worker in turn. locals may be NULL. The scan stops once visit returns
+   other than RHF_OK, or on an error, and returns that. The records of
+   the file must not change during the scan. */
+extern int RHF_ParallelScan(int fd, int nworkers,
+                            int (*visit)(void *local, RID *rid, char *record, int length),
+                            void **locals,
+                            void (*merge)(void *result, void *local), void *result);
+
 /* Utility */
 extern void RHF_PrintError(char *s, int err);
 
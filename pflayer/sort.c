@@ -0,0 +1,575 @@
+/* sort.c: Implementation of the external merge sort */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sort.h"
+
+/* smallest read buffer of a run */
+#define SORT_BLOCK (SORT_BLOCK_PAGES * PF_PAGE_SIZE)
+
+/*
+ * Items are kept as an int length followed by the item bytes, both in
+ * memory and in the run file. In memory they fill the sort area from the
+ * bottom, and pointers to them fill it from the top.
+ */
+
+/* Extent of a run in the run file */
+typedef struct {
+    off_t start;
+    off_t end;
+} sort_Run;
+
+/* Reads a run through a window of the run file */
+typedef struct {
+    off_t pos;        /* next byte of the run to read */
+    off_t end;        /* end of the run */
+    char *buf;        /* the window */
+    int size;         /* size of the window */
+    int have;         /* bytes in the window */
+    int off;          /* offset of the current item in the window */
+    int done;         /* TRUE if the run has no item left */
+} sort_Cursor;
+
+/* Appends items to a run file */
+typedef struct {
+    FILE *file;
+    off_t pos;        /* offset in the file of buf[0] */
+    char *buf;
+    int used;         /* bytes in buf */
+} sort_Writer;
+
+struct SORT_Sort {
+    SORT_CompareFn cmp;
+    void *cmpArg;
+
+    char *area;       /* sort memory: items, then merge windows */
+    size_t areaSize;
+    size_t used;      /* bytes of items at the bottom of the area */
+    int numItems;     /* # of item pointers at the top of the area */
+    int fanIn;        /* most runs merged at once */
+
+    char *outBuf;     /* SORT_BLOCK bytes for writing runs */
+    FILE *runFile;    /* runs not merged yet */
+    off_t runEnd;     /* end of the runs in runFile */
+    sort_Run *runs;
+    int numRuns;
+    int maxRuns;
+    int totalRuns;    /* # of runs written from memory */
+    int numPasses;    /* # of merge passes written to disk */
+
+    int output;       /* TRUE once SORT_Next() has been called */
+    int error;        /* error that stopped the output, if any */
+    int next;         /* next item of a sort done in memory */
+    sort_Cursor *cursors;  /* runs being merged */
+    int numCursors;
+    int *tree;        /* loser tree over the cursors */
+};
+
+/* Gets the array of item pointers at the top of the area */
+#define SORT_PTRS(s) ((char **)((s)->area + (s)->areaSize) - (s)->numItems)
+
+/* Gets the length of an item stored at p */
+static int sort_Length(char *p)
+{
+    int length;
+
+    memcpy(&length, p, sizeof(int));
+    return length;
+}
+
+static int sort_ComparePtrs(const void *pa, const void *pb, void *arg)
+{
+    SORT_Sort *s = (SORT_Sort *)arg;
+    char *a = *(char **)pa, *b = *(char **)pb;
+
+    return s->cmp(a + sizeof(int), sort_Length(a), b + sizeof(int), sort_Length(b),
+                  s->cmpArg);
+}
+
+/*
+ * Run files
+ */
+static int sort_Flush(sort_Writer *w)
+{
+    int done = 0, n;
+
+    while (done < w->used) {
+        n = pwrite(fileno(w->file), w->buf + done, w->used - done, w->pos + done);
+        if (n <= 0) {
+            return SORT_UNIX;
+        }
+        done += n;
+    }
+    w->pos += w->used;
+    w->used = 0;
+    return SORT_OK;
+}
+
+static int sort_Write(sort_Writer *w, char *data, int length)
+{
+    int n, error;
+
+    while (length > 0) {
+        if (w->used == SORT_BLOCK && (error = sort_Flush(w)) != SORT_OK) {
+            return error;
+        }
+        n = SORT_BLOCK - w->used;
+        if (n > length) n = length;
+        memcpy(w->buf + w->used, data, n);
+        w->used += n;
+        data += n;
+        length -= n;
+    }
+    return SORT_OK;
+}
+
+/* Records a run ending at the writer's current position */
+static int sort_AddRun(SORT_Sort *s, int index, off_t start, sort_Writer *w)
+{
+    sort_Run *runs;
+
+    if (index == s->maxRuns) {
+        s->maxRuns = s->maxRuns ? 2 * s->maxRuns : 16;
+        runs = (sort_Run *)realloc(s->runs, s->maxRuns * sizeof(sort_Run));
+        if (runs == NULL) {
+            return SORT_NOMEM;
+        }
+        s->runs = runs;
+    }
+    s->runs[index].start = start;
+    s->runs[index].end = w->pos + w->used;
+    return SORT_OK;
+}
+
+/* Sorts the items in memory and writes them out as a new run */
+static int sort_Spill(SORT_Sort *s)
+{
+    sort_Writer w;
+    char **ptrs = SORT_PTRS(s);
+    off_t start;
+    int i, error;
+
+    if (s->runFile == NULL && (s->runFile = tmpfile()) == NULL) {
+        return SORT_UNIX;
+    }
+    qsort_r(ptrs, s->numItems, sizeof(char *), sort_ComparePtrs, s);
+
+    w.file = s->runFile;
+    w.pos = s->runEnd;
+    w.buf = s->outBuf;
+    w.used = 0;
+    start = s->runEnd;
+    for (i = 0; i < s->numItems; i++) {
+        if ((error = sort_Write(&w, ptrs[i], sizeof(int) + sort_Length(ptrs[i]))) != SORT_OK) {
+            return error;
+        }
+    }
+    if ((error = sort_AddRun(s, s->numRuns, start, &w)) != SORT_OK ||
+        (error = sort_Flush(&w)) != SORT_OK) {
+        return error;
+    }
+    s->runEnd = w.pos;
+    s->numRuns++;
+    s->totalRuns++;
+    s->used = 0;
+    s->numItems = 0;
+    return SORT_OK;
+}
+
+/*
+ * Merging
+ */
+
+/* Moves the unread bytes of the window to its front and reads more */
+static int sort_Fill(SORT_Sort *s, sort_Cursor *c)
+{
+    int n, got;
+
+    memmove(c->buf, c->buf + c->off, c->have - c->off);
+    c->have -= c->off;
+    c->off = 0;
+    n = c->size - c->have;
+    if (n > c->end - c->pos) n = c->end - c->pos;
+    while (n > 0) {
+        got = pread(fileno(s->runFile), c->buf + c->have, n, c->pos);
+        if (got <= 0) {
+            return SORT_UNIX;
+        }
+        c->have += got;
+        c->pos += got;
+        n -= got;
+    }
+    return SORT_OK;
+}
+
+/* Makes sure the current item of the cursor is whole in its window */
+static int sort_Load(SORT_Sort *s, sort_Cursor *c)
+{
+    int error;
+
+    if (c->off == c->have && c->pos == c->end) {
+        c->done = TRUE;
+        return SORT_OK;
+    }
+    if (c->have - c->off < (int)sizeof(int) && (error = sort_Fill(s, c)) != SORT_OK) {
+        return error;
+    }
+    if (c->have - c->off < (int)sizeof(int) + sort_Length(c->buf + c->off) &&
+        (error = sort_Fill(s, c)) != SORT_OK) {
+        return error;
+    }
+    return SORT_OK;
+}
+
+/*
+ * TRUE if cursor a's item sorts after cursor b's. numCursors stands for
+ * an item before all others, and a finished cursor for one after all
+ * others. Ties go to the earlier run, which keeps the merge stable.
+ */
+static int sort_Loses(SORT_Sort *s, int a, int b)
+{
+    sort_Cursor *ca, *cb;
+    int result;
+
+    if (a == s->numCursors) return FALSE;
+    if (b == s->numCursors) return TRUE;
+    ca = &s->cursors[a];
+    cb = &s->cursors[b];
+    if (cb->done) return FALSE;
+    if (ca->done) return TRUE;
+    result = s->cmp(ca->buf + ca->off + sizeof(int), sort_Length(ca->buf + ca->off),
+                    cb->buf + cb->off + sizeof(int), sort_Length(cb->buf + cb->off),
+                    s->cmpArg);
+    return result > 0 || (result == 0 && a > b);
+}
+
+/* Replays the matches of cursor c's new item up to the root of the tree */
+static void sort_Adjust(SORT_Sort *s, int c)
+{
+    int t, temp;
+
+    for (t = (c + s->numCursors) / 2; t > 0; t /= 2) {
+        if (sort_Loses(s, c, s->tree[t])) {
+            temp = s->tree[t];
+            s->tree[t] = c;
+            c = temp;
+        }
+    }
+    s->tree[0] = c;
+}
+
+/* Starts merging runs [first, first+count), with windows of size bytes */
+static int sort_StartMerge(SORT_Sort *s, int first, int count, int size)
+{
+    sort_Cursor *c;
+    int i, error;
+
+    s->numCursors = count;
+    for (i = 0; i < count; i++) {
+        c = &s->cursors[i];
+        c->pos = s->runs[first + i].start;
+        c->end = s->runs[first + i].end;
+        c->buf = s->area + (size_t)i * size;
+        c->size = size;
+        c->have = 0;
+        c->off = 0;
+        c->done = FALSE;
+        if ((error = sort_Load(s, c)) != SORT_OK) {
+            return error;
+        }
+        s->tree[i] = count;
+    }
+    for (i = count - 1; i >= 0; i--) {
+        sort_Adjust(s, i);
+    }
+    return SORT_OK;
+}
+
+/* Gets the smallest item of the merge, or NULL when it is over */
+static char *sort_Winner(SORT_Sort *s)
+{
+    sort_Cursor *c = &s->cursors[s->tree[0]];
+
+    return c->done ? NULL : c->buf + c->off;
+}
+
+/* Moves past the smallest item of the merge */
+static int sort_Advance(SORT_Sort *s)
+{
+    int w = s->tree[0];
+    sort_Cursor *c = &s->cursors[w];
+    int error;
+
+    c->off += sizeof(int) + sort_Length(c->buf + c->off);
+    if ((error = sort_Load(s, c)) != SORT_OK) {
+        return error;
+    }
+    sort_Adjust(s, w);
+    return SORT_OK;
+}
+
+/* Merges the runs fanIn at a time into a new run file */
+static int sort_MergePass(SORT_Sort *s)
+{
+    sort_Writer w;
+    FILE *old = s->runFile;
+    char *item;
+    off_t start;
+    int first, count, numRuns, error;
+
+    if ((w.file = tmpfile()) == NULL) {
+        return SORT_UNIX;
+    }
+    w.pos = 0;
+    w.buf = s->outBuf;
+    w.used = 0;
+
+    /* the new runs take the place of the old ones, which are read first */
+    numRuns = 0;
+    for (first = 0; first < s->numRuns; first += count) {
+        count = s->numRuns - first;
+        if (count > s->fanIn) count = s->fanIn;
+        if ((error = sort_StartMerge(s, first, count, s->areaSize / count)) != SORT_OK) {
+            fclose(w.file);
+            return error;
+        }
+        start = w.pos + w.used;
+        while ((item = sort_Winner(s)) != NULL) {
+            if ((error = sort_Write(&w, item, sizeof(int) + sort_Length(item))) != SORT_OK ||
+                (error = sort_Advance(s)) != SORT_OK) {
+                fclose(w.file);
+                return error;
+            }
+        }
+        if ((error = sort_AddRun(s, numRuns, start, &w)) != SORT_OK) {
+            fclose(w.file);
+            return error;
+        }
+        numRuns++;
+    }
+    if ((error = sort_Flush(&w)) != SORT_OK) {
+        fclose(w.file);
+        return error;
+    }
+    fclose(old);
+    s->runFile = w.file;
+    s->runEnd = w.pos;
+    s->numRuns = numRuns;
+    s->numPasses++;
+    return SORT_OK;
+}
+
+/* Ends the input: sorts it in memory, or merges the runs down to the
+   last merge */
+static int sort_Finish(SORT_Sort *s)
+{
+    int error;
+
+    if (s->numRuns == 0) {
+        qsort_r(SORT_PTRS(s), s->numItems, sizeof(char *), sort_ComparePtrs, s);
+        s->next = 0;
+        return SORT_OK;
+    }
+    if (s->numItems > 0 && (error = sort_Spill(s)) != SORT_OK) {
+        return error;
+    }
+    while (s->numRuns > s->fanIn) {
+        if ((error = sort_MergePass(s)) != SORT_OK) {
+            return error;
+        }
+    }
+    return sort_StartMerge(s, 0, s->numRuns, s->areaSize / s->numRuns);
+}
+
+/*
+ * Public API
+ */
+int SORT_CompareKey(char *a, int alen, char *b, int blen, void *arg)
+{
+    SORT_Key *key = (SORT_Key *)arg;
+    int ia, ib;
+    float fa, fb;
+
+    a += key->offset;
+    b += key->offset;
+    switch (key->attrType) {
+        case 'i':
+            memcpy(&ia, a, sizeof(int));
+            memcpy(&ib, b, sizeof(int));
+            return (ia > ib) - (ia < ib);
+        case 'f':
+            memcpy(&fa, a, sizeof(float));
+            memcpy(&fb, b, sizeof(float));
+            return (fa > fb) - (fa < fb);
+        default:
+            return strncmp(a, b, key->attrLength);
+    }
+}
+
+int SORT_Begin(SORT_Sort **sort, int memPages, SORT_CompareFn cmp, void *cmpArg)
+{
+    SORT_Sort *s;
+
+    if (memPages <= 0) {
+        memPages = PF_GetBufferSize();
+    }
+    if (memPages < SORT_MIN_PAGES) {
+        memPages = SORT_MIN_PAGES;
+    }
+    if ((s = (SORT_Sort *)calloc(1, sizeof(SORT_Sort))) == NULL) {
+        return SORT_NOMEM;
+    }
+    s->cmp = cmp;
+    s->cmpArg = cmpArg;
+    s->areaSize = (size_t)memPages * PF_PAGE_SIZE;
+    s->areaSize -= s->areaSize % sizeof(char *);
+    s->fanIn = s->areaSize / SORT_BLOCK - 1;
+    s->area = (char *)malloc(s->areaSize);
+    s->outBuf = (char *)malloc(SORT_BLOCK);
+    s->cursors = (sort_Cursor *)malloc(s->fanIn * sizeof(sort_Cursor));
+    s->tree = (int *)malloc(s->fanIn * sizeof(int));
+    if (s->area == NULL || s->outBuf == NULL || s->cursors == NULL || s->tree == NULL) {
+        SORT_End(s);
+        return SORT_NOMEM;
+    }
+    *sort = s;
+    return SORT_OK;
+}
+
+int SORT_Insert(SORT_Sort *sort, char *item, int length)
+{
+    char *p;
+    int error;
+
+    if (sort->output) {
+        return SORT_SORTED;
+    }
+    if (length < 0 || length > SORT_MAX_ITEM) {
+        return SORT_TOOBIG;
+    }
+
+    /* a full area is written out as a run */
+    if (sort->used + sizeof(int) + length + (sort->numItems + 1) * sizeof(char *) >
+        sort->areaSize && (error = sort_Spill(sort)) != SORT_OK) {
+        return error;
+    }
+    p = sort->area + sort->used;
+    memcpy(p, &length, sizeof(int));
+    memcpy(p + sizeof(int), item, length);
+    sort->used += sizeof(int) + length;
+    sort->numItems++;
+    SORT_PTRS(sort)[0] = p;
+    return SORT_OK;
+}
+
+int SORT_InsertFile(SORT_Sort *sort, int fd, SORT_ItemFn make, void *arg)
+{
+    RHF_Scan scan;
+    RID rid;
+    char *record;  /* in the page, as long as the scan stays on it */
+    char item[SORT_MAX_ITEM];
+    int length, error;
+
+    if ((error = RHF_StartScan(fd, &scan)) != RHF_OK) {
+        return error;
+    }
+    while ((error = RHF_GetNextRecordView(&scan, &record, &length, &rid)) == RHF_OK) {
+        if (make == NULL) {
+            error = SORT_Insert(sort, record, length);
+        }
+        else if ((length = make(record, length, &rid, item, arg)) < 0) {
+            error = length;
+        }
+        else {
+            error = SORT_Insert(sort, item, length);
+        }
+        if (error != SORT_OK) {
+            break;
+        }
+    }
+    RHF_EndScan(&scan);
+    return (error == RHF_EOF) ? SORT_OK : error;
+}
+
+int SORT_Next(SORT_Sort *sort, char *item, int *length)
+{
+    char *p;
+
+    if (!sort->output) {
+        sort->output = TRUE;
+        sort->error = sort_Finish(sort);
+    }
+    if (sort->error != SORT_OK) {
+        return sort->error;
+    }
+
+    if (sort->numRuns == 0) {
+        /* everything fit in memory */
+        if (sort->next == sort->numItems) {
+            return SORT_EOF;
+        }
+        p = SORT_PTRS(sort)[sort->next++];
+    }
+    else if ((p = sort_Winner(sort)) == NULL) {
+        return SORT_EOF;
+    }
+    if (sort_Length(p) > *length) {
+        return SORT_TOOBIG;
+    }
+    *length = sort_Length(p);
+    memcpy(item, p + sizeof(int), *length);
+    if (sort->numRuns > 0) {
+        sort->error = sort_Advance(sort);
+    }
+    return SORT_OK;
+}
+
+void SORT_GetStats(SORT_Sort *sort, int *numRuns, int *numPasses)
+{
+    *numRuns = sort->totalRuns;
+    *numPasses = sort->numPasses;
+}
+
+int SORT_End(SORT_Sort *sort)
+{
+    if (sort->runFile != NULL) {
+        fclose(sort->runFile);
+    }
+    free(sort->area);
+    free(sort->outBuf);
+    free(sort->runs);
+    free(sort->cursors);
+    free(sort->tree);
+    free(sort);
+    return SORT_OK;
+}
+
+/*
+ * Helper for printing sort errors
+ */
+void SORT_PrintError(char *s, int err)
+{
+    switch(err) {
+        case SORT_EOF:
+            fprintf(stderr, "%s: No more items.\n", s);
+            break;
+        case SORT_NOMEM:
+            fprintf(stderr, "%s: Out of memory.\n", s);
+            break;
+        case SORT_TOOBIG:
+            fprintf(stderr, "%s: Item too long to sort.\n", s);
+            break;
+        case SORT_UNIX:
+            perror(s);
+            break;
+        case SORT_SORTED:
+            fprintf(stderr, "%s: Items inserted after the output started.\n", s);
+            break;
+        default:
+            /* Assume it's an RHF or PF error */
+            RHF_PrintError(s, err);
+            break;
+    }
+}
@@ -0,0 +1,78 @@
+/* sort.h: Public interface for the external merge sort */
+#ifndef SORT_H
+#define SORT_H
+
+#include "rhf.h"
+
+/* --- Error Codes --- */
+#define SORT_OK         0
+#define SORT_EOF      -30  /* No more items */
+#define SORT_NOMEM    -31  /* Out of memory */
+#define SORT_TOOBIG   -32  /* Item longer than SORT_MAX_ITEM or the buffer */
+#define SORT_UNIX     -33  /* Unix error on a run file, see errno */
+#define SORT_SORTED   -34  /* Items inserted after the first SORT_Next() */
+
+/*
+ * Items are byte strings of up to SORT_MAX_ITEM bytes. They are sorted in
+ * memory a run at a time; runs too large for memory go to a temporary
+ * file and are merged, SORT_BLOCK_PAGES pages per run at least, with a
+ * loser tree.
+ */
+#define SORT_BLOCK_PAGES  4    /* smallest read buffer of a run, in pages */
+#define SORT_MIN_PAGES    (3 * SORT_BLOCK_PAGES)  /* smallest sort memory */
+#define SORT_MAX_ITEM     (SORT_BLOCK_PAGES * PF_PAGE_SIZE - (int)sizeof(int))
+
+/*
+ * Comparison function: returns < 0, 0 or > 0 as item a sorts before,
+ * with, or after item b.
+ */
+typedef int (*SORT_CompareFn)(char *a, int alen, char *b, int blen, void *arg);
+
+/*
+ * A key at a fixed offset of every item, compared like the AM layer
+ * compares keys: 'i' as an int, 'f' as a float, 'c' as attrLength
+ * characters. SORT_CompareKey() takes a SORT_Key as its argument.
+ */
+typedef struct {
+    int offset;       /* offset of the key in the item */
+    char attrType;    /* 'i', 'f' or 'c' */
+    int attrLength;   /* 4 for 'i' or 'f', 1-255 for 'c' */
+} SORT_Key;
+
+extern int SORT_CompareKey(char *a, int alen, char *b, int blen, void *arg);
+
+/*
+ * Builds the item to sort for a record found by SORT_InsertFile().
+ * Returns the item's length, or a negative error code to stop.
+ */
+typedef int (*SORT_ItemFn)(char *record, int length, RID *rid, char *item, void *arg);
+
+typedef struct SORT_Sort SORT_Sort;
+
+/* --- Public Sort API Functions --- */
+
+/* Starts a sort using memPages pages of memory, or as many pages as the
+   PF buffer pool if memPages is 0 */
+extern int SORT_Begin(SORT_Sort **sort, int memPages, SORT_CompareFn cmp, void *cmpArg);
+
+/* Input */
+extern int SORT_Insert(SORT_Sort *sort, char *item, int length);
+/* Inserts an item for every record of an RHF file, as built by make, or
+   the record itself if make is NULL */
+extern int SORT_InsertFile(SORT_Sort *sort, int fd, SORT_ItemFn make, void *arg);
+
+/* Output, in order. The first call ends the input. *length is the size
+   of item on input and the length of the item on output; SORT_TOOBIG is
+   returned, and the item kept, if it does not fit. */
+extern int SORT_Next(SORT_Sort *sort, char *item, int *length);
+
+/* # of runs written to disk and of merge passes before the last merge */
+extern void SORT_GetStats(SORT_Sort *sort, int *numRuns, int *numPasses);
+
+/* Frees the sort and its run files */
+extern int SORT_End(SORT_Sort *sort);
+
+/* Utility */
+extern void SORT_PrintError(char *s, int err);
+
+#endif
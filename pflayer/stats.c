@@ -0,0 +1,348 @@
+/* stats.c: detailed statistics of the PF layer: the counters of each
+open file, latency histograms and event counters. They are kept with
+relaxed atomic adds, by any thread, while PFstatson is TRUE; the
+counters of PF_GetStats() are kept by buf.c. */
+#include <stdio.h>
+#include <time.h>
+#include "pf.h"
+#include "pftypes.h"
+
+#ifndef PF_NO_STATS
+int PFstatson = FALSE;	/* TRUE while the statistics are kept */
+PF_FileStats PFfilestats[PF_FTAB_SIZE];	/* counters of each open file */
+static long PFstathist[PF_HIST_NUM][PF_HIST_BUCKETS];	/* histograms */
+static long PFstatcount[PF_CNT_NUM];	/* event counters */
+#endif
+
+/* names of the histograms and counters in PF_DumpStats() */
+static char *PFhistname[PF_HIST_NUM] = {
+	"read", "write", "rhf_insert", "am_search"
+};
+static char *PFcountname[PF_CNT_NUM] = {
+	"nobuf", "am_splits", "am_scan_pages"
+};
+
+#define PFstatLoad(counter)	__atomic_load_n(&(counter),__ATOMIC_RELAXED)
+
+
+long PFstatClock(void)
+/****************************************************************************
+SPECIFICATIONS:
+	Return the time in nanoseconds from some fixed point, never 0.
+*****************************************************************************/
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return((long)ts.tv_sec * 1000000000L + ts.tv_nsec + 1);
+}
+
+void PFstatRecord(hist,start)
+int hist;	/* histogram */
+long start;	/* PFstatClock() when the operation started */
+/****************************************************************************
+SPECIFICATIONS:
+	Count the time since "start" in histogram "hist": bucket 0 for
+	less than 1 microsecond, bucket i for 2^(i-1) to 2^i - 1
+	microseconds, the last bucket for anything longer.
+*****************************************************************************/
+{
+#ifndef PF_NO_STATS
+long usecs;	/* latency in microseconds */
+int bucket;
+
+	usecs = (PFstatClock() - start) / 1000;
+	for (bucket = 0; usecs > 0 && bucket < PF_HIST_BUCKETS - 1; bucket++)
+		usecs >>= 1;
+	__atomic_fetch_add(&PFstathist[hist][bucket],1,__ATOMIC_RELAXED);
+#endif
+}
+
+void PFstatCount(counter,n)
+int counter;	/* event counter */
+long n;		/* amount to add */
+/****************************************************************************
+SPECIFICATIONS:
+	Add "n" to event counter "counter", if the statistics are on.
+*****************************************************************************/
+{
+#ifndef PF_NO_STATS
+	if (PFstatOn())
+		__atomic_fetch_add(&PFstatcount[counter],n,__ATOMIC_RELAXED);
+#endif
+}
+
+void PFstatResetFile(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Reset the counters of file "fd", which is being opened.
+*****************************************************************************/
+{
+#ifndef PF_NO_STATS
+	__atomic_store_n(&PFfilestats[fd].hits,0,__ATOMIC_RELAXED);
+	__atomic_store_n(&PFfilestats[fd].misses,0,__ATOMIC_RELAXED);
+	__atomic_store_n(&PFfilestats[fd].evictions,0,__ATOMIC_RELAXED);
+	__atomic_store_n(&PFfilestats[fd].dirty_evictions,0,__ATOMIC_RELAXED);
+	__atomic_store_n(&PFfilestats[fd].prefetch_hits,0,__ATOMIC_RELAXED);
+	__atomic_store_n(&PFfilestats[fd].reads,0,__ATOMIC_RELAXED);
+	__atomic_store_n(&PFfilestats[fd].writes,0,__ATOMIC_RELAXED);
+#endif
+}
+
+void PFstatReset(void)
+/****************************************************************************
+SPECIFICATIONS:
+	Reset the counters of every file, the histograms and the event
+	counters.
+*****************************************************************************/
+{
+#ifndef PF_NO_STATS
+int i,j;
+
+	for (i=0; i < PF_FTAB_SIZE; i++)
+		PFstatResetFile(i);
+	for (i=0; i < PF_HIST_NUM; i++)
+		for (j=0; j < PF_HIST_BUCKETS; j++)
+			__atomic_store_n(&PFstathist[i][j],0,__ATOMIC_RELAXED);
+	for (i=0; i < PF_CNT_NUM; i++)
+		__atomic_store_n(&PFstatcount[i],0,__ATOMIC_RELAXED);
+#endif
+}
+
+void PFstatGetFile(fd,stats)
+int fd;		/* file descriptor */
+PF_FileStats *stats;	/* set to the counters of the file */
+/****************************************************************************
+SPECIFICATIONS:
+	Set *stats to the counters of file "fd".
+*****************************************************************************/
+{
+#ifndef PF_NO_STATS
+	stats->hits = PFstatLoad(PFfilestats[fd].hits);
+	stats->misses = PFstatLoad(PFfilestats[fd].misses);
+	stats->evictions = PFstatLoad(PFfilestats[fd].evictions);
+	stats->dirty_evictions = PFstatLoad(PFfilestats[fd].dirty_evictions);
+	stats->prefetch_hits = PFstatLoad(PFfilestats[fd].prefetch_hits);
+	stats->reads = PFstatLoad(PFfilestats[fd].reads);
+	stats->writes = PFstatLoad(PFfilestats[fd].writes);
+#else
+	stats->hits = stats->misses = stats->evictions = 0;
+	stats->dirty_evictions = stats->prefetch_hits = 0;
+	stats->reads = stats->writes = 0;
+#endif
+}
+
+static long PFstatGetHist(hist,bucket)
+int hist;	/* histogram */
+int bucket;	/* bucket of it */
+{
+#ifndef PF_NO_STATS
+	return(PFstatLoad(PFstathist[hist][bucket]));
+#else
+	return(0);
+#endif
+}
+
+static long PFstatGetCount(counter)
+int counter;	/* event counter */
+{
+#ifndef PF_NO_STATS
+	return(PFstatLoad(PFstatcount[counter]));
+#else
+	return(0);
+#endif
+}
+
+static void PFstatPutName(fp,name,format)
+FILE *fp;
+char *name;	/* file name */
+int format;	/* PF_STATS_JSON or PF_STATS_CSV */
+/****************************************************************************
+SPECIFICATIONS:
+	Write "name" as a quoted JSON string or CSV field.
+*****************************************************************************/
+{
+	putc('"',fp);
+	for (; *name != '\0'; name++){
+		if (*name == '"')
+			fputs((format == PF_STATS_JSON) ? "\\\"" : "\"\"",fp);
+		else if (format == PF_STATS_JSON && *name == '\\')
+			fputs("\\\\",fp);
+		else if (format == PF_STATS_JSON &&
+				(unsigned char)*name < ' ')
+			fprintf(fp,"\\u%04x",(unsigned char)*name);
+		else	putc(*name,fp);
+	}
+	putc('"',fp);
+}
+
+static void PFstatCsvFile(fp,name,key,value)
+FILE *fp;
+char *name;	/* file name */
+char *key;	/* name of the counter */
+long value;
+{
+	fprintf(fp,"file,");
+	PFstatPutName(fp,name,PF_STATS_CSV);
+	fprintf(fp,",%s,%ld\n",key,value);
+}
+
+void PFstatDump(fp,format,fnames)
+FILE *fp;	/* where to write */
+int format;	/* PF_STATS_JSON or PF_STATS_CSV */
+char **fnames;	/* name of each open file, NULL for unused slots */
+/****************************************************************************
+SPECIFICATIONS:
+	Write every statistic onto "fp": see PF_DumpStats().
+*****************************************************************************/
+{
+long logical,physread,physwrite;
+PF_FileStats st;
+char *sep;	/* separator before the next JSON element */
+int i,j;
+
+	PFbufGetStats(&logical,&physread,&physwrite);
+	if (format == PF_STATS_CSV){
+		fprintf(fp,"kind,name,key,value\n");
+		fprintf(fp,"global,,logical_reads,%ld\n",logical);
+		fprintf(fp,"global,,physical_reads,%ld\n",physread);
+		fprintf(fp,"global,,physical_writes,%ld\n",physwrite);
+		for (i=0; i < PF_FTAB_SIZE; i++){
+			if (fnames[i] == NULL)
+				continue;
+			PFstatGetFile(i,&st);
+			PFstatCsvFile(fp,fnames[i],"hits",st.hits);
+			PFstatCsvFile(fp,fnames[i],"misses",st.misses);
+			PFstatCsvFile(fp,fnames[i],"evictions",st.evictions);
+			PFstatCsvFile(fp,fnames[i],"dirty_evictions",
+						st.dirty_evictions);
+			PFstatCsvFile(fp,fnames[i],"prefetch_hits",
+						st.prefetch_hits);
+			PFstatCsvFile(fp,fnames[i],"reads",st.reads);
+			PFstatCsvFile(fp,fnames[i],"writes",st.writes);
+		}
+		for (i=0; i < PF_CNT_NUM; i++)
+			fprintf(fp,"counter,,%s,%ld\n",PFcountname[i],
+						PFstatGetCount(i));
+		for (i=0; i < PF_HIST_NUM; i++)
+			for (j=0; j < PF_HIST_BUCKETS; j++)
+				fprintf(fp,"hist,%s,%d,%ld\n",PFhistname[i],j,
+						PFstatGetHist(i,j));
+		return;
+	}
+
+	fprintf(fp,"{\"logical_reads\": %ld, \"physical_reads\": %ld, ",
+						logical,physread);
+	fprintf(fp,"\"physical_writes\": %ld,\n \"files\": [",physwrite);
+	sep = "";
+	for (i=0; i < PF_FTAB_SIZE; i++){
+		if (fnames[i] == NULL)
+			continue;
+		PFstatGetFile(i,&st);
+		fprintf(fp,"%s\n  {\"fd\": %d, \"name\": ",sep,i);
+		PFstatPutName(fp,fnames[i],format);
+		fprintf(fp,", \"hits\": %ld, \"misses\": %ld, ",
+						st.hits,st.misses);
+		fprintf(fp,"\"evictions\": %ld, \"dirty_evictions\": %ld, ",
+						st.evictions,st.dirty_evictions);
+		fprintf(fp,"\"prefetch_hits\": %ld, \"reads\": %ld, ",
+						st.prefetch_hits,st.reads);
+		fprintf(fp,"\"writes\": %ld}",st.writes);
+		sep = ",";
+	}
+	fprintf(fp,"],\n \"counters\": {");
+	for (i=0; i < PF_CNT_NUM; i++)
+		fprintf(fp,"%s\"%s\": %ld",(i > 0) ? ", " : "",PFcountname[i],
+						PFstatGetCount(i));
+	fprintf(fp,"},\n \"histograms\": {");
+	for (i=0; i < PF_HIST_NUM; i++){
+		fprintf(fp,"%s\n  \"%s\": [",(i > 0) ? "," : "",PFhistname[i]);
+		for (j=0; j < PF_HIST_BUCKETS; j++)
+			fprintf(fp,"%s%ld",(j > 0) ? ", " : "",PFstatGetHist(i,j));
+		fprintf(fp,"]");
+	}
+	fprintf(fp,"}}\n");
+}
+
+/****************************************************************************/
+
+void PF_SetStats(int on)
+/****************************************************************************
+SPECIFICATIONS:
+	Turn the detailed statistics on or off.
+*****************************************************************************/
+{
+#ifndef PF_NO_STATS
+	__atomic_store_n(&PFstatson,on ? TRUE : FALSE,__ATOMIC_RELAXED);
+#endif
+}
+
+int PF_GetHistogram(int hist, long *counts)
+/****************************************************************************
+SPECIFICATIONS:
+	Set counts[0..PF_HIST_BUCKETS-1] to the counts of histogram "hist".
+
+RETURN VALUE:
+	PFE_OK	if ok.
+	PFE_NOSTAT	if there is no such histogram.
+*****************************************************************************/
+{
+int j;
+
+	if (hist < 0 || hist >= PF_HIST_NUM){
+		PFerrno = PFE_NOSTAT;
+		return(PFerrno);
+	}
+	for (j=0; j < PF_HIST_BUCKETS; j++)
+		counts[j] = PFstatGetHist(hist,j);
+	return(PFE_OK);
+}
+
+long PF_GetCounter(int counter)
+/****************************************************************************
+SPECIFICATIONS:
+	Return event counter "counter".
+
+RETURN VALUE:
+	the count.
+	PFE_NOSTAT	if there is no such counter.
+*****************************************************************************/
+{
+	if (counter < 0 || counter >= PF_CNT_NUM){
+		PFerrno = PFE_NOSTAT;
+		return(PFerrno);
+	}
+	return(PFstatGetCount(counter));
+}
+
+long PF_StatsStart(void)
+/****************************************************************************
+SPECIFICATIONS:
+	Return the start time of an operation, or 0 if the statistics
+	are off.
+*****************************************************************************/
+{
+	return(PFstatStart());
+}
+
+void PF_StatsEnd(int hist, long start)
+/****************************************************************************
+SPECIFICATIONS:
+	Count the time since "start", from PF_StatsStart(), in histogram
+	"hist", unless "start" is 0.
+*****************************************************************************/
+{
+	if (start != 0 && hist >= 0 && hist < PF_HIST_NUM)
+		PFstatRecord(hist,start);
+}
+
+void PF_StatsCount(int counter, long n)
+/****************************************************************************
+SPECIFICATIONS:
+	Add "n" to event counter "counter", if the statistics are on.
+*****************************************************************************/
+{
+	if (counter >= 0 && counter < PF_CNT_NUM)
+		PFstatCount(counter,n);
+}
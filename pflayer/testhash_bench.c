@@ -0,0 +1,91 @@
+/* testhash_bench.c: Times PF hash table lookups for a range of pool sizes */
+#include <stdio.h>
+#include <stdlib.h> /* For rand, srand, exit */
+#include <time.h>   /* For clock_gettime */
+#include "pf.h"
+#include "pftypes.h"
+
+/* CONFIGURATION */
+#define NUM_FILES 4         /* resident pages are spread over this many fds */
+#define LOOKUPS 2000000     /* Number of lookups timed per pool size */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Fills the table with "npages" entries the way a buffer pool of that
+ * size would (a run of pages per open file), then times hits, misses
+ * and delete/insert churn. The bpage pointers are never dereferenced.
+ */
+static void bench(int npages)
+{
+    int i, fd, page, per_file;
+    long found = 0;
+    double t0, hit_ns, miss_ns, churn_ns;
+
+    PFhashInit();
+    PFhashReserve(npages);
+    per_file = npages / NUM_FILES;
+    for (i = 0; i < npages; i++) {
+        fd = i % NUM_FILES;
+        page = i / NUM_FILES;
+        if (PFhashInsert(fd, page, (PFbpage *)(long)(i + 1)) != PFE_OK) {
+            printf("PFhashInsert failed at %d\n", i);
+            exit(1);
+        }
+    }
+
+    /* hits: random resident pages */
+    srand(1);
+    t0 = now_ns();
+    for (i = 0; i < LOOKUPS; i++) {
+        fd = rand() % NUM_FILES;
+        page = rand() % per_file;
+        if (PFhashFind(fd, page) != NULL)
+            found++;
+    }
+    hit_ns = (now_ns() - t0) / LOOKUPS;
+
+    /* misses: pages past the end of each file */
+    t0 = now_ns();
+    for (i = 0; i < LOOKUPS; i++) {
+        fd = rand() % NUM_FILES;
+        page = per_file + 1 + rand() % per_file;
+        if (PFhashFind(fd, page) != NULL)
+            found++;
+    }
+    miss_ns = (now_ns() - t0) / LOOKUPS;
+
+    /* churn: replace a resident page by a new one, as page replacement does */
+    t0 = now_ns();
+    for (i = 0; i < LOOKUPS / 2; i++) {
+        fd = i % NUM_FILES;
+        page = i / NUM_FILES;
+        PFhashDelete(fd, page);
+        PFhashInsert(fd, page + per_file, (PFbpage *)(long)(i + 1));
+    }
+    churn_ns = (now_ns() - t0) / (LOOKUPS / 2);
+
+    if (found != LOOKUPS) {
+        printf("lookup mismatch: found %ld of %d\n", found, LOOKUPS);
+        exit(1);
+    }
+
+    /* Format: PoolPages, HitNs, MissNs, ReplaceNs */
+    printf("%d,%.1f,%.1f,%.1f\n", npages, hit_ns, miss_ns, churn_ns);
+}
+
+int main(void)
+{
+    static int sizes[] = { 20, 100, 1000, 10000, 100000 };
+    int i;
+
+    printf("PoolPages,HitNs,MissNs,ReplaceNs\n");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+        bench(sizes[i]);
+    return 0;
+}
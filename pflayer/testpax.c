@@ -0,0 +1,211 @@
+/* testpax.c: Test program for PAX files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pax.h"
+
+#define PAX_FILE "students_pax.db"
+#define RHF_FILE "students_rows.db"
+#define NUM_RECORDS 10000
+#define NAME_LEN 20
+
+/* A student record; its fields have no padding, so it is also a row */
+typedef struct {
+    int studentID;
+    float gpa;
+    char name[NAME_LEN];
+} Student;
+
+static void make_student(Student *s, int i)
+{
+    memset(s, 0, sizeof(Student));
+    s->studentID = i;
+    s->gpa = (float)(i % 40) / 10.0;
+    sprintf(s->name, "student%d", i);
+}
+
+/* Whether a student satisfies "gpa >= 3.5 and name < student5" */
+static int good_student(Student *s)
+{
+    return s->gpa >= 3.5 && strncmp(s->name, "student5", NAME_LEN) < 0;
+}
+
+/* Counts the rows selected, and those that do not satisfy the predicate */
+typedef struct {
+    int count;
+    int wrong;
+} Totals;
+
+int check_row(void *arg, RID *rid, char *row)
+{
+    Totals *t = (Totals *)arg;
+    Student s;
+
+    memcpy(&s, row, sizeof(Student));
+    t->count++;
+    if (!good_student(&s))
+        t->wrong++;
+    return RHF_OK;
+}
+
+int stop_row(void *arg, RID *rid, char *row)
+{
+    return -99;
+}
+
+/* Counts the records of an RHF file with an ID below *(int *)arg */
+int count_low(void *arg, RID *rid, char *record, int length)
+{
+    Student s;
+
+    memcpy(&s, record, sizeof(Student));
+    if (s.studentID < 1000)
+        (*(int *)arg)++;
+    return RHF_OK;
+}
+
+int main()
+{
+    PAX_Schema schema;
+    PAX_Pred preds[2];
+    Student s, t;
+    RID *rids, rrid;
+    RHF_Scan scan;
+    Totals totals;
+    float minGpa = 3.5;
+    int lowID = 1000;
+    int fd, rfd, error, i, expected, count, same, paxPages, rhfPages;
+
+    PF_Init();
+    rids = (RID *)malloc(NUM_RECORDS * sizeof(RID));
+
+    schema.numAttrs = 3;
+    schema.attrType[0] = 'i'; schema.attrLength[0] = sizeof(int);
+    schema.attrType[1] = 'f'; schema.attrLength[1] = sizeof(float);
+    schema.attrType[2] = 'c'; schema.attrLength[2] = NAME_LEN;
+
+    printf("--- Testing PAX files ---\n");
+    PAX_DestroyFile(PAX_FILE);
+    if ((error = PAX_CreateFile(PAX_FILE, &schema)) != RHF_OK) {
+        PAX_PrintError("PAX_CreateFile", error); exit(1);
+    }
+    if ((fd = PAX_OpenFile(PAX_FILE)) < 0) {
+        PAX_PrintError("PAX_OpenFile", fd); exit(1);
+    }
+    for (i = 0; i < NUM_RECORDS; i++) {
+        make_student(&s, i);
+        if ((error = PAX_InsertRecord(fd, (char *)&s, &rids[i])) != RHF_OK) {
+            PAX_PrintError("PAX_InsertRecord", error); exit(1);
+        }
+    }
+    same = 0;
+    for (i = 0; i < NUM_RECORDS; i++) {
+        make_student(&s, i);
+        if (PAX_GetRecord(fd, &rids[i], (char *)&t) == RHF_OK &&
+            memcmp(&s, &t, sizeof(Student)) == 0)
+            same++;
+    }
+    printf("Inserted %d rows; %d of %d read back.\n", NUM_RECORDS, same, NUM_RECORDS);
+
+    /* The same rows in an RHF file, to compare */
+    RHF_DestroyFile(RHF_FILE);
+    if ((error = RHF_CreateFile(RHF_FILE)) != RHF_OK ||
+        (rfd = RHF_OpenFile(RHF_FILE)) < 0) {
+        RHF_PrintError("RHF_CreateFile", error); exit(1);
+    }
+    for (i = 0; i < NUM_RECORDS; i++) {
+        make_student(&s, i);
+        RHF_InsertRecord(rfd, (char *)&s, sizeof(Student), &rrid);
+    }
+    count = 0;
+    RHF_StartScan(rfd, &scan);
+    while (RHF_ScanPage(&scan, count_low, &count) == RHF_OK)
+        ;
+    RHF_EndScan(&scan);
+    rhfPages = PF_NumPages(rfd);
+    RHF_CloseFile(rfd);
+    RHF_DestroyFile(RHF_FILE);
+
+    /* Count on one column */
+    printf("\nTesting PAX_Select...\n");
+    paxPages = PF_NumPages(fd);
+    preds[0].attr = 0;
+    preds[0].op = PAX_LT;
+    preds[0].value = (char *)&lowID;
+    error = PAX_Select(fd, preds, 1, NULL, NULL);
+    printf("ID < 1000: %d rows (expected 1000, RHF scan %d); %d pages (RHF: %d).\n",
+           error, count, paxPages, rhfPages);
+
+    /* Two predicates, rows put together */
+    preds[0].attr = 1;
+    preds[0].op = PAX_GE;
+    preds[0].value = (char *)&minGpa;
+    preds[1].attr = 2;
+    preds[1].op = PAX_LT;
+    preds[1].value = "student5";
+    expected = 0;
+    for (i = 0; i < NUM_RECORDS; i++) {
+        make_student(&s, i);
+        expected += good_student(&s);
+    }
+    totals.count = totals.wrong = 0;
+    error = PAX_Select(fd, preds, 2, check_row, &totals);
+    printf("gpa >= 3.5 and name < student5: %d rows (expected %d), %d handed over, %d wrong.\n",
+           error, expected, totals.count, totals.wrong);
+    printf("Stopping a selection: %s.\n",
+           (PAX_Select(fd, preds, 2, stop_row, NULL) == -99) ? "stopped" : "NOT stopped");
+    preds[0].attr = 3;
+    printf("Predicate on a missing attribute: %s.\n",
+           (PAX_Select(fd, preds, 1, NULL, NULL) == PAX_BADPRED) ? "refused" : "NOT refused");
+
+    /* Delete every third row; the slots are used again */
+    printf("\nTesting PAX_DeleteRecord...\n");
+    for (i = 0; i < NUM_RECORDS; i += 3) {
+        if ((error = PAX_DeleteRecord(fd, &rids[i])) != RHF_OK) {
+            PAX_PrintError("PAX_DeleteRecord", error); exit(1);
+        }
+    }
+    preds[0].attr = 0;
+    preds[0].op = PAX_LT;
+    preds[0].value = (char *)&lowID;
+    error = PAX_Select(fd, preds, 1, NULL, NULL);
+    printf("ID < 1000 after deletes: %d rows (expected 666); deleted row %s.\n",
+           error, (PAX_GetRecord(fd, &rids[0], (char *)&t) == RHF_NORECORD) ?
+           "gone" : "NOT gone");
+    for (i = 0; i < NUM_RECORDS; i += 3) {
+        make_student(&s, i);
+        PAX_InsertRecord(fd, (char *)&s, &rids[i]);
+    }
+    printf("Reinserted: %d pages (before: %d).\n", PF_NumPages(fd), paxPages);
+    PAX_CloseFile(fd);
+
+    /* Read-only mapped, and not an RHF file */
+    if ((fd = PAX_OpenFileMode(PAX_FILE, PF_MODE_MMAP)) < 0) {
+        PAX_PrintError("PAX_OpenFileMode", fd); exit(1);
+    }
+    error = PAX_Select(fd, preds, 1, NULL, NULL);
+    printf("\nMapped: ID < 1000: %d rows (expected 1000).\n", error);
+    make_student(&s, NUM_RECORDS);
+    printf("Mapped: insert %s, ",
+           (PAX_InsertRecord(fd, (char *)&s, &rrid) == PFE_READONLY) ?
+           "refused" : "NOT refused");
+    printf("delete %s, ",
+           (PAX_DeleteRecord(fd, &rids[1]) == PFE_READONLY) ?
+           "refused" : "NOT refused");
+    printf("row %s after it.\n",
+           (PAX_GetRecord(fd, &rids[1], (char *)&t) == RHF_OK) ?
+           "still read" : "NOT read");
+    if ((error = PAX_CloseFile(fd)) != RHF_OK) {
+        PAX_PrintError("PAX_CloseFile", error); exit(1);
+    }
+    printf("Opened as an RHF file: %s.\n",
+           (RHF_OpenFile(PAX_FILE) == RHF_BADFILE) ? "refused" : "NOT refused");
+    schema.attrLength[2] = 300;
+    printf("Attribute of 300 bytes: %s.\n",
+           (PAX_CreateFile(PAX_FILE ".bad", &schema) == PAX_BADSCHEMA) ?
+           "refused" : "NOT refused");
+
+    PAX_DestroyFile(PAX_FILE);
+    free(rids);
+    return 0;
+}
@@ -39,7 +39,6 @@
 void run_workload(int fd)
 {
 	int i;
-	int pagenum;
 	char *buf;
 	int error;
 
@@ -109,6 +108,50 @@ void print_stats()
 }
 
 
+long counts[PF_HIST_BUCKETS];
+
+/* # of operations in histogram "hist" */
+long hist_total(int hist)
+{
+	long total = 0;
+	int i;
+
+	PF_GetHistogram(hist, counts);
+	for (i = 0; i < PF_HIST_BUCKETS; i++)
+		total += counts[i];
+	return total;
+}
+
+/* Checks the counters of file fd after "gets" page requests against
+ * the global ones, which count for that file only. */
+void check_file_stats(int fd, long gets)
+{
+	PF_FileStats st;
+	long logical, physical_r, physical_w;
+
+	if (PF_GetFileStats(fd, &st) != PFE_OK)
+	{
+		PF_PrintError("PF_GetFileStats");
+		exit(1);
+	}
+	PF_GetStats(&logical, &physical_r, &physical_w);
+	printf("hits %ld misses %ld evictions %ld (%ld dirty) "
+	       "prefetch hits %ld reads %ld writes %ld\n",
+	       st.hits, st.misses, st.evictions, st.dirty_evictions,
+	       st.prefetch_hits, st.reads, st.writes);
+	if (st.hits + st.misses != gets || st.reads != physical_r ||
+	    st.writes != physical_w || st.dirty_evictions > st.evictions ||
+	    st.misses + st.prefetch_hits > st.reads ||
+	    hist_total(PF_HIST_READ) == 0 ||
+	    hist_total(PF_HIST_READ) > st.reads ||
+	    PF_GetCounter(PF_CNT_NOBUF) != 0)
+	{
+		printf("file statistics do not add up\n");
+		exit(1);
+	}
+}
+
+
 int main()
 {
 	int fd, i, error;
@@ -210,6 +253,50 @@ int main()
 		exit(1);
 	}
 	
+	/*
+	 * === TEST 3: DETAILED STATISTICS ===
+	 */
+	printf("************************\n");
+	printf("* TESTING DETAILED STATS *\n");
+	printf("************************\n");
+	PF_SetStrategy(PF_STRAT_LRU);
+	PF_SetStats(TRUE);
+
+	if ((fd=PF_OpenFile(TESTFILE)) < 0)
+	{
+		PF_PrintError("PF_OpenFile stats");
+		exit(1);
+	}
+
+	PF_ResetStats();
+	run_workload(fd);
+	check_file_stats(fd, 2 * FILE_SIZE);
+
+	printf("\n--- JSON ---\n");
+	PF_DumpStats(stdout, PF_STATS_JSON);
+	printf("--- CSV ---\n");
+	PF_DumpStats(stdout, PF_STATS_CSV);
+
+	if ((error=PF_CloseFile(fd)) != PFE_OK)
+	{
+		PF_PrintError("PF_CloseFile stats");
+		exit(1);
+	}
+	if (hist_total(PF_HIST_WRITE) == 0)
+	{
+		printf("no write timed\n");
+		exit(1);
+	}
+	if (PF_GetHistogram(PF_HIST_NUM, counts) != PFE_NOSTAT ||
+	    PF_GetCounter(PF_CNT_NUM) != PFE_NOSTAT ||
+	    PF_DumpStats(stdout, -1) != PFE_NOSTAT)
+	{
+		printf("invalid statistic accepted\n");
+		exit(1);
+	}
+	PF_SetStats(FALSE);
+	printf("Detailed statistics OK.\n");
+
 	/* Clean up */
 	PF_DestroyFile(TESTFILE);
 	printf("Cleaned up %s.\n", TESTFILE);
@@ -0,0 +1,205 @@
+/* testpf_threads.c: Several threads sharing the PF buffer pool */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pf.h"
+
+#define TESTFILE "threads_file"
+#define NUM_PAGES 200
+#define BUFFER_SIZE 32
+#define NUM_THREADS 8
+#define ITERATIONS 20000
+
+/*
+ * Every page holds its own page number followed by a counter.
+ * Each thread fixes random pages, checks the page number, and every
+ * fourth time increments the counter under an exclusive latch. Several
+ * threads often have the same page fixed at once, so the latch is what
+ * keeps the increments apart. The
+ * buffer pool is much smaller than the file, so threads keep evicting
+ * pages written by the others. At the end every counter must equal the
+ * number of increments made to it, in the buffer and on disk.
+ */
+typedef struct {
+	int id;
+	int fd;
+	int updates[NUM_PAGES];	/* # of increments made to each page */
+	int errors;
+} Worker;
+
+static void *run_worker(void *arg)
+{
+	Worker *w = (Worker *)arg;
+	unsigned seed = 1 + w->id;
+	int i, page, error;
+	int *buf;
+	int update;
+
+	for (i = 0; i < ITERATIONS; i++) {
+		page = rand_r(&seed) % NUM_PAGES;
+		update = (rand_r(&seed) % 4 == 0);
+
+		if ((error = PF_GetThisPage(w->fd, page, (char **)&buf)) != PFE_OK) {
+			PF_PrintError("PF_GetThisPage");
+			w->errors++;
+			return NULL;
+		}
+
+		PF_LatchPage(w->fd, page, update ? PF_LATCH_EXCLUSIVE : PF_LATCH_SHARED);
+		if (buf[0] != page)
+			w->errors++;
+		if (update) {
+			buf[1]++;
+			w->updates[page]++;
+		}
+		PF_UnlatchPage(w->fd, page);
+
+		if ((error = PF_UnfixPage(w->fd, page, update)) != PFE_OK) {
+			PF_PrintError("PF_UnfixPage");
+			w->errors++;
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+/* Checks every counter against the increments of all the workers */
+static int check_counters(int fd, Worker *workers)
+{
+	int page, t, expected, bad = 0;
+	int *buf;
+
+	for (page = 0; page < NUM_PAGES; page++) {
+		if (PF_GetThisPage(fd, page, (char **)&buf) != PFE_OK) {
+			PF_PrintError("PF_GetThisPage");
+			return NUM_PAGES;
+		}
+		expected = 0;
+		for (t = 0; t < NUM_THREADS; t++)
+			expected += workers[t].updates[page];
+		if (buf[0] != page || buf[1] != expected)
+			bad++;
+		PF_UnfixPage(fd, page, FALSE);
+	}
+	return bad;
+}
+
+/* Runs the workers over fd, and returns their # of errors */
+static int run_workers(int fd, Worker *workers)
+{
+	pthread_t threads[NUM_THREADS];
+	int i, errors = 0;
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		workers[i].id = i;
+		workers[i].fd = fd;
+		workers[i].errors = 0;
+		pthread_create(&threads[i], NULL, run_worker, &workers[i]);
+	}
+	for (i = 0; i < NUM_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+		errors += workers[i].errors;
+	}
+	return errors;
+}
+
+int main()
+{
+	static Worker workers[NUM_THREADS];
+	int fd, i, pagenum, errors = 0, bad;
+	int *buf;
+	long logical, physReads, physWrites;
+
+	PF_SetBufferSize(BUFFER_SIZE);
+	PF_Init();
+	PF_DestroyFile(TESTFILE);
+	if (PF_CreateFile(TESTFILE) != PFE_OK ||
+	    (fd = PF_OpenFile(TESTFILE)) < 0) {
+		PF_PrintError("create");
+		exit(1);
+	}
+	for (i = 0; i < NUM_PAGES; i++) {
+		if (PF_AllocPage(fd, &pagenum, (char **)&buf) != PFE_OK) {
+			PF_PrintError("PF_AllocPage");
+			exit(1);
+		}
+		buf[0] = pagenum;
+		buf[1] = 0;
+		PF_UnfixPage(fd, pagenum, TRUE);
+	}
+
+	/* a page fixed twice shares its buffer, and needs two unfixes */
+	{
+		int *again;
+		if (PF_GetThisPage(fd, 0, (char **)&buf) != PFE_OK ||
+		    PF_GetThisPage(fd, 0, (char **)&again) != PFE_OK ||
+		    again != buf) {
+			PF_PrintError("fix twice");
+			exit(1);
+		}
+		if (PF_DisposePage(fd, 0) != PFE_PAGEFIXED ||
+		    PF_UnfixPage(fd, 0, FALSE) != PFE_OK ||
+		    PF_UnfixPage(fd, 0, FALSE) != PFE_OK ||
+		    PF_UnfixPage(fd, 0, FALSE) != PFE_PAGEUNFIXED) {
+			printf("Pinning a page twice: WRONG\n");
+			exit(1);
+		}
+		printf("Pinning a page twice: ok\n");
+	}
+
+	PF_ResetStats();
+	errors += run_workers(fd, workers);
+	PF_GetStats(&logical, &physReads, &physWrites);
+	printf("%d threads, %d fixes each: %d errors\n", NUM_THREADS, ITERATIONS, errors);
+	printf("Physical reads %s logical ones, some writes %s\n",
+	       (physReads <= logical) ? "do not exceed" : "EXCEED",
+	       (physWrites > 0) ? "done" : "NOT done");
+
+	bad = check_counters(fd, workers);
+	printf("Counters in the buffer: %d wrong\n", bad);
+	errors += bad;
+
+	/* the evicted pages and the ones flushed by close must agree */
+	if (PF_CloseFile(fd) != PFE_OK || (fd = PF_OpenFile(TESTFILE)) < 0) {
+		PF_PrintError("reopen");
+		exit(1);
+	}
+	bad = check_counters(fd, workers);
+	printf("Counters on disk: %d wrong\n", bad);
+	errors += bad;
+
+	/* again with write-behind keeping half the frames clean, so the
+	flusher writes pages out while the workers fix them */
+	if (PF_SetWriteBehind(50) != PFE_OK) {
+		PF_PrintError("PF_SetWriteBehind");
+		exit(1);
+	}
+	bad = run_workers(fd, workers);
+	PF_SetWriteBehind(0);
+	bad += check_counters(fd, workers);
+	printf("With write-behind: %d wrong\n", bad);
+	errors += bad;
+
+	/* after a flush the buffer is clean, and close writes nothing */
+	if (PF_FlushFile(fd) != PFE_OK) {
+		PF_PrintError("PF_FlushFile");
+		exit(1);
+	}
+	PF_ResetStats();
+	if (PF_CloseFile(fd) != PFE_OK || (fd = PF_OpenFile(TESTFILE)) < 0) {
+		PF_PrintError("reopen");
+		exit(1);
+	}
+	PF_GetStats(&logical, &physReads, &physWrites);
+	printf("Close after a flush: %ld writes\n", physWrites);
+	if (physWrites != 0)
+		errors++;
+	bad = check_counters(fd, workers);
+	printf("Counters on disk: %d wrong\n", bad);
+	errors += bad;
+	PF_CloseFile(fd);
+	PF_DestroyFile(TESTFILE);
+
+	return (errors == 0) ? 0 : 1;
+}
@@ -1,8 +1,7 @@
-/* testpf_workload.c: Runs a random access workload */
+/* testpf_workload.c: Runs a random, cyclic or mixed access workload */
 #include <stdio.h>
 #include <stdlib.h> /* For rand, srand, exit, atof */
 #include <string.h> /* For strcmp */
-#include <time.h>   /* For time() */
 #include "pf.h"
 
 /* CONFIGURATION */
@@ -10,6 +9,11 @@
 #define BUFFER_SIZE 20      /* 20-page buffer */
 #define FILE_SIZE 100       /* 100-page file (larger than buffer) */
 #define TOTAL_ACCESSES 10000  /* Number of random requests */
+#define HOT_PAGES 8         /* mixed: hot set, like B+-tree upper levels */
+#define SEED 1              /* every strategy sees the same requests */
+
+static const char *strategy_names[] = { "lru", "mru", "clock", "2q", "lru2" };
+#define NUM_STRATEGIES ((int)(sizeof(strategy_names) / sizeof(strategy_names[0])))
 
 /*
  * Prints stats in a CSV (Comma-Separated Value) format
@@ -28,29 +32,92 @@ void print_stats(const char* strategy_name, double write_mix)
            strategy_name, write_mix, logical, physical_r, physical_w, total_physical, hit_rate);
 }
 
+/*
+ * Returns the page for request "i" of the workload:
+ *   random: uniform over the file.
+ *   cyclic: the file is read in order, over and over.
+ *   mixed:  every other request goes to a small hot set, the others
+ *           scan the rest of the file in order.
+ */
+static int next_page(const char *workload, int i)
+{
+    if (strcmp(workload, "cyclic") == 0)
+        return i % FILE_SIZE;
+    if (strcmp(workload, "mixed") == 0) {
+        if (i % 2 == 0)
+            return rand() % HOT_PAGES;
+        return HOT_PAGES + (i / 2) % (FILE_SIZE - HOT_PAGES);
+    }
+    return rand() % FILE_SIZE;
+}
+
+/* Runs the workload once under "strategy" and prints its stats */
+static void run(int strategy, double write_mix, const char *workload)
+{
+    int fd, i, pageNum;
+    char *buf;
+
+    srand(SEED);
+    PF_SetStrategy(strategy);
+    if ((fd = PF_OpenFile(TESTFILE)) < 0) { PF_PrintError("PF_OpenFile"); exit(1); }
+    
+    PF_ResetStats();
+    
+    for (i = 0; i < TOTAL_ACCESSES; i++) {
+        /* Get the next page */
+        pageNum = next_page(workload, i);
+        
+        /* Get a random operation type (read or write) */
+        double op_type = (double)rand() / (double)RAND_MAX;
+
+        if (PF_GetThisPage(fd, pageNum, &buf) != PFE_OK) {
+            PF_PrintError("PF_GetThisPage");
+            exit(1);
+        }
+
+        if (op_type < write_mix) {
+            /* This is a "write" operation */
+            if (PF_MarkDirty(fd, pageNum) != PFE_OK) {
+                PF_PrintError("PF_MarkDirty");
+                exit(1);
+            }
+            PF_UnfixPage(fd, pageNum, TRUE); /* Mark as dirty */
+        } else {
+            /* This is a "read" operation */
+            PF_UnfixPage(fd, pageNum, FALSE); /* Not dirty */
+        }
+    }
+    
+    /* --- Report Results --- */
+    print_stats(strategy_names[strategy], write_mix);
+
+    PF_CloseFile(fd);
+}
+
 
 int main(int argc, char *argv[])
 {
-    int fd, i, error;
+    int fd, i, s;
     int pagenum;
     char *buf;
+    const char *workload = "random";
+    int strategy = -1;  /* -1: all of them */
 
     /* --- 1. Argument Parsing --- */
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <strategy: lru|mru> <write_mix_float: 0.0 to 1.0>\n", argv[0]);
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: %s <strategy: lru|mru|clock|2q|lru2|all> "
+                "<write_mix_float: 0.0 to 1.0> [workload: random|cyclic|mixed]\n", argv[0]);
         return 1;
     }
     
     char* strategy_str = argv[1];
     double write_mix = atof(argv[2]); /* Convert string to float */
-    int strategy;
-
-    if (strcmp(strategy_str, "lru") == 0) {
-        strategy = PF_STRAT_LRU;
-    } else if (strcmp(strategy_str, "mru") == 0) {
-        strategy = PF_STRAT_MRU;
-    } else {
-        fprintf(stderr, "Error: Strategy must be 'lru' or 'mru'.\n");
+
+    for (s = 0; s < NUM_STRATEGIES; s++)
+        if (strcmp(strategy_str, strategy_names[s]) == 0)
+            strategy = s;
+    if (strategy < 0 && strcmp(strategy_str, "all") != 0) {
+        fprintf(stderr, "Error: Strategy must be 'lru', 'mru', 'clock', '2q', 'lru2' or 'all'.\n");
         return 1;
     }
     
@@ -59,11 +126,18 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if (argc == 4) {
+        workload = argv[3];
+        if (strcmp(workload, "random") != 0 && strcmp(workload, "cyclic") != 0 &&
+            strcmp(workload, "mixed") != 0) {
+            fprintf(stderr, "Error: Workload must be 'random', 'cyclic' or 'mixed'.\n");
+            return 1;
+        }
+    }
+
     /* --- 2. Setup --- */
-    srand(time(NULL)); /* Seed the random number generator */
     PF_SetBufferSize(BUFFER_SIZE);
     PF_Init();
-    PF_SetStrategy(strategy);
     PF_DestroyFile(TESTFILE); /* Clean up from any previous run */
 
     /* Create and populate the file */
@@ -80,40 +154,18 @@ int main(int argc, char *argv[])
 
 
     /* --- 3. Run Workload --- */
-    if ((fd = PF_OpenFile(TESTFILE)) < 0) { PF_PrintError("PF_OpenFile"); exit(1); }
-    
-    PF_ResetStats();
-    
-    for (i = 0; i < TOTAL_ACCESSES; i++) {
-        /* Get a random page */
-        int pageNum = rand() % FILE_SIZE; 
-        
-        /* Get a random operation type (read or write) */
-        double op_type = (double)rand() / (double)RAND_MAX;
+    /* The rows keep their columns; a workload asked for by name is
+       told on a line of its own before them */
+    if (argc == 4)
+        printf("# workload: %s\n", workload);
+    /* Each run starts with an empty buffer: closing the file emptied it */
+    if (strategy >= 0)
+        run(strategy, write_mix, workload);
+    else
+        for (s = 0; s < NUM_STRATEGIES; s++)
+            run(s, write_mix, workload);
 
-        if (PF_GetThisPage(fd, pageNum, &buf) != PFE_OK) {
-            PF_PrintError("PF_GetThisPage");
-            exit(1);
-        }
-
-        if (op_type < write_mix) {
-            /* This is a "write" operation */
-            if (PF_MarkDirty(fd, pageNum) != PFE_OK) {
-                PF_PrintError("PF_MarkDirty");
-                exit(1);
-            }
-            PF_UnfixPage(fd, pageNum, TRUE); /* Mark as dirty */
-        } else {
-            /* This is a "read" operation */
-            PF_UnfixPage(fd, pageNum, FALSE); /* Not dirty */
-        }
-    }
-    
-    /* --- 4. Report Results --- */
-    print_stats(strategy_str, write_mix);
-
-    /* --- 5. Cleanup --- */
-    PF_CloseFile(fd);
+    /* --- 4. Cleanup --- */
     PF_DestroyFile(TESTFILE);
     
     return 0;
@@ -7,6 +7,10 @@
 #include "rhf.h"
 
 #define SLOTTED_FILE "students_slotted.db"
+#define BATCH_FILE "students_batch.db"
+#define LARGE_FILE "students_large.db"
+#define LARGE_PAGE_SIZE 32768
+#define LARGE_RECORD 20000
 #define NUM_RECORDS 1000
 #define MIN_NAME_LEN 10
 #define MAX_NAME_LEN 50
@@ -32,6 +36,20 @@ void get_random_name(char *name)
     name[len] = '\0'; /* Null terminate */
 }
 
+/*
+ * Counts the pages of the file that PF considers in use
+ */
+int count_used_pages(int fd)
+{
+    int pagenum = -1, count = 0;
+    char *buf;
+    while (PF_GetNextPage(fd, &pagenum, &buf) == PFE_OK) {
+        count++;
+        PF_UnfixPage(fd, pagenum, FALSE);
+    }
+    return count;
+}
+
 /*
  * Returns the actual storage size of a student record
  */
@@ -41,6 +59,47 @@ int get_record_size(Student *s)
     return sizeof(int) + sizeof(float) + strlen(s->name) + 1;
 }
 
+/*
+ * RHF_ScanPage callback: counts the records with an odd studentID
+ */
+int count_odd(void *arg, RID *rid, char *record, int length)
+{
+    if (((Student *)record)->studentID % 2 == 1)
+        (*(int *)arg)++;
+    return RHF_OK;
+}
+
+/*
+ * RHF_GetRecords callback: counts the records fetched
+ */
+int count_fetched(void *arg, int i, char *record, int length)
+{
+    (*(int *)arg)++;
+    return RHF_OK;
+}
+
+/*
+ * RHF_ParallelScan callbacks: count the records and sum their IDs
+ */
+typedef struct {
+    long count;
+    long idSum;
+} ScanTotals;
+
+int add_record(void *local, RID *rid, char *record, int length)
+{
+    ScanTotals *t = (ScanTotals *)local;
+    t->count++;
+    t->idSum += ((Student *)record)->studentID;
+    return RHF_OK;
+}
+
+void merge_totals(void *result, void *local)
+{
+    ((ScanTotals *)result)->count += ((ScanTotals *)local)->count;
+    ((ScanTotals *)result)->idSum += ((ScanTotals *)local)->idSum;
+}
+
 void run_tests()
 {
     int fd, error;
@@ -118,6 +177,14 @@ void run_tests()
         }
     }
     printf("Deleted %d records.\n", delete_count);
+    int gone = 0;
+    for (i = 0; i < NUM_RECORDS; i += 2)
+    {
+        if (RHF_GetRecord(fd, &rids[i], recBuf, &recLen) == RHF_NORECORD &&
+            RHF_DeleteRecord(fd, &rids[i]) == RHF_NORECORD)
+            gone++;
+    }
+    printf("%d of %d deleted records neither read nor deleted again.\n", gone, delete_count);
 
     /* Test Scan again */
     printf("Running scan again...\n");
@@ -133,6 +200,296 @@ void run_tests()
     if (RHF_CloseFile(fd) != RHF_OK) {
         RHF_PrintError("RHF_CloseFile", PFerrno); exit(1);
     }
+
+    /* Test the free-space map: with a cold buffer, inserts should only
+       read the header page and the pages they land on */
+    printf("\nTesting free-space map (cold buffer)...\n");
+    if ((fd = RHF_OpenFile(SLOTTED_FILE)) < 0) {
+        RHF_PrintError("RHF_OpenFile", fd); exit(1);
+    }
+    long logical, physReads, physWrites;
+    PF_ResetStats();
+    for (i = 0; i < 100; i++)
+    {
+        s.studentID = NUM_RECORDS + i;
+        s.gpa = 0.0;
+        get_random_name(s.name);
+        if ((error = RHF_InsertRecord(fd, (char*)&s, get_record_size(&s), &rid)) != RHF_OK) {
+            RHF_PrintError("RHF_InsertRecord", error); exit(1);
+        }
+    }
+    PF_GetStats(&logical, &physReads, &physWrites);
+    printf("Inserted 100 records: %ld physical reads (file had %d pages).\n",
+           physReads, totalSlottedPages);
+
+    /* Test space reclamation: RHF_Vacuum hands the pages emptied by the
+       deletes back to PF, and later inserts reuse them */
+    printf("\nTesting space reclamation...\n");
+    for (i = 1; i < NUM_RECORDS; i += 2) {
+        if ((error = RHF_DeleteRecord(fd, &rids[i])) != RHF_OK) {
+            RHF_PrintError("RHF_DeleteRecord", error); exit(1);
+        }
+    }
+    int pagesBefore = count_used_pages(fd);
+    if ((error = RHF_Vacuum(fd)) != RHF_OK) {
+        RHF_PrintError("RHF_Vacuum", error); exit(1);
+    }
+    printf("Vacuum: %d pages in use before, %d after.\n",
+           pagesBefore, count_used_pages(fd));
+
+    int maxPage = 0;
+    for (i = 0; i < NUM_RECORDS; i++)
+    {
+        s.studentID = i;
+        get_random_name(s.name);
+        if ((error = RHF_InsertRecord(fd, (char*)&s, get_record_size(&s), &rid)) != RHF_OK) {
+            RHF_PrintError("RHF_InsertRecord", error); exit(1);
+        }
+        if (rid.pageNum > maxPage) maxPage = rid.pageNum;
+    }
+    scan_count = 0;
+    RHF_StartScan(fd, &scan);
+    while (RHF_GetNextRecord(&scan, recBuf, &recLen, &recRID) == RHF_OK)
+    {
+        scan_count++;
+    }
+    RHF_EndScan(&scan);
+    printf("Re-inserted %d records: highest page %d (was %d). Found %d records (expected %d).\n",
+           NUM_RECORDS, maxPage, pagesBefore - 1, scan_count, NUM_RECORDS + 100);
+
+    if (RHF_CloseFile(fd) != RHF_OK) {
+        RHF_PrintError("RHF_CloseFile", PFerrno); exit(1);
+    }
+
+    /* Test the read-only mapped mode: the scan is served from the
+       mapping, not the buffer pool; reads work, inserts and deletes
+       are refused */
+    printf("\nTesting read-only mapped mode...\n");
+    if ((fd = RHF_OpenFileMode(SLOTTED_FILE, PF_MODE_MMAP)) < 0) {
+        RHF_PrintError("RHF_OpenFileMode", fd); exit(1);
+    }
+    PF_ResetStats();
+    scan_count = 0;
+    RID mapRID;
+    RHF_StartScan(fd, &scan);
+    while (RHF_GetNextRecord(&scan, recBuf, &recLen, &recRID) == RHF_OK)
+    {
+        if (scan_count == 0) mapRID = recRID;
+        scan_count++;
+    }
+    RHF_EndScan(&scan);
+    PF_GetStats(&logical, &physReads, &physWrites);
+    error = RHF_InsertRecord(fd, (char*)&s, get_record_size(&s), &rid);
+    printf("Found %d records (expected %d), %ld buffer requests, insert %s.\n",
+           scan_count, NUM_RECORDS + 100, logical,
+           (error == PFE_READONLY) ? "refused" : "NOT refused");
+    error = RHF_DeleteRecord(fd, &mapRID);
+    printf("Delete %s, ", (error == PFE_READONLY) ? "refused" : "NOT refused");
+    error = RHF_GetRecord(fd, &mapRID, recBuf, &recLen);
+    printf("record %s after it", (error == RHF_OK) ? "still read" : "NOT read");
+    int fetched = 0;
+    error = RHF_GetRecords(fd, &mapRID, 1, count_fetched, &fetched);
+    printf(", %s in a batch.\n", (error == RHF_OK && fetched == 1) ? "and" : "NOT");
+    /* A dirty unfix is refused but still unfixes, so the file closes */
+    char *mapBuf;
+    PF_GetThisPage(fd, mapRID.pageNum, &mapBuf);
+    error = PF_UnfixPage(fd, mapRID.pageNum, TRUE);
+    printf("Dirty unfix %s.\n", (error == PFE_READONLY) ? "refused" : "NOT refused");
+
+    /* Test zero-copy access: views into the pages and the page callback
+       see the same records as the copying scan */
+    printf("\nTesting zero-copy access...\n");
+    RHF_RecordView view;
+    char *recPtr;
+    int odd_copy = 0, odd_view = 0, odd_page = 0, pages = 0, same = 0;
+    RHF_StartScan(fd, &scan);
+    while (RHF_GetNextRecord(&scan, recBuf, &recLen, &recRID) == RHF_OK)
+    {
+        if (((Student *)recBuf)->studentID % 2 == 1) odd_copy++;
+    }
+    RHF_EndScan(&scan);
+    RHF_InitView(&view);
+    RHF_StartScan(fd, &scan);
+    while (RHF_GetNextRecordView(&scan, &recPtr, &recLen, &recRID) == RHF_OK)
+    {
+        if (((Student *)recPtr)->studentID % 2 == 1) odd_view++;
+        if (RHF_PinRecord(fd, &recRID, &view) == RHF_OK &&
+            view.length == recLen && memcmp(view.record, recPtr, recLen) == 0)
+            same++;
+    }
+    RHF_EndScan(&scan);
+    RHF_UnpinRecord(&view);
+    RHF_StartScan(fd, &scan);
+    while ((error = RHF_ScanPage(&scan, count_odd, &odd_page)) == RHF_OK)
+        pages++;
+    RHF_EndScan(&scan);
+    printf("Odd IDs: %d copied, %d viewed, %d visited on %d pages; %d of %d pinned records match.\n",
+           odd_copy, odd_view, odd_page, pages, same, NUM_RECORDS + 100);
+    if (RHF_CloseFile(fd) != RHF_OK) {
+        RHF_PrintError("RHF_CloseFile", PFerrno); exit(1);
+    }
+
+    /* Test batched insert: the same records as single inserts, with far
+       fewer buffer requests, and each RID gives back its record */
+    printf("\nTesting RHF_InsertRecords...\n");
+    Student *studs = (Student *)malloc(NUM_RECORDS * sizeof(Student));
+    char **recs = (char **)malloc(NUM_RECORDS * sizeof(char *));
+    int *lens = (int *)malloc(NUM_RECORDS * sizeof(int));
+    long singleLogical;
+    int batch;
+    for (i = 0; i < NUM_RECORDS; i++) {
+        studs[i].studentID = i;
+        studs[i].gpa = (float)(i % 40) / 10.0;
+        get_random_name(studs[i].name);
+        recs[i] = (char *)&studs[i];
+        lens[i] = get_record_size(&studs[i]);
+    }
+    for (batch = 0; batch <= 1; batch++) {
+        RHF_DestroyFile(BATCH_FILE);
+        if ((error = RHF_CreateFile(BATCH_FILE)) != RHF_OK) {
+            RHF_PrintError("RHF_CreateFile", error); exit(1);
+        }
+        if ((fd = RHF_OpenFile(BATCH_FILE)) < 0) {
+            RHF_PrintError("RHF_OpenFile", fd); exit(1);
+        }
+        PF_ResetStats();
+        if (batch) {
+            if ((error = RHF_InsertRecords(fd, recs, lens, NUM_RECORDS, rids)) != RHF_OK) {
+                RHF_PrintError("RHF_InsertRecords", error); exit(1);
+            }
+        }
+        else {
+            for (i = 0; i < NUM_RECORDS; i++) {
+                if ((error = RHF_InsertRecord(fd, recs[i], lens[i], &rids[i])) != RHF_OK) {
+                    RHF_PrintError("RHF_InsertRecord", error); exit(1);
+                }
+            }
+        }
+        PF_GetStats(&logical, &physReads, &physWrites);
+        if (!batch) singleLogical = logical;
+        if (RHF_CloseFile(fd) != RHF_OK) {
+            RHF_PrintError("RHF_CloseFile", PFerrno); exit(1);
+        }
+    }
+    if ((fd = RHF_OpenFile(BATCH_FILE)) < 0) {
+        RHF_PrintError("RHF_OpenFile", fd); exit(1);
+    }
+    same = 0;
+    for (i = 0; i < NUM_RECORDS; i++) {
+        if (RHF_GetRecord(fd, &rids[i], recBuf, &recLen) == RHF_OK &&
+            recLen == lens[i] && memcmp(recBuf, recs[i], recLen) == 0)
+            same++;
+    }
+    s.name[0] = '\0';
+    recs[0] = (char *)&s;
+    lens[0] = PF_PAGE_SIZE;
+    error = RHF_InsertRecords(fd, recs, lens, 2, rids);
+    printf("Batch: %ld buffer requests (single inserts: %ld); %d of %d records read back; oversized batch %s.\n",
+           logical, singleLogical, same, NUM_RECORDS,
+           (error == RHF_PAGEFULL) ? "refused" : "NOT refused");
+
+    /* Test the parallel scan: the merged totals of the workers are those
+       of the whole file */
+    printf("\nTesting RHF_ParallelScan...\n");
+    ScanTotals parts[4], total;
+    void *locals[4];
+    for (i = 0; i < 4; i++) {
+        parts[i].count = parts[i].idSum = 0;
+        locals[i] = &parts[i];
+    }
+    total.count = total.idSum = 0;
+    error = RHF_ParallelScan(fd, 4, add_record, locals, merge_totals, &total);
+    printf("4 workers: %s, %ld records (expected %d), ID sum %ld (expected %ld).\n",
+           (error == RHF_OK) ? "ok" : "FAILED", total.count, NUM_RECORDS,
+           total.idSum, (long)NUM_RECORDS * (NUM_RECORDS - 1) / 2);
+    int smallPages = PF_NumPages(fd);
+    if (RHF_CloseFile(fd) != RHF_OK) {
+        RHF_PrintError("RHF_CloseFile", PFerrno); exit(1);
+    }
+    RHF_DestroyFile(BATCH_FILE);
+
+    /* Test a file of large pages: the same records on fewer pages, one
+       too long for the default page, and the size survives a reopen */
+    printf("\nTesting large pages...\n");
+    char *big = (char *)malloc(LARGE_RECORD);
+    char *bigBuf = (char *)malloc(LARGE_RECORD);
+    RID bigRid;
+    for (i = 0; i < LARGE_RECORD; i++)
+        big[i] = (char)(i % 251);
+    recs[0] = (char *)&studs[0];
+    lens[0] = get_record_size(&studs[0]);
+    RHF_DestroyFile(LARGE_FILE);
+    if ((error = RHF_CreateFileSize(LARGE_FILE, LARGE_PAGE_SIZE)) != RHF_OK) {
+        RHF_PrintError("RHF_CreateFileSize", error); exit(1);
+    }
+    if ((fd = RHF_OpenFile(LARGE_FILE)) < 0) {
+        RHF_PrintError("RHF_OpenFile", fd); exit(1);
+    }
+    if ((error = RHF_InsertRecords(fd, recs, lens, NUM_RECORDS, rids)) != RHF_OK) {
+        RHF_PrintError("RHF_InsertRecords", error); exit(1);
+    }
+    if ((error = RHF_InsertRecord(fd, big, LARGE_RECORD, &bigRid)) != RHF_OK) {
+        RHF_PrintError("RHF_InsertRecord", error); exit(1);
+    }
+    if (RHF_CloseFile(fd) != RHF_OK) {
+        RHF_PrintError("RHF_CloseFile", PFerrno); exit(1);
+    }
+    if ((fd = RHF_OpenFile(LARGE_FILE)) < 0) {
+        RHF_PrintError("RHF_OpenFile", fd); exit(1);
+    }
+    same = 0;
+    for (i = 0; i < NUM_RECORDS; i++) {
+        if (RHF_GetRecord(fd, &rids[i], recBuf, &recLen) == RHF_OK &&
+            recLen == lens[i] && memcmp(recBuf, recs[i], recLen) == 0)
+            same++;
+    }
+    error = RHF_GetRecord(fd, &bigRid, bigBuf, &recLen);
+    printf("%d-byte pages: %d pages (%d-byte pages: %d); %d of %d records read back; %d-byte record %s.\n",
+           PF_PageSize(fd), PF_NumPages(fd), PF_PAGE_SIZE, smallPages,
+           same, NUM_RECORDS, LARGE_RECORD,
+           (error == RHF_OK && recLen == LARGE_RECORD &&
+            memcmp(bigBuf, big, LARGE_RECORD) == 0) ? "read back" : "LOST");
+    error = RHF_CreateFileSize(LARGE_FILE ".bad", 3000);
+    printf("Page size 3000 %s.\n", (error == PFE_PAGESIZE) ? "refused" : "NOT refused");
+    if (RHF_CloseFile(fd) != RHF_OK) {
+        RHF_PrintError("RHF_CloseFile", PFerrno); exit(1);
+    }
+    RHF_DestroyFile(LARGE_FILE);
+
+    /* Test empty records: they go on data pages, never the header page */
+    printf("\nTesting empty records...\n");
+    RHF_DestroyFile(BATCH_FILE);
+    RHF_CreateFile(BATCH_FILE);
+    if ((fd = RHF_OpenFile(BATCH_FILE)) < 0) {
+        RHF_PrintError("RHF_OpenFile", fd); exit(1);
+    }
+    for (i = 0; i < 3; i++) {
+        if ((error = RHF_InsertRecord(fd, recBuf, 0, &rids[i])) != RHF_OK) {
+            RHF_PrintError("RHF_InsertRecord", error); exit(1);
+        }
+    }
+    if (RHF_CloseFile(fd) != RHF_OK) {
+        RHF_PrintError("RHF_CloseFile", PFerrno); exit(1);
+    }
+    if ((fd = RHF_OpenFile(BATCH_FILE)) < 0) {
+        RHF_PrintError("RHF_OpenFile", fd); exit(1);
+    }
+    same = 0;
+    for (i = 0; i < 3; i++) {
+        if (rids[i].pageNum != RHF_HDR_PAGE &&
+            RHF_GetRecord(fd, &rids[i], recBuf, &recLen) == RHF_OK && recLen == 0)
+            same++;
+    }
+    printf("%d of 3 empty records read back after reopening.\n", same);
+    if (RHF_CloseFile(fd) != RHF_OK) {
+        RHF_PrintError("RHF_CloseFile", PFerrno); exit(1);
+    }
+    RHF_DestroyFile(BATCH_FILE);
+    free(big);
+    free(bigBuf);
+    free(studs);
+    free(recs);
+    free(lens);
     
     free(rids);
     
@@ -0,0 +1,128 @@
+/* testsort.c: Test program for the external merge sort */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sort.h"
+
+#define SORT_FILE "students_sort.db"
+#define NUM_RECORDS 5000
+#define NAME_LEN 20
+
+/* A student record */
+typedef struct {
+    int studentID;
+    float gpa;
+    char name[NAME_LEN];
+} Student;
+
+/* An index entry: the gpa followed by the record id */
+typedef struct {
+    float gpa;
+    RID rid;
+} Entry;
+
+/*
+ * Builds the index entry of a student record
+ */
+int make_entry(char *record, int length, RID *rid, char *item, void *arg)
+{
+    Entry e;
+
+    memcpy(&e.gpa, record + sizeof(int), sizeof(float));
+    e.rid = *rid;
+    memcpy(item, &e, sizeof(Entry));
+    return sizeof(Entry);
+}
+
+/*
+ * Reads a sort to the end, checking the order of the key. Returns the
+ * number of items, or -1 if they were out of order.
+ */
+int check_sort(SORT_Sort *sort, SORT_Key *key)
+{
+    char item[SORT_MAX_ITEM], last[SORT_MAX_ITEM];
+    int length, lastLength = 0, count = 0, error;
+
+    length = sizeof(item);
+    while ((error = SORT_Next(sort, item, &length)) == SORT_OK) {
+        if (count > 0 && SORT_CompareKey(last, lastLength, item, length, key) > 0) {
+            return -1;
+        }
+        memcpy(last, item, length);
+        lastLength = length;
+        length = sizeof(item);
+        count++;
+    }
+    if (error != SORT_EOF) {
+        SORT_PrintError("SORT_Next", error);
+        return -1;
+    }
+    return count;
+}
+
+int main()
+{
+    int fd, error, i, count, runs, passes;
+    Student s;
+    RID rid;
+    SORT_Sort *sort;
+    SORT_Key byID = { 0, 'i', sizeof(int) };
+    SORT_Key byName = { sizeof(int) + sizeof(float), 'c', NAME_LEN };
+    SORT_Key byGpa = { 0, 'f', sizeof(float) };
+
+    PF_Init();
+    srand(1);
+    RHF_DestroyFile(SORT_FILE);
+    if ((error = RHF_CreateFile(SORT_FILE)) != RHF_OK ||
+        (fd = RHF_OpenFile(SORT_FILE)) < 0) {
+        RHF_PrintError("create", error); exit(1);
+    }
+    printf("Inserting %d student records...\n", NUM_RECORDS);
+    for (i = 0; i < NUM_RECORDS; i++) {
+        memset(&s, 0, sizeof(Student));
+        s.studentID = rand();
+        s.gpa = (float)(rand() % 400) / 100.0;
+        sprintf(s.name, "student%d", rand());
+        if ((error = RHF_InsertRecord(fd, (char *)&s, sizeof(Student), &rid)) != RHF_OK) {
+            RHF_PrintError("RHF_InsertRecord", error); exit(1);
+        }
+    }
+
+    /* in the least memory, runs are merged a few at a time */
+    printf("\nSorting by id in %d pages of memory...\n", SORT_MIN_PAGES);
+    SORT_Begin(&sort, SORT_MIN_PAGES, SORT_CompareKey, &byID);
+    if ((error = SORT_InsertFile(sort, fd, NULL, NULL)) != SORT_OK) {
+        SORT_PrintError("SORT_InsertFile", error); exit(1);
+    }
+    count = check_sort(sort, &byID);
+    SORT_GetStats(sort, &runs, &passes);
+    SORT_End(sort);
+    printf("Sorted %d records (expected %d): %s runs, %s merge passes.\n",
+           count, NUM_RECORDS, (runs > 1) ? "several" : "NOT several",
+           (passes > 0) ? "some" : "NO");
+
+    /* char keys, in as much memory as the PF buffer pool: one merge */
+    printf("\nSorting by name in %d pages of memory...\n", PF_GetBufferSize());
+    SORT_Begin(&sort, 0, SORT_CompareKey, &byName);
+    SORT_InsertFile(sort, fd, NULL, NULL);
+    count = check_sort(sort, &byName);
+    SORT_GetStats(sort, &runs, &passes);
+    SORT_End(sort);
+    printf("Sorted %d records (expected %d): %s runs, %d merge passes.\n",
+           count, NUM_RECORDS, (runs > 1) ? "several" : "NOT several", passes);
+
+    /* index entries built from the records fit in memory */
+    printf("\nSorting index entries by gpa in 100 pages of memory...\n");
+    SORT_Begin(&sort, 100, SORT_CompareKey, &byGpa);
+    SORT_InsertFile(sort, fd, make_entry, NULL);
+    count = check_sort(sort, &byGpa);
+    SORT_GetStats(sort, &runs, &passes);
+    error = SORT_Insert(sort, (char *)&s, sizeof(Student));
+    SORT_End(sort);
+    printf("Sorted %d entries (expected %d): %d runs, late insert %s.\n",
+           count, NUM_RECORDS, runs, (error == SORT_SORTED) ? "refused" : "NOT refused");
+
+    RHF_CloseFile(fd);
+    RHF_DestroyFile(SORT_FILE);
+    return 0;
+}